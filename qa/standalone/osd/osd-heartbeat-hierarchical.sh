@@ -0,0 +1,77 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7151" # git grep '\<7151\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd-heartbeat-topology=hierarchical "
+    CEPH_ARGS+="--osd-heartbeat-interval=1 --osd-heartbeat-grace=6 "
+    # only heartbeats may notice a dead osd
+    CEPH_ARGS+="--osd-fast-fail-on-connection-refused=false "
+    # the members of a domain share a host
+    CEPH_ARGS+="--mon-osd-reporter-subtree-level=osd "
+    CEPH_ARGS+="--osd-crush-update-on-start=false "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function TEST_aggregator_takeover() {
+    local dir=$1
+
+    run_mon $dir a || return 1
+    run_mgr $dir x || return 1
+    # two heartbeat domains: osd.0-2 and osd.3-5
+    for host in hba hbb ; do
+        ceph osd crush add-bucket $host host || return 1
+        ceph osd crush move $host root=default || return 1
+    done
+    for id in 0 1 2 3 4 5 ; do
+        run_osd $dir $id || return 1
+        local host=hba
+        test $id -ge 3 && host=hbb
+        ceph osd crush add osd.$id 1.0 host=$host || return 1
+    done
+    for id in 0 1 2 3 4 5 ; do
+        wait_for_osd up $id || return 1
+    done
+
+    # no pools, so no pg interval change tells anyone to re-peer
+    kill -9 $(cat $dir/osd.0.pid)
+    wait_for_osd down 0 || return 1
+
+    # osd.1 aggregates what is left of the domain and is the only one
+    # pinging osd.2
+    kill -9 $(cat $dir/osd.2.pid)
+    TIMEOUT=60 wait_for_osd down 2 || return 1
+    grep -q "heartbeat aggregator reported osd.2 down" $dir/mon.a.log || return 1
+    ceph osd dump | grep "osd.1 up" || return 1
+    ceph osd dump | grep "osd.3 up" || return 1
+}
+
+main osd-heartbeat-hierarchical "$@"
+
+# Local Variables:
+# compile-command: "cd ../../.. ; make -j4 && qa/standalone/osd/osd-heartbeat-hierarchical.sh"
+# End:
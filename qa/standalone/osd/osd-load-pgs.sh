@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7155" # git grep '\<7155\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd-load-pgs-threads=4 "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function get_osd_counter() {
+    local id=$1
+    local counter=$2
+
+    CEPH_ARGS='' ceph --format=json daemon $(get_asok_path osd.$id) \
+        perf dump | jq ".osd.$counter"
+}
+
+function TEST_load_pgs_counters() {
+    local dir=$1
+    local pgs=16
+
+    run_mon $dir a --osd_pool_default_size=1 || return 1
+    run_mgr $dir x || return 1
+    run_osd $dir 0 || return 1
+    create_pool test $pgs $pgs || return 1
+    wait_for_clean || return 1
+    for i in $(seq 0 31) ; do
+        rados -p test put obj$i /etc/group || return 1
+    done
+
+    kill_daemons $dir TERM osd.0 || return 1
+    activate_osd $dir 0 || return 1
+    wait_for_clean || return 1
+
+    # every pg found on disk was counted, and every one of them got loaded
+    local total=$(get_osd_counter 0 numpg_load_total)
+    local loaded=$(get_osd_counter 0 numpg_loaded)
+    test "$total" -ge $pgs || return 1
+    test "$loaded" = "$total" || return 1
+    grep -q "load_pgs loading $total pgs with 4 threads" $dir/osd.0.log || return 1
+
+    for i in 0 15 31 ; do
+        rados -p test get obj$i $dir/copy || return 1
+        diff /etc/group $dir/copy || return 1
+    done
+}
+
+main osd-load-pgs "$@"
+
+# Local Variables:
+# compile-command: "cd ../../.. ; make -j4 && qa/standalone/osd/osd-load-pgs.sh"
+# End:
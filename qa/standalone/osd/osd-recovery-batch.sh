@@ -0,0 +1,91 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7154" # git grep '\<7154\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    CEPH_ARGS+="--osd-recovery-max-active=2 "
+    CEPH_ARGS+="--osd-recovery-batch-max-objects=8 "
+    CEPH_ARGS+="--osd-recovery-sleep=0 "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function TEST_recover_small_objects() {
+    local dir=$1
+    local poolname=test
+    local objects=200
+
+    run_mon $dir a --osd_pool_default_size=2 || return 1
+    run_mgr $dir x || return 1
+    run_osd $dir 0 || return 1
+    run_osd $dir 1 || return 1
+    create_pool $poolname 1 1 || return 1
+    wait_for_clean || return 1
+
+    local primary=$(get_primary $poolname obj0)
+    local replica=$(get_not_primary $poolname obj0)
+    ceph osd set noout || return 1
+    kill_daemons $dir TERM osd.$replica || return 1
+    ceph osd down $replica || return 1
+
+    dd if=/dev/urandom of=$dir/data bs=4k count=1 2>/dev/null
+    for i in $(seq 0 $((objects - 1))) ; do
+        rados -p $poolname put obj$i $dir/data || return 1
+    done
+
+    activate_osd $dir $replica || return 1
+    wait_for_clean || return 1
+    ceph osd dump | grep "osd.$primary up" || return 1
+
+    local primary_log=$dir/osd.$primary.log
+    # objects rode along with others...
+    grep -q "start_recovery_op .* (batched)" $primary_log || return 1
+    # ...and went out several to a push message
+    grep -q "send_pushes: sending \([2-9]\|[1-9][0-9]\) pushes to osd.$replica" \
+        $primary_log || return 1
+
+    # the osd never had more than osd_recovery_max_active slots out,
+    # used fewer slots than objects, and got every slot back
+    grep "start_recovery_op .* rops)" $primary_log | \
+        sed -e 's/.*(\([0-9]*\)\/\([0-9]*\) rops).*/\1 \2/' | \
+        awk '$1 >= $2 { bad = 1 } END { exit bad }' || return 1
+    local starts=$(grep -c "start_recovery_op .* rops)" $primary_log)
+    local finishes=$(grep -c "finish_recovery_op .* rops)" $primary_log)
+    test $starts -gt 0 || return 1
+    test $starts -lt $objects || return 1
+    test $starts = $finishes || return 1
+
+    for i in 0 $((objects / 2)) $((objects - 1)) ; do
+        rados -p $poolname get obj$i $dir/copy || return 1
+        diff $dir/data $dir/copy || return 1
+    done
+}
+
+main osd-recovery-batch "$@"
+
+# Local Variables:
+# compile-command: "cd ../../.. ; make -j4 && qa/standalone/osd/osd-recovery-batch.sh"
+# End:
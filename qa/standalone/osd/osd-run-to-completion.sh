@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+
+source $CEPH_ROOT/qa/standalone/ceph-helpers.sh
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7153" # git grep '\<7153\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+    # one shard, so every pg competes for the same worker
+    CEPH_ARGS+="--osd-op-run-to-completion=true "
+    CEPH_ARGS+="--osd-op-run-to-completion-max-items=8 "
+    CEPH_ARGS+="--osd-op-num-shards=1 "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function TEST_ordering_and_fairness() {
+    local dir=$1
+
+    run_mon $dir a --osd_pool_default_size=1 || return 1
+    run_mgr $dir x || return 1
+    run_osd $dir 0 || return 1
+    create_pool hot 1 1 || return 1
+    create_pool spread 8 8 || return 1
+    wait_for_clean || return 1
+
+    # ceph_test_rados fails if a write completes out of order.  the hot
+    # pool keeps one pg busy so that its batches run up against the
+    # other pool's pgs
+    local rados_args="--max-ops 2000 --max-in-flight 32 --size 65536"
+    rados_args+=" --min-stride-size 4096 --max-stride-size 16384"
+    rados_args+=" --op read 100 --op write 100 --op append 50 --op delete 10"
+    ceph_test_rados --pool hot --objects 4 $rados_args > $dir/hot.out 2>&1 &
+    local hot_pid=$!
+    timeout 300 ceph_test_rados --pool spread --objects 64 \
+        $rados_args > $dir/spread.out 2>&1 || return 1
+    wait $hot_pid || return 1
+
+    # items for one pg were run back to back, and a batch that ran into
+    # another pg's item left it for the next turn instead of requeueing
+    grep -q "_run_pg_batch .* (batched " $dir/osd.0.log || return 1
+    grep -q "_run_pg_batch .* batch ends at " $dir/osd.0.log || return 1
+    grep -q "_process .* continuing after batch" $dir/osd.0.log || return 1
+}
+
+main osd-run-to-completion "$@"
+
+# Local Variables:
+# compile-command: "cd ../../.. ; make -j4 && qa/standalone/osd/osd-run-to-completion.sh"
+# End:
@@ -4,10 +4,17 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include <string.h>
+#include <vector>
+
+#include "include/crc32c.h"
 #include "xxHash/xxhash.h"
 
 class Checksummer {
 public:
+  /// max number of csum blocks handed to Alg::calc_many() at once
+  static const size_t BATCH = 16;
+
   enum CSumType {
     CSUM_NONE = 1,	//intentionally set to 1 to be aligned with OSDMnitor's pool_opts_t handling - it treats 0 as unset while we need to distinguish none and unset cases
     CSUM_XXHASH32 = 2,
@@ -86,6 +93,24 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      value_t *out
+      ) {
+      uint32_t v[BATCH];
+      assert(n <= BATCH);
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<const unsigned char * const *>(data),
+			len, n, v);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = v[i];
+      }
+    }
   };
 
   struct crc32c_16 {
@@ -107,6 +132,24 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      value_t *out
+      ) {
+      uint32_t v[BATCH];
+      assert(n <= BATCH);
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<const unsigned char * const *>(data),
+			len, n, v);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = v[i] & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -128,6 +171,24 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      value_t *out
+      ) {
+      uint32_t v[BATCH];
+      assert(n <= BATCH);
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<const unsigned char * const *>(data),
+			len, n, v);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = v[i] & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -157,6 +218,19 @@ public:
       }
       return XXH32_digest(state);
     }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      value_t *out
+      ) {
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = XXH32(data[i], len, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -186,8 +260,164 @@ public:
       }
       return XXH64_digest(state);
     }
+
+    /*
+     * XXH64 over several equally sized buffers, interleaved.  Every
+     * lane is an independent multiply/rotate chain, so running STREAMS
+     * buffers side by side hides the multiplier latency and gives the
+     * compiler independent lanes to vectorize where the target has a
+     * 64-bit vector multiply.
+     */
+    static const size_t STREAMS = 4;
+    static const uint64_t PRIME64_1 = 11400714785074694791ULL;
+    static const uint64_t PRIME64_2 = 14029467366897019727ULL;
+    static const uint64_t PRIME64_3 =  1609587929392839161ULL;
+    static const uint64_t PRIME64_4 =  9650029242287828579ULL;
+    static const uint64_t PRIME64_5 =  2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r) {
+      return (x << r) | (x >> (64 - r));
+    }
+    static uint64_t read64(const char *p) {
+      __le64 v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    static uint32_t read32(const char *p) {
+      __le32 v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+      acc += input * PRIME64_2;
+      acc = rotl(acc, 31);
+      return acc * PRIME64_1;
+    }
+    static uint64_t merge_round(uint64_t acc, uint64_t val) {
+      acc ^= xxh_round(0, val);
+      return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    static void calc_streams(
+      init_value_t seed,
+      size_t len,
+      const char * const *data,
+      value_t *out
+      ) {
+      uint64_t h[STREAMS];
+      size_t off = 0;
+      if (len >= 32) {
+	uint64_t v[STREAMS][4];
+	for (size_t s = 0; s < STREAMS; ++s) {
+	  v[s][0] = seed + PRIME64_1 + PRIME64_2;
+	  v[s][1] = seed + PRIME64_2;
+	  v[s][2] = seed;
+	  v[s][3] = seed - PRIME64_1;
+	}
+	for (; off + 32 <= len; off += 32) {
+	  for (size_t s = 0; s < STREAMS; ++s) {
+	    for (size_t l = 0; l < 4; ++l) {
+	      v[s][l] = xxh_round(v[s][l], read64(data[s] + off + l * 8));
+	    }
+	  }
+	}
+	for (size_t s = 0; s < STREAMS; ++s) {
+	  h[s] = rotl(v[s][0], 1) + rotl(v[s][1], 7) +
+	    rotl(v[s][2], 12) + rotl(v[s][3], 18);
+	  for (size_t l = 0; l < 4; ++l) {
+	    h[s] = merge_round(h[s], v[s][l]);
+	  }
+	}
+      } else {
+	for (size_t s = 0; s < STREAMS; ++s) {
+	  h[s] = seed + PRIME64_5;
+	}
+      }
+      for (size_t s = 0; s < STREAMS; ++s) {
+	h[s] += len;
+      }
+      for (; off + 8 <= len; off += 8) {
+	for (size_t s = 0; s < STREAMS; ++s) {
+	  h[s] ^= xxh_round(0, read64(data[s] + off));
+	  h[s] = rotl(h[s], 27) * PRIME64_1 + PRIME64_4;
+	}
+      }
+      if (off + 4 <= len) {
+	for (size_t s = 0; s < STREAMS; ++s) {
+	  h[s] ^= (uint64_t)read32(data[s] + off) * PRIME64_1;
+	  h[s] = rotl(h[s], 23) * PRIME64_2 + PRIME64_3;
+	}
+	off += 4;
+      }
+      for (; off < len; ++off) {
+	for (size_t s = 0; s < STREAMS; ++s) {
+	  h[s] ^= (uint64_t)(unsigned char)data[s][off] * PRIME64_5;
+	  h[s] = rotl(h[s], 11) * PRIME64_1;
+	}
+      }
+      for (size_t s = 0; s < STREAMS; ++s) {
+	uint64_t x = h[s];
+	x ^= x >> 33;
+	x *= PRIME64_2;
+	x ^= x >> 29;
+	x *= PRIME64_3;
+	x ^= x >> 32;
+	out[s] = x;
+      }
+    }
+
+    static void calc_many(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      value_t *out
+      ) {
+      size_t i = 0;
+      for (; i + STREAMS <= n; i += STREAMS) {
+	calc_streams(init_value, len, data + i, out + i);
+      }
+      for (; i < n; ++i) {
+	out[i] = XXH64(data[i], len, init_value);
+      }
+    }
   };
 
+  /**
+   * collect pointers to whole csum blocks that are contiguous in memory
+   *
+   * Advances p past up to max blocks that do not straddle a buffer
+   * boundary and stores their addresses in data.  A block that does
+   * straddle one is left in place (for Alg::calc()), so 0 may be
+   * returned.
+   */
+  static size_t gather(
+    size_t csum_block_size,
+    size_t max,
+    bufferlist::const_iterator& p,
+    const char **data
+    ) {
+    size_t n = 0;
+    while (n < max) {
+      const char *d;
+      size_t want = (max - n) * csum_block_size;
+      size_t l = p.get_ptr_and_advance(want, &d);
+      size_t whole = l / csum_block_size;
+      for (size_t i = 0; i < whole; ++i) {
+	data[n++] = d + i * csum_block_size;
+      }
+      if (l % csum_block_size) {
+	p.advance(-(int)(l % csum_block_size));
+	break;
+      }
+      if (l == 0) {
+	break;
+      }
+    }
+    return n;
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -221,10 +451,94 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
+    const char *data[BATCH];
+    while (blocks) {
+      size_t n = gather(csum_block_size, std::min(blocks, (size_t)BATCH), p,
+			data);
+      if (n) {
+	Alg::calc_many(state, init_value, csum_block_size, data, n, pv);
+      } else {
+	*pv = Alg::calc(state, init_value, csum_block_size, p);
+	n = 1;
+      }
+      pv += n;
+      blocks -= n;
+    }
+    Alg::fini(&state);
+    return 0;
+  }
+
+  /// one region of a calculate_batch() call
+  struct batch_item_t {
+    size_t csum_block_size;
+    size_t offset;
+    size_t length;
+    const bufferlist *bl;
+    bufferptr *csum_data;
+  };
+
+  /**
+   * calculate() for several regions (e.g., blobs) at once
+   *
+   * Blocks of the same size are checksummed together even if they
+   * belong to different items, which matters when every item is
+   * only a block or two long.
+   */
+  template<class Alg>
+  static int calculate_batch(
+    typename Alg::init_value_t init_value,
+    std::vector<batch_item_t>& items
+    ) {
+    typename Alg::state_t state;
+    Alg::init(&state);
+
+    const char *data[BATCH];
+    typename Alg::value_t *dst[BATCH];
+    typename Alg::value_t v[BATCH];
+    size_t n = 0;
+    size_t n_block_size = 0;
+    auto flush = [&]() {
+      if (n) {
+	Alg::calc_many(state, init_value, n_block_size, data, n, v);
+	for (size_t i = 0; i < n; ++i) {
+	  *dst[i] = v[i];
+	}
+	n = 0;
+      }
+    };
+
+    for (auto& i : items) {
+      assert(i.length % i.csum_block_size == 0);
+      assert(i.bl->length() >= i.length);
+      assert(i.csum_data->length() >= (i.offset + i.length) /
+	     i.csum_block_size * sizeof(typename Alg::value_t));
+      size_t blocks = i.length / i.csum_block_size;
+      bufferlist::const_iterator p = i.bl->begin();
+      typename Alg::value_t *pv =
+	reinterpret_cast<typename Alg::value_t*>(i.csum_data->c_str());
+      pv += i.offset / i.csum_block_size;
+      if (i.csum_block_size != n_block_size) {
+	flush();
+	n_block_size = i.csum_block_size;
+      }
+      while (blocks) {
+	if (n == BATCH) {
+	  flush();
+	}
+	size_t got = gather(n_block_size, std::min(blocks, (size_t)BATCH - n),
+			    p, data + n);
+	if (got) {
+	  for (size_t j = 0; j < got; ++j) {
+	    dst[n++] = pv++;
+	  }
+	} else {
+	  *pv++ = Alg::calc(state, init_value, n_block_size, p);
+	  got = 1;
+	}
+	blocks -= got;
+      }
     }
+    flush();
     Alg::fini(&state);
     return 0;
   }
@@ -249,18 +563,29 @@ public:
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
     size_t pos = offset;
+    const char *data[BATCH];
+    typename Alg::value_t v[BATCH];
     while (length > 0) {
-      typename Alg::value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+      size_t n = gather(csum_block_size,
+			std::min(length / csum_block_size, (size_t)BATCH), p, data);
+      if (n) {
+	Alg::calc_many(state, -1, csum_block_size, data, n, v);
+      } else {
+	v[0] = Alg::calc(state, -1, csum_block_size, p);
+	n = 1;
+      }
+      for (size_t i = 0; i < n; ++i) {
+	if (pv[i] != v[i]) {
+	  if (bad_csum) {
+	    *bad_csum = v[i];
+	  }
+	  Alg::fini(&state);
+	  return pos + i * csum_block_size;
 	}
-	Alg::fini(&state);
-	return pos;
       }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
+      pv += n;
+      pos += n * csum_block_size;
+      length -= n * csum_block_size;
     }
     Alg::fini(&state);
     return -1;  // no errors
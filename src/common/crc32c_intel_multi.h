@@ -0,0 +1,21 @@
+#ifndef CEPH_COMMON_CRC32C_INTEL_MULTI_H
+#define CEPH_COMMON_CRC32C_INTEL_MULTI_H
+
+#include "include/int_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* is the multi-stream version compiled in */
+extern int ceph_crc32c_intel_multi_exists(void);
+
+extern void ceph_crc32c_intel_multi(uint32_t crc,
+				    unsigned char const * const *buffers,
+				    unsigned len, unsigned n, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -123,6 +123,7 @@ OPTION(ms_public_type, OPT_STR)   // messenger backend
 OPTION(ms_cluster_type, OPT_STR)   // messenger backend
 OPTION(ms_tcp_nodelay, OPT_BOOL)
 OPTION(ms_tcp_rcvbuf, OPT_INT)
+OPTION(ms_tcp_zerocopy_min_bytes, OPT_U64)
 OPTION(ms_tcp_prefetch_max_size, OPT_INT) // max prefetch size, we limit this to avoid extra memcpy
 OPTION(ms_initial_backoff, OPT_DOUBLE)
 OPTION(ms_max_backoff, OPT_DOUBLE)
@@ -154,6 +155,10 @@ OPTION(ms_dump_on_send, OPT_BOOL)           // hexdump msg to log on send
 OPTION(ms_dump_corrupt_message_level, OPT_INT)  // debug level to hexdump undecodeable messages at
 OPTION(ms_async_op_threads, OPT_U64)            // number of worker processing threads for async messenger created on init
 OPTION(ms_async_max_op_threads, OPT_U64)        // max number of worker processing threads for async messenger
+OPTION(ms_async_lockless_send, OPT_BOOL)
+OPTION(ms_async_coalesce_max_messages, OPT_U64)
+OPTION(ms_async_coalesce_max_bytes, OPT_U64)
+OPTION(ms_async_coalesce_delay_us, OPT_U64)
 OPTION(ms_async_set_affinity, OPT_BOOL)
 // example: ms_async_affinity_cores = 0,1
 // The number of coreset is expected to equal to ms_async_op_threads, otherwise
@@ -425,6 +430,9 @@ OPTION(objecter_completion_locks_per_session, OPT_U64) // num of completion lock
 OPTION(objecter_inject_no_watch_ping, OPT_BOOL)   // suppress watch pings
 OPTION(objecter_retry_writes_after_first_reply, OPT_BOOL)   // ignore the first reply for each write, and resend the osd op instead
 OPTION(objecter_debug_inject_relock_delay, OPT_BOOL)
+OPTION(objecter_pg_mapping_threads, OPT_U64)
+OPTION(objecter_pg_mapping_pgs_per_chunk, OPT_U64)
+OPTION(objecter_map_lock_shards, OPT_U64)
 
 // Max number of deletes at once in a single Filer::purge call
 OPTION(filer_max_purge_ops, OPT_U32)
@@ -688,11 +696,16 @@ OPTION(osd_op_num_threads_per_shard, OPT_INT)
 OPTION(osd_op_num_threads_per_shard_hdd, OPT_INT)
 OPTION(osd_op_num_threads_per_shard_ssd, OPT_INT)
 OPTION(osd_op_num_shards, OPT_INT)
+OPTION(osd_load_pgs_threads, OPT_U32)
+OPTION(osd_op_run_to_completion, OPT_BOOL)
+OPTION(osd_op_run_to_completion_max_items, OPT_U32)
 OPTION(osd_op_num_shards_hdd, OPT_INT)
 OPTION(osd_op_num_shards_ssd, OPT_INT)
 
 // PrioritzedQueue (prio), Weighted Priority Queue (wpq ; default),
-// mclock_opclass, mclock_client, or debug_random. "mclock_opclass"
+// mclock_opclass, mclock_client, mclock_scheduler or debug_random.
+// "mclock_scheduler" schedules client ops per pool and all background
+// work in one queue with enforced limits. "mclock_opclass"
 // and "mclock_client" are based on the mClock/dmClock algorithm
 // (Gulati, et al. 2010). "mclock_opclass" prioritizes based on the
 // class the operation belongs to. "mclock_client" does the same but
@@ -719,12 +732,34 @@ OPTION(osd_op_queue_mclock_scrub_res, OPT_DOUBLE)
 OPTION(osd_op_queue_mclock_scrub_wgt, OPT_DOUBLE)
 OPTION(osd_op_queue_mclock_scrub_lim, OPT_DOUBLE)
 
+// mclock_scheduler parameters, as fractions of the OSD's IOPS capacity
+OPTION(osd_mclock_scheduler_client_res, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_client_wgt, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_client_lim, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_recovery_res, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_recovery_wgt, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_recovery_lim, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_backfill_res, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_backfill_wgt, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_backfill_lim, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_scrub_res, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_scrub_wgt, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_scrub_lim, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_snaptrim_res, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_snaptrim_wgt, OPT_DOUBLE)
+OPTION(osd_mclock_scheduler_snaptrim_lim, OPT_DOUBLE)
+OPTION(osd_mclock_max_capacity_iops, OPT_DOUBLE) // 0 = measure at startup
+OPTION(osd_mclock_max_capacity_iops_hdd, OPT_DOUBLE)
+OPTION(osd_mclock_max_capacity_iops_ssd, OPT_DOUBLE)
+OPTION(osd_mclock_skip_benchmark, OPT_BOOL)
+
 OPTION(osd_ignore_stale_divergent_priors, OPT_BOOL) // do not assert on divergent_prior entries which aren't in the log and whose on-disk objects are newer
 
 // Set to true for testing.  Users should NOT set this.
 // If set to true even after reading enough shards to
 // decode the object, any error will be reported.
 OPTION(osd_read_ec_check_for_errors, OPT_BOOL) // return error if any ec shard has an error
+OPTION(osd_ec_delta_overwrites, OPT_BOOL)
 
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
@@ -752,6 +787,8 @@ OPTION(osd_heartbeat_interval, OPT_INT)       // (seconds) how often we ping pee
 // This setting is read by the MONs and OSDs and has to be set to a equal value in both settings of the configuration
 OPTION(osd_heartbeat_grace, OPT_INT)
 OPTION(osd_heartbeat_min_peers, OPT_INT)     // minimum number of peers
+OPTION(osd_heartbeat_topology, OPT_STR)     // flat or hierarchical
+OPTION(osd_heartbeat_aggregate_level, OPT_STR)  // crush type that groups osds for hierarchical heartbeats
 OPTION(osd_heartbeat_use_min_delay_socket, OPT_BOOL) // prio the heartbeat tcp socket and set dscp as CS6 on it if true
 OPTION(osd_heartbeat_min_size, OPT_INT) // the minimum size of OSD heartbeat messages to send
 
@@ -784,6 +821,8 @@ OPTION(osd_copyfrom_max_chunk, OPT_U64)   // max size of a COPYFROM chunk
 OPTION(osd_push_per_object_cost, OPT_U64)  // push cost per object
 OPTION(osd_max_push_cost, OPT_U64)  // max size of push message
 OPTION(osd_max_push_objects, OPT_U64)  // max objects in single push op
+OPTION(osd_recovery_batch_max_objects, OPT_U64)  // small objects sharing one recovery op
+OPTION(osd_recovery_batch_max_object_size, OPT_U64)
 OPTION(osd_recovery_forget_lost_objects, OPT_BOOL)   // off for now
 OPTION(osd_max_scrubs, OPT_INT)
 OPTION(osd_scrub_during_recovery, OPT_BOOL) // Allow new scrubs to start while recovery is active on the OSD
@@ -797,11 +836,15 @@ OPTION(osd_scrub_backoff_ratio, OPT_DOUBLE)   // the probability to back off the
 OPTION(osd_scrub_chunk_min, OPT_INT)
 OPTION(osd_scrub_chunk_max, OPT_INT)
 OPTION(osd_scrub_sleep, OPT_FLOAT)   // sleep between [deep]scrub ops
+OPTION(osd_scrub_sleep_target_latency, OPT_FLOAT)
+OPTION(osd_scrub_sleep_latency_percentile, OPT_FLOAT)
+OPTION(osd_scrub_sleep_max, OPT_FLOAT)
 OPTION(osd_scrub_auto_repair, OPT_BOOL)   // whether auto-repair inconsistencies upon deep-scrubbing
 OPTION(osd_scrub_auto_repair_num_errors, OPT_U32)   // only auto-repair when number of errors is below this threshold
 OPTION(osd_deep_scrub_interval, OPT_FLOAT) // once a week
 OPTION(osd_deep_scrub_randomize_ratio, OPT_FLOAT) // scrubs will randomly become deep scrubs at this rate (0.15 -> 15% of scrubs are deep)
 OPTION(osd_deep_scrub_stride, OPT_INT)
+OPTION(osd_deep_scrub_checksum_only, OPT_BOOL)
 OPTION(osd_deep_scrub_update_digest_min_age, OPT_INT)   // objects must be this old (seconds) before we update the whole-object digest on scrub
 OPTION(osd_class_dir, OPT_STR) // where rados plugins are stored
 OPTION(osd_open_classes_on_start, OPT_BOOL)
@@ -858,6 +901,8 @@ OPTION(osd_failsafe_full_ratio, OPT_FLOAT) // what % full makes an OSD "full" (f
 OPTION(osd_fast_fail_on_connection_refused, OPT_BOOL) // immediately mark OSDs as down once they refuse to accept connections
 
 OPTION(osd_pg_object_context_cache_count, OPT_INT)
+OPTION(osd_pg_object_context_cache_bytes, OPT_U64)
+OPTION(osd_pg_snapset_context_cache_count, OPT_U32)
 OPTION(osd_tracing, OPT_BOOL) // true if LTTng-UST tracepoints should be enabled
 OPTION(osd_function_tracing, OPT_BOOL) // true if function instrumentation should use LTTng
 
@@ -977,6 +1022,10 @@ OPTION(bdev_aio, OPT_BOOL)
 OPTION(bdev_aio_poll_ms, OPT_INT)  // milliseconds
 OPTION(bdev_aio_max_queue_depth, OPT_INT)
 OPTION(bdev_aio_reap_max, OPT_INT)
+OPTION(bdev_ioring, OPT_BOOL)
+OPTION(bdev_ioring_hipri, OPT_BOOL)
+OPTION(bdev_ioring_registered_buffers, OPT_U64)
+OPTION(bdev_ioring_registered_buffer_size, OPT_U64)
 OPTION(bdev_block_size, OPT_INT)
 OPTION(bdev_debug_aio, OPT_BOOL)
 OPTION(bdev_debug_aio_suicide_timeout, OPT_FLOAT)
@@ -999,7 +1048,7 @@ OPTION(bluefs_min_flush_size, OPT_U64)  // ignore flush until its this big
 OPTION(bluefs_compact_log_sync, OPT_BOOL)  // sync or async log compaction?
 OPTION(bluefs_buffered_io, OPT_BOOL)
 OPTION(bluefs_sync_write, OPT_BOOL)
-OPTION(bluefs_allocator, OPT_STR)     // stupid | bitmap
+OPTION(bluefs_allocator, OPT_STR)     // stupid | bitmap | extent
 OPTION(bluefs_preextend_wal_files, OPT_BOOL)  // this *requires* that rocksdb has recycling enabled
 
 OPTION(bluestore_bluefs, OPT_BOOL)
@@ -1034,6 +1083,9 @@ OPTION(bluestore_block_db_create, OPT_BOOL)
 OPTION(bluestore_block_wal_path, OPT_STR)
 OPTION(bluestore_block_wal_size, OPT_U64) // rocksdb wal
 OPTION(bluestore_block_wal_create, OPT_BOOL)
+OPTION(bluestore_block_deferred_path, OPT_STR)
+OPTION(bluestore_block_deferred_size, OPT_U64) // deferred write log
+OPTION(bluestore_block_deferred_create, OPT_BOOL)
 OPTION(bluestore_block_preallocate_file, OPT_BOOL) //whether preallocate space if block/db_path/wal_path is file rather that block device.
 OPTION(bluestore_csum_type, OPT_STR) // none|xxhash32|xxhash64|crc32c|crc32c_16|crc32c_8
 OPTION(bluestore_min_alloc_size, OPT_U32)
@@ -1051,6 +1103,7 @@ OPTION(bluestore_compression_min_blob_size_ssd, OPT_U32)
 OPTION(bluestore_compression_max_blob_size, OPT_U32)
 OPTION(bluestore_compression_max_blob_size_hdd, OPT_U32)
 OPTION(bluestore_compression_max_blob_size_ssd, OPT_U32)
+OPTION(bluestore_compression_frame_size, OPT_U32)
 /*
  * Specifies minimum expected amount of saved allocation units
  * per single blob to enable compressed blobs garbage collection
@@ -1083,14 +1136,19 @@ OPTION(bluestore_cache_trim_max_skip_pinned, OPT_U32) // skip this many onodes p
 OPTION(bluestore_cache_type, OPT_STR)   // lru, 2q
 OPTION(bluestore_2q_cache_kin_ratio, OPT_DOUBLE)    // kin page slot size / max page slot size
 OPTION(bluestore_2q_cache_kout_ratio, OPT_DOUBLE)   // number of kout page slot / total number of page slot
+OPTION(bluestore_cache_lockless_hits, OPT_BOOL)
+OPTION(bluestore_cache_trim_batch_bytes, OPT_U64)
 OPTION(bluestore_cache_size, OPT_U64)
 OPTION(bluestore_cache_size_hdd, OPT_U64)
 OPTION(bluestore_cache_size_ssd, OPT_U64)
 OPTION(bluestore_cache_meta_ratio, OPT_DOUBLE)
 OPTION(bluestore_cache_kv_ratio, OPT_DOUBLE)
+OPTION(bluestore_cache_decompressed_max, OPT_U64)
 OPTION(bluestore_cache_kv_max, OPT_U64) // limit the maximum amount of cache for the kv store
 OPTION(bluestore_kvbackend, OPT_STR)
-OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap
+OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap | extent
+OPTION(bluestore_alloc_snapshot, OPT_BOOL)
+OPTION(bluestore_alloc_snapshot_chunk_extents, OPT_U64)
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT)
 OPTION(bluestore_bitmapallocator_blocks_per_zone, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_bitmapallocator_span_size, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
@@ -1103,6 +1161,7 @@ OPTION(bluestore_fsck_on_umount_deep, OPT_BOOL)
 OPTION(bluestore_fsck_on_mkfs, OPT_BOOL)
 OPTION(bluestore_fsck_on_mkfs_deep, OPT_BOOL)
 OPTION(bluestore_sync_submit_transaction, OPT_BOOL) // submit kv txn in queueing thread (not kv_sync_thread)
+OPTION(bluestore_kv_submit_lanes, OPT_U64) // threads submitting kv txns in parallel (0 = kv_sync_thread)
 OPTION(bluestore_throttle_bytes, OPT_U64)
 OPTION(bluestore_throttle_deferred_bytes, OPT_U64)
 OPTION(bluestore_throttle_cost_per_io_hdd, OPT_U64)
@@ -1123,6 +1182,7 @@ OPTION(bluestore_debug_freelist, OPT_BOOL)
 OPTION(bluestore_debug_prefill, OPT_FLOAT)
 OPTION(bluestore_debug_prefragment_max, OPT_INT)
 OPTION(bluestore_debug_inject_read_err, OPT_BOOL)
+OPTION(bluestore_debug_inject_csum_err_probability, OPT_FLOAT)
 OPTION(bluestore_debug_randomize_serial_transaction, OPT_INT)
 OPTION(bluestore_debug_omit_block_device_write, OPT_BOOL)
 OPTION(bluestore_debug_fsck_abort, OPT_BOOL)
@@ -206,7 +206,32 @@ namespace ceph {
 
     SubQueues high_queue;
 
-    dmc::PullPriorityQueue<K,T> queue;
+    // exposes whether the dmclock queue has a request that may be
+    // pulled now, without pulling it
+    class PullQueue : public dmc::PullPriorityQueue<K,T> {
+      using super = dmc::PullPriorityQueue<K,T>;
+
+    public:
+
+      PullQueue(const typename super::ClientInfoFunc& info_func,
+		bool allow_limit_break) :
+	super(info_func, allow_limit_break)
+      {
+	// empty
+      }
+
+      bool is_ready(dmc::Time now, dmc::Time *when) {
+	typename super::DataGuard g(this->data_mtx);
+	auto next = this->do_next_request(now);
+	if (super::NextReqType::future == next.type) {
+	  *when = next.when_ready;
+	  return false;
+	}
+	return true;
+      }
+    };
+
+    PullQueue queue;
 
     // when enqueue_front is called, rather than try to re-calc tags
     // to put in mClock priority queue, we'll just keep a separate
@@ -216,9 +241,12 @@ namespace ceph {
 
   public:
 
+    // with use_limits, requests are held back until their limit tag
+    // allows them; callers must check is_ready() before dequeue()
     mClockQueue(
-      const typename dmc::PullPriorityQueue<K,T>::ClientInfoFunc& info_func) :
-      queue(info_func, true)
+      const typename dmc::PullPriorityQueue<K,T>::ClientInfoFunc& info_func,
+      bool use_limits = false) :
+      queue(info_func, !use_limits)
     {
       // empty
     }
@@ -288,6 +316,19 @@ namespace ceph {
       }
     }
 
+    // requeue the requests of client from in the dmclock queue under
+    // client to, keeping their order, so they are scheduled with the
+    // ClientInfo of to from now on
+    void move_client(K from, K to) {
+      std::list<T> moved;
+      queue.remove_by_client(from,
+			     true,
+			     [&moved] (T&& t) { moved.push_front(std::move(t)); });
+      for (auto& t : moved) {
+	queue.add_request(std::move(t), to, 0);
+      }
+    }
+
     void enqueue_strict(K cl, unsigned priority, T item) override final {
       high_queue[priority].enqueue(cl, 0, item);
     }
@@ -312,6 +353,16 @@ namespace ceph {
       return queue.empty() && high_queue.empty() && queue_front.empty();
     }
 
+    // Returns true if dequeue() has something to return now.  If every
+    // queued request is held back by its limit, returns false and sets
+    // *when to the time (as dmc::get_time()) the first one is due.
+    bool is_ready(double *when) {
+      if (!high_queue.empty() || !queue_front.empty()) {
+	return true;
+      }
+      return queue.is_ready(dmc::get_time(), when);
+    }
+
     T dequeue() override final {
       assert(!empty());
 
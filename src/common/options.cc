@@ -594,6 +594,11 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description(""),
 
+    Option("ms_tcp_zerocopy_min_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Send with MSG_ZEROCOPY when at least this many bytes are queued on a connection (0 to disable)")
+    .set_long_description("Only supported by the posix async messenger stack on Linux 4.14 and later.  The kernel then transmits straight from our buffers, which stay referenced until it reports completion; this saves a copy for large replies but costs more than it saves for small ones."),
+
     Option("ms_tcp_prefetch_max_size", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(4096)
     .set_description(""),
@@ -729,6 +734,27 @@ std::vector<Option> get_global_options() {
     .set_default(5)
     .set_description(""),
 
+    Option("ms_async_lockless_send", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Hand outgoing messages to the connection's event thread through a lock-free queue")
+    .set_long_description("Otherwise every sender takes the connection's write lock, which the event thread also holds while writing to the socket; with many threads sending on one connection they contend for it."),
+
+    Option("ms_async_coalesce_max_messages", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_min(1)
+    .set_description("Most queued messages packed into a single socket send")
+    .set_long_description("When several messages are queued on a connection they are framed back to back and handed to the kernel with one vectored send.  1 sends every message on its own."),
+
+    Option("ms_async_coalesce_max_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Stop packing messages into a socket send once it holds this many bytes"),
+
+    Option("ms_async_coalesce_delay_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("How long a message may wait for others to share its socket send (0 to never wait)")
+    .set_long_description("Only messages queued within this long after the connection's previous send are held back, so an idle connection still sends right away while a busy one sends fewer, larger batches.  A send goes out early once ms_async_coalesce_max_messages are queued.")
+    .add_see_also("ms_async_coalesce_max_messages"),
+
     Option("ms_async_set_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_description(""),
@@ -1531,6 +1557,23 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("objecter_map_lock_shards", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(8)
+    .set_min(1)
+    .set_description("Number of shards of the Objecter's map lock")
+    .set_long_description("Ops are submitted holding the lock shared; each client thread takes only its own shard, so many threads submitting at once do not contend on a single lock.  Map updates and session changes take every shard.  1 gives a single lock."),
+
+    Option("objecter_pg_mapping_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Threads precalculating where every PG maps in each new osdmap (0 to disable)")
+    .set_long_description("With the mapping in place the Objecter targets an op with a table lookup instead of a CRUSH calculation.  The mapping is rebuilt in the background whenever the osdmap changes, and ops fall back to CRUSH until it is ready.  It costs memory in proportion to the number of PGs in the cluster, so it suits clients that send many ops, such as radosgw.")
+    .add_see_also("objecter_pg_mapping_pgs_per_chunk"),
+
+    Option("objecter_pg_mapping_pgs_per_chunk", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4096)
+    .set_min(1)
+    .set_description("PGs mapped per work item when building the Objecter's PG mapping"),
+
     Option("objecter_debug_inject_relock_delay", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description(""),
@@ -1911,6 +1954,23 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description(""),
 
+    Option("osd_load_pgs_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of threads used to read PG state and logs at startup; 0 means one per op shard")
+    .add_see_also("osd_op_num_shards"),
+
+    Option("osd_op_run_to_completion", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Give each op shard a single worker thread that drains consecutive work items for a PG under one PG lock")
+    .set_long_description("Each shard thread then owns its PGs among the op workers: items for the same PG are run back to back without handing the PG lock to another worker.  The number of shards should be set to roughly the number of cores available to the OSD.")
+    .add_see_also("osd_op_run_to_completion_max_items")
+    .add_see_also("osd_op_num_shards"),
+
+    Option("osd_op_run_to_completion_max_items", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_description("Maximum number of queued items for one PG to run under a single PG lock acquisition")
+    .add_see_also("osd_op_run_to_completion"),
+
     Option("osd_op_num_shards_hdd", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(5)
     .set_description(""),
@@ -1921,10 +1981,11 @@ std::vector<Option> get_global_options() {
 
     Option("osd_op_queue", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("wpq")
-    .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "debug_random" } )
+    .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "mclock_scheduler", "debug_random" } )
     .set_description("which operation queue algorithm to use")
-    .set_long_description("which operation queue algorithm to use; mclock_opclass and mclock_client are currently experimental")
-    .add_see_also("osd_op_queue_cut_off"),
+    .set_long_description("which operation queue algorithm to use; mclock_opclass, mclock_client and mclock_scheduler are currently experimental")
+    .add_see_also("osd_op_queue_cut_off")
+    .add_see_also("osd_mclock_max_capacity_iops"),
 
     Option("osd_op_queue_cut_off", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("low")
@@ -2233,6 +2294,135 @@ std::vector<Option> get_global_options() {
     .add_see_also("osd_op_queue_mclock_scrub_res")
     .add_see_also("osd_op_queue_mclock_scrub_wgt"),
 
+    Option("osd_mclock_scheduler_client_res", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.5)
+    .set_description("mclock reservation of client ops, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity guaranteed to client ops when osd_op_queue is 'mclock_scheduler', split evenly between the active pools without qos settings of their own; if the reservations add up to more than 1 they are scaled down proportionally; a pool's qos_res, qos_wgt and qos_lim override these for its client ops")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_client_wgt", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(2.0)
+    .set_description("mclock weight of client ops")
+    .set_long_description("share of the capacity left after reservations given to client ops when osd_op_queue is 'mclock_scheduler'; higher values increase the weight; a pool's qos_res, qos_wgt and qos_lim override these for its client ops")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_client_lim", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_description("mclock limit of client ops, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity client ops may not exceed when osd_op_queue is 'mclock_scheduler'; 0 means no limit; a pool's qos_res, qos_wgt and qos_lim override these for its client ops")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_recovery_res", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.2)
+    .set_description("mclock reservation of recovery, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity guaranteed to recovery when osd_op_queue is 'mclock_scheduler'; if the reservations add up to more than 1 they are scaled down proportionally")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_recovery_wgt", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_description("mclock weight of recovery")
+    .set_long_description("share of the capacity left after reservations given to recovery when osd_op_queue is 'mclock_scheduler'; higher values increase the weight")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_recovery_lim", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_description("mclock limit of recovery, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity recovery may not exceed when osd_op_queue is 'mclock_scheduler'; 0 means no limit")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_backfill_res", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.05)
+    .set_description("mclock reservation of backfill, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity guaranteed to backfill when osd_op_queue is 'mclock_scheduler'; if the reservations add up to more than 1 they are scaled down proportionally")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_backfill_wgt", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_description("mclock weight of backfill")
+    .set_long_description("share of the capacity left after reservations given to backfill when osd_op_queue is 'mclock_scheduler'; higher values increase the weight")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_backfill_lim", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.5)
+    .set_description("mclock limit of backfill, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity backfill may not exceed when osd_op_queue is 'mclock_scheduler'; 0 means no limit")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_scrub_res", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_description("mclock reservation of scrub, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity guaranteed to scrub when osd_op_queue is 'mclock_scheduler'; if the reservations add up to more than 1 they are scaled down proportionally")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_scrub_wgt", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_description("mclock weight of scrub")
+    .set_long_description("share of the capacity left after reservations given to scrub when osd_op_queue is 'mclock_scheduler'; higher values increase the weight")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_scrub_lim", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.3)
+    .set_description("mclock limit of scrub, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity scrub may not exceed when osd_op_queue is 'mclock_scheduler'; 0 means no limit")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_snaptrim_res", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_description("mclock reservation of snap trimming, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity guaranteed to snap trimming when osd_op_queue is 'mclock_scheduler'; if the reservations add up to more than 1 they are scaled down proportionally")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_snaptrim_wgt", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_description("mclock weight of snap trimming")
+    .set_long_description("share of the capacity left after reservations given to snap trimming when osd_op_queue is 'mclock_scheduler'; higher values increase the weight")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_scheduler_snaptrim_lim", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.3)
+    .set_description("mclock limit of snap trimming, as a fraction of the OSD's IOPS capacity")
+    .set_long_description("fraction of the OSD's IOPS capacity snap trimming may not exceed when osd_op_queue is 'mclock_scheduler'; 0 means no limit")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_max_capacity_iops", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0.0)
+    .set_description("IOPS the OSD can sustain, used by the mclock_scheduler op queue; 0 means measure it at startup")
+    .set_long_description("The mclock_scheduler op queue turns the reservation and limit of each class into IOPS using this capacity.  If 0, the OSD measures it with a short 4 KiB write benchmark when it starts, or falls back to osd_mclock_max_capacity_iops_hdd/ssd if osd_mclock_skip_benchmark is set or the benchmark fails.")
+    .add_see_also("osd_op_queue")
+    .add_see_also("osd_mclock_skip_benchmark")
+    .add_see_also("osd_mclock_max_capacity_iops_hdd")
+    .add_see_also("osd_mclock_max_capacity_iops_ssd"),
+
+    Option("osd_mclock_max_capacity_iops_hdd", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(315.0)
+    .set_description("IOPS capacity assumed for a rotational OSD that did not measure its own")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_max_capacity_iops_ssd", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(21500.0)
+    .set_description("IOPS capacity assumed for a non-rotational OSD that did not measure its own")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
+    Option("osd_mclock_skip_benchmark", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Do not measure the OSD's IOPS capacity at startup")
+    .add_see_also("osd_mclock_max_capacity_iops"),
+
     Option("osd_ignore_stale_divergent_priors", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -2241,6 +2431,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_delta_overwrites", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Apply small erasure coded overwrites as parity deltas")
+    .set_long_description("When a partial stripe overwrite leaves some data shards untouched, read only the touched data shards and the coding shards, compute the change to the coding chunks from the change to the data, and write only those shards, instead of reading and rewriting whole stripes.  Only used while no other write to the object is in flight."),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -2325,6 +2520,18 @@ std::vector<Option> get_global_options() {
     .set_default(10)
     .set_description(""),
 
+    Option("osd_heartbeat_topology", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("flat")
+    .set_enum_allowed({"flat", "hierarchical"})
+    .set_description("How OSDs choose their heartbeat peers")
+    .set_long_description("flat: every OSD pings the peers of its PGs, plus enough other OSDs to reach osd_heartbeat_min_peers.  hierarchical: OSDs are grouped by the CRUSH bucket type osd_heartbeat_aggregate_level.  The lowest-numbered up OSD of each group is its aggregator: it pings the other members and the aggregators of all other groups, and failures it sees within its group are marked down by the monitors without further reporters.  The other members only ping their aggregator.  If an aggregator stops responding, the other aggregators ping the members of its group directly until a new one takes over.  Monitors must use the same settings.")
+    .add_see_also("osd_heartbeat_aggregate_level"),
+
+    Option("osd_heartbeat_aggregate_level", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("host")
+    .set_description("CRUSH bucket type that groups OSDs for hierarchical heartbeats")
+    .add_see_also("osd_heartbeat_topology"),
+
     Option("osd_heartbeat_use_min_delay_socket", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -2425,6 +2632,19 @@ std::vector<Option> get_global_options() {
     .set_default(10)
     .set_description(""),
 
+    Option("osd_recovery_batch_max_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(10)
+    .set_description("Maximum number of small objects pushed to replicas as a single recovery op")
+    .set_long_description("Small objects recovered together go out in one push message per peer, are applied in one transaction on the replica, and count as a single op against osd_recovery_max_active, which then bounds the number of batches in flight.  The batch is further limited by osd_max_push_objects and osd_max_push_cost.  Set to 1 to recover one object per op.")
+    .add_see_also("osd_recovery_batch_max_object_size")
+    .add_see_also("osd_recovery_max_active")
+    .add_see_also("osd_max_push_objects"),
+
+    Option("osd_recovery_batch_max_object_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Largest object (without omap) that may be batched with others during recovery")
+    .add_see_also("osd_recovery_batch_max_objects"),
+
     Option("osd_recovery_forget_lost_objects", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -2477,6 +2697,24 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description(""),
 
+    Option("osd_scrub_sleep_target_latency", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Client op latency (seconds) above which scrub backs off; 0 disables adaptive pacing")
+    .set_long_description("The OSD tracks an estimate of the osd_scrub_sleep_latency_percentile client op latency.  While it is above this target, the sleep between scrub chunks grows linearly from osd_scrub_sleep up to osd_scrub_sleep + osd_scrub_sleep_max at twice the target.")
+    .add_see_also("osd_scrub_sleep")
+    .add_see_also("osd_scrub_sleep_latency_percentile")
+    .add_see_also("osd_scrub_sleep_max"),
+
+    Option("osd_scrub_sleep_latency_percentile", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.99)
+    .set_description("Client op latency percentile that adaptive scrub pacing tracks")
+    .add_see_also("osd_scrub_sleep_target_latency"),
+
+    Option("osd_scrub_sleep_max", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1.0)
+    .set_description("Most extra sleep (seconds) adaptive pacing adds between scrub chunks")
+    .add_see_also("osd_scrub_sleep_target_latency"),
+
     Option("osd_scrub_auto_repair", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
@@ -2497,6 +2735,12 @@ std::vector<Option> get_global_options() {
     .set_default(524288)
     .set_description(""),
 
+    Option("osd_deep_scrub_checksum_only", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Have the object store verify object data against its own stored checksums during deep scrub, instead of reading it back to compute a digest")
+    .set_long_description("Only applies to replicated pools on an object store that keeps checksums (BlueStore).  Data digests are then not compared between replicas or against the object info; omap is still digested and compared.")
+    .add_see_also("osd_deep_scrub_stride"),
+
     Option("osd_deep_scrub_update_digest_min_age", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(2_hr)
     .set_description(""),
@@ -2712,7 +2956,19 @@ std::vector<Option> get_global_options() {
 
     Option("osd_pg_object_context_cache_count", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(64)
-    .set_description(""),
+    .set_description("Number of object contexts cached per PG")
+    .set_long_description("Only used if osd_pg_object_context_cache_bytes is 0."),
+
+    Option("osd_pg_object_context_cache_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(256_K)
+    .set_description("Memory used to cache object contexts per PG")
+    .set_long_description("Object contexts are charged for their object info and cached xattrs, so a PG can keep many more small objects than large ones with many xattrs.  0 caches osd_pg_object_context_cache_count object contexts regardless of size.")
+    .add_see_also("osd_pg_object_context_cache_count"),
+
+    Option("osd_pg_snapset_context_cache_count", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64)
+    .set_description("Number of decoded snapsets kept per PG after their objects leave the object context cache")
+    .set_long_description("A later op on the object, or on one of its clones, then does not have to read and decode the snapset again."),
 
     Option("osd_tracing", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
@@ -3056,6 +3312,25 @@ std::vector<Option> get_global_options() {
     .set_default(16)
     .set_description(""),
 
+    Option("bdev_ioring", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use io_uring instead of libaio for KernelDevice io")
+    .set_long_description("Only available when built with liburing; falls back to libaio if the kernel does not support io_uring."),
+
+    Option("bdev_ioring_hipri", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Poll for io_uring completions instead of waiting for interrupts")
+    .set_long_description("Requires a device with poll queues (e.g., NVMe with nvme.poll_queues set).  Burns a cpu in the completion thread while io is in flight."),
+
+    Option("bdev_ioring_registered_buffers", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(256)
+    .set_description("Number of read buffers to register with io_uring")
+    .set_long_description("Registered buffers are pinned and count against RLIMIT_MEMLOCK.  A buffer is only in use while a read is in flight; the data is copied out of it when the read completes.  0 disables registered buffers."),
+
+    Option("bdev_ioring_registered_buffer_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Size of each registered io_uring read buffer; larger reads use normal buffers"),
+
     Option("bdev_block_size", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(4096)
     .set_description(""),
@@ -3118,6 +3393,7 @@ std::vector<Option> get_global_options() {
 
     Option("bluefs_allocator", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("stupid")
+    .set_enum_allowed({"bitmap", "stupid", "extent"})
     .set_description(""),
 
     Option("bluefs_preextend_wal_files", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
@@ -3221,6 +3497,24 @@ std::vector<Option> get_global_options() {
     .add_see_also("bluestore_block_wal_path")
     .add_see_also("bluestore_block_wal_size"),
 
+    Option("bluestore_block_deferred_path", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("")
+    .add_tag("mkfs")
+    .set_description("Path to block device/file backing the deferred write log")
+    .set_long_description("If set, payloads of deferred (small overwrite) transactions are persisted to a ring log on this device instead of the key/value store, and flushed to the main device in batches later.  A file on a DAX-mounted persistent memory file system is accessed with the pmem device backend."),
+
+    Option("bluestore_block_deferred_size", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(1_G)
+    .add_tag("mkfs")
+    .set_description("Size of file to create for bluestore_block_deferred_path"),
+
+    Option("bluestore_block_deferred_create", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .add_tag("mkfs")
+    .set_description("Create bluestore_block_deferred_path if it doesn't exist")
+    .add_see_also("bluestore_block_deferred_path")
+    .add_see_also("bluestore_block_deferred_size"),
+
     Option("bluestore_block_preallocate_file", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .add_tag("mkfs")
@@ -3313,6 +3607,12 @@ std::vector<Option> get_global_options() {
     .set_safe()
     .set_description("Default value of bluestore_compression_max_blob_size for non-rotational (solid state) media"),
 
+    Option("bluestore_compression_frame_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_safe()
+    .set_description("Compress blobs larger than this in independent frames of this many bytes (0 to compress each blob as one stream)")
+    .set_long_description("Reads of a framed blob only decompress the frames they touch, which helps small random reads of large compressed blobs at some cost in compression ratio.  Releases that do not understand framed blobs fail to read them."),
+
     Option("bluestore_gc_enable_blob_threshold", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(0)
     .set_safe()
@@ -3385,6 +3685,15 @@ std::vector<Option> get_global_options() {
     .set_default(.5)
     .set_description("2Q paper suggests .5"),
 
+    Option("bluestore_cache_lockless_hits", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Serve onode and buffer cache hits without taking the cache shard lock")
+    .set_long_description("Hits only take a shared lock on the collection's onode map or the blob's buffer map and flag the item as referenced; the LRU order is updated by the trim thread (second chance), which also trims in bounded batches."),
+
+    Option("bluestore_cache_trim_batch_bytes", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4_M)
+    .set_description("Max bytes trimmed from a cache shard per lock hold when bluestore_cache_lockless_hits is enabled"),
+
     Option("bluestore_cache_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(0)
     .set_description("Cache size (in bytes) for BlueStore")
@@ -3406,6 +3715,11 @@ std::vector<Option> get_global_options() {
     .set_default(.99)
     .set_description("Ratio of bluestore cache to devote to kv database (rocksdb)"),
 
+    Option("bluestore_cache_decompressed_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64_M)
+    .set_description("Max memory (bytes) of decompressed blob data to cache for reads that are not otherwise buffered")
+    .set_long_description("This is carved out of the data portion of the bluestore cache and split evenly between the cache shards.  Buffered reads of compressed data are cached as before and do not count against it."),
+
     Option("bluestore_cache_kv_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(512_M)
     .set_description("Max memory (bytes) to devote to kv database (rocksdb)"),
@@ -3417,8 +3731,18 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("stupid")
-    .set_enum_allowed({"bitmap", "stupid"})
-    .set_description("Allocator policy"),
+    .set_enum_allowed({"bitmap", "stupid", "extent"})
+    .set_description("Allocator policy")
+    .set_long_description("extent keeps free space in offset and size indexed trees; its fragmentation can be inspected with the 'bluestore allocator fragmentation block' admin socket command"),
+
+    Option("bluestore_alloc_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Save the allocator state at umount and load it at the next mount")
+    .set_long_description("This avoids enumerating the whole freelist when mounting after a clean shutdown.  The snapshot is removed as soon as it is loaded; if it is missing or does not match the store, the freelist is enumerated as usual."),
+
+    Option("bluestore_alloc_snapshot_chunk_extents", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(65536)
+    .set_description("Number of free extents stored per allocator snapshot key"),
 
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(128)
@@ -3468,6 +3792,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_submit_lanes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of threads submitting metadata transactions to rocksdb in parallel")
+    .set_long_description("Each sequencer is bound to one lane, so per-sequencer ordering is preserved.  The kv_sync_thread still performs the final synchronous commit for all lanes.  0 means transactions are submitted by the kv_sync_thread itself."),
+
     Option("bluestore_throttle_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_safe()
@@ -3560,6 +3889,10 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("bluestore_debug_inject_csum_err_probability", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(0.0)
+    .set_description("inject crc verification errors into bluestore device reads"),
+
     Option("bluestore_debug_randomize_serial_transaction", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(0)
     .set_description(""),
@@ -0,0 +1,84 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_COMMON_SHARDED_SHARED_MUTEX_H
+#define CEPH_COMMON_SHARDED_SHARED_MUTEX_H
+
+#include <memory>
+#include <thread>
+#include <boost/thread/shared_mutex.hpp>
+
+#include "include/hash.h"
+
+namespace ceph {
+// A shared mutex for state that is read by many threads at once and
+// rarely written.  Every acquisition of a plain shared_mutex, shared or
+// not, writes the same lock word, so with enough readers they spend
+// their time bouncing its cache line between cores.  Here each reader
+// takes the shared lock of one of several shards, picked by thread; a
+// writer takes all of them, in order, which makes writes that much
+// more expensive.
+//
+// It is Lockable and SharedLockable, and goes with unique_lock,
+// shared_lock and shunique_lock.  As the shard is picked by the
+// calling thread, a shared lock must be released by the thread that
+// took it.
+class sharded_shared_mutex {
+  struct shard_t {
+    boost::shared_mutex lock;
+    // keep the shards' lock words apart
+    char pad[64];
+  };
+
+  const unsigned num_shards;
+  std::unique_ptr<shard_t[]> shards;
+
+  shard_t& my_shard() {
+    static thread_local uint64_t h =
+      rjhash64(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return shards[h % num_shards];
+  }
+
+public:
+  explicit sharded_shared_mutex(unsigned n = 1)
+    : num_shards(n ? n : 1),
+      shards(new shard_t[num_shards]) {}
+  sharded_shared_mutex(const sharded_shared_mutex&) = delete;
+  sharded_shared_mutex& operator=(const sharded_shared_mutex&) = delete;
+
+  unsigned get_num_shards() const {
+    return num_shards;
+  }
+
+  void lock() {
+    for (unsigned i = 0; i < num_shards; ++i)
+      shards[i].lock.lock();
+  }
+  bool try_lock() {
+    for (unsigned i = 0; i < num_shards; ++i) {
+      if (!shards[i].lock.try_lock()) {
+	while (i-- > 0)
+	  shards[i].lock.unlock();
+	return false;
+      }
+    }
+    return true;
+  }
+  void unlock() {
+    for (unsigned i = num_shards; i > 0; --i)
+      shards[i - 1].lock.unlock();
+  }
+
+  void lock_shared() {
+    my_shard().lock.lock_shared();
+  }
+  bool try_lock_shared() {
+    return my_shard().lock.try_lock_shared();
+  }
+  void unlock_shared() {
+    my_shard().lock.unlock_shared();
+  }
+};
+} // namespace ceph
+
+#endif // CEPH_COMMON_SHARDED_SHARED_MUTEX_H
@@ -17,6 +17,7 @@
 
 #include <map>
 #include <list>
+#include <functional>
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "include/unordered_map.h"
@@ -32,15 +33,24 @@ class SharedLRU {
   Mutex lock;
   size_t max_size;
   Cond cond;
-  unsigned size;
+  size_t size;   ///< sum of the costs of the entries in the lru
 public:
   int waiting;
+  /// cost of an entry against max_size; every entry costs 1 if unset
+  typedef std::function<size_t(const V&)> cost_func_t;
 private:
-  ceph::unordered_map<K, typename list<pair<K, VPtr> >::iterator, H> contents;
+  typedef typename list<pair<K, VPtr> >::iterator lru_iter;
+  // lru position and the cost the entry was charged
+  ceph::unordered_map<K, pair<lru_iter, size_t>, H> contents;
   list<pair<K, VPtr> > lru;
+  cost_func_t cost_func;
 
   map<K, pair<WeakVPtr, V*>, C> weak_refs;
 
+  size_t get_cost(const V& v) const {
+    return cost_func ? cost_func(v) : 1;
+  }
+
   void trim_cache(list<VPtr> *to_release) {
     while (size > max_size) {
       to_release->push_back(lru.back().second);
@@ -49,26 +59,38 @@ private:
   }
 
   void lru_remove(const K& key) {
-    typename ceph::unordered_map<K, typename list<pair<K, VPtr> >::iterator, H>::iterator i = 
+    typename ceph::unordered_map<K, pair<lru_iter, size_t>, H>::iterator i =
       contents.find(key);
     if (i == contents.end())
       return;
-    lru.erase(i->second);
-    --size;
+    lru.erase(i->second.first);
+    size -= i->second.second;
     contents.erase(i);
   }
 
+  // charge the entry for what it costs now; values may grow after
+  // they are inserted
+  void lru_recost(pair<lru_iter, size_t> *entry) {
+    if (!cost_func)
+      return;
+    size_t cost = get_cost(*entry->first->second);
+    size = size - entry->second + cost;
+    entry->second = cost;
+  }
+
   void lru_add(const K& key, const VPtr& val, list<VPtr> *to_release) {
-    typename ceph::unordered_map<K, typename list<pair<K, VPtr> >::iterator, H>::iterator i =
+    typename ceph::unordered_map<K, pair<lru_iter, size_t>, H>::iterator i =
       contents.find(key);
     if (i != contents.end()) {
-      lru.splice(lru.begin(), lru, i->second);
+      lru.splice(lru.begin(), lru, i->second.first);
+      lru_recost(&i->second);
     } else {
-      ++size;
+      size_t cost = get_cost(*val);
+      size += cost;
       lru.push_front(make_pair(key, val));
-      contents[key] = lru.begin();
-      trim_cache(to_release);
+      contents[key] = make_pair(lru.begin(), cost);
     }
+    trim_cache(to_release);
   }
 
   void remove(const K& key, V *valptr) {
@@ -195,6 +217,33 @@ public:
     }
   }
 
+  /// charge entries by cost_func rather than by count; set before use
+  void set_cost_func(const cost_func_t& f) {
+    Mutex::Locker l(lock);
+    assert(lru.empty());
+    cost_func = f;
+  }
+
+  /// total cost of the entries held by the lru
+  size_t get_size() {
+    Mutex::Locker l(lock);
+    return size;
+  }
+
+  /// re-evaluate the cost of key after its value was changed in place
+  void update_cost(const K& key) {
+    list<VPtr> to_release;
+    {
+      Mutex::Locker l(lock);
+      typename ceph::unordered_map<K, pair<lru_iter, size_t>, H>::iterator i =
+	contents.find(key);
+      if (i == contents.end())
+	return;
+      lru_recost(&i->second);
+      trim_cache(&to_release);
+    }
+  }
+
   // Returns K key s.t. key <= k for all currently cached k,v
   K cached_key_lower_bound() {
     Mutex::Locker l(lock);
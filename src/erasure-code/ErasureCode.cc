@@ -179,6 +179,42 @@ int ErasureCode::encode_chunks(const set<int> &want_to_encode,
 {
   assert("ErasureCode::encode_chunks not implemented" == 0);
 }
+
+int ErasureCode::encode_delta(const map<int, bufferlist> &data_deltas,
+                              map<int, bufferlist> *coding_deltas)
+{
+  // the code is linear, so encoding the deltas with every unchanged
+  // data chunk set to zero yields the coding chunk deltas
+  if (data_deltas.empty())
+    return -EINVAL;
+  unsigned int k = get_data_chunk_count();
+  unsigned int m = get_chunk_count() - k;
+  unsigned blocksize = data_deltas.begin()->second.length();
+  bufferlist in;
+  for (unsigned int i = 0; i < k; i++) {
+    map<int, bufferlist>::const_iterator delta =
+      data_deltas.find(chunk_index(i));
+    if (delta == data_deltas.end()) {
+      in.append_zero(blocksize);
+    } else {
+      if (delta->second.length() != blocksize)
+        return -EINVAL;
+      in.append(delta->second);
+    }
+  }
+  if (get_chunk_size(in.length()) != blocksize)
+    return -EINVAL;
+  set<int> want;
+  for (unsigned int i = k; i < k + m; i++)
+    want.insert(chunk_index(i));
+  map<int, bufferlist> encoded;
+  int r = encode(want, in, &encoded);
+  if (r)
+    return r;
+  for (set<int>::iterator i = want.begin(); i != want.end(); ++i)
+    (*coding_deltas)[*i].claim(encoded[*i]);
+  return 0;
+}
  
 int ErasureCode::decode(const set<int> &want_to_read,
                         const map<int, bufferlist> &chunks,
@@ -74,6 +74,9 @@ namespace ceph {
     int encode_chunks(const std::set<int> &want_to_encode,
                               std::map<int, bufferlist> *encoded) override;
 
+    int encode_delta(const std::map<int, bufferlist> &data_deltas,
+                     std::map<int, bufferlist> *coding_deltas) override;
+
     int decode(const std::set<int> &want_to_read,
                        const std::map<int, bufferlist> &chunks,
                        std::map<int, bufferlist> *decoded) override;
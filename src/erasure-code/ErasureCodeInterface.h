@@ -358,6 +358,33 @@ namespace ceph {
     virtual int encode_chunks(const std::set<int> &want_to_encode,
                               std::map<int, bufferlist> *encoded) = 0;
 
+    /**
+     * Compute how the coding chunks change when some data chunks
+     * change, without the content of the unchanged data chunks.
+     *
+     * Each entry of **data_deltas** maps a data chunk index to the
+     * XOR of its old and new content. Data chunks that are not listed
+     * are unchanged. On success, **coding_deltas** maps every coding
+     * chunk index to a buffer that, XORed into the old coding chunk,
+     * gives the new one.
+     *
+     * All buffers in **data_deltas** must have the same length, which
+     * must be a chunk size as returned by **get_chunk_size**.
+     *
+     * This lets a small overwrite read and rewrite only the changed
+     * data chunks and the coding chunks instead of the whole stripe.
+     * It is only valid for codes that are linear, which all the
+     * plugins shipped with Ceph are.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] data_deltas map data chunk index to (old ^ new)
+     * @param [out] coding_deltas map coding chunk index to its delta
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_delta(const std::map<int, bufferlist> &data_deltas,
+                             std::map<int, bufferlist> *coding_deltas) = 0;
+
     /**
      * Decode the **chunks** and store at least **want_to_read**
      * chunks in **decoded**.
@@ -17,6 +17,18 @@ extern ceph_crc32c_func_t ceph_crc32c_func;
 
 extern ceph_crc32c_func_t ceph_choose_crc32(void);
 
+typedef void (*ceph_crc32c_multi_func_t)(uint32_t crc,
+					 unsigned char const * const *buffers,
+					 unsigned length, unsigned n,
+					 uint32_t *out);
+
+/*
+ * chosen implementation of ceph_crc32c_multi()
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void);
+
 /**
  * calculate crc32c for data that is entirely 0 (ZERO)
  *
@@ -50,6 +62,27 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * calculate crc32c for several buffers of the same length
+ *
+ * out[i] is the same as ceph_crc32c(crc, buffers[i], length), but the
+ * buffers may be processed as interleaved streams, which is faster
+ * than one call per buffer for short (e.g., checksum chunk sized)
+ * buffers.  The buffers must not be NULL.
+ *
+ * @param crc initial value
+ * @param buffers array of n data pointers
+ * @param length length of each buffer
+ * @param n number of buffers
+ * @param out array of n results
+ */
+static inline void ceph_crc32c_multi(uint32_t crc,
+				     unsigned char const * const *buffers,
+				     unsigned length, unsigned n, uint32_t *out)
+{
+  ceph_crc32c_multi_func(crc, buffers, length, n, out);
+}
+
 #ifdef __cplusplus
 }
 #endif
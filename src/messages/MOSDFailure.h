@@ -29,6 +29,7 @@ class MOSDFailure : public PaxosServiceMessage {
     FLAG_ALIVE = 0,      // use this on its own to mark as "I'm still alive"
     FLAG_FAILED = 1,     // if set, failure; if not, recovery
     FLAG_IMMEDIATE = 2,  // known failure, not a timeout
+    FLAG_AGGREGATED = 4, // from the heartbeat aggregator of the target
   };
   
   uuid_d fsid;
@@ -60,6 +61,9 @@ public:
   bool is_immediate() const { 
     return flags & FLAG_IMMEDIATE; 
   }
+  bool is_aggregated() const {
+    return flags & FLAG_AGGREGATED;
+  }
   epoch_t get_epoch() const { return epoch; }
 
   void decode_payload() override {
@@ -86,6 +90,7 @@ public:
     out << "osd_failure("
 	<< (if_osd_failed() ? "failed " : "recovered ")
 	<< (is_immediate() ? "immediate " : "timeout ")
+	<< (is_aggregated() ? "aggregated " : "")
 	<< target_osd << " for " << failed_for << "sec e" << epoch
 	<< " v" << version << ")";
   }
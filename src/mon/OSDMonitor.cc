@@ -1908,9 +1908,11 @@ bool OSDMonitor::check_failure(utime_t now, int target_osd, failure_info_t& fi)
   // help us localize the grace correction to a subset of the system
   // (say, a rack with a bad switch) that is unhappy.
   assert(fi.reporters.size());
+  bool aggregated = false;
   for (map<int,failure_reporter_t>::iterator p = fi.reporters.begin();
 	p != fi.reporters.end();
 	++p) {
+    aggregated |= p->second.aggregated;
     // get the parent bucket whose type matches with "reporter_subtree_level".
     // fall back to OSD if the level doesn't exist.
     map<string, string> reporter_loc = osdmap.crush->get_full_location(p->first);
@@ -1939,6 +1941,19 @@ bool OSDMonitor::check_failure(utime_t now, int target_osd, failure_info_t& fi)
 	   << " + " << peer_grace << "), max_failed_since " << max_failed_since
 	   << dendl;
 
+  if (failed_for >= grace && aggregated) {
+    // nobody outside the target's heartbeat domain pings it
+    dout(1) << " heartbeat aggregator reported osd." << target_osd
+	    << " down" << dendl;
+    pending_inc.new_state[target_osd] = CEPH_OSD_UP;
+
+    mon->clog->info() << "osd." << target_osd << " failed ("
+		      << osdmap.crush->get_full_location_ordered_string(
+			target_osd)
+		      << ") (reported by its heartbeat aggregator after "
+		      << failed_for << " >= grace " << grace << ")";
+    return true;
+  }
   if (failed_for >= grace &&
       (int)reporters_by_subtree.size() >= g_conf->mon_osd_min_down_reporters) {
     dout(1) << " we have enough reporters to mark osd." << target_osd
@@ -1958,6 +1973,16 @@ bool OSDMonitor::check_failure(utime_t now, int target_osd, failure_info_t& fi)
   return false;
 }
 
+bool OSDMonitor::is_heartbeat_aggregator(int reporter, int target_osd)
+{
+  if (g_conf->osd_heartbeat_topology != "hierarchical" ||
+      reporter == target_osd) {
+    return false;
+  }
+  return osdmap.get_heartbeat_aggregator(
+    g_conf->osd_heartbeat_aggregate_level, target_osd) == reporter;
+}
+
 void OSDMonitor::force_failure(int target_osd, int by)
 {
   // already pending failure?
@@ -2005,8 +2030,18 @@ bool OSDMonitor::prepare_failure(MonOpRequestRef op)
     mon->clog->debug() << m->get_target() << " reported failed by "
 		      << m->get_orig_source_inst();
 
+    bool aggregated = false;
+    if (m->is_aggregated()) {
+      aggregated = is_heartbeat_aggregator(reporter, target_osd);
+      if (!aggregated) {
+	dout(5) << " osd." << reporter << " is not the heartbeat aggregator"
+		<< " of osd." << target_osd << ", counting as a peer report"
+		<< dendl;
+      }
+    }
     failure_info_t& fi = failure_info[target_osd];
-    MonOpRequestRef old_op = fi.add_report(reporter, failed_since, op);
+    MonOpRequestRef old_op = fi.add_report(reporter, failed_since, op,
+					   aggregated);
     if (old_op) {
       mon->no_reply(old_op);
     }
@@ -3877,7 +3912,8 @@ namespace {
     RECOVERY_PRIORITY, RECOVERY_OP_PRIORITY, SCRUB_PRIORITY,
     COMPRESSION_MODE, COMPRESSION_ALGORITHM, COMPRESSION_REQUIRED_RATIO,
     COMPRESSION_MAX_BLOB_SIZE, COMPRESSION_MIN_BLOB_SIZE,
-    CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK };
+    CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK,
+    QOS_RES, QOS_WGT, QOS_LIM };
 
   std::set<osd_pool_get_choices>
     subtract_second_from_first(const std::set<osd_pool_get_choices>& first,
@@ -4498,6 +4534,9 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
       {"csum_type", CSUM_TYPE},
       {"csum_max_block", CSUM_MAX_BLOCK},
       {"csum_min_block", CSUM_MIN_BLOCK},
+      {"qos_res", QOS_RES},
+      {"qos_wgt", QOS_WGT},
+      {"qos_lim", QOS_LIM},
     };
 
     typedef std::set<osd_pool_get_choices> choices_set_t;
@@ -4704,6 +4743,9 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
 	  case CSUM_TYPE:
 	  case CSUM_MAX_BLOCK:
 	  case CSUM_MIN_BLOCK:
+	  case QOS_RES:
+	  case QOS_WGT:
+	  case QOS_LIM:
             pool_opts_t::key_t key = pool_opts_t::get_opt_desc(i->first).key;
             if (p->opts.is_set(key)) {
               f->open_object_section("pool");
@@ -4862,6 +4904,9 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
 	  case CSUM_TYPE:
 	  case CSUM_MAX_BLOCK:
 	  case CSUM_MIN_BLOCK:
+	  case QOS_RES:
+	  case QOS_WGT:
+	  case QOS_LIM:
 	    for (i = ALL_CHOICES.begin(); i != ALL_CHOICES.end(); ++i) {
 	      if (i->second == *it)
 		break;
@@ -6414,6 +6459,17 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       //preserve csum_type numeric value
       n = t;
       interr.clear(); 
+    } else if (var == "qos_res" ||
+               var == "qos_wgt" ||
+               var == "qos_lim") {
+      if (floaterr.length()) {
+        ss << "error parsing float value '" << val << "': " << floaterr;
+        return -EINVAL;
+      }
+      if (f < 0 || (var != "qos_wgt" && f > 1)) {
+        ss << var << " is out of range: '" << val << "'";
+        return -EINVAL;
+      }
     } else if (var == "compression_max_blob_size" ||
                var == "compression_min_blob_size" ||
                var == "csum_max_block" ||
@@ -49,6 +49,7 @@ class MOSDMap;
 struct failure_reporter_t {
   utime_t failed_since;     ///< when they think it failed
   MonOpRequestRef op;       ///< failure op request
+  bool aggregated = false;  ///< reporter aggregates heartbeats for the target
 
   failure_reporter_t() {}
   explicit failure_reporter_t(utime_t s) : failed_since(s) {}
@@ -77,13 +78,14 @@ struct failure_info_t {
   // set the message for the latest report.  return any old op request we had,
   // if any, so we can discard it.
   MonOpRequestRef add_report(int who, utime_t failed_since,
-			     MonOpRequestRef op) {
+			     MonOpRequestRef op, bool aggregated = false) {
     map<int, failure_reporter_t>::iterator p = reporters.find(who);
     if (p == reporters.end()) {
       if (max_failed_since < failed_since)
 	max_failed_since = failed_since;
       p = reporters.insert(map<int, failure_reporter_t>::value_type(who, failure_reporter_t(failed_since))).first;
     }
+    p->second.aggregated = aggregated;
 
     MonOpRequestRef ret = p->second.op;
     p->second.op = op;
@@ -148,6 +150,7 @@ public:
   bool check_failures(utime_t now);
   bool check_failure(utime_t now, int target_osd, failure_info_t& fi);
   void force_failure(int target_osd, int by);
+  bool is_heartbeat_aggregator(int reporter, int target_osd);
 
   // the time of last msg(MSG_ALIVE and MSG_PGTEMP) proposed without delay
   utime_t last_attempted_minwait_time;
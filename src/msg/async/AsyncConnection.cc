@@ -124,6 +124,10 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
     logger(w->get_perf_counter()), global_seq(0), connect_seq(0), peer_global_seq(0),
     state(STATE_NONE), state_after_send(STATE_NONE), port(-1),
     dispatch_queue(q), can_write(WriteStatus::NOWRITE),
+    lockless_send(cct->_conf->ms_async_lockless_send),
+    coalesce_max_messages(cct->_conf->ms_async_coalesce_max_messages),
+    coalesce_max_bytes(cct->_conf->ms_async_coalesce_max_bytes),
+    coalesce_delay_us(cct->_conf->ms_async_coalesce_delay_us),
     keepalive(false), recv_buf(NULL),
     recv_max_prefetch(MAX(msgr->cct->_conf->ms_tcp_prefetch_max_size, TCP_PREFETCH_MIN_SIZE)),
     recv_start(0), recv_end(0),
@@ -146,6 +150,14 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
 
 AsyncConnection::~AsyncConnection()
 {
+  // a sender may have raced with the connection being closed
+  send_item_t *i = send_inbox.exchange(nullptr);
+  while (i) {
+    send_item_t *next = i->next;
+    i->m->put();
+    delete i;
+    i = next;
+  }
   assert(out_q.empty());
   assert(sent.empty());
   delete authorizer;
@@ -1941,6 +1953,26 @@ int AsyncConnection::send_message(Message *m)
   if (can_fast_prepare)
     prepare_send_message(f, m, bl);
 
+  if (lockless_send) {
+    if (can_write == WriteStatus::CLOSED) {
+      ldout(async_msgr->cct, 10) << __func__ << " connection closed."
+				 << " Drop message " << m << dendl;
+      m->put();
+      return 0;
+    }
+    m->trace.event("async enqueueing message");
+    logger->inc(l_msgr_send_inbox);
+    // only the first sender after a drain needs to wake the event
+    // thread; the write handler takes everything queued by then
+    if (push_send_inbox(new send_item_t(m, bl, f)) &&
+	can_write != WriteStatus::REPLACING) {
+      ldout(async_msgr->cct, 15) << __func__ << " queued m=" << m
+				 << ", waking event thread" << dendl;
+      center->dispatch_event_external(write_handler);
+    }
+    return 0;
+  }
+
   std::lock_guard<std::mutex> l(write_lock);
   // "features" changes will change the payload encoding
   if (can_fast_prepare && (can_write == WriteStatus::NOWRITE || get_features() != f)) {
@@ -1964,6 +1996,44 @@ int AsyncConnection::send_message(Message *m)
   return 0;
 }
 
+/*
+ * Moves what senders pushed onto send_inbox to out_q, oldest first.
+ * Must hold write_lock prior to calling.
+ */
+void AsyncConnection::_drain_send_inbox()
+{
+  send_item_t *head = send_inbox.exchange(nullptr, std::memory_order_acquire);
+  send_item_t *items = nullptr;
+  while (head) {
+    send_item_t *next = head->next;
+    head->next = items;
+    items = head;
+    head = next;
+  }
+  while (items) {
+    send_item_t *i = items;
+    items = i->next;
+    Message *m = i->m;
+    if (can_write == WriteStatus::CLOSED) {
+      ldout(async_msgr->cct, 10) << __func__ << " connection closed."
+				 << " Drop message " << m << dendl;
+      m->put();
+    } else {
+      // "features" changes will change the payload encoding
+      if (i->bl.length() &&
+	  (can_write == WriteStatus::NOWRITE || get_features() != i->features)) {
+	i->bl.clear();
+	m->get_payload().clear();
+	ldout(async_msgr->cct, 5) << __func__ << " clear encoded buffer previous "
+				  << i->features << " != " << get_features()
+				  << dendl;
+      }
+      out_q[m->get_priority()].emplace_back(std::move(i->bl), m);
+    }
+    delete i;
+  }
+}
+
 void AsyncConnection::requeue_sent()
 {
   if (sent.empty())
@@ -2009,6 +2079,8 @@ void AsyncConnection::discard_out_queue()
 {
   ldout(async_msgr->cct, 10) << __func__ << " started" << dendl;
 
+  _drain_send_inbox();
+
   for (list<Message*>::iterator p = sent.begin(); p != sent.end(); ++p) {
     ldout(async_msgr->cct, 20) << __func__ << " discard " << *p << dendl;
     (*p)->put();
@@ -2183,20 +2255,85 @@ void AsyncConnection::prepare_send_message(uint64_t features, Message *m, buffer
     ldout(async_msgr->cct, 20) << __func__ << " half-reencoding features "
                                << features << " " << m << " " << *m << dendl;
 
-  // encode and copy out of *m
-  m->encode(features, msgr->crcflags);
+  // encode and copy out of *m; the segment crcs are computed below while
+  // the frame is assembled, and the header crc once the seq is known
+  m->encode(features, 0);
+
+  // the frame is the tag and header, the segments and the footer.  the
+  // header and footer only get filled in by write_message(), but their
+  // room is reserved here so the whole frame goes to the socket as is.
+  ceph_msg_footer& footer = m->get_footer();
+  const bufferlist *segments[3] = {
+    &m->get_payload(), &m->get_middle(), &m->get_data() };
+  bool want_crc[3] = {
+    !!(msgr->crcflags & MSG_CRC_HEADER), !!(msgr->crcflags & MSG_CRC_HEADER),
+    !!(msgr->crcflags & MSG_CRC_DATA) };
+  uint32_t crcs[3] = { 0, 0, 0 };
+  unsigned header_len = get_frame_header_len(features);
+  unsigned footer_len = get_frame_footer_len(features);
+  unsigned len = 0;
+  for (auto seg : segments)
+    len += seg->length();
+
+  if (len <= ASYNC_COALESCE_THRESHOLD) {
+    // small messages are sent as a single buffer; checksum each segment
+    // as it is copied in rather than in a pass of its own
+    bufferptr bp = buffer::create(header_len + len + footer_len);
+    char *p = bp.c_str() + header_len;
+    for (unsigned i = 0; i < 3; ++i) {
+      for (const auto& pb : segments[i]->buffers()) {
+        if (!pb.length())
+          continue;
+        memcpy(p, pb.c_str(), pb.length());
+        if (want_crc[i])
+          crcs[i] = ceph_crc32c(crcs[i], (unsigned char*)p, pb.length());
+        p += pb.length();
+      }
+    }
+    bl.append(std::move(bp));
+  } else {
+    // the header and footer share an allocation; the segments are
+    // referenced, and their crcs come from the buffers' crc cache when
+    // the same data was sent before
+    bufferptr bp = buffer::create(header_len + footer_len);
+    bl.append(bufferptr(bp, 0, header_len));
+    for (unsigned i = 0; i < 3; ++i) {
+      if (want_crc[i])
+        crcs[i] = segments[i]->crc32c(0);
+      bl.append(*segments[i]);
+    }
+    bl.append(bufferptr(bp, header_len, footer_len));
+  }
 
-  bl.append(m->get_payload());
-  bl.append(m->get_middle());
-  bl.append(m->get_data());
+  if (want_crc[0]) {
+    footer.front_crc = crcs[0];
+    footer.middle_crc = crcs[1];
+  }
+  // encode() without crcflags marked the data as unchecksummed; it is
+  // if we were asked to, and the receiver must check it
+  footer.flags = CEPH_MSG_FOOTER_COMPLETE;
+  if (want_crc[2])
+    footer.data_crc = crcs[2];
+  else
+    footer.flags = (unsigned)footer.flags | CEPH_MSG_FOOTER_NOCRC;
 }
 
-ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
+ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more,
+				       bool flush)
 {
   FUNCTRACE();
   assert(center->in_thread());
   m->set_seq(++out_seq);
 
+  if (bl.length() != get_frame_header_len(get_features()) +
+      m->get_payload().length() + m->get_middle().length() +
+      m->get_data().length() + get_frame_footer_len(get_features())) {
+    // framed for features the connection no longer has
+    ldout(async_msgr->cct, 5) << __func__ << " reframing " << m << dendl;
+    bl.clear();
+    prepare_send_message(get_features(), m, bl);
+  }
+
   if (msgr->crcflags & MSG_CRC_HEADER)
     m->calc_header_crc();
 
@@ -2222,11 +2359,13 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
   }
   
   unsigned original_bl_len = outcoming_bl.length();
+  unsigned footer_len = get_frame_footer_len(get_features());
 
-  outcoming_bl.append(CEPH_MSGR_TAG_MSG);
+  char tag = CEPH_MSGR_TAG_MSG;
+  bl.copy_in(0, 1, &tag);
 
   if (has_feature(CEPH_FEATURE_NOSRCADDR)) {
-    outcoming_bl.append((char*)&header, sizeof(header));
+    bl.copy_in(1, sizeof(header), (char*)&header);
   } else {
     ceph_msg_header_old oldheader;
     memcpy(&oldheader, &header, sizeof(header));
@@ -2236,7 +2375,7 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
     oldheader.reserved = header.reserved;
     oldheader.crc = ceph_crc32c(0, (unsigned char*)&oldheader,
                                 sizeof(oldheader) - sizeof(oldheader.crc));
-    outcoming_bl.append((char*)&oldheader, sizeof(oldheader));
+    bl.copy_in(1, sizeof(oldheader), (char*)&oldheader);
   }
 
   ldout(async_msgr->cct, 20) << __func__ << " sending message type=" << header.type
@@ -2245,19 +2384,11 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
                              << " data=" << header.data_len
                              << " off " << header.data_off << dendl;
 
-  if ((bl.length() <= ASYNC_COALESCE_THRESHOLD) && (bl.buffers().size() > 1)) {
-    for (const auto &pb : bl.buffers()) {
-      outcoming_bl.append((char*)pb.c_str(), pb.length());
-    }
-  } else {
-    outcoming_bl.claim_append(bl);  
-  }
-
   // send footer; if receiver doesn't support signatures, use the old footer format
-  ceph_msg_footer_old old_footer;
   if (has_feature(CEPH_FEATURE_MSG_AUTH)) {
-    outcoming_bl.append((char*)&footer, sizeof(footer));
+    bl.copy_in(bl.length() - footer_len, footer_len, (char*)&footer);
   } else {
+    ceph_msg_footer_old old_footer;
     if (msgr->crcflags & MSG_CRC_HEADER) {
       old_footer.front_crc = footer.front_crc;
       old_footer.middle_crc = footer.middle_crc;
@@ -2267,23 +2398,30 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
     }
     old_footer.data_crc = msgr->crcflags & MSG_CRC_DATA ? footer.data_crc : 0;
     old_footer.flags = footer.flags;
-    outcoming_bl.append((char*)&old_footer, sizeof(old_footer));
+    bl.copy_in(bl.length() - footer_len, footer_len, (char*)&old_footer);
   }
+  outcoming_bl.claim_append(bl);
 
   m->trace.event("async writing message");
   ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
                              << " " << m << dendl;
   ssize_t total_send_size = outcoming_bl.length();
-  ssize_t rc = _try_send(more);
+  ssize_t rc = 0;
+  if (flush)
+    rc = _try_send(more);
   if (rc < 0) {
     ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
                               << cpp_strerror(rc) << dendl;
-  } else if (rc == 0) {
-    logger->inc(l_msgr_send_bytes, total_send_size - original_bl_len);
-    ldout(async_msgr->cct, 10) << __func__ << " sending " << m << " done." << dendl;
   } else {
-    logger->inc(l_msgr_send_bytes, total_send_size - outcoming_bl.length());
-    ldout(async_msgr->cct, 10) << __func__ << " sending " << m << " continuely." << dendl;
+    // the frame is on the wire or right behind what is; the rest of
+    // outcoming_bl goes out as the socket drains
+    logger->inc(l_msgr_send_bytes, total_send_size - original_bl_len);
+    if (!flush)
+      ldout(async_msgr->cct, 10) << __func__ << " queued " << m << dendl;
+    else if (rc == 0)
+      ldout(async_msgr->cct, 10) << __func__ << " sending " << m << " done." << dendl;
+    else
+      ldout(async_msgr->cct, 10) << __func__ << " sending " << m << " continuely." << dendl;
   }
   if (m->get_type() == CEPH_MSG_OSD_OP)
     OID_EVENT_TRACE_WITH_MSG(m, "SEND_MSG_OSD_OP_END", false);
@@ -2447,7 +2585,12 @@ void AsyncConnection::handle_write()
     }
 
     auto start = ceph::mono_clock::now();
+    if (_defer_write(start)) {
+      write_lock.unlock();
+      return;
+    }
     bool more;
+    unsigned batched = 0;
     do {
       bufferlist data;
       Message *m = _get_next_outgoing(&data);
@@ -2466,16 +2609,30 @@ void AsyncConnection::handle_write()
       if (!data.length())
         prepare_send_message(get_features(), m, data);
 
-      r = write_message(m, data, more);
+      // pack what is queued into one send, within the limits
+      ++batched;
+      bool flush = !more || batched >= coalesce_max_messages ||
+	outcoming_bl.length() + data.length() >= coalesce_max_bytes;
+      r = write_message(m, data, more, flush);
       if (r < 0) {
         ldout(async_msgr->cct, 1) << __func__ << " send msg failed" << dendl;
         goto fail;
       }
+      if (flush) {
+	logger->inc(l_msgr_send_coalesced, batched);
+	last_flush = start;
+	batched = 0;
+      }
       write_lock.lock();
       if (r > 0)
         break;
     } while (can_write == WriteStatus::CANWRITE);
     write_lock.unlock();
+    if (batched) {
+      // stopped early; whatever was packed goes out below
+      logger->inc(l_msgr_send_coalesced, batched);
+      last_flush = start;
+    }
 
     uint64_t left = ack_left;
     if (left) {
@@ -2525,6 +2682,40 @@ void AsyncConnection::handle_write()
   lock.unlock();
 }
 
+unsigned AsyncConnection::_get_outgoing_count()
+{
+  _drain_send_inbox();
+  unsigned n = 0;
+  for (auto& p : out_q)
+    n += p.second.size();
+  return n;
+}
+
+// Nagle, more or less: a message queued soon after the connection's
+// previous send waits for others to join it, until coalesce_delay_us
+// after that send at the latest.  An idle connection sends at once.
+bool AsyncConnection::_defer_write(ceph::mono_clock::time_point now)
+{
+  if (coalesce_timer_id) {
+    // either it fired, or we are about to send what it waited for
+    center->delete_time_event(coalesce_timer_id);
+    coalesce_timer_id = 0;
+  }
+  if (!coalesce_delay_us || keepalive || ack_left ||
+      outcoming_bl.length() || !_has_next_outgoing())
+    return false;
+  auto due = last_flush + std::chrono::microseconds(coalesce_delay_us);
+  if (now >= due || _get_outgoing_count() >= coalesce_max_messages)
+    return false;
+
+  uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+    due - now).count();
+  ldout(async_msgr->cct, 20) << __func__ << " for " << us << "us" << dendl;
+  coalesce_timer_id = center->create_time_event(us, write_handler);
+  logger->inc(l_msgr_send_deferred);
+  return true;
+}
+
 void AsyncConnection::wakeup_from(uint64_t id)
 {
   lock.lock();
@@ -60,6 +60,15 @@ class AsyncConnection : public Connection {
   ssize_t _try_send(bool more=false);
   ssize_t _send(Message *m);
   void prepare_send_message(uint64_t features, Message *m, bufferlist &bl);
+  // bytes of a message frame around the segments: tag and header, footer
+  static unsigned get_frame_header_len(uint64_t features) {
+    return 1 + ((features & CEPH_FEATURE_NOSRCADDR) ?
+		sizeof(ceph_msg_header) : sizeof(ceph_msg_header_old));
+  }
+  static unsigned get_frame_footer_len(uint64_t features) {
+    return (features & CEPH_FEATURE_MSG_AUTH) ?
+      sizeof(ceph_msg_footer) : sizeof(ceph_msg_footer_old);
+  }
   ssize_t read_until(unsigned needed, char *p);
   ssize_t _process_connection();
   void _connect();
@@ -74,7 +83,7 @@ class AsyncConnection : public Connection {
   int randomize_out_seq();
   void handle_ack(uint64_t seq);
   void _append_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
-  ssize_t write_message(Message *m, bufferlist& bl, bool more);
+  ssize_t write_message(Message *m, bufferlist& bl, bool more, bool flush);
   void inject_delay();
   ssize_t _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
                     bufferlist &authorizer_reply) {
@@ -96,12 +105,17 @@ class AsyncConnection : public Connection {
     return 0;
   }
   bool is_queued() const {
-    return !out_q.empty() || outcoming_bl.length();
+    return !out_q.empty() || outcoming_bl.length() ||
+      send_inbox.load(std::memory_order_relaxed);
   }
   void shutdown_socket() {
     for (auto &&t : register_time_events)
       center->delete_time_event(t);
     register_time_events.clear();
+    if (coalesce_timer_id) {
+      center->delete_time_event(coalesce_timer_id);
+      coalesce_timer_id = 0;
+    }
     if (last_tick_id) {
       center->delete_time_event(last_tick_id);
       last_tick_id = 0;
@@ -114,6 +128,7 @@ class AsyncConnection : public Connection {
   }
   Message *_get_next_outgoing(bufferlist *bl) {
     Message *m = 0;
+    _drain_send_inbox();
     while (!m && !out_q.empty()) {
       map<int, list<pair<bufferlist, Message*> > >::reverse_iterator it = out_q.rbegin();
       if (!it->second.empty()) {
@@ -129,8 +144,10 @@ class AsyncConnection : public Connection {
     return m;
   }
   bool _has_next_outgoing() const {
-    return !out_q.empty();
+    return !out_q.empty() || send_inbox.load(std::memory_order_relaxed);
   }
+  unsigned _get_outgoing_count();
+  bool _defer_write(ceph::mono_clock::time_point now);
   void reset_recv_state();
 
    /**
@@ -318,6 +335,42 @@ class AsyncConnection : public Connection {
   std::atomic<WriteStatus> can_write;
   list<Message*> sent; // the first bufferlist need to inject seq
   map<int, list<pair<bufferlist, Message*> > > out_q;  // priority queue for outbound msgs
+
+  // with ms_async_lockless_send, senders push onto send_inbox (a
+  // lock-free stack) instead of taking write_lock; whoever next holds
+  // write_lock moves the items to out_q.
+  struct send_item_t {
+    Message *m;
+    bufferlist bl;        ///< prepared payload, may be empty
+    uint64_t features;    ///< bl was encoded for these
+    send_item_t *next = nullptr;
+    send_item_t(Message *m, bufferlist& b, uint64_t f) : m(m), features(f) {
+      bl.swap(b);
+    }
+  };
+  const bool lockless_send;
+  std::atomic<send_item_t*> send_inbox = {nullptr};
+  /// returns true if the inbox was empty
+  bool push_send_inbox(send_item_t *item) {
+    send_item_t *head = send_inbox.load(std::memory_order_relaxed);
+    do {
+      item->next = head;
+    } while (!send_inbox.compare_exchange_weak(head, item,
+					       std::memory_order_release,
+					       std::memory_order_relaxed));
+    return head == nullptr;
+  }
+  void _drain_send_inbox();
+
+  // queued messages are framed into outcoming_bl back to back and go to
+  // the socket together, up to these limits
+  const unsigned coalesce_max_messages;
+  const uint64_t coalesce_max_bytes;
+  // how long a message may wait for company; see _defer_write()
+  const uint64_t coalesce_delay_us;
+  ceph::mono_clock::time_point last_flush;
+  uint64_t coalesce_timer_id = 0;
+
   bool keepalive;
 
   std::mutex lock;
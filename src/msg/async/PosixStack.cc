@@ -21,6 +21,15 @@
 #include <errno.h>
 
 #include <algorithm>
+#include <list>
+#include <map>
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+#define HAVE_MSG_ZEROCOPY
+#endif
+#endif
 
 #include "PosixStack.h"
 
@@ -40,15 +49,97 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   int _fd;
   entity_addr_t sa;
   bool connected;
+  PerfCounters *logger;    ///< of the worker; null in tests
 #if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
   sigset_t sigpipe_mask;
   bool sigpipe_pending;
   bool sigpipe_unblock;
 #endif
 
+  // MSG_ZEROCOPY: the kernel numbers our zerocopy sendmsg calls from 0
+  // and later reports ranges of them as done on the socket error queue.
+  // until then the pages must not be reused, so we hold on to what we
+  // sent.
+  uint64_t zc_min_bytes;   ///< 0 if zerocopy sends are off
+  uint32_t zc_next_id = 0; ///< id of our next zerocopy sendmsg
+  uint32_t zc_done = 0;    ///< every id before this one has completed
+  std::map<uint32_t,uint32_t> zc_done_ahead;  ///< completions after a gap
+  std::list<std::pair<uint32_t,bufferlist>> zc_pending; ///< (last id, data)
+
+  void _zerocopy_done(uint32_t lo, uint32_t hi) {
+    if (lo != zc_done) {
+      zc_done_ahead[lo] = hi;
+      return;
+    }
+    zc_done = hi + 1;
+    auto p = zc_done_ahead.find(zc_done);
+    while (p != zc_done_ahead.end()) {
+      zc_done = p->second + 1;
+      zc_done_ahead.erase(p);
+      p = zc_done_ahead.find(zc_done);
+    }
+  }
+
+  void reap_zerocopy() {
+#ifdef HAVE_MSG_ZEROCOPY
+    while (true) {
+      char control[CMSG_SPACE(sizeof(struct sock_extended_err)) +
+		   CMSG_SPACE(sizeof(struct sockaddr_in6))];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (::recvmsg(_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+	break;
+      }
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+	   cm = CMSG_NXTHDR(&msg, cm)) {
+	if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+	    !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+	  continue;
+	}
+	auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+	if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+	  continue;
+	}
+	uint32_t n = serr->ee_data - serr->ee_info + 1;
+	if (logger)
+	  logger->inc(l_msgr_send_zerocopy_done, n);
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+	  // the kernel had to copy anyway (e.g., loopback); stop paying
+	  // for the notifications
+	  zc_min_bytes = 0;
+	  if (logger)
+	    logger->inc(l_msgr_send_zerocopy_copied, n);
+	}
+	_zerocopy_done(serr->ee_info, serr->ee_data);
+      }
+    }
+    while (!zc_pending.empty() &&
+	   (int32_t)(zc_pending.front().first - zc_done) < 0) {
+      zc_pending.pop_front();
+    }
+#endif
+  }
+
  public:
-  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected,
+				    PerfCounters *l = nullptr,
+				    uint64_t zerocopy_min_bytes = 0)
+      : handler(h), _fd(f), sa(sa), connected(connected), logger(l),
+	zc_min_bytes(zerocopy_min_bytes) {
+#ifdef HAVE_MSG_ZEROCOPY
+    if (zc_min_bytes && handler.set_zerocopy(_fd) < 0) {
+      zc_min_bytes = 0;
+      if (logger)
+	logger->inc(l_msgr_send_zerocopy_fallback);
+    }
+#else
+    if (zc_min_bytes && logger)
+      logger->inc(l_msgr_send_zerocopy_fallback);
+    zc_min_bytes = 0;
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -70,6 +161,10 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t read(char *buf, size_t len) override {
+    // pending completions make the socket poll as errored until we
+    // collect them
+    if (!zc_pending.empty())
+      reap_zerocopy();
     ssize_t r = ::read(_fd, buf, len);
     if (r < 0)
       r = -errno;
@@ -140,7 +235,11 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
 
   // return the sent length
   // < 0 means error occured
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  // *zc_calls counts the calls that went out with MSG_ZEROCOPY, and
+  // *zc_fallbacks the ones that wanted to but had to copy
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+			    int flags = 0, uint32_t *zc_calls = nullptr,
+			    uint32_t *zc_fallbacks = nullptr)
   {
     suppress_sigpipe();
 
@@ -148,9 +247,9 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     while (1) {
       ssize_t r;
   #if defined(MSG_NOSIGNAL)
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, flags | MSG_NOSIGNAL | (more ? MSG_MORE : 0));
   #else
-      r = ::sendmsg(fd, &msg, (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, flags | (more ? MSG_MORE : 0));
   #endif /* defined(MSG_NOSIGNAL) */
 
       if (r < 0) {
@@ -158,10 +257,21 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
           continue;
         } else if (errno == EAGAIN) {
           break;
+  #ifdef HAVE_MSG_ZEROCOPY
+        } else if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+          // out of optmem for pinning pages; just copy this time
+          flags &= ~MSG_ZEROCOPY;
+          ++*zc_fallbacks;
+          continue;
+  #endif
         }
         return -errno;
       }
 
+  #ifdef HAVE_MSG_ZEROCOPY
+      if (flags & MSG_ZEROCOPY)
+        ++*zc_calls;
+  #endif
       sent += r;
       if (len == sent) break;
 
@@ -183,6 +293,14 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t send(bufferlist &bl, bool more) override {
+    int flags = 0;
+    uint32_t zc_calls = 0, zc_fallbacks = 0;
+#ifdef HAVE_MSG_ZEROCOPY
+    if (!zc_pending.empty())
+      reap_zerocopy();
+    if (zc_min_bytes && bl.length() >= zc_min_bytes)
+      flags |= MSG_ZEROCOPY;
+#endif
     size_t sent_bytes = 0;
     std::list<bufferptr>::const_iterator pb = bl.buffers().begin();
     uint64_t left_pbrs = bl.buffers().size();
@@ -204,7 +322,8 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         size--;
       }
 
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more, flags,
+			     &zc_calls, &zc_fallbacks);
       if (r < 0)
         return r;
 
@@ -221,7 +340,19 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         bl.splice(sent_bytes, bl.length()-sent_bytes, &swapped);
         bl.swap(swapped);
       } else {
-        bl.clear();
+        swapped.swap(bl);
+      }
+      // swapped now holds what we sent
+      if (logger) {
+	if (zc_calls)
+	  logger->inc(l_msgr_send_zerocopy, zc_calls);
+	if (zc_fallbacks)
+	  logger->inc(l_msgr_send_zerocopy_fallback, zc_fallbacks);
+      }
+      if (zc_calls) {
+        zc_next_id += zc_calls;
+        zc_pending.push_back(std::make_pair(zc_next_id - 1, bufferlist()));
+        zc_pending.back().second.claim(swapped);
       }
     }
 
@@ -232,6 +363,8 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
   void close() override {
     ::close(_fd);
+    // nothing more goes out on this socket
+    zc_pending.clear();
   }
   int fd() const override {
     return _fd;
@@ -282,7 +415,9 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
   out->set_sockaddr((sockaddr*)&ss);
   handler.set_priority(sd, opt.priority, out->get_family());
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(
+    new PosixConnectedSocketImpl(handler, *out, sd, true, w->perf_logger,
+				 w->cct->_conf->ms_tcp_zerocopy_min_bytes));
   *sock = ConnectedSocket(std::move(csi));
   return 0;
 }
@@ -350,7 +485,10 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
 
   net.set_priority(sd, opts.priority, addr.get_family());
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(
+	new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock,
+				     perf_logger,
+				     cct->_conf->ms_tcp_zerocopy_min_bytes)));
   return 0;
 }
 
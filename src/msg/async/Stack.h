@@ -192,6 +192,13 @@ enum {
   l_msgr_send_bytes,
   l_msgr_created_connections,
   l_msgr_active_connections,
+  l_msgr_send_coalesced,
+  l_msgr_send_deferred,
+  l_msgr_send_zerocopy,
+  l_msgr_send_zerocopy_done,
+  l_msgr_send_zerocopy_copied,
+  l_msgr_send_zerocopy_fallback,
+  l_msgr_send_inbox,
 
   l_msgr_running_total_time,
   l_msgr_running_send_time,
@@ -232,6 +239,13 @@ class Worker {
     plb.add_u64_counter(l_msgr_send_bytes, "msgr_send_bytes", "Network sent bytes");
     plb.add_u64_counter(l_msgr_active_connections, "msgr_active_connections", "Active connection number");
     plb.add_u64_counter(l_msgr_created_connections, "msgr_created_connections", "Created connection number");
+    plb.add_u64_avg(l_msgr_send_coalesced, "msgr_send_coalesced", "Messages packed into each socket send");
+    plb.add_u64_counter(l_msgr_send_deferred, "msgr_send_deferred", "Socket sends held back to pack more messages");
+    plb.add_u64_counter(l_msgr_send_zerocopy, "msgr_send_zerocopy", "Socket sends done with MSG_ZEROCOPY");
+    plb.add_u64_counter(l_msgr_send_zerocopy_done, "msgr_send_zerocopy_done", "MSG_ZEROCOPY sends the kernel reported complete");
+    plb.add_u64_counter(l_msgr_send_zerocopy_copied, "msgr_send_zerocopy_copied", "MSG_ZEROCOPY sends the kernel copied anyway");
+    plb.add_u64_counter(l_msgr_send_zerocopy_fallback, "msgr_send_zerocopy_fallback", "Socket sends that wanted MSG_ZEROCOPY but copied");
+    plb.add_u64_counter(l_msgr_send_inbox, "msgr_send_inbox", "Messages queued through the lockless send inbox");
 
     plb.add_time(l_msgr_running_total_time, "msgr_running_total_time", "The total time of thread running");
     plb.add_time(l_msgr_running_send_time, "msgr_running_send_time", "The total time of message sending");
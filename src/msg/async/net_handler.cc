@@ -130,6 +130,21 @@ int NetHandler::set_socket_options(int sd, bool nodelay, int size)
   return -r;
 }
 
+int NetHandler::set_zerocopy(int sd)
+{
+#ifdef SO_ZEROCOPY
+  int flag = 1;
+  int r = ::setsockopt(sd, SOL_SOCKET, SO_ZEROCOPY, (void*)&flag, sizeof(flag));
+  if (r < 0) {
+    r = errno;
+    ldout(cct, 1) << "couldn't set SO_ZEROCOPY: " << cpp_strerror(r) << dendl;
+  }
+  return -r;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
 void NetHandler::set_priority(int sd, int prio, int domain)
 {
 #ifdef SO_PRIORITY
@@ -29,6 +29,8 @@ namespace ceph {
     int set_nonblock(int sd);
     void set_close_on_exec(int sd);
     int set_socket_options(int sd, bool nodelay, int size);
+    /// enable MSG_ZEROCOPY sends on sd, if the platform supports it
+    int set_zerocopy(int sd);
     int connect(const entity_addr_t &addr, const entity_addr_t& bind_addr);
     
     /**
@@ -1721,6 +1721,29 @@ public:
      return read(c->get_cid(), oid, offset, len, bl, op_flags);
    }
 
+  /**
+   * verify_checksums -- check stored data against the store's own checksums
+   *
+   * Reads the byte range from the backing device and verifies it
+   * against the checksums the store recorded when it was written,
+   * without returning the data or populating any cache.
+   *
+   * @param c collection for object
+   * @param oid oid of object
+   * @param offset location offset of first byte to be verified
+   * @param len number of bytes to be verified
+   * @returns 0 if the range verifies, -EIO on a checksum mismatch,
+   *          -EOPNOTSUPP if there are no stored checksums to verify
+   *          against, or another negative error code on failure.
+   */
+  virtual int verify_checksums(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len) {
+    return -EOPNOTSUPP;
+  }
+
   /**
    * fiemap -- get extent map of data of an object
    *
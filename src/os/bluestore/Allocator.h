@@ -12,6 +12,7 @@
 #ifndef CEPH_OS_BLUESTORE_ALLOCATOR_H
 #define CEPH_OS_BLUESTORE_ALLOCATOR_H
 
+#include <functional>
 #include <ostream>
 #include "include/assert.h"
 #include "os/bluestore/bluestore_types.h"
@@ -48,14 +49,25 @@ public:
 
   virtual void dump() = 0;
 
+  /**
+   * call notify for every free extent, in no particular order
+   *
+   * @return false if the allocator cannot enumerate its free space
+   */
+  virtual bool foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) {
+    return false;
+  }
+
   virtual void init_add_free(uint64_t offset, uint64_t length) = 0;
   virtual void init_rm_free(uint64_t offset, uint64_t length) = 0;
 
   virtual uint64_t get_free() = 0;
 
   virtual void shutdown() = 0;
+  /// @param name if set, identifies the allocator on the admin socket
   static Allocator *create(CephContext* cct, string type, int64_t size,
-			   int64_t block_size);
+			   int64_t block_size, const std::string& name = "");
 };
 
 #endif
@@ -32,6 +32,7 @@ struct IOContext {
 private:
   std::mutex lock;
   std::condition_variable cond;
+  std::atomic_int r = {0};
 
 public:
   CephContext* cct;
@@ -47,9 +48,12 @@ public:
   std::list<aio_t> running_aios;    ///< submitting or submitted
   std::atomic_int num_pending = {0};
   std::atomic_int num_running = {0};
+  /// reads may fail with EIO rather than take the process down; see
+  /// get_return_value()
+  const bool allow_eio;
 
-  explicit IOContext(CephContext* cct, void *p)
-    : cct(cct), priv(p)
+  explicit IOContext(CephContext* cct, void *p, bool allow_eio = false)
+    : cct(cct), priv(p), allow_eio(allow_eio)
     {}
 
   // no copying
@@ -62,6 +66,14 @@ public:
 
   void aio_wait();
 
+  /// 0, or the error of a failed read if allow_eio
+  int get_return_value() const {
+    return r;
+  }
+  void set_return_value(int _r) {
+    r = _r;
+  }
+
   void try_aio_wake() {
     if (num_running == 1) {
 
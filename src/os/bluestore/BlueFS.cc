@@ -353,6 +353,7 @@ int BlueFS::mkfs(uuid_d osd_uuid)
 void BlueFS::_init_alloc()
 {
   dout(20) << __func__ << dendl;
+  static const char *devnames[MAX_BDEV] = { "wal", "db", "slow" };
   alloc.resize(MAX_BDEV);
   pending_release.resize(MAX_BDEV);
   for (unsigned id = 0; id < bdev.size(); ++id) {
@@ -362,7 +363,8 @@ void BlueFS::_init_alloc()
     assert(bdev[id]->get_size());
     alloc[id] = Allocator::create(cct, cct->_conf->bluefs_allocator,
 				  bdev[id]->get_size(),
-				  cct->_conf->bluefs_alloc_size);
+				  cct->_conf->bluefs_alloc_size,
+				  std::string("bluefs ") + devnames[id]);
     interval_set<uint64_t>& p = block_all[id];
     for (interval_set<uint64_t>::iterator q = p.begin(); q != p.end(); ++q) {
       alloc[id]->init_add_free(q.get_start(), q.get_len());
@@ -466,8 +468,16 @@ int BlueFS::fsck()
 
 int BlueFS::_write_super()
 {
-  // build superblock
   bufferlist bl;
+  _encode_super(&bl);
+  _write_super_bl(bl);
+  return 0;
+}
+
+void BlueFS::_encode_super(bufferlist *out)
+{
+  // build superblock
+  bufferlist& bl = *out;
   ::encode(super, bl);
   uint32_t crc = bl.crc32c(-1);
   ::encode(crc, bl);
@@ -476,13 +486,16 @@ int BlueFS::_write_super()
   dout(10) << __func__ << " log_fnode " << super.log_fnode << dendl;
   assert(bl.length() <= get_super_length());
   bl.append_zero(get_super_length() - bl.length());
+  dout(20) << __func__ << " v " << super.version
+           << " crc 0x" << std::hex << crc << std::dec << dendl;
+}
 
+void BlueFS::_write_super_bl(bufferlist& bl)
+{
+  // NOTE: this is safe to call without a lock.
   bdev[BDEV_DB]->write(get_super_offset(), bl, false);
-  dout(20) << __func__ << " v " << super.version
-           << " crc 0x" << std::hex << crc
-           << " offset 0x" << get_super_offset() << std::dec
-           << dendl;
-  return 0;
+  dout(20) << __func__ << " offset 0x" << std::hex << get_super_offset()
+	   << std::dec << dendl;
 }
 
 int BlueFS::_open_super()
@@ -1039,7 +1052,7 @@ void BlueFS::compact_log()
 {
   std::unique_lock<std::mutex> l(lock);
   if (cct->_conf->bluefs_compact_log_sync) {
-     _compact_log_sync();
+     _compact_log_sync(l);
   } else {
     _compact_log_async(l);
   }
@@ -1097,9 +1110,14 @@ void BlueFS::_compact_log_dump_metadata(bluefs_transaction_t *t)
   }
 }
 
-void BlueFS::_compact_log_sync()
+void BlueFS::_compact_log_sync(std::unique_lock<std::mutex>& l)
 {
   dout(10) << __func__ << dendl;
+  // a log flush writes log_writer with the lock dropped; don't replace
+  // it under that
+  while (log_flushing) {
+    log_cond.wait(l);
+  }
   File *log_file = log_writer->file.get();
 
   // clear out log (be careful who calls us!!!)
@@ -1192,6 +1210,19 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   new_log = new File;
   new_log->fnode.ino = 0;   // so that _flush_range won't try to log the fnode
 
+  // new_log is set, so nobody else will start a compaction while we
+  // drop the lock for device io here.  this must happen before the
+  // jump is queued: a log flush run by anyone else in the meantime
+  // would write the jump without moving log_writer->pos.
+  l.unlock();
+  flush_bdev();
+  l.lock();
+  // likewise, don't queue the jump while a flush in progress could
+  // let another one in before ours
+  while (log_flushing) {
+    log_cond.wait(l);
+  }
+
   // 1. allocate new log space and jump to it.
   old_log_jump_to = log_file->fnode.get_allocated();
   uint64_t need = old_log_jump_to + cct->_conf->bluefs_max_log_runway;
@@ -1211,8 +1242,6 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   log_t.op_file_update(log_file->fnode);
   log_t.op_jump(log_seq, old_log_jump_to);
 
-  flush_bdev();  // FIXME?
-
   _flush_and_sync_log(l, 0, old_log_jump_to);
 
   // 2. prepare compacted log
@@ -1226,9 +1255,12 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
                                 cct->_conf->bluefs_alloc_size);
   t.op_jump(log_seq, new_log_jump_to);
 
+  // t is a private snapshot now; encode it without the lock
   bufferlist bl;
+  l.unlock();
   ::encode(t, bl);
   _pad_bl(bl);
+  l.lock();
 
   dout(10) << __func__ << " new_log_jump_to 0x" << std::hex << new_log_jump_to
 	   << std::dec << dendl;
@@ -1242,12 +1274,18 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   new_log_writer->append(bl);
 
   // 3. flush
-  r = _flush(new_log_writer, true);
+  r = _flush_log_writer(l, new_log_writer);
   assert(r == 0);
 
   // 4. wait
   _flush_bdev_safely(new_log_writer);
 
+  // a log flush may have started while we waited; let it finish before
+  // we move log_writer->pos and the log extents under it
+  while (log_flushing) {
+    log_cond.wait(l);
+  }
+
   // 5. update our log fnode
   // discard first old_log_jump_to extents
   dout(10) << __func__ << " remove 0x" << std::hex << old_log_jump_to << std::dec
@@ -1287,15 +1325,19 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   log_writer->pos = log_writer->file->fnode.size =
     log_writer->pos - old_log_jump_to + new_log_jump_to;
 
-  // 6. write the super block to reflect the changes
+  // 6. write the super block to reflect the changes.  log appends that
+  // race with us land in the same physical extents under either super,
+  // so only the encoding needs the lock.
   dout(10) << __func__ << " writing super" << dendl;
   super.log_fnode = log_file->fnode;
   ++super.version;
-  _write_super();
+  bufferlist super_bl;
+  _encode_super(&super_bl);
 
-  lock.unlock();
+  l.unlock();
+  _write_super_bl(super_bl);
   flush_bdev();
-  lock.lock();
+  l.lock();
 
   // 7. release old space
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
@@ -1330,8 +1372,8 @@ void BlueFS::_pad_bl(bufferlist& bl)
 
 void BlueFS::flush_log()
 {
-  std::unique_lock<std::mutex> l(lock);
   flush_bdev();
+  std::unique_lock<std::mutex> l(lock);
   _flush_and_sync_log(l);
 }
 
@@ -1403,7 +1445,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   log_t.seq = 0;  // just so debug output is less confusing
   log_flushing = true;
 
-  int r = _flush(log_writer, true);
+  int r = _flush_log_writer(l, log_writer);
   assert(r == 0);
 
   if (jump_to) {
@@ -1453,24 +1495,63 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   return 0;
 }
 
-int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
+int BlueFS::_flush_log_writer(std::unique_lock<std::mutex>& l, FileWriter *h)
+{
+  h->buffer_appender.flush();
+  uint64_t offset = h->pos;
+  uint64_t length = h->buffer.length();
+  dout(10) << __func__ << " " << h << " 0x"
+           << std::hex << offset << "~" << length << std::dec
+	   << " to " << h->file->fnode << dendl;
+  if (length == 0) {
+    return 0;
+  }
+  uint64_t x_off = 0;
+  vector<bluefs_extent_t> extents;
+  int r = _flush_range_prepare(h, &offset, &length, &x_off, &extents);
+  if (r < 0)
+    return r;
+  l.unlock();
+  r = _flush_range_write(h, offset, length, x_off, extents);
+  l.lock();
+  return r;
+}
+
+int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+			 bool have_lock)
 {
   dout(10) << __func__ << " " << h << " pos 0x" << std::hex << h->pos
 	   << " 0x" << offset << "~" << length << std::dec
 	   << " to " << h->file->fnode << dendl;
-  assert(!h->file->deleted);
-  assert(h->file->num_readers.load() == 0);
-
   h->buffer_appender.flush();
 
-  bool buffered;
-  if (h->file->fnode.ino == 1)
-    buffered = false;
-  else
-    buffered = cct->_conf->bluefs_buffered_io;
-
   if (offset + length <= h->pos)
     return 0;
+
+  int r;
+  uint64_t x_off = 0;
+  vector<bluefs_extent_t> extents;
+  if (have_lock) {
+    r = _flush_range_prepare(h, &offset, &length, &x_off, &extents);
+  } else {
+    std::lock_guard<std::mutex> l(lock);
+    r = _flush_range_prepare(h, &offset, &length, &x_off, &extents);
+  }
+  if (r < 0)
+    return r;
+  return _flush_range_write(h, offset, length, x_off, extents);
+}
+
+int BlueFS::_flush_range_prepare(FileWriter *h,
+				 uint64_t *poffset, uint64_t *plength,
+				 uint64_t *px_off,
+				 vector<bluefs_extent_t> *extents)
+{
+  uint64_t& offset = *poffset;
+  uint64_t& length = *plength;
+  assert(!h->file->deleted);
+  assert(h->file->num_readers.load() == 0);
+
   if (offset < h->pos) {
     length -= h->pos - offset;
     offset = h->pos;
@@ -1547,9 +1628,32 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   }
   dout(20) << __func__ << " file now " << h->file->fnode << dendl;
 
-  uint64_t x_off = 0;
-  auto p = h->file->fnode.seek(offset, &x_off);
-  assert(p != h->file->fnode.extents.end());
+  // the extents can change under lock (_preallocate, log compaction)
+  // once we drop it; take the ones we are writing to with us
+  auto p = h->file->fnode.seek(offset, px_off);
+  uint64_t end = *px_off + length;
+  while (true) {
+    assert(p != h->file->fnode.extents.end());
+    extents->push_back(*p);
+    if (end <= p->length)
+      break;
+    end -= p->length;
+    ++p;
+  }
+  return 0;
+}
+
+int BlueFS::_flush_range_write(FileWriter *h, uint64_t offset, uint64_t length,
+			       uint64_t x_off,
+			       const vector<bluefs_extent_t>& extents)
+{
+  bool buffered;
+  if (h->file->fnode.ino == 1)
+    buffered = false;
+  else
+    buffered = cct->_conf->bluefs_buffered_io;
+
+  auto p = extents.begin();
   dout(20) << __func__ << " in " << *p << " x_off 0x"
            << std::hex << x_off << std::dec << dendl;
 
@@ -1680,7 +1784,7 @@ void BlueFS::wait_for_aio(FileWriter *h)
   dout(10) << __func__ << " " << h << " done in " << dur << dendl;
 }
 
-int BlueFS::_flush(FileWriter *h, bool force)
+int BlueFS::_flush(FileWriter *h, bool force, bool have_lock)
 {
   h->buffer_appender.flush();
   uint64_t length = h->buffer.length();
@@ -1701,7 +1805,7 @@ int BlueFS::_flush(FileWriter *h, bool force)
            << std::hex << offset << "~" << length << std::dec
 	   << " to " << h->file->fnode << dendl;
   assert(h->pos <= h->file->fnode.size);
-  return _flush_range(h, offset, length);
+  return _flush_range(h, offset, length, have_lock);
 }
 
 int BlueFS::_truncate(FileWriter *h, uint64_t offset)
@@ -1745,17 +1849,31 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
   return 0;
 }
 
-int BlueFS::_fsync(FileWriter *h, std::unique_lock<std::mutex>& l)
+int BlueFS::_fsync(FileWriter *h)
 {
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
-  int r = _flush(h, true);
+  int r = _flush(h, true, false);
   if (r < 0)
      return r;
-  uint64_t old_dirty_seq = h->file->dirty_seq;
 
-  _flush_bdev_safely(h);
+  uint64_t old_dirty_seq;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    old_dirty_seq = h->file->dirty_seq;
+  }
+
+  // our data is all submitted, and h->lock keeps anyone else from adding
+  // more; wait for it without blocking writers to other files.
+  if (!cct->_conf->bluefs_sync_write) {
+    list<aio_t> completed_ios;
+    _claim_completed_aios(h, &completed_ios);
+    wait_for_aio(h);
+    completed_ios.clear();
+  }
+  flush_bdev();
 
   if (old_dirty_seq) {
+    std::unique_lock<std::mutex> l(lock);
     uint64_t s = log_seq;
     dout(20) << __func__ << " file metadata was dirty (" << old_dirty_seq
 	     << ") on " << h->file->fnode << ", flushing log" << dendl;
@@ -1890,7 +2008,9 @@ void BlueFS::sync_metadata()
     utime_t start = ceph_clock_now();
     vector<interval_set<uint64_t>> to_release(pending_release.size());
     to_release.swap(pending_release);
+    l.unlock();
     flush_bdev(); // FIXME?
+    l.lock();
     _flush_and_sync_log(l);
     for (unsigned i = 0; i < to_release.size(); ++i) {
       for (auto p = to_release[i].begin(); p != to_release[i].end(); ++p) {
@@ -1904,7 +2024,7 @@ void BlueFS::sync_metadata()
 
   if (_should_compact_log()) {
     if (cct->_conf->bluefs_compact_log_sync) {
-      _compact_log_sync();
+      _compact_log_sync(l);
     } else {
       _compact_log_async(l);
     }
@@ -124,6 +124,8 @@ public:
     bufferlist::page_aligned_appender buffer_appender;  //< for const char* only
     int writer_type = 0;    ///< WRITER_*
 
+    /// serializes flush/fsync/truncate of this file; taken before
+    /// BlueFS::lock, never after it.
     std::mutex lock;
     std::array<IOContext*,MAX_BDEV> iocv; ///< for each bdev
 
@@ -269,9 +271,22 @@ private:
 
   int _allocate(uint8_t bdev, uint64_t len,
 		mempool::bluefs::vector<bluefs_extent_t> *ev);
-  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
-  int _flush(FileWriter *h, bool force);
-  int _fsync(FileWriter *h, std::unique_lock<std::mutex>& l);
+  /// have_lock=false: caller holds only h->lock; the global lock is
+  /// taken just for allocation and dirty bookkeeping, not for the io.
+  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+		   bool have_lock = true);
+  /// also returns the extents [offset, offset+length) falls in, and
+  /// where in the first one it starts
+  int _flush_range_prepare(FileWriter *h, uint64_t *offset, uint64_t *length,
+			   uint64_t *x_off, vector<bluefs_extent_t> *extents);
+  int _flush_range_write(FileWriter *h, uint64_t offset, uint64_t length,
+			 uint64_t x_off,
+			 const vector<bluefs_extent_t>& extents);
+  int _flush(FileWriter *h, bool force, bool have_lock = true);
+  /// flush log_writer or new_log_writer, doing the io with l dropped;
+  /// the caller keeps others off h (log_flushing or new_log)
+  int _flush_log_writer(std::unique_lock<std::mutex>& l, FileWriter *h);
+  int _fsync(FileWriter *h);  ///< caller holds h->lock, not lock
 
   void _claim_completed_aios(FileWriter *h, list<aio_t> *ls);
   void wait_for_aio(FileWriter *h);  // safe to call without a lock
@@ -282,7 +297,7 @@ private:
   uint64_t _estimate_log_size();
   bool _should_compact_log();
   void _compact_log_dump_metadata(bluefs_transaction_t *t);
-  void _compact_log_sync();
+  void _compact_log_sync(std::unique_lock<std::mutex>& l);
   void _compact_log_async(std::unique_lock<std::mutex>& l);
 
   //void _aio_finish(void *priv);
@@ -310,6 +325,8 @@ private:
 
   int _open_super();
   int _write_super();
+  void _encode_super(bufferlist *bl);
+  void _write_super_bl(bufferlist& bl);
   int _replay(bool noop); ///< replay journal
 
   FileWriter *_create_writer(FileRef f);
@@ -358,6 +375,9 @@ public:
     bool random = false);
 
   void close_writer(FileWriter *h) {
+    // drain our aios first so that _close_writer does not wait on the
+    // device with the global lock held.
+    wait_for_aio(h);
     std::lock_guard<std::mutex> l(lock);
     _close_writer(h);
   }
@@ -397,16 +417,16 @@ public:
 		     AllocExtentVector *extents);
 
   void flush(FileWriter *h) {
-    std::lock_guard<std::mutex> l(lock);
-    _flush(h, false);
+    std::lock_guard<std::mutex> hl(h->lock);
+    _flush(h, false, false);
   }
   void flush_range(FileWriter *h, uint64_t offset, uint64_t length) {
-    std::lock_guard<std::mutex> l(lock);
-    _flush_range(h, offset, length);
+    std::lock_guard<std::mutex> hl(h->lock);
+    _flush_range(h, offset, length, false);
   }
   int fsync(FileWriter *h) {
-    std::unique_lock<std::mutex> l(lock);
-    return _fsync(h, l);
+    std::lock_guard<std::mutex> hl(h->lock);
+    return _fsync(h);
   }
   int read(FileReader *h, FileReaderBuffer *buf, uint64_t offset, size_t len,
 	   bufferlist *outbl, char *out) {
@@ -431,6 +451,7 @@ public:
     return _preallocate(f, offset, len);
   }
   int truncate(FileWriter *h, uint64_t offset) {
+    std::lock_guard<std::mutex> hl(h->lock);
     std::lock_guard<std::mutex> l(lock);
     return _truncate(h, offset);
   }
@@ -28,6 +28,7 @@
 #include "common/safe_io.h"
 #include "Allocator.h"
 #include "FreelistManager.h"
+#include "DeferredLog.h"
 #include "BlueFS.h"
 #include "BlueRocksEnv.h"
 #include "auth/Crypto.h"
@@ -64,8 +65,10 @@ const string PREFIX_COLL = "C";    // collection name -> cnode_t
 const string PREFIX_OBJ = "O";     // object name -> onode_t
 const string PREFIX_OMAP = "M";    // u64 + keyname -> value
 const string PREFIX_DEFERRED = "L";  // id -> deferred_transaction_t
+const string PREFIX_DEFERRED_LOG = "D";  // id -> deferred log extent
 const string PREFIX_ALLOC = "B";   // u64 offset -> u64 length (freelist)
 const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
+const string PREFIX_ALLOC_SNAPSHOT = "A"; // header, u64 chunk -> free extents
 
 // write a label in the first block.  always use this size.  note that
 // bluefs makes a matching assumption about the location of its
@@ -531,6 +534,11 @@ static void get_deferred_key(uint64_t seq, string *out)
   _key_encode_u64(seq, out);
 }
 
+static void get_alloc_snapshot_chunk_key(uint64_t chunk, string *out)
+{
+  _key_encode_u64(chunk, out);
+}
+
 
 // merge operators
 
@@ -568,8 +576,10 @@ ostream& operator<<(ostream& out, const BlueStore::Buffer& b)
   out << "buffer(" << &b << " space " << b.space << " 0x" << std::hex
       << b.offset << "~" << b.length << std::dec
       << " " << BlueStore::Buffer::get_state_name(b.state);
-  if (b.flags)
-    out << " " << BlueStore::Buffer::get_flag_name(b.flags);
+  for (unsigned f = 1; f <= b.flags; f <<= 1) {
+    if (b.flags & f)
+      out << " " << BlueStore::Buffer::get_flag_name(f);
+  }
   return out << ")";
 }
 
@@ -774,6 +784,7 @@ BlueStore::Cache *BlueStore::Cache::create(CephContext* cct, string type,
     assert(0 == "unrecognized cache type");
 
   c->logger = logger;
+  c->lockless_hits = cct->_conf->bluestore_cache_lockless_hits;
   return c;
 }
 
@@ -789,7 +800,7 @@ void BlueStore::Cache::trim(
   float target_data_ratio,
   float bytes_per_onode)
 {
-  std::lock_guard<std::recursive_mutex> l(lock);
+  std::unique_lock<std::recursive_mutex> l(lock);
   uint64_t current_meta = _get_num_onodes() * bytes_per_onode;
   uint64_t current_buffer = _get_buffer_bytes();
   uint64_t current = current_meta + current_buffer;
@@ -845,7 +856,34 @@ void BlueStore::Cache::trim(
 	   << " -> max " << max_onodes << " onodes + "
 	   << max_buffer << " buffer"
 	   << dendl;
-  _trim(max_onodes, max_buffer);
+  if (!lockless_hits) {
+    _trim(max_onodes, max_buffer);
+    return;
+  }
+
+  // hits don't queue up behind us in this mode, but writes and misses
+  // still do; drop the lock between bounded batches.
+  uint64_t batch_bytes = MAX(cct->_conf->bluestore_cache_trim_batch_bytes, 1u);
+  uint64_t batch_onodes = bytes_per_onode > 0 ?
+    MAX((uint64_t)(batch_bytes / bytes_per_onode), 1u) : batch_bytes;
+  while (true) {
+    uint64_t onodes = _get_num_onodes();
+    uint64_t buffer = _get_buffer_bytes();
+    if (onodes <= max_onodes && buffer <= max_buffer) {
+      break;
+    }
+    uint64_t step_onodes = MAX(max_onodes, onodes > batch_onodes ?
+			       onodes - batch_onodes : 0);
+    uint64_t step_buffer = MAX(max_buffer, buffer > batch_bytes ?
+			       buffer - batch_bytes : 0);
+    _trim(step_onodes, step_buffer);
+    if (_get_num_onodes() == onodes && _get_buffer_bytes() == buffer) {
+      dout(20) << __func__ << " no progress (all pinned?), stopping" << dendl;
+      break;
+    }
+    l.unlock();
+    l.lock();
+  }
 }
 
 
@@ -869,6 +907,7 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   _audit("trim start");
 
   // buffers
+  uint64_t rotate = lockless_hits ? buffer_lru.size() : 0;
   while (buffer_size > buffer_max) {
     auto i = buffer_lru.rbegin();
     if (i == buffer_lru.rend()) {
@@ -878,7 +917,18 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
 
     Buffer *b = &*i;
     assert(b->is_clean());
+    if (rotate && b->cache_touched.exchange(false)) {
+      // hit since we last looked; give it another trip through the lru
+      --rotate;
+      _touch_buffer(b);
+      continue;
+    }
     dout(20) << __func__ << " rm " << *b << dendl;
+    std::unique_lock<boost::shared_mutex> ml(b->space->get_map_lock(this),
+					     std::defer_lock);
+    if (lockless_hits) {
+      ml.lock();
+    }
     b->space->_rm_buffer(this, b);
   }
 
@@ -892,8 +942,22 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   --p;
   int skipped = 0;
   int max_skipped = g_conf->bluestore_cache_trim_max_skip_pinned;
+  rotate = lockless_hits ? onode_lru.size() : 0;
   while (num > 0) {
     Onode *o = &*p;
+    if (rotate && p != onode_lru.begin() && o->cache_touched.exchange(false)) {
+      dout(20) << __func__ << "  " << o->oid << " was hit, rotating" << dendl;
+      --rotate;
+      onode_lru.erase(p--);
+      onode_lru.push_front(*o);
+      continue;
+    }
+    // nobody may find (and ref) o while we decide to drop it
+    OnodeSpace *space = &o->c->onode_map;
+    std::unique_lock<boost::shared_mutex> ml(space->lock, std::defer_lock);
+    if (lockless_hits) {
+      ml.lock();
+    }
     int refs = o->nref.load();
     if (refs > 1) {
       dout(20) << __func__ << "  " << o->oid << " has " << refs
@@ -920,7 +984,10 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       assert(num == 1);
     }
     o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
+    space->remove(o->oid);
+    if (ml.owns_lock()) {
+      ml.unlock();
+    }
     o->put();
     --num;
   }
@@ -1011,6 +1078,7 @@ void BlueStore::TwoQCache::_add_buffer(Buffer *b, int level, Buffer *near)
   if (!b->is_empty()) {
     buffer_bytes += b->length;
     buffer_list_bytes[b->cache_private] += b->length;
+    _account_buffer(b, b->length);
   }
 }
 
@@ -1022,6 +1090,7 @@ void BlueStore::TwoQCache::_rm_buffer(Buffer *b)
     buffer_bytes -= b->length;
     assert(buffer_list_bytes[b->cache_private] >= b->length);
     buffer_list_bytes[b->cache_private] -= b->length;
+    _account_buffer(b, -(int64_t)b->length);
   }
   switch (b->cache_private) {
   case BUFFER_WARM_IN:
@@ -1063,6 +1132,7 @@ void BlueStore::TwoQCache::_move_buffer(Cache *srcc, Buffer *b)
   if (!b->is_empty()) {
     buffer_bytes += b->length;
     buffer_list_bytes[b->cache_private] += b->length;
+    _account_buffer(b, b->length);
   }
 }
 
@@ -1074,6 +1144,7 @@ void BlueStore::TwoQCache::_adjust_buffer_size(Buffer *b, int64_t delta)
     buffer_bytes += delta;
     assert((int64_t)buffer_list_bytes[b->cache_private] + delta >= 0);
     buffer_list_bytes[b->cache_private] += delta;
+    _account_buffer(b, delta);
   }
 }
 
@@ -1123,10 +1194,18 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       Buffer *b = &*p;
       assert(b->is_clean());
       dout(20) << __func__ << " buffer_warm_in -> out " << *b << dendl;
+      // hits don't promote out of warm_in; just forget about them
+      b->cache_touched = false;
+      std::unique_lock<boost::shared_mutex> ml(b->space->get_map_lock(this),
+					       std::defer_lock);
+      if (lockless_hits) {
+	ml.lock();
+      }
       assert(buffer_bytes >= b->length);
       buffer_bytes -= b->length;
       assert(buffer_list_bytes[BUFFER_WARM_IN] >= b->length);
       buffer_list_bytes[BUFFER_WARM_IN] -= b->length;
+      _account_buffer(b, -(int64_t)b->length);
       to_evict_bytes -= b->length;
       evicted += b->length;
       b->state = Buffer::STATE_EMPTY;
@@ -1145,6 +1224,7 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
     // adjust hot list
     to_evict_bytes = buffer_list_bytes[BUFFER_HOT] - khot;
     evicted = 0;
+    uint64_t rotate = lockless_hits ? buffer_hot.size() : 0;
 
     while (to_evict_bytes > 0) {
       auto p = buffer_hot.rbegin();
@@ -1154,11 +1234,22 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       }
 
       Buffer *b = &*p;
+      if (rotate && b->cache_touched.exchange(false)) {
+	// hit since we last looked; move to front of hot
+	--rotate;
+	_touch_buffer(b);
+	continue;
+      }
       dout(20) << __func__ << " buffer_hot rm " << *b << dendl;
       assert(b->is_clean());
       // adjust evict size before buffer goes invalid
       to_evict_bytes -= b->length;
       evicted += b->length;
+      std::unique_lock<boost::shared_mutex> ml(b->space->get_map_lock(this),
+					       std::defer_lock);
+      if (lockless_hits) {
+	ml.lock();
+      }
       b->space->_rm_buffer(this, b);
     }
 
@@ -1174,6 +1265,11 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       Buffer *b = &*buffer_warm_out.rbegin();
       assert(b->is_empty());
       dout(20) << __func__ << " buffer_warm_out rm " << *b << dendl;
+      std::unique_lock<boost::shared_mutex> ml(b->space->get_map_lock(this),
+					       std::defer_lock);
+      if (lockless_hits) {
+	ml.lock();
+      }
       b->space->_rm_buffer(this, b);
     }
   }
@@ -1188,9 +1284,23 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   --p;
   int skipped = 0;
   int max_skipped = g_conf->bluestore_cache_trim_max_skip_pinned;
+  uint64_t rotate = lockless_hits ? onode_lru.size() : 0;
   while (num > 0) {
     Onode *o = &*p;
     dout(20) << __func__ << " considering " << o << dendl;
+    if (rotate && p != onode_lru.begin() && o->cache_touched.exchange(false)) {
+      dout(20) << __func__ << "  " << o->oid << " was hit, rotating" << dendl;
+      --rotate;
+      onode_lru.erase(p--);
+      onode_lru.push_front(*o);
+      continue;
+    }
+    // nobody may find (and ref) o while we decide to drop it
+    OnodeSpace *space = &o->c->onode_map;
+    std::unique_lock<boost::shared_mutex> ml(space->lock, std::defer_lock);
+    if (lockless_hits) {
+      ml.lock();
+    }
     int refs = o->nref.load();
     if (refs > 1) {
       dout(20) << __func__ << "  " << o->oid << " has " << refs
@@ -1217,7 +1327,10 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       assert(num == 1);
     }
     o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
+    space->remove(o->oid);
+    if (ml.owns_lock()) {
+      ml.unlock();
+    }
     o->put();
     --num;
   }
@@ -1271,6 +1384,12 @@ void BlueStore::TwoQCache::_audit(const char *when)
 #undef dout_prefix
 #define dout_prefix *_dout << "bluestore.BufferSpace(" << this << " in " << cache << ") "
 
+boost::shared_mutex& BlueStore::BufferSpace::get_map_lock(Cache* cache)
+{
+  size_t h = reinterpret_cast<uintptr_t>(this) / sizeof(BufferSpace);
+  return cache->buffer_map_locks[h % Cache::BUFFER_MAP_LOCKS];
+}
+
 void BlueStore::BufferSpace::_clear(Cache* cache)
 {
   // note: we already hold cache->lock
@@ -1366,7 +1485,23 @@ void BlueStore::BufferSpace::read(
   uint32_t end = offset + length;
 
   {
-    std::lock_guard<std::recursive_mutex> l(cache->lock);
+    // with lockless_hits we only need buffer_map to hold still, and
+    // record hits on the buffers for the next trim to act upon.
+    std::unique_lock<std::recursive_mutex> l(cache->lock, std::defer_lock);
+    boost::shared_lock<boost::shared_mutex> ml(get_map_lock(cache),
+					       boost::defer_lock);
+    if (cache->lockless_hits) {
+      ml.lock();
+    } else {
+      l.lock();
+    }
+    auto touch = [&](Buffer *b) {
+      if (cache->lockless_hits) {
+	b->cache_touched = true;
+      } else {
+	cache->_touch_buffer(b);
+      }
+    };
     for (auto i = _data_lower_bound(offset);
          i != buffer_map.end() && offset < end && i->first < end;
          ++i) {
@@ -1381,7 +1516,7 @@ void BlueStore::BufferSpace::read(
 	  offset += l;
 	  length -= l;
 	  if (!b->is_writing()) {
-	    cache->_touch_buffer(b);
+	    touch(b);
 	  }
 	  continue;
         }
@@ -1394,7 +1529,7 @@ void BlueStore::BufferSpace::read(
 	  length -= gap;
         }
         if (!b->is_writing()) {
-	  cache->_touch_buffer(b);
+	  touch(b);
         }
         if (b->length > length) {
 	  res[offset].substr_of(b->data, 0, length);
@@ -1422,6 +1557,11 @@ void BlueStore::BufferSpace::read(
 void BlueStore::BufferSpace::finish_write(Cache* cache, uint64_t seq)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<boost::shared_mutex> ml(get_map_lock(cache),
+					   std::defer_lock);
+  if (cache->lockless_hits) {
+    ml.lock();
+  }
 
   auto i = writing.begin();
   while (i != writing.end()) {
@@ -1456,6 +1596,17 @@ void BlueStore::BufferSpace::finish_write(Cache* cache, uint64_t seq)
 void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSpace &r)
 {
   std::lock_guard<std::recursive_mutex> lk(cache->lock);
+  std::unique_lock<boost::shared_mutex> ml(get_map_lock(cache),
+					   std::defer_lock);
+  std::unique_lock<boost::shared_mutex> rml(r.get_map_lock(cache),
+					    std::defer_lock);
+  if (cache->lockless_hits) {
+    if (ml.mutex() == rml.mutex()) {
+      ml.lock();
+    } else {
+      std::lock(ml, rml);
+    }
+  }
   if (buffer_map.empty())
     return;
 
@@ -1511,6 +1662,10 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
 BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid, OnodeRef o)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<boost::shared_mutex> ml(lock, std::defer_lock);
+  if (cache->lockless_hits) {
+    ml.lock();
+  }
   auto p = onode_map.find(oid);
   if (p != onode_map.end()) {
     ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
@@ -1530,7 +1685,20 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   OnodeRef o;
   bool hit = false;
 
-  {
+  if (cache->lockless_hits) {
+    // trim looks at the flag; the lru order is left alone here
+    boost::shared_lock<boost::shared_mutex> ml(lock);
+    auto p = onode_map.find(oid);
+    if (p == onode_map.end()) {
+      ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
+    } else {
+      ldout(cache->cct, 30) << __func__ << " " << oid << " hit " << p->second
+			    << dendl;
+      p->second->cache_touched = true;
+      hit = true;
+      o = p->second;
+    }
+  } else {
     std::lock_guard<std::recursive_mutex> l(cache->lock);
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
     if (p == onode_map.end()) {
@@ -1555,6 +1723,10 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 void BlueStore::OnodeSpace::clear()
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<boost::shared_mutex> ml(lock, std::defer_lock);
+  if (cache->lockless_hits) {
+    ml.lock();
+  }
   ldout(cache->cct, 10) << __func__ << dendl;
   for (auto &p : onode_map) {
     cache->_rm_onode(p.second);
@@ -1575,6 +1747,10 @@ void BlueStore::OnodeSpace::rename(
   const mempool::bluestore_cache_other::string& new_okey)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  std::unique_lock<boost::shared_mutex> ml(lock, std::defer_lock);
+  if (cache->lockless_hits) {
+    ml.lock();
+  }
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1646,6 +1822,11 @@ BlueStore::SharedBlob::~SharedBlob()
 {
   if (get_cache()) {   // the dummy instances have a nullptr
     std::lock_guard<std::recursive_mutex> l(get_cache()->lock);
+    std::unique_lock<boost::shared_mutex> ml(bc.get_map_lock(get_cache()),
+					     std::defer_lock);
+    if (get_cache()->lockless_hits) {
+      ml.lock();
+    }
     bc._clear(get_cache());
     get_cache()->rm_blob();
   }
@@ -3254,6 +3435,12 @@ void BlueStore::Collection::split_cache(
   std::lock(cache->lock, dest->cache->lock);
   std::lock_guard<std::recursive_mutex> l(cache->lock, std::adopt_lock);
   std::lock_guard<std::recursive_mutex> l2(dest->cache->lock, std::adopt_lock);
+  std::unique_lock<boost::shared_mutex> ml(onode_map.lock, std::defer_lock);
+  std::unique_lock<boost::shared_mutex> ml2(dest->onode_map.lock,
+					    std::defer_lock);
+  if (cache->lockless_hits) {
+    std::lock(ml, ml2);
+  }
 
   int destbits = dest->cnode.bits;
   spg_t destpg;
@@ -3834,6 +4021,8 @@ void BlueStore::_init_logger()
     "Average decompress latency");
   b.add_time_avg(l_bluestore_csum_lat, "csum_lat",
     "Average checksum latency");
+  b.add_u64_counter(l_bluestore_csum_verify_bytes, "csum_verify_bytes",
+    "Bytes verified in place against stored checksums");
   b.add_u64_counter(l_bluestore_compress_success_count, "compress_success_count",
     "Sum for beneficial compress ops");
   b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
@@ -3844,6 +4033,18 @@ void BlueStore::_init_logger()
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def");
+  b.add_u64_counter(l_bluestore_deferred_log_ops, "deferred_log_ops",
+		    "Deferred transactions persisted to the deferred log");
+  b.add_u64_counter(l_bluestore_deferred_log_bytes, "deferred_log_bytes",
+		    "Bytes written to the deferred log");
+  b.add_u64_counter(l_bluestore_deferred_log_full, "deferred_log_full",
+		    "Deferred transactions journaled in kv because the "
+		    "deferred log was full");
+  b.add_time_avg(l_bluestore_deferred_log_lat, "deferred_log_lat",
+		 "Average wait for a kv batch's deferred log records to be "
+		 "stable");
+  b.add_u64(l_bluestore_deferred_log_used, "deferred_log_used",
+	    "Bytes of the deferred log holding live records");
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -3880,6 +4081,9 @@ void BlueStore::_init_logger()
     "Sum for bytes of read hit in the cache");
   b.add_u64(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
     "Sum for bytes of read missed in the cache");
+  b.add_u64(l_bluestore_buffer_decompressed_bytes,
+	    "bluestore_buffer_decompressed_bytes",
+	    "Number of unbuffered decompressed bytes in cache");
 
   b.add_u64_counter(l_bluestore_write_big, "bluestore_write_big",
 		    "Large aligned writes into fresh blobs");
@@ -4155,6 +4359,60 @@ void BlueStore::_close_bdev()
   bdev = NULL;
 }
 
+int BlueStore::_open_deferred_log(bool create)
+{
+  assert(deferred_bdev == NULL);
+  assert(deferred_log == NULL);
+  string p = path + "/block.deferred";
+  struct stat st;
+  if (::stat(p.c_str(), &st) < 0) {
+    dout(10) << __func__ << " no " << p << ", deferred log disabled" << dendl;
+    return 0;
+  }
+  deferred_bdev = BlockDevice::create(cct, p, NULL, NULL);
+  int r = deferred_bdev->open(p);
+  if (r < 0)
+    goto fail;
+
+  if (deferred_bdev->supported_bdev_label()) {
+    r = _check_or_set_bdev_label(p, deferred_bdev->get_size(),
+				 "bluestore deferred log", create);
+    if (r < 0)
+      goto fail_close;
+  }
+
+  deferred_log = new DeferredLog(cct, deferred_bdev);
+  if (create)
+    r = deferred_log->create(fsid);
+  else
+    r = deferred_log->open(fsid);
+  if (r < 0)
+    goto fail_log;
+  return 0;
+
+ fail_log:
+  delete deferred_log;
+  deferred_log = NULL;
+ fail_close:
+  deferred_bdev->close();
+ fail:
+  derr << __func__ << " " << p << ": " << cpp_strerror(r) << dendl;
+  delete deferred_bdev;
+  deferred_bdev = NULL;
+  return r;
+}
+
+void BlueStore::_close_deferred_log()
+{
+  if (!deferred_bdev)
+    return;
+  delete deferred_log;
+  deferred_log = NULL;
+  deferred_bdev->close();
+  delete deferred_bdev;
+  deferred_bdev = NULL;
+}
+
 int BlueStore::_open_fm(bool create)
 {
   assert(fm == NULL);
@@ -4255,13 +4513,13 @@ void BlueStore::_close_fm()
   fm = NULL;
 }
 
-int BlueStore::_open_alloc()
+int BlueStore::_open_alloc(bool use_snapshot)
 {
   assert(alloc == NULL);
   assert(bdev->get_size());
   alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
                             bdev->get_size(),
-                            min_alloc_size);
+                            min_alloc_size, "block");
   if (!alloc) {
     lderr(cct) << __func__ << " Allocator::unknown alloc type "
                << cct->_conf->bluestore_allocator
@@ -4271,6 +4529,42 @@ int BlueStore::_open_alloc()
 
   uint64_t num = 0, bytes = 0;
 
+  if (use_snapshot) {
+    bufferlist header;
+    int r = db->get(PREFIX_ALLOC_SNAPSHOT, "header", &header);
+    if (r >= 0) {
+      if (cct->_conf->bluestore_alloc_snapshot) {
+	r = _load_alloc_snapshot(header, &num, &bytes);
+	if (r < 0) {
+	  derr << __func__ << " ignoring allocator snapshot: "
+	       << cpp_strerror(r) << dendl;
+	  num = bytes = 0;
+	  // start over with an empty allocator
+	  _close_alloc();
+	  alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
+				    bdev->get_size(),
+				    min_alloc_size, "block");
+	  assert(alloc);
+	}
+      } else {
+	r = -ENOENT;
+      }
+      // the snapshot is only valid until the freelist changes again;
+      // make sure a crash can never leave a stale one behind.
+      KeyValueDB::Transaction t = db->get_transaction();
+      t->rmkeys_by_prefix(PREFIX_ALLOC_SNAPSHOT);
+      int rr = db->submit_transaction_sync(t);
+      if (rr < 0) {
+	derr << __func__ << " failed to remove allocator snapshot: "
+	     << cpp_strerror(rr) << dendl;
+	return rr;
+      }
+      if (r == 0) {
+	return 0;
+      }
+    }
+  }
+
   dout(1) << __func__ << " opening allocation metadata" << dendl;
   // initialize from freelist
   fm->enumerate_reset();
@@ -4295,6 +4589,172 @@ int BlueStore::_open_alloc()
   return 0;
 }
 
+int BlueStore::_load_alloc_snapshot(bufferlist& header,
+				    uint64_t *num, uint64_t *bytes)
+{
+  dout(1) << __func__ << dendl;
+  utime_t start = ceph_clock_now();
+
+  uint8_t v;
+  uint64_t size, au, num_chunks, num_extents, num_bytes;
+  interval_set<uint64_t> bluefs;
+  uint32_t crc, expected_crc;
+  try {
+    bufferlist::iterator p = header.begin();
+    ::decode(v, p);
+    ::decode(size, p);
+    ::decode(au, p);
+    ::decode(bluefs, p);
+    ::decode(num_chunks, p);
+    ::decode(num_extents, p);
+    ::decode(num_bytes, p);
+    bufferlist t;
+    t.substr_of(header, 0, p.get_off());
+    crc = t.crc32c(-1);
+    ::decode(expected_crc, p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " unable to decode header" << dendl;
+    return -EIO;
+  }
+  if (v != 1 || crc != expected_crc) {
+    derr << __func__ << " bad header, v " << (int)v << " crc 0x" << std::hex
+	 << crc << " expected 0x" << expected_crc << std::dec << dendl;
+    return -EIO;
+  }
+  if (size != bdev->get_size() || au != min_alloc_size ||
+      !(bluefs == bluefs_extents)) {
+    derr << __func__ << " stale: size 0x" << std::hex << size
+	 << " min_alloc_size 0x" << au << " bluefs_extents " << bluefs
+	 << " vs 0x" << bdev->get_size() << " 0x" << min_alloc_size
+	 << " " << bluefs_extents << std::dec << dendl;
+    return -ESTALE;
+  }
+
+  // verify everything before touching the allocator
+  vector<bufferlist> chunks(num_chunks);
+  uint64_t n = 0;
+  for (uint64_t i = 0; i < num_chunks; ++i) {
+    string key;
+    get_alloc_snapshot_chunk_key(i, &key);
+    bufferlist bl;
+    int r = db->get(PREFIX_ALLOC_SNAPSHOT, key, &bl);
+    if (r < 0 || bl.length() < sizeof(uint32_t) * 2) {
+      derr << __func__ << " missing chunk " << i << dendl;
+      return -EIO;
+    }
+    uint32_t count;
+    chunks[i].substr_of(bl, 0, bl.length() - sizeof(uint32_t));
+    bufferlist::iterator p = bl.begin();
+    ::decode(count, p);
+    p.advance(chunks[i].length() - sizeof(uint32_t));
+    ::decode(expected_crc, p);
+    if (chunks[i].crc32c(-1) != expected_crc ||
+	chunks[i].length() != sizeof(uint32_t) + count * 2 * sizeof(uint64_t)) {
+      derr << __func__ << " bad chunk " << i << dendl;
+      return -EIO;
+    }
+    n += count;
+  }
+  if (n != num_extents) {
+    derr << __func__ << " found " << n << " extents, expected "
+	 << num_extents << dendl;
+    return -EIO;
+  }
+
+  for (auto& bl : chunks) {
+    bufferlist::iterator p = bl.begin();
+    uint32_t count;
+    ::decode(count, p);
+    while (count--) {
+      uint64_t offset, length;
+      ::decode(offset, p);
+      ::decode(length, p);
+      alloc->init_add_free(offset, length);
+      *bytes += length;
+    }
+  }
+  *num = num_extents;
+  if (*bytes != num_bytes) {
+    derr << __func__ << " loaded 0x" << std::hex << *bytes
+	 << " bytes, expected 0x" << num_bytes << std::dec << dendl;
+    return -EIO;
+  }
+  dout(1) << __func__ << " loaded " << pretty_si_t(*bytes)
+	  << " in " << *num << " extents in "
+	  << (ceph_clock_now() - start) << " seconds" << dendl;
+  return 0;
+}
+
+void BlueStore::_write_alloc_snapshot()
+{
+  if (!cct->_conf->bluestore_alloc_snapshot) {
+    return;
+  }
+  dout(1) << __func__ << dendl;
+  utime_t start = ceph_clock_now();
+
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkeys_by_prefix(PREFIX_ALLOC_SNAPSHOT);
+
+  uint64_t num = 0, bytes = 0, num_chunks = 0;
+  uint32_t count = 0;
+  bufferlist extents;
+  auto finish_chunk = [&]() {
+    bufferlist bl;
+    ::encode(count, bl);
+    bl.claim_append(extents);
+    ::encode(bl.crc32c(-1), bl);
+    string key;
+    get_alloc_snapshot_chunk_key(num_chunks++, &key);
+    t->set(PREFIX_ALLOC_SNAPSHOT, key, bl);
+    count = 0;
+  };
+  bool supported = alloc->foreach(
+    [&](uint64_t offset, uint64_t length) {
+      ::encode(offset, extents);
+      ::encode(length, extents);
+      ++num;
+      bytes += length;
+      if (++count == cct->_conf->bluestore_alloc_snapshot_chunk_extents) {
+	finish_chunk();
+      }
+    });
+  if (!supported) {
+    dout(1) << __func__ << " " << cct->_conf->bluestore_allocator
+	    << " allocator cannot be snapshotted" << dendl;
+    return;
+  }
+  if (count) {
+    finish_chunk();
+  }
+  if (bytes != alloc->get_free()) {
+    derr << __func__ << " enumerated 0x" << std::hex << bytes
+	 << " bytes but allocator has 0x" << alloc->get_free() << std::dec
+	 << " free; not writing snapshot" << dendl;
+    return;
+  }
+
+  bufferlist bl;
+  ::encode((uint8_t)1, bl);
+  ::encode(bdev->get_size(), bl);
+  ::encode(min_alloc_size, bl);
+  ::encode(bluefs_extents, bl);
+  ::encode(num_chunks, bl);
+  ::encode(num, bl);
+  ::encode(bytes, bl);
+  ::encode(bl.crc32c(-1), bl);
+  t->set(PREFIX_ALLOC_SNAPSHOT, "header", bl);
+
+  int r = db->submit_transaction_sync(t);
+  if (r < 0) {
+    derr << __func__ << " failed: " << cpp_strerror(r) << dendl;
+    return;
+  }
+  dout(1) << __func__ << " wrote " << pretty_si_t(bytes) << " in " << num
+	  << " extents in " << (ceph_clock_now() - start) << " seconds"
+	  << dendl;
+}
+
 void BlueStore::_close_alloc()
 {
   assert(alloc);
@@ -5155,15 +5615,25 @@ int BlueStore::mkfs()
     if (r < 0)
       goto out_close_fsid;
   }
+  r = _setup_block_symlink_or_file("block.deferred",
+				   cct->_conf->bluestore_block_deferred_path,
+				   cct->_conf->bluestore_block_deferred_size,
+				   cct->_conf->bluestore_block_deferred_create);
+  if (r < 0)
+    goto out_close_fsid;
 
   r = _open_bdev(true);
   if (r < 0)
     goto out_close_fsid;
 
-  r = _open_db(true);
+  r = _open_deferred_log(true);
   if (r < 0)
     goto out_close_bdev;
 
+  r = _open_db(true);
+  if (r < 0)
+    goto out_close_deferred_log;
+
   r = _open_fm(true);
   if (r < 0)
     goto out_close_db;
@@ -5231,6 +5701,8 @@ int BlueStore::mkfs()
   _close_fm();
  out_close_db:
   _close_db();
+ out_close_deferred_log:
+  _close_deferred_log();
  out_close_bdev:
   _close_bdev();
  out_close_fsid:
@@ -5322,10 +5794,14 @@ int BlueStore::_mount(bool kv_only)
   if (r < 0)
     goto out_fsid;
 
-  r = _open_db(false);
+  r = _open_deferred_log(false);
   if (r < 0)
     goto out_bdev;
 
+  r = _open_db(false);
+  if (r < 0)
+    goto out_deferred_log;
+
   if (kv_only)
     return 0;
 
@@ -5337,7 +5813,7 @@ int BlueStore::_mount(bool kv_only)
   if (r < 0)
     goto out_db;
 
-  r = _open_alloc();
+  r = _open_alloc(true);
   if (r < 0)
     goto out_fm;
 
@@ -5377,6 +5853,8 @@ int BlueStore::_mount(bool kv_only)
   _close_fm();
  out_db:
   _close_db();
+ out_deferred_log:
+  _close_deferred_log();
  out_bdev:
   _close_bdev();
  out_fsid:
@@ -5400,12 +5878,14 @@ int BlueStore::umount()
   _kv_stop();
   _reap_collections();
   _flush_cache();
+  _write_alloc_snapshot();
   dout(20) << __func__ << " closing" << dendl;
 
   mounted = false;
   _close_alloc();
   _close_fm();
   _close_db();
+  _close_deferred_log();
   _close_bdev();
   _close_fsid();
   _close_path();
@@ -5527,10 +6007,14 @@ int BlueStore::fsck(bool deep)
   if (r < 0)
     goto out_fsid;
 
-  r = _open_db(false);
+  r = _open_deferred_log(false);
   if (r < 0)
     goto out_bdev;
 
+  r = _open_db(false);
+  if (r < 0)
+    goto out_deferred_log;
+
   r = _open_super_meta();
   if (r < 0)
     goto out_db;
@@ -5947,19 +6431,16 @@ int BlueStore::fsck(bool deep)
   }
 
   dout(1) << __func__ << " checking deferred events" << dendl;
-  it = db->get_iterator(PREFIX_DEFERRED);
-  if (it) {
-    for (it->lower_bound(string()); it->valid(); it->next()) {
-      bufferlist bl = it->value();
+  {
+    auto check_deferred = [&](const string& key, bufferlist& bl) {
       bufferlist::iterator p = bl.begin();
       bluestore_deferred_transaction_t wt;
       try {
 	::decode(wt, p);
       } catch (buffer::error& e) {
 	derr << __func__ << " error: failed to decode deferred txn "
-	     << pretty_binary_string(it->key()) << dendl;
-	r = -EIO;
-        goto out_scan;
+	     << pretty_binary_string(key) << dendl;
+	return false;
       }
       dout(20) << __func__ << "  deferred " << wt.seq
 	       << " ops " << wt.ops.size()
@@ -5972,6 +6453,58 @@ int BlueStore::fsck(bool deep)
           }
         );
       }
+      return true;
+    };
+
+    it = db->get_iterator(PREFIX_DEFERRED);
+    if (it) {
+      for (it->lower_bound(string()); it->valid(); it->next()) {
+	bufferlist bl = it->value();
+	if (!check_deferred(it->key(), bl)) {
+	  r = -EIO;
+	  goto out_scan;
+	}
+      }
+    }
+
+    // deferred txns whose payload is in the deferred log
+    it = db->get_iterator(PREFIX_DEFERRED_LOG);
+    if (it) {
+      for (it->lower_bound(string()); it->valid(); it->next()) {
+	uint64_t seq, offset, length;
+	_key_decode_u64(it->key().c_str(), &seq);
+	bufferlist ref = it->value();
+	bufferlist::iterator p = ref.begin();
+	try {
+	  ::decode(offset, p);
+	  ::decode(length, p);
+	} catch (buffer::error& e) {
+	  derr << __func__ << " error: failed to decode deferred log ref "
+	       << pretty_binary_string(it->key()) << dendl;
+	  ++errors;
+	  continue;
+	}
+	if (!deferred_log) {
+	  derr << __func__ << " error: deferred txn " << seq
+	       << " is in the deferred log but block.deferred is missing"
+	       << dendl;
+	  ++errors;
+	  continue;
+	}
+	bufferlist bl;
+	int rr = deferred_log->read(seq, offset, length, &bl);
+	if (rr < 0) {
+	  derr << __func__ << " error: failed to read deferred txn " << seq
+	       << " from the deferred log at 0x" << std::hex << offset << "~"
+	       << length << std::dec << ": " << cpp_strerror(rr) << dendl;
+	  ++errors;
+	  continue;
+	}
+	if (!check_deferred(it->key(), bl)) {
+	  r = -EIO;
+	  goto out_scan;
+	}
+      }
     }
   }
 
@@ -6044,6 +6577,8 @@ int BlueStore::fsck(bool deep)
  out_db:
   it.reset();  // before db is closed
   _close_db();
+ out_deferred_log:
+  _close_deferred_log();
  out_bdev:
   _close_bdev();
  out_fsid:
@@ -6177,15 +6712,18 @@ void BlueStore::_update_cache_logger()
   uint64_t num_blobs = 0;
   uint64_t num_buffers = 0;
   uint64_t num_buffer_bytes = 0;
+  uint64_t num_decompressed_bytes = 0;
   for (auto c : cache_shards) {
     c->add_stats(&num_onodes, &num_extents, &num_blobs,
 		 &num_buffers, &num_buffer_bytes);
+    num_decompressed_bytes += c->decompressed_bytes;
   }
   logger->set(l_bluestore_onodes, num_onodes);
   logger->set(l_bluestore_extents, num_extents);
   logger->set(l_bluestore_blobs, num_blobs);
   logger->set(l_bluestore_buffers, num_buffers);
   logger->set(l_bluestore_buffer_bytes, num_buffer_bytes);
+  logger->set(l_bluestore_buffer_decompressed_bytes, num_decompressed_bytes);
 }
 
 // ---------------
@@ -6407,6 +6945,15 @@ int BlueStore::_do_read(
     dout(20) << __func__ << " defaulting to buffered read" << dendl;
     buffered = true;
   }
+  // unbuffered reads may still keep what they decompress, within its own
+  // budget, unless the client asked us not to.
+  uint64_t decompressed_max = 0;
+  if (!buffered &&
+      (op_flags & (CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+		   CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) == 0) {
+    decompressed_max =
+      cct->_conf->bluestore_cache_decompressed_max / cache_shards.size();
+  }
 
   if (offset + length > o->onode.size) {
     length = o->onode.size - offset;
@@ -6575,17 +7122,28 @@ int BlueStore::_do_read(
 		       b2r_it->second.front().logical_offset) < 0) {
 	return -EIO;
       }
+      uint32_t need_start = UINT32_MAX, need_end = 0;
+      for (auto& i : b2r_it->second) {
+	need_start = std::min<uint32_t>(need_start, i.blob_xoffset);
+	need_end = std::max<uint32_t>(need_end, i.blob_xoffset + i.length);
+      }
       bufferlist raw_bl;
-      r = _decompress(compressed_bl, &raw_bl);
+      uint32_t raw_off = 0;
+      r = _decompress(compressed_bl, need_start, need_end - need_start,
+		      &raw_bl, &raw_off);
       if (r < 0)
 	return r;
+      Cache *cache = bptr->shared_blob->get_cache();
       if (buffered) {
-	bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(), 0,
-				       raw_bl);
+	bptr->shared_blob->bc.did_read(cache, raw_off, raw_bl);
+      } else if (cache->decompressed_bytes + raw_bl.length() <=
+		 decompressed_max) {
+	bptr->shared_blob->bc.did_read(cache, raw_off, raw_bl,
+				       Buffer::FLAG_DECOMPRESSED);
       }
       for (auto& i : b2r_it->second) {
 	ready_regions[i.logical_offset].substr_of(
-	  raw_bl, i.blob_xoffset, i.length);
+	  raw_bl, i.blob_xoffset - raw_off, i.length);
       }
     } else {
       for (auto& reg : b2r_it->second) {
@@ -6638,6 +7196,105 @@ int BlueStore::_do_read(
   return r;
 }
 
+int BlueStore::verify_checksums(
+  CollectionHandle &c_,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t length)
+{
+  Collection *c = static_cast<Collection *>(c_.get());
+  dout(15) << __func__ << " " << c->cid << " " << oid
+	   << " 0x" << std::hex << offset << "~" << length << std::dec
+	   << dendl;
+  if (!c->exists)
+    return -ENOENT;
+
+  RWLock::RLocker l(c->lock);
+  OnodeRef o = c->get_onode(oid, false);
+  if (!o || !o->exists) {
+    return -ENOENT;
+  }
+  if (offset >= o->onode.size) {
+    return 0;
+  }
+  if (offset + length > o->onode.size) {
+    length = o->onode.size - offset;
+  }
+  o->extent_map.fault_range(db, offset, length);
+
+  // Read everything straight from the device, bypassing the buffer
+  // cache: what is cached says nothing about what is on disk.
+  // Compressed blobs are checksummed as a whole, the rest per chunk.
+  struct verify_region_t {
+    BlobRef blob;
+    uint64_t logical_offset;
+    uint64_t b_off;
+    bufferlist bl;
+    verify_region_t(BlobRef b, uint64_t l, uint64_t o)
+      : blob(b), logical_offset(l), b_off(o) {}
+  };
+  list<verify_region_t> regions;
+  set<Blob*> whole;
+  IOContext ioc(cct, NULL, true);  // a device error is a scrub error
+  uint64_t end = offset + length;
+  for (auto lp = o->extent_map.seek_lextent(offset);
+       lp != o->extent_map.extent_map.end() && lp->logical_offset < end;
+       ++lp) {
+    const bluestore_blob_t& blob = lp->blob->get_blob();
+    if (!blob.has_csum()) {
+      dout(20) << __func__ << " blob " << *lp->blob << " has no csum" << dendl;
+      return -EOPNOTSUPP;
+    }
+    uint64_t l_start = std::max<uint64_t>(offset, lp->logical_offset);
+    uint64_t l_end = std::min<uint64_t>(end, lp->logical_end());
+    uint64_t r_off, r_len;
+    if (blob.is_compressed()) {
+      if (!whole.insert(lp->blob.get()).second) {
+	continue;
+      }
+      r_off = 0;
+      r_len = blob.get_ondisk_length();
+    } else {
+      uint64_t chunk_size = blob.get_chunk_size(block_size);
+      r_off = P2ALIGN(l_start - lp->logical_offset + lp->blob_offset,
+		      chunk_size);
+      r_len = P2ROUNDUP(l_end - lp->logical_offset + lp->blob_offset,
+			chunk_size) - r_off;
+    }
+    regions.emplace_back(lp->blob, lp->logical_offset - lp->blob_offset,
+			 r_off);
+    verify_region_t& reg = regions.back();
+    int r = blob.map(
+      r_off, r_len,
+      [&](uint64_t off, uint64_t len) {
+	return bdev->aio_read(off, len, &reg.bl, &ioc);
+      });
+    if (r < 0) {
+      return r;
+    }
+  }
+  if (ioc.has_pending_aios()) {
+    bdev->aio_submit(&ioc);
+    ioc.aio_wait();
+    int r = ioc.get_return_value();
+    if (r < 0) {
+      derr << __func__ << " " << c->cid << " " << oid << " 0x" << std::hex
+	   << offset << "~" << length << std::dec << " read got "
+	   << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+
+  for (auto& reg : regions) {
+    if (_verify_csum(o, &reg.blob->get_blob(), reg.b_off, reg.bl,
+		     reg.logical_offset + reg.b_off) < 0) {
+      return -EIO;
+    }
+  }
+  logger->inc(l_bluestore_csum_verify_bytes, length);
+  return 0;
+}
+
 int BlueStore::_verify_csum(OnodeRef& o,
 			    const bluestore_blob_t* blob, uint64_t blob_xoffset,
 			    const bufferlist& bl,
@@ -6647,6 +7304,13 @@ int BlueStore::_verify_csum(OnodeRef& o,
   uint64_t bad_csum;
   utime_t start = ceph_clock_now();
   int r = blob->verify_csum(blob_xoffset, bl, &bad, &bad_csum);
+  if (cct->_conf->bluestore_debug_inject_csum_err_probability > 0 &&
+      (rand() % 10000) < cct->_conf->bluestore_debug_inject_csum_err_probability * 10000.0) {
+    derr << __func__ << " injecting bluestore checksum verifcation error" << dendl;
+    bad = blob_xoffset;
+    r = -1;
+    bad_csum = 0xDEADBEEF;
+  }
   if (r < 0) {
     if (r == -1) {
       PExtentVector pex;
@@ -6677,7 +7341,9 @@ int BlueStore::_verify_csum(OnodeRef& o,
   return r;
 }
 
-int BlueStore::_decompress(bufferlist& source, bufferlist* result)
+int BlueStore::_decompress(bufferlist& source,
+			   uint32_t offset, uint32_t length,
+			   bufferlist* result, uint32_t *result_offset)
 {
   int r = 0;
   utime_t start = ceph_clock_now();
@@ -6690,17 +7356,52 @@ int BlueStore::_decompress(bufferlist& source, bufferlist* result)
     cp = Compressor::create(cct, alg);
   }
 
+  *result_offset = 0;
   if (!cp.get()) {
     // if compressor isn't available - error, because cannot return
     // decompressed data?
     derr << __func__ << " can't load decompressor " << alg << dendl;
     r = -EIO;
-  } else {
+  } else if (!chdr.is_framed()) {
     r = cp->decompress(i, chdr.length, *result);
     if (r < 0) {
       derr << __func__ << " decompression failed with exit code " << r << dendl;
       r = -EIO;
     }
+  } else {
+    // only inflate the frames that overlap offset~length
+    assert(length > 0);
+    uint32_t first = offset / chdr.frame_size;
+    uint32_t last = (offset + length - 1) / chdr.frame_size;
+    if (last >= chdr.frame_lengths.size()) {
+      derr << __func__ << " need frame " << last << " but blob has "
+	   << chdr.frame_lengths.size() << dendl;
+      r = -EIO;
+    }
+    uint32_t frame_off = 0;
+    for (uint32_t f = 0; r >= 0 && f <= last; ++f) {
+      if (f >= first) {
+	// decompressors may read past the end of their input; give each
+	// frame its own iterator
+	bufferlist::iterator fi = i;
+	fi.advance(frame_off);
+	unsigned before = result->length();
+	r = cp->decompress(fi, chdr.frame_lengths[f], *result);
+	if (r < 0) {
+	  derr << __func__ << " decompression of frame " << f
+	       << " failed with exit code " << r << dendl;
+	  r = -EIO;
+	} else if (f + 1 < chdr.frame_lengths.size() &&
+		   result->length() - before != chdr.frame_size) {
+	  derr << __func__ << " frame " << f << " decompressed to 0x"
+	       << std::hex << result->length() - before << " bytes, expected 0x"
+	       << chdr.frame_size << std::dec << dendl;
+	  r = -EIO;
+	}
+      }
+      frame_off += chdr.frame_lengths[f];
+    }
+    *result_offset = first * chdr.frame_size;
   }
   logger->tinc(l_bluestore_decompress_lat, ceph_clock_now() - start);
   return r;
@@ -7763,6 +8464,9 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	} else if (txc->osr->txc_with_unstable_io) {
 	  dout(20) << __func__ << " prior txc(s) with unstable ios "
 		   << txc->osr->txc_with_unstable_io.load() << dendl;
+	} else if (txc->deferred_logged) {
+	  dout(20) << __func__ << " deferred log record not yet stable"
+		   << dendl;
 	} else if (cct->_conf->bluestore_debug_randomize_serial_transaction &&
 		   rand() % cct->_conf->bluestore_debug_randomize_serial_transaction
 		   == 0) {
@@ -7775,6 +8479,11 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	  _txc_applied_kv(txc);
 	}
       }
+      if (txc->state == TransContext::STATE_KV_QUEUED &&
+	  !kv_lanes.empty()) {
+	_kv_lane_queue(txc);
+	return;
+      }
       {
 	std::lock_guard<std::mutex> l(kv_lock);
 	kv_queue.push_back(txc);
@@ -7790,6 +8499,11 @@ void BlueStore::_txc_state_proc(TransContext *txc)
       return;
     case TransContext::STATE_KV_SUBMITTED:
       txc->log_state_latency(logger, l_bluestore_state_kv_committing_lat);
+      if (txc->kv_lane >= 0) {
+	kv_lanes[txc->kv_lane]->logger->tinc(
+	  l_bluestore_kv_lane_commit_lat,
+	  ceph_clock_now() - txc->kv_lane_stamp);
+      }
       txc->state = TransContext::STATE_KV_DONE;
       _txc_committed_kv(txc);
       // ** fall-thru **
@@ -8247,17 +8961,53 @@ void BlueStore::_kv_start()
     finishers.push_back(f);
   }
 
+  for (unsigned i = 0; i < cct->_conf->bluestore_kv_submit_lanes; ++i) {
+    KVSubmitLane *lane = new KVSubmitLane(this, i);
+    PerfCountersBuilder b(cct, string("bluestore_kv_lane_") + stringify(i),
+			  l_bluestore_kv_lane_first, l_bluestore_kv_lane_last);
+    b.add_u64_counter(l_bluestore_kv_lane_txc, "txc",
+		      "Transactions submitted by this lane");
+    b.add_u64_counter(l_bluestore_kv_lane_bytes, "bytes",
+		      "Bytes written by transactions submitted by this lane");
+    b.add_u64_counter(l_bluestore_kv_lane_batches, "batches",
+		      "Batches of transactions submitted by this lane");
+    b.add_time_avg(l_bluestore_kv_lane_flush_lat, "flush_lat",
+		   "Average block device flush latency before submit");
+    b.add_time_avg(l_bluestore_kv_lane_submit_lat, "submit_lat",
+		   "Average kv submit latency per batch");
+    b.add_time_avg(l_bluestore_kv_lane_commit_lat, "commit_lat",
+		   "Average latency from lane queue to kv commit");
+    lane->logger = b.create_perf_counters();
+    cct->get_perfcounters_collection()->add(lane->logger);
+    kv_lanes.push_back(lane);
+  }
+
   deferred_finisher.start();
   for (auto f : finishers) {
     f->start();
   }
   kv_sync_thread.create("bstore_kv_sync");
   kv_finalize_thread.create("bstore_kv_final");
+  for (auto lane : kv_lanes) {
+    lane->create("bstore_kv_lane");
+  }
 }
 
 void BlueStore::_kv_stop()
 {
   dout(10) << __func__ << dendl;
+  // lanes feed kv_sync_thread, so they have to go first
+  for (auto lane : kv_lanes) {
+    std::unique_lock<std::mutex> l(lane->lock);
+    while (!lane->started) {
+      lane->cond.wait(l);
+    }
+    lane->stop = true;
+    lane->cond.notify_all();
+  }
+  for (auto lane : kv_lanes) {
+    lane->join();
+  }
   {
     std::unique_lock<std::mutex> l(kv_lock);
     while (!kv_sync_started) {
@@ -8291,6 +9041,12 @@ void BlueStore::_kv_stop()
     f->wait_for_empty();
     f->stop();
   }
+  for (auto lane : kv_lanes) {
+    cct->get_perfcounters_collection()->remove(lane->logger);
+    delete lane->logger;
+    delete lane;
+  }
+  kv_lanes.clear();
   dout(10) << __func__ << " stopped" << dendl;
 }
 
@@ -8303,7 +9059,7 @@ void BlueStore::_kv_sync_thread()
   kv_cond.notify_all();
   while (true) {
     assert(kv_committing.empty());
-    if (kv_queue.empty() &&
+    if (kv_queue.empty() && !kv_lane_max_waiters &&
 	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
 	 !deferred_aggressive)) {
       if (kv_stop)
@@ -8366,6 +9122,7 @@ void BlueStore::_kv_sync_thread()
 			       deferred_done.end());
 	deferred_done.clear();
       }
+      _deferred_log_wait(kv_submitting);
       utime_t after_flush = ceph_clock_now();
 
       // we will use one final transaction to force a sync
@@ -8453,7 +9210,8 @@ void BlueStore::_kv_sync_thread()
 	  assert(wt.released.empty()); // only kraken did this
 	  string key;
 	  get_deferred_key(wt.seq, &key);
-	  synct->rm_single_key(PREFIX_DEFERRED, key);
+	  synct->rm_single_key(
+	    txc.deferred_logged ? PREFIX_DEFERRED_LOG : PREFIX_DEFERRED, key);
 	}
       }
 
@@ -8461,6 +9219,18 @@ void BlueStore::_kv_sync_thread()
       int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
       assert(r == 0);
 
+      // the log records are no longer referenced
+      if (deferred_log) {
+	for (auto b : deferred_stable) {
+	  for (auto& txc : b->txcs) {
+	    if (txc.deferred_logged) {
+	      deferred_log->release(txc.deferred_log_pos);
+	    }
+	  }
+	}
+	logger->set(l_bluestore_deferred_log_used, deferred_log->get_used());
+      }
+
       if (new_nid_max) {
 	nid_max = new_nid_max;
 	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
@@ -8527,6 +9297,9 @@ void BlueStore::_kv_sync_thread()
       // previously deferred "done" are now "stable" by virtue of this
       // commit cycle.
       deferred_stable_queue.swap(deferred_done);
+      if (new_nid_max || new_blobid_max) {
+	kv_lane_max_cond.notify_all();
+      }
     }
   }
   dout(10) << __func__ << " finish" << dendl;
@@ -8594,6 +9367,141 @@ void BlueStore::_kv_finalize_thread()
   kv_finalize_started = false;
 }
 
+void BlueStore::_deferred_log_wait(const deque<TransContext*>& txcs)
+{
+  // the kv references to deferred log records must not become stable
+  // before the records do: wait for their aios, then flush once for
+  // the whole batch
+  utime_t start = ceph_clock_now();
+  unsigned n = 0;
+  for (auto txc : txcs) {
+    if (txc->deferred_logged) {
+      txc->deferred_log_ioc.aio_wait();
+      ++n;
+    }
+  }
+  if (n) {
+    deferred_bdev->flush();
+    dout(20) << __func__ << " " << n << " records stable" << dendl;
+    logger->tinc(l_bluestore_deferred_log_lat, ceph_clock_now() - start);
+  }
+}
+
+void BlueStore::_kv_lane_queue(TransContext *txc)
+{
+  // an osr always maps to the same lane, and lanes submit in queue
+  // order, so per-sequencer ordering is preserved.
+  KVSubmitLane *lane = kv_lanes[txc->osr->kv_lane_seq % kv_lanes.size()];
+  dout(20) << __func__ << " txc " << txc << " lane " << lane->id << dendl;
+  txc->kv_lane = lane->id;
+  txc->kv_lane_stamp = ceph_clock_now();
+  // keep later txcs from being submitted synchronously ahead of us
+  ++txc->osr->kv_committing_serially;
+  std::lock_guard<std::mutex> l(lane->lock);
+  lane->q.push_back(txc);
+  lane->cond.notify_one();
+}
+
+void BlueStore::_kv_lane_wait_for_max(TransContext *txc)
+{
+  // the new {nid,blobid}_max must be durable before any txc using an id
+  // beyond the old one is; kv_sync_thread takes care of raising it.
+  dout(10) << __func__ << " txc " << txc << " last_nid " << txc->last_nid
+	   << " last_blobid " << txc->last_blobid << dendl;
+  std::unique_lock<std::mutex> l(kv_lock);
+  ++kv_lane_max_waiters;
+  kv_cond.notify_one();
+  while (txc->last_nid >= nid_max ||
+	 txc->last_blobid >= blobid_max) {
+    kv_lane_max_cond.wait(l);
+  }
+  --kv_lane_max_waiters;
+}
+
+void BlueStore::_kv_lane_thread(KVSubmitLane *lane)
+{
+  dout(10) << __func__ << " " << lane->id << " start" << dendl;
+  std::unique_lock<std::mutex> l(lane->lock);
+  assert(!lane->started);
+  lane->started = true;
+  lane->cond.notify_all();
+  while (true) {
+    if (lane->q.empty()) {
+      if (lane->stop)
+	break;
+      dout(20) << __func__ << " " << lane->id << " sleep" << dendl;
+      lane->cond.wait(l);
+      dout(20) << __func__ << " " << lane->id << " wake" << dendl;
+    } else {
+      deque<TransContext*> kv_submitting;
+      kv_submitting.swap(lane->q);
+      l.unlock();
+
+      dout(20) << __func__ << " " << lane->id << " submitting "
+	       << kv_submitting.size() << dendl;
+      utime_t start = ceph_clock_now();
+
+      // kv_sync_thread may sync the kv store at any moment, so unlike
+      // it we have to make the data stable before we submit.
+      bool had_ios = false;
+      uint64_t bytes = 0, costs = 0;
+      for (auto txc : kv_submitting) {
+	had_ios |= txc->had_ios;
+	bytes += txc->bytes;
+	costs += txc->cost;
+      }
+      if (had_ios) {
+	bdev->flush();
+      }
+      _deferred_log_wait(kv_submitting);
+      utime_t after_flush = ceph_clock_now();
+
+      for (auto txc : kv_submitting) {
+	assert(txc->state == TransContext::STATE_KV_QUEUED);
+	if (txc->last_nid >= nid_max ||
+	    txc->last_blobid >= blobid_max) {
+	  _kv_lane_wait_for_max(txc);
+	}
+	txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
+	int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction(txc->t);
+	assert(r == 0);
+	_txc_applied_kv(txc);
+	--txc->osr->kv_committing_serially;
+	txc->state = TransContext::STATE_KV_SUBMITTED;
+	if (txc->osr->kv_submitted_waiters) {
+	  std::lock_guard<std::mutex> l(txc->osr->qlock);
+	  if (txc->osr->_is_all_kv_submitted()) {
+	    txc->osr->qcond.notify_all();
+	  }
+	}
+      }
+
+      utime_t finish = ceph_clock_now();
+      lane->logger->inc(l_bluestore_kv_lane_txc, kv_submitting.size());
+      lane->logger->inc(l_bluestore_kv_lane_bytes, bytes);
+      lane->logger->inc(l_bluestore_kv_lane_batches);
+      if (had_ios) {
+	lane->logger->tinc(l_bluestore_kv_lane_flush_lat, after_flush - start);
+      }
+      lane->logger->tinc(l_bluestore_kv_lane_submit_lat, finish - after_flush);
+
+      // hand off to kv_sync_thread for the sync commit.  our ios are
+      // already stable, so they don't count toward kv_ios.
+      {
+	std::lock_guard<std::mutex> l(kv_lock);
+	kv_queue.insert(kv_queue.end(), kv_submitting.begin(),
+			kv_submitting.end());
+	kv_throttle_costs += costs;
+	kv_cond.notify_one();
+      }
+
+      l.lock();
+    }
+  }
+  dout(10) << __func__ << " " << lane->id << " finish" << dendl;
+  lane->started = false;
+}
+
 bluestore_deferred_op_t *BlueStore::_get_deferred_op(
   TransContext *txc, OnodeRef o)
 {
@@ -8761,27 +9669,80 @@ int BlueStore::_deferred_replay()
   OpSequencerRef osr = new OpSequencer(cct, this);
   int count = 0;
   int r = 0;
-  KeyValueDB::Iterator it = db->get_iterator(PREFIX_DEFERRED);
-  for (it->lower_bound(string()); it->valid(); it->next(), ++count) {
-    dout(20) << __func__ << " replay " << pretty_binary_string(it->key())
-	     << dendl;
+
+  // records in the deferred log; replayed in seq order with the kv ones
+  map<uint64_t,pair<uint64_t,uint64_t>> logged;  // seq -> (offset, length)
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_DEFERRED_LOG);
+  for (it->lower_bound(string()); it->valid(); it->next()) {
+    uint64_t seq, offset, length;
+    const char *k = _key_decode_u64(it->key().c_str(), &seq);
+    assert(k);
+    bufferlist bl = it->value();
+    bufferlist::iterator p = bl.begin();
+    try {
+      ::decode(offset, p);
+      ::decode(length, p);
+    } catch (buffer::error& e) {
+      derr << __func__ << " failed to decode deferred log ref "
+	   << pretty_binary_string(it->key()) << dendl;
+      r = -EIO;
+      goto out;
+    }
+    logged[seq] = make_pair(offset, length);
+  }
+  if (!logged.empty() && !deferred_log) {
+    derr << __func__ << " " << logged.size() << " deferred txns are in the "
+	 << "deferred log but block.deferred is missing" << dendl;
+    r = -EIO;
+    goto out;
+  }
+
+  it = db->get_iterator(PREFIX_DEFERRED);
+  it->lower_bound(string());
+  while (it->valid() || !logged.empty()) {
+    bufferlist bl;
+    bool from_log = false;
+    uint64_t seq = 0;
+    if (it->valid()) {
+      const char *k = _key_decode_u64(it->key().c_str(), &seq);
+      assert(k);
+    }
+    if (!logged.empty() && (!it->valid() || logged.begin()->first < seq)) {
+      seq = logged.begin()->first;
+      dout(20) << __func__ << " replay " << seq << " from deferred log 0x"
+	       << std::hex << logged.begin()->second.first << "~"
+	       << logged.begin()->second.second << std::dec << dendl;
+      r = deferred_log->read(seq, logged.begin()->second.first,
+			     logged.begin()->second.second, &bl);
+      if (r < 0) {
+	goto out;
+      }
+      logged.erase(logged.begin());
+      from_log = true;
+    } else {
+      dout(20) << __func__ << " replay " << pretty_binary_string(it->key())
+	       << dendl;
+      bl = it->value();
+      it->next();
+    }
     bluestore_deferred_transaction_t *deferred_txn =
       new bluestore_deferred_transaction_t;
-    bufferlist bl = it->value();
     bufferlist::iterator p = bl.begin();
     try {
       ::decode(*deferred_txn, p);
     } catch (buffer::error& e) {
-      derr << __func__ << " failed to decode deferred txn "
-	   << pretty_binary_string(it->key()) << dendl;
+      derr << __func__ << " failed to decode deferred txn " << seq << dendl;
       delete deferred_txn;
       r = -EIO;
       goto out;
     }
     TransContext *txc = _txc_create(osr.get());
     txc->deferred_txn = deferred_txn;
+    txc->deferred_logged = from_log;
+    txc->deferred_log_pos = (uint64_t)-1;
     txc->state = TransContext::STATE_KV_DONE;
     _txc_state_proc(txc);
+    ++count;
   }
  out:
   dout(20) << __func__ << " draining osr" << dendl;
@@ -8851,7 +9812,32 @@ int BlueStore::queue_transactions(
     ::encode(*txc->deferred_txn, bl);
     string key;
     get_deferred_key(txc->deferred_txn->seq, &key);
-    txc->t->set(PREFIX_DEFERRED, key, bl);
+    if (deferred_log) {
+      // write the payload to the deferred log; kv only records where to
+      // find it.  the record is made stable by whoever submits the kv
+      // transaction (see _deferred_log_wait).  fall back to kv if the
+      // ring is full.
+      uint64_t offset, length;
+      int r = deferred_log->append(txc->deferred_txn->seq, bl,
+				   &txc->deferred_log_ioc,
+				   &txc->deferred_log_pos, &offset, &length);
+      if (r == 0) {
+	txc->deferred_logged = true;
+	deferred_bdev->aio_submit(&txc->deferred_log_ioc);
+	bufferlist rbl;
+	::encode(offset, rbl);
+	::encode(length, rbl);
+	txc->t->set(PREFIX_DEFERRED_LOG, key, rbl);
+	logger->inc(l_bluestore_deferred_log_ops);
+	logger->inc(l_bluestore_deferred_log_bytes, length);
+	logger->set(l_bluestore_deferred_log_used, deferred_log->get_used());
+      } else if (r == -ENOSPC) {
+	logger->inc(l_bluestore_deferred_log_full);
+      }
+    }
+    if (!txc->deferred_logged) {
+      txc->t->set(PREFIX_DEFERRED, key, bl);
+    }
   }
 
   _txc_finalize_kv(txc, txc->t);
@@ -9853,6 +10839,8 @@ int BlueStore::_do_alloc_write(
     }
   );
 
+  vector<bluestore_blob_t::csum_batch_item_t> csum_batch;
+  csum_batch.reserve(wctx->writes.size());
   for (auto& wi : wctx->writes) {
     BlobRef b = wi.b;
     bluestore_blob_t& dblob = b->dirty_blob();
@@ -9875,8 +10863,23 @@ int BlueStore::_do_alloc_write(
       // FIXME: memory alignment here is bad
       bufferlist t;
 
-      r = c->compress(*l, t);
-      assert(r == 0);
+      uint64_t frame_size = cct->_conf->bluestore_compression_frame_size;
+      if (frame_size && wi.blob_length > frame_size) {
+	// compress independent frames so that small reads only have to
+	// inflate the frames they touch
+	chdr.frame_size = frame_size;
+	for (uint64_t off = 0; off < wi.blob_length; off += frame_size) {
+	  bufferlist in, out;
+	  in.substr_of(*l, off, std::min(frame_size, wi.blob_length - off));
+	  r = c->compress(in, out);
+	  assert(r == 0);
+	  chdr.frame_lengths.push_back(out.length());
+	  t.claim_append(out);
+	}
+      } else {
+	r = c->compress(*l, t);
+	assert(r == 0);
+      }
 
       chdr.length = t.length();
       ::encode(chdr, compressed_bl);
@@ -9968,7 +10971,8 @@ int BlueStore::_do_alloc_write(
 
     dout(20) << __func__ << " blob " << *b << dendl;
     if (dblob.has_csum()) {
-      dblob.calc_csum(b_off, *l);
+      // batched below, after all blobs are laid out
+      csum_batch.emplace_back(&dblob, b_off, *l);
     }
 
     if (wi.mark_unused) {
@@ -10016,6 +11020,9 @@ int BlueStore::_do_alloc_write(
       }
     }
   }
+  if (!csum_batch.empty()) {
+    bluestore_blob_t::calc_csum_batch(csum_batch);
+  }
   if (need > 0) {
     alloc->unreserve(need);
   }
@@ -11443,6 +12450,9 @@ void BlueStore::generate_db_histogram(Formatter *f)
     } else if (key.first == PREFIX_DEFERRED) {
 	hist.update_hist_entry(hist.key_hist, PREFIX_DEFERRED, key_size, value_size);
 	num_deferred++;
+    } else if (key.first == PREFIX_DEFERRED_LOG) {
+	hist.update_hist_entry(hist.key_hist, PREFIX_DEFERRED_LOG, key_size, value_size);
+	num_deferred++;
     } else if (key.first == PREFIX_ALLOC || key.first == "b" ) {
 	hist.update_hist_entry(hist.key_hist, PREFIX_ALLOC, key_size, value_size);
 	num_alloc++;
@@ -28,6 +28,7 @@
 #include <boost/intrusive/set.hpp>
 #include <boost/functional/hash.hpp>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include "include/assert.h"
 #include "include/unordered_map.h"
@@ -45,6 +46,7 @@
 class Allocator;
 class FreelistManager;
 class BlueFS;
+class DeferredLog;
 
 //#define DEBUG_CACHE
 //#define DEBUG_DEFERRED
@@ -80,11 +82,17 @@ enum {
   l_bluestore_compress_lat,
   l_bluestore_decompress_lat,
   l_bluestore_csum_lat,
+  l_bluestore_csum_verify_bytes,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_log_ops,
+  l_bluestore_deferred_log_bytes,
+  l_bluestore_deferred_log_full,
+  l_bluestore_deferred_log_lat,
+  l_bluestore_deferred_log_used,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -102,6 +110,7 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_buffer_decompressed_bytes,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -119,6 +128,17 @@ enum {
   l_bluestore_last
 };
 
+enum {
+  l_bluestore_kv_lane_first = 732550,
+  l_bluestore_kv_lane_txc,
+  l_bluestore_kv_lane_bytes,
+  l_bluestore_kv_lane_batches,
+  l_bluestore_kv_lane_flush_lat,
+  l_bluestore_kv_lane_submit_lat,
+  l_bluestore_kv_lane_commit_lat,
+  l_bluestore_kv_lane_last
+};
+
 class BlueStore : public ObjectStore,
 		  public md_config_obs_t {
   // -----------------------------------------------------
@@ -166,11 +186,13 @@ public:
     }
     enum {
       FLAG_NOCACHE = 1,  ///< trim when done WRITING (do not become CLEAN)
-      // NOTE: fix operator<< when you define a second flag
+      FLAG_DECOMPRESSED = 2,  ///< unbuffered decompressed data; see
+                              ///< bluestore_cache_decompressed_max
     };
     static const char *get_flag_name(int s) {
       switch (s) {
       case FLAG_NOCACHE: return "nocache";
+      case FLAG_DECOMPRESSED: return "decompressed";
       default: return "???";
       }
     }
@@ -183,6 +205,9 @@ public:
     uint32_t offset, length;
     bufferlist data;
 
+    /// hit without the Cache lock since the last trim (lockless_hits only)
+    std::atomic<bool> cache_touched = {false};
+
     boost::intrusive::list_member_hook<> lru_item;
     boost::intrusive::list_member_hook<> state_item;
 
@@ -258,6 +283,11 @@ public:
       assert(writing.empty());
     }
 
+    /// lock readers take (shared) instead of the Cache lock when
+    /// Cache::lockless_hits is set.  writers take it (exclusive) after
+    /// the Cache lock.
+    boost::shared_mutex& get_map_lock(Cache* cache);
+
     void _add_buffer(Cache* cache, Buffer *b, int level, Buffer *near) {
       cache->_audit("_add_buffer start");
       buffer_map[b->offset].reset(b);
@@ -315,6 +345,11 @@ public:
     // return value is the highest cache_private of a trimmed buffer, or 0.
     int discard(Cache* cache, uint32_t offset, uint32_t length) {
       std::lock_guard<std::recursive_mutex> l(cache->lock);
+      std::unique_lock<boost::shared_mutex> ml(get_map_lock(cache),
+					       std::defer_lock);
+      if (cache->lockless_hits) {
+	ml.lock();
+      }
       return _discard(cache, offset, length);
     }
     int _discard(Cache* cache, uint32_t offset, uint32_t length);
@@ -322,17 +357,30 @@ public:
     void write(Cache* cache, uint64_t seq, uint32_t offset, bufferlist& bl,
 	       unsigned flags) {
       std::lock_guard<std::recursive_mutex> l(cache->lock);
+      std::unique_lock<boost::shared_mutex> ml(get_map_lock(cache),
+					       std::defer_lock);
+      if (cache->lockless_hits) {
+	ml.lock();
+      }
       Buffer *b = new Buffer(this, Buffer::STATE_WRITING, seq, offset, bl,
 			     flags);
       b->cache_private = _discard(cache, offset, bl.length());
       _add_buffer(cache, b, (flags & Buffer::FLAG_NOCACHE) ? 0 : 1, nullptr);
     }
     void finish_write(Cache* cache, uint64_t seq);
-    void did_read(Cache* cache, uint32_t offset, bufferlist& bl) {
+    void did_read(Cache* cache, uint32_t offset, bufferlist& bl,
+		  unsigned flags = 0) {
       std::lock_guard<std::recursive_mutex> l(cache->lock);
-      Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl);
+      std::unique_lock<boost::shared_mutex> ml(get_map_lock(cache),
+					       std::defer_lock);
+      if (cache->lockless_hits) {
+	ml.lock();
+      }
+      Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl, flags);
       b->cache_private = _discard(cache, offset, bl.length());
-      _add_buffer(cache, b, 1, nullptr);
+      // nobody asked us to cache decompressed data; start it out cold
+      _add_buffer(cache, b, (flags & Buffer::FLAG_DECOMPRESSED) ? 0 : 1,
+		  nullptr);
     }
 
     void read(Cache* cache, uint32_t offset, uint32_t length,
@@ -1005,6 +1053,9 @@ public:
 
     boost::intrusive::list_member_hook<> lru_item;
 
+    /// hit without the Cache lock since the last trim (lockless_hits only)
+    std::atomic<bool> cache_touched = {false};
+
     bluestore_onode_t onode;  ///< metadata stored as value in kv store
     bool exists;              ///< true if object logically exists
 
@@ -1047,6 +1098,18 @@ public:
     std::atomic<uint64_t> num_extents = {0};
     std::atomic<uint64_t> num_blobs = {0};
 
+    /// clean bytes in FLAG_DECOMPRESSED buffers.  these count toward the
+    /// buffer bytes as well; this only bounds how many we admit.
+    std::atomic<uint64_t> decompressed_bytes = {0};
+
+    /// serve hits without taking lock; hits are only flagged on the
+    /// onode/buffer and folded into the lru order when we trim
+    bool lockless_hits = false;
+
+    static const unsigned BUFFER_MAP_LOCKS = 32;
+    /// striped locks for BufferSpace::buffer_map, see lockless_hits
+    boost::shared_mutex buffer_map_locks[BUFFER_MAP_LOCKS];
+
     static Cache *create(CephContext* cct, string type, PerfCounters *logger);
 
     Cache(CephContext* cct) : cct(cct), logger(nullptr) {}
@@ -1079,6 +1142,13 @@ public:
       --num_blobs;
     }
 
+    void _account_buffer(Buffer *b, int64_t delta) {
+      if (b->flags & Buffer::FLAG_DECOMPRESSED) {
+	assert((int64_t)decompressed_bytes + delta >= 0);
+	decompressed_bytes += delta;
+      }
+    }
+
     void trim(uint64_t target_bytes,
 	      float target_meta_ratio,
 	      float target_data_ratio,
@@ -1156,10 +1226,12 @@ public:
 	buffer_lru.push_back(*b);
       }
       buffer_size += b->length;
+      _account_buffer(b, b->length);
     }
     void _rm_buffer(Buffer *b) override {
       assert(buffer_size >= b->length);
       buffer_size -= b->length;
+      _account_buffer(b, -(int64_t)b->length);
       auto q = buffer_lru.iterator_to(*b);
       buffer_lru.erase(q);
     }
@@ -1170,6 +1242,7 @@ public:
     void _adjust_buffer_size(Buffer *b, int64_t delta) override {
       assert((int64_t)buffer_size + delta >= 0);
       buffer_size += delta;
+      _account_buffer(b, delta);
     }
     void _touch_buffer(Buffer *b) override {
       auto p = buffer_lru.iterator_to(*b);
@@ -1296,6 +1369,13 @@ public:
   private:
     Cache *cache;
 
+  public:
+    /// protect onode_map from lockless lookups (see Cache::lockless_hits);
+    /// writers take it exclusive after the Cache lock
+    boost::shared_mutex lock;
+
+  private:
+
     /// forward lookups
     mempool::bluestore_cache_other::unordered_map<ghobject_t,OnodeRef> onode_map;
 
@@ -1309,6 +1389,7 @@ public:
 
     OnodeRef add(const ghobject_t& oid, OnodeRef o);
     OnodeRef lookup(const ghobject_t& o);
+    /// caller holds the Cache lock (and our lock with lockless_hits)
     void remove(const ghobject_t& oid) {
       onode_map.erase(oid);
     }
@@ -1549,6 +1630,9 @@ public:
 
     boost::intrusive::list_member_hook<> deferred_queue_item;
     bluestore_deferred_transaction_t *deferred_txn = nullptr; ///< if any
+    bool deferred_logged = false;  ///< deferred_txn lives in deferred_log
+    uint64_t deferred_log_pos = 0; ///< ring pos, or -1 if replayed
+    IOContext deferred_log_ioc;    ///< write of the deferred log record
 
     interval_set<uint64_t> allocated, released;
     volatile_statfs statfs_delta;
@@ -1563,8 +1647,12 @@ public:
     uint64_t last_nid = 0;     ///< if non-zero, highest new nid we allocated
     uint64_t last_blobid = 0;  ///< if non-zero, highest new blobid we allocated
 
+    int kv_lane = -1;          ///< kv submit lane we went through, if any
+    utime_t kv_lane_stamp;     ///< when we were queued on that lane
+
     explicit TransContext(CephContext* cct, OpSequencer *o)
       : osr(o),
+	deferred_log_ioc(cct, NULL),
 	ioc(cct, this),
 	start(ceph_clock_now()) {
       last_stamp = start;
@@ -1661,12 +1749,15 @@ public:
 
     std::atomic_int kv_submitted_waiters = {0};
 
+    unsigned kv_lane_seq;  ///< picks our kv submit lane (if lanes are enabled)
+
     std::atomic_bool registered = {true}; ///< registered in BlueStore's osr_set
     std::atomic_bool zombie = {false};    ///< owning Sequencer has gone away
 
     OpSequencer(CephContext* cct, BlueStore *store)
       : Sequencer_impl(cct),
-	parent(NULL), store(store) {
+	parent(NULL), store(store),
+	kv_lane_seq(store->kv_lane_next++) {
       store->register_osr(this);
     }
     ~OpSequencer() override {
@@ -1781,6 +1872,25 @@ public:
     }
   };
 
+  /// submits kv transactions for a subset of OpSequencers in parallel
+  /// with the other lanes; kv_sync_thread still does the (single) sync.
+  struct KVSubmitLane : public Thread {
+    BlueStore *store;
+    unsigned id;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool started = false;
+    bool stop = false;
+    deque<TransContext*> q;  ///< ready, need submit by this lane
+    PerfCounters *logger = nullptr;
+
+    KVSubmitLane(BlueStore *s, unsigned i) : store(s), id(i) {}
+    void *entry() override {
+      store->_kv_lane_thread(this);
+      return NULL;
+    }
+  };
+
   struct DBHistogram {
     struct value_dist {
       uint64_t count;
@@ -1814,6 +1924,8 @@ private:
 
   KeyValueDB *db = nullptr;
   BlockDevice *bdev = nullptr;
+  BlockDevice *deferred_bdev = nullptr;  ///< optional block.deferred
+  DeferredLog *deferred_log = nullptr;   ///< deferred payload ring on it
   std::string freelist_type;
   FreelistManager *fm = nullptr;
   Allocator *alloc = nullptr;
@@ -1870,6 +1982,11 @@ private:
   deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
   deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
 
+  vector<KVSubmitLane*> kv_lanes;        ///< empty unless lanes are enabled
+  std::atomic<unsigned> kv_lane_next = {0};
+  std::condition_variable kv_lane_max_cond; ///< {nid,blobid}_max raised
+  int kv_lane_max_waiters = 0;           ///< lanes waiting on kv_lane_max_cond
+
   PerfCounters *logger = nullptr;
 
   std::mutex reap_lock;
@@ -1966,12 +2083,17 @@ private:
 
   int _open_bdev(bool create);
   void _close_bdev();
+  int _open_deferred_log(bool create);
+  void _close_deferred_log();
   int _open_db(bool create);
   void _close_db();
   int _open_fm(bool create);
   void _close_fm();
-  int _open_alloc();
+  /// @param use_snapshot consume the allocator snapshot from umount, if any
+  int _open_alloc(bool use_snapshot = false);
   void _close_alloc();
+  int _load_alloc_snapshot(bufferlist& header, uint64_t *num, uint64_t *bytes);
+  void _write_alloc_snapshot();
   int _open_collections(int *errors=0);
   void _close_collections();
 
@@ -2033,6 +2155,10 @@ private:
   void _kv_stop();
   void _kv_sync_thread();
   void _kv_finalize_thread();
+  void _deferred_log_wait(const deque<TransContext*>& txcs);
+  void _kv_lane_queue(TransContext *txc);
+  void _kv_lane_thread(KVSubmitLane *lane);
+  void _kv_lane_wait_for_max(TransContext *txc);
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc, OnodeRef o);
   void _deferred_queue(TransContext *txc);
@@ -2213,6 +2339,11 @@ public:
     size_t len,
     bufferlist& bl,
     uint32_t op_flags = 0) override;
+  int verify_checksums(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len) override;
   int _do_read(
     Collection *c,
     OnodeRef o,
@@ -2426,7 +2557,10 @@ private:
     uint64_t blob_xoffset,
     const bufferlist& bl,
     uint64_t logical_offset) const;
-  int _decompress(bufferlist& source, bufferlist* result);
+  /// decompress (at least) blob range offset~length; the result starts
+  /// at *result_offset in the blob
+  int _decompress(bufferlist& source, uint32_t offset, uint32_t length,
+		  bufferlist* result, uint32_t *result_offset);
 
 
   // --------------------------------------------------------
@@ -0,0 +1,218 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "DeferredLog.h"
+#include "BlockDevice.h"
+
+#include "include/encoding.h"
+#include "include/intarith.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "deferred_log "
+
+static const uint64_t SUPER_OFFSET = 4096;   // right after the bdev label
+static const uint64_t SUPER_MAGIC = 0x626c75656465666cull;  // "bluedefl"
+static const uint64_t RECORD_MAGIC = 0x626c756564656672ull; // "bluedefr"
+static const uint64_t RECORD_HEADER_SIZE = 24;  // magic, seq, len, crc
+
+void DeferredLog::_init_geometry()
+{
+  block_size = bdev->get_block_size();
+  assert(SUPER_RESERVED % block_size == 0);
+  assert(bdev->get_size() > SUPER_RESERVED);
+  ring_size = (bdev->get_size() - SUPER_RESERVED) & ~(block_size - 1);
+  head = 0;
+  used = 0;
+  live.clear();
+}
+
+int DeferredLog::create(const uuid_d& fsid)
+{
+  _init_geometry();
+
+  bufferlist bl;
+  ::encode(SUPER_MAGIC, bl);
+  ::encode(fsid, bl);
+  ::encode(ring_size, bl);
+  ::encode(bl.crc32c(-1), bl);
+  bufferptr z(SUPER_RESERVED - SUPER_OFFSET - bl.length());
+  z.zero();
+  bl.append(std::move(z));
+  int r = bdev->write(SUPER_OFFSET, bl, false);
+  if (r < 0) {
+    derr << __func__ << " failed to write superblock: " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+  r = bdev->flush();
+  dout(1) << __func__ << " ring 0x" << std::hex << ring_size << std::dec
+	  << dendl;
+  return r;
+}
+
+int DeferredLog::open(const uuid_d& fsid)
+{
+  _init_geometry();
+
+  bufferlist bl;
+  IOContext ioc(cct, NULL);
+  int r = bdev->read(SUPER_OFFSET, SUPER_RESERVED - SUPER_OFFSET, &bl, &ioc,
+		     false);
+  if (r < 0) {
+    derr << __func__ << " failed to read superblock: " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+  uint64_t magic, size;
+  uuid_d uuid;
+  uint32_t crc, expected_crc;
+  bufferlist::iterator p = bl.begin();
+  try {
+    ::decode(magic, p);
+    ::decode(uuid, p);
+    ::decode(size, p);
+    bufferlist t;
+    t.substr_of(bl, 0, p.get_off());
+    crc = t.crc32c(-1);
+    ::decode(expected_crc, p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " unable to decode superblock" << dendl;
+    return -EIO;
+  }
+  if (magic != SUPER_MAGIC || crc != expected_crc) {
+    derr << __func__ << " bad superblock magic 0x" << std::hex << magic
+	 << " crc 0x" << crc << " expected 0x" << expected_crc << std::dec
+	 << dendl;
+    return -EIO;
+  }
+  if (uuid != fsid) {
+    derr << __func__ << " fsid " << uuid << " does not match our fsid "
+	 << fsid << dendl;
+    return -EIO;
+  }
+  if (size > ring_size) {
+    derr << __func__ << " ring 0x" << std::hex << size
+	 << " does not fit on device (0x" << ring_size << ")" << std::dec
+	 << dendl;
+    return -EIO;
+  }
+  ring_size = size;
+  dout(1) << __func__ << " ring 0x" << std::hex << ring_size << std::dec
+	  << dendl;
+  return 0;
+}
+
+int DeferredLog::append(uint64_t seq, bufferlist& payload, IOContext *ioc,
+			uint64_t *pos, uint64_t *offset, uint64_t *length)
+{
+  uint64_t need = ROUND_UP_TO(RECORD_HEADER_SIZE + payload.length(),
+			      block_size);
+  // leave room for wrap-around padding; big records go to kv instead
+  if (need > ring_size / 4) {
+    dout(20) << __func__ << " seq " << seq << " 0x" << std::hex << need
+	     << std::dec << " too big" << dendl;
+    return -ENOSPC;
+  }
+
+  {
+    std::lock_guard<std::mutex> l(lock);
+    uint64_t p = head;
+    uint64_t phys = p % ring_size;
+    if (phys + need > ring_size) {
+      p += ring_size - phys;
+      phys = 0;
+    }
+    uint64_t tail = live.empty() ? head : live.begin()->first;
+    if (p + need - tail > ring_size) {
+      dout(20) << __func__ << " seq " << seq << " ring full, tail 0x"
+	       << std::hex << tail << " head 0x" << head << std::dec << dendl;
+      return -ENOSPC;
+    }
+    head = p + need;
+    live[p] = need;
+    used += need;
+    *pos = p;
+    *offset = SUPER_RESERVED + phys;
+    *length = need;
+  }
+
+  bufferlist bl;
+  ::encode(RECORD_MAGIC, bl);
+  ::encode(seq, bl);
+  ::encode((uint32_t)payload.length(), bl);
+  ::encode(payload.crc32c(-1), bl);
+  assert(bl.length() == RECORD_HEADER_SIZE);
+  bl.append(payload);
+  bl.append_zero(need - bl.length());
+
+  dout(20) << __func__ << " seq " << seq << " pos 0x" << std::hex << *pos
+	   << " at 0x" << *offset << "~" << need << std::dec << dendl;
+  int r = bdev->aio_write(*offset, bl, ioc, false);
+  if (r < 0) {
+    derr << __func__ << " seq " << seq << " write failed: "
+	 << cpp_strerror(r) << dendl;
+    release(*pos);
+  }
+  return r;
+}
+
+int DeferredLog::read(uint64_t seq, uint64_t offset, uint64_t length,
+		      bufferlist *payload)
+{
+  if (offset < SUPER_RESERVED ||
+      offset + length > SUPER_RESERVED + ring_size ||
+      length < RECORD_HEADER_SIZE) {
+    derr << __func__ << " seq " << seq << " bad extent 0x" << std::hex
+	 << offset << "~" << length << std::dec << dendl;
+    return -EIO;
+  }
+  bufferlist bl;
+  IOContext ioc(cct, NULL);
+  int r = bdev->read(offset, length, &bl, &ioc, false);
+  if (r < 0) {
+    derr << __func__ << " seq " << seq << " read failed: " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+  uint64_t magic, rseq;
+  uint32_t len, crc;
+  bufferlist::iterator p = bl.begin();
+  ::decode(magic, p);
+  ::decode(rseq, p);
+  ::decode(len, p);
+  ::decode(crc, p);
+  if (magic != RECORD_MAGIC || rseq != seq ||
+      RECORD_HEADER_SIZE + len > length) {
+    derr << __func__ << " seq " << seq << " bad record header at 0x"
+	 << std::hex << offset << std::dec << " (magic 0x" << std::hex
+	 << magic << std::dec << " seq " << rseq << " len " << len << ")"
+	 << dendl;
+    return -EIO;
+  }
+  payload->clear();
+  payload->substr_of(bl, RECORD_HEADER_SIZE, len);
+  if (payload->crc32c(-1) != crc) {
+    derr << __func__ << " seq " << seq << " bad crc at 0x" << std::hex
+	 << offset << std::dec << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+void DeferredLog::release(uint64_t pos)
+{
+  std::lock_guard<std::mutex> l(lock);
+  auto p = live.find(pos);
+  if (p == live.end()) {
+    // record from a previous mount; its space was reset on open
+    return;
+  }
+  dout(20) << __func__ << " pos 0x" << std::hex << pos << "~" << p->second
+	   << std::dec << dendl;
+  used -= p->second;
+  live.erase(p);
+}
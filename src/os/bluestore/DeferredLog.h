@@ -0,0 +1,91 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_DEFERREDLOG_H
+#define CEPH_OS_BLUESTORE_DEFERREDLOG_H
+
+#include <map>
+#include <mutex>
+
+#include "include/buffer.h"
+#include "include/uuid.h"
+
+class BlockDevice;
+class CephContext;
+struct IOContext;
+
+/**
+ * DeferredLog - ring log for deferred write payloads
+ *
+ * The ring lives on a dedicated (fast, typically persistent memory)
+ * BlockDevice.  Each record holds one encoded
+ * bluestore_deferred_transaction_t and must be stable before the kv
+ * transaction that references it is submitted, so the (potentially
+ * large) deferred data never passes through the kv store's own WAL; the
+ * kv store only carries a small (offset, length) reference.
+ *
+ * Records are appended at the head and released, possibly out of
+ * order, once the deferred io is stable on the main device and the
+ * reference has been removed from the kv store.  Space is reclaimed
+ * from the oldest record still live.  Records never wrap around the
+ * end of the ring.
+ */
+class DeferredLog {
+public:
+  /// superblock is stored in the first block after the bdev label
+  static const uint64_t SUPER_RESERVED = 8192;
+
+  DeferredLog(CephContext *cct, BlockDevice *bdev)
+    : cct(cct), bdev(bdev) {}
+
+  int create(const uuid_d& fsid);
+  int open(const uuid_d& fsid);
+
+  /**
+   * queue a record as aio on @p ioc
+   *
+   * The caller submits @p ioc, and must wait for it and flush the
+   * device before anything referencing the record may commit.
+   *
+   * @param seq deferred transaction seq, stored in the record header
+   * @param payload encoded deferred transaction
+   * @param ioc io context to queue the write on
+   * @param pos [out] ring position, to be passed to release()
+   * @param offset [out] device offset of the record
+   * @param length [out] on-disk length of the record
+   * @return 0 on success, -ENOSPC if the record does not fit right now
+   */
+  int append(uint64_t seq, bufferlist& payload, IOContext *ioc,
+	     uint64_t *pos, uint64_t *offset, uint64_t *length);
+
+  /// read back and verify a record written by append()
+  int read(uint64_t seq, uint64_t offset, uint64_t length,
+	   bufferlist *payload);
+
+  /// allow the space used by the record at @p pos to be reused
+  void release(uint64_t pos);
+
+  uint64_t get_ring_size() const {
+    return ring_size;
+  }
+  uint64_t get_used() {
+    std::lock_guard<std::mutex> l(lock);
+    return used;
+  }
+
+private:
+  CephContext *cct;
+  BlockDevice *bdev;
+
+  uint64_t block_size = 0;
+  uint64_t ring_size = 0;   ///< bytes available for records
+
+  std::mutex lock;
+  uint64_t head = 0;        ///< logical position of next append
+  uint64_t used = 0;        ///< bytes held by live records
+  std::map<uint64_t,uint64_t> live;  ///< logical pos -> length
+
+  void _init_geometry();
+};
+
+#endif
@@ -0,0 +1,401 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ExtentAllocator.h"
+#include "bluestore_types.h"
+#include "common/admin_socket.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/Formatter.h"
+#include "include/intarith.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "extentalloc " << name << " "
+
+/// number of misaligned best-fit candidates we look at before giving up
+/// on an exact size and jumping to one that surely fits
+static const unsigned MAX_SKEWED_CANDIDATES = 8;
+
+class ExtentAllocatorHook : public AdminSocketHook {
+  ExtentAllocator *alloc;
+public:
+  explicit ExtentAllocatorHook(ExtentAllocator *a) : alloc(a) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) override {
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    alloc->dump_fragmentation(f);
+    f->flush(out);
+    delete f;
+    return true;
+  }
+};
+
+ExtentAllocator::ExtentAllocator(CephContext* cct, const std::string& name)
+  : cct(cct), name(name)
+{
+  if (name.empty())
+    return;
+  asok_hook = new ExtentAllocatorHook(this);
+  string cmd = "bluestore allocator fragmentation " + name;
+  int r = cct->get_admin_socket()->register_command(
+    cmd, cmd, asok_hook, "dump free space fragmentation of " + name);
+  if (r < 0) {
+    // e.g., several stores in one process
+    ldout(cct, 1) << __func__ << " unable to register '" << cmd << "': "
+		  << cpp_strerror(r) << dendl;
+    delete asok_hook;
+    asok_hook = nullptr;
+  }
+}
+
+ExtentAllocator::~ExtentAllocator()
+{
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command(
+      "bluestore allocator fragmentation " + name);
+    delete asok_hook;
+  }
+}
+
+void ExtentAllocator::_insert(uint64_t offset, uint64_t length)
+{
+  by_offset[offset] = length;
+  by_size.insert(len_off_t(length, offset));
+}
+
+void ExtentAllocator::_remove(offset_map_t::iterator p)
+{
+  by_size.erase(len_off_t(p->second, p->first));
+  by_offset.erase(p);
+}
+
+void ExtentAllocator::_add_free(uint64_t offset, uint64_t length)
+{
+  ldout(cct, 30) << __func__ << " 0x" << std::hex << offset << "~" << length
+		 << std::dec << dendl;
+  uint64_t end = offset + length;
+  auto n = by_offset.lower_bound(offset);
+  if (n != by_offset.end()) {
+    assert(n->first >= end);  // no overlap
+  }
+  bool merge_next = n != by_offset.end() && n->first == end;
+  bool merge_prev = false;
+  uint64_t prev_offset = 0;
+  if (n != by_offset.begin()) {
+    auto p = n;
+    --p;
+    assert(p->first + p->second <= offset);
+    merge_prev = p->first + p->second == offset;
+    prev_offset = p->first;
+  }
+  // btree iterators do not survive an erase; look things up again
+  if (merge_next) {
+    end += n->second;
+    _remove(n);
+  }
+  if (merge_prev) {
+    offset = prev_offset;
+    _remove(by_offset.find(prev_offset));
+  }
+  _insert(offset, end - offset);
+}
+
+void ExtentAllocator::_take(offset_map_t::iterator p,
+			    uint64_t offset, uint64_t length)
+{
+  uint64_t start = p->first;
+  uint64_t end = p->first + p->second;
+  assert(start <= offset && offset + length <= end);
+  _remove(p);
+  if (start < offset) {
+    _insert(start, offset - start);
+  }
+  if (offset + length < end) {
+    _insert(offset + length, end - offset - length);
+  }
+}
+
+bool ExtentAllocator::_allocate_one(
+  uint64_t want, uint64_t alloc_unit, uint64_t hint,
+  uint64_t *offset, uint64_t *length)
+{
+  offset_map_t::iterator p = by_offset.end();
+  uint64_t aoff = 0;
+
+  // the free extent that contains or follows the hint, for locality
+  if (hint) {
+    auto q = by_offset.upper_bound(hint);
+    if (q != by_offset.begin()) {
+      auto prev = q;
+      --prev;
+      uint64_t a = ROUND_UP_TO(std::max(prev->first, hint), alloc_unit);
+      if (a + want <= prev->first + prev->second) {
+	p = prev;
+	aoff = a;
+      }
+    }
+    if (p == by_offset.end() && q != by_offset.end()) {
+      uint64_t a = ROUND_UP_TO(q->first, alloc_unit);
+      if (a + want <= q->first + q->second) {
+	p = q;
+	aoff = a;
+      }
+    }
+  }
+
+  // best fit: the smallest extent that holds want once aligned
+  if (p == by_offset.end()) {
+    auto s = by_size.lower_bound(len_off_t(want, 0));
+    unsigned skewed = 0;
+    while (s != by_size.end()) {
+      uint64_t a = ROUND_UP_TO(s->second, alloc_unit);
+      if (a + want <= s->second + s->first) {
+	p = by_offset.find(s->second);
+	aoff = a;
+	break;
+      }
+      if (++skewed == MAX_SKEWED_CANDIDATES) {
+	s = by_size.lower_bound(len_off_t(want + alloc_unit - 1, 0));
+      } else {
+	++s;
+      }
+    }
+  }
+
+  // nothing big enough: settle for the largest extent we can align
+  if (p == by_offset.end()) {
+    auto s = by_size.end();
+    while (s != by_size.begin()) {
+      --s;
+      if (s->first < alloc_unit) {
+	break;
+      }
+      uint64_t a = ROUND_UP_TO(s->second, alloc_unit);
+      uint64_t e = s->second + s->first;
+      if (a + alloc_unit <= e) {
+	p = by_offset.find(s->second);
+	aoff = a;
+	want = std::min(want, (e - a) / alloc_unit * alloc_unit);
+	break;
+      }
+    }
+  }
+
+  if (p == by_offset.end()) {
+    return false;
+  }
+
+  if (cct->_conf->bluestore_debug_small_allocations) {
+    uint64_t max =
+      alloc_unit * (rand() % cct->_conf->bluestore_debug_small_allocations);
+    if (max && want > max) {
+      ldout(cct, 10) << __func__ << " shortening allocation of 0x" << std::hex
+		     << want << " -> 0x" << max
+		     << " due to debug_small_allocations" << std::dec << dendl;
+      want = max;
+    }
+  }
+
+  ldout(cct, 30) << __func__ << " got 0x" << std::hex << aoff << "~" << want
+		 << " from 0x" << p->first << "~" << p->second << std::dec
+		 << dendl;
+  _take(p, aoff, want);
+  *offset = aoff;
+  *length = want;
+  return true;
+}
+
+int ExtentAllocator::reserve(uint64_t need)
+{
+  int64_t reserved = num_reserved.load();
+  do {
+    if ((int64_t)need > num_free.load() - reserved) {
+      ldout(cct, 10) << __func__ << " need 0x" << std::hex << need
+		     << " num_free 0x" << num_free.load()
+		     << " num_reserved 0x" << reserved << std::dec
+		     << " -ENOSPC" << dendl;
+      return -ENOSPC;
+    }
+  } while (!num_reserved.compare_exchange_weak(reserved, reserved + need));
+  ldout(cct, 10) << __func__ << " need 0x" << std::hex << need
+		 << " num_reserved 0x" << reserved + need << std::dec << dendl;
+  return 0;
+}
+
+void ExtentAllocator::unreserve(uint64_t unused)
+{
+  int64_t was = num_reserved.fetch_sub(unused);
+  ldout(cct, 10) << __func__ << " unused 0x" << std::hex << unused
+		 << " num_reserved 0x" << was - (int64_t)unused << std::dec
+		 << dendl;
+  assert(was >= (int64_t)unused);
+}
+
+int64_t ExtentAllocator::allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  AllocExtentVector *extents)
+{
+  ldout(cct, 10) << __func__ << " want_size 0x" << std::hex << want_size
+		 << " alloc_unit 0x" << alloc_unit
+		 << " hint 0x" << hint << std::dec << dendl;
+  if (max_alloc_size == 0) {
+    max_alloc_size = want_size;
+  }
+  ExtentList block_list = ExtentList(extents, 1, max_alloc_size);
+
+  uint64_t allocated_size = 0;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    if (!hint)
+      hint = last_alloc;
+    while (allocated_size < want_size) {
+      uint64_t offset, length;
+      uint64_t want = std::max(alloc_unit,
+			       std::min(max_alloc_size,
+					want_size - allocated_size));
+      if (!_allocate_one(want, alloc_unit, hint, &offset, &length)) {
+	break;
+      }
+      block_list.add_extents(offset, length);
+      allocated_size += length;
+      hint = offset + length;
+    }
+    if (allocated_size) {
+      last_alloc = hint;
+    }
+  }
+
+  if (allocated_size == 0) {
+    return -ENOSPC;
+  }
+  // free first, so that a racing reserve() errs on the safe side
+  num_free -= allocated_size;
+  num_reserved -= allocated_size;
+  assert(num_free.load() >= 0);
+  return allocated_size;
+}
+
+void ExtentAllocator::release(
+  uint64_t offset, uint64_t length)
+{
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+		 << std::dec << dendl;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    _add_free(offset, length);
+  }
+  num_free += length;
+}
+
+uint64_t ExtentAllocator::get_free()
+{
+  return num_free.load();
+}
+
+void ExtentAllocator::dump()
+{
+  std::lock_guard<std::mutex> l(lock);
+  ldout(cct, 0) << __func__ << " " << by_offset.size() << " free extents, 0x"
+		<< std::hex << num_free.load() << std::dec << " bytes"
+		<< dendl;
+  for (auto& p : by_offset) {
+    ldout(cct, 0) << __func__ << "  0x" << std::hex << p.first << "~"
+		  << p.second << std::dec << dendl;
+  }
+}
+
+bool ExtentAllocator::foreach(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard<std::mutex> l(lock);
+  for (auto& p : by_offset) {
+    notify(p.first, p.second);
+  }
+  return true;
+}
+
+void ExtentAllocator::dump_fragmentation(Formatter *f)
+{
+  // free extents by power-of-two size class
+  vector<uint64_t> bin_count, bin_bytes;
+  uint64_t free = 0, largest = 0, extents;
+  double sum_sq = 0;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    extents = by_size.size();
+    for (auto& p : by_size) {
+      unsigned bin = cbits(p.first) - 1;
+      if (bin >= bin_count.size()) {
+	bin_count.resize(bin + 1);
+	bin_bytes.resize(bin + 1);
+      }
+      ++bin_count[bin];
+      bin_bytes[bin] += p.first;
+      free += p.first;
+      sum_sq += (double)p.first * (double)p.first;
+    }
+    if (!by_size.empty()) {
+      largest = by_size.rbegin()->first;
+    }
+  }
+
+  f->open_object_section("fragmentation");
+  f->dump_string("name", name);
+  f->dump_unsigned("free_bytes", free);
+  f->dump_unsigned("free_extents", extents);
+  f->dump_unsigned("largest_free_extent", largest);
+  f->dump_unsigned("average_free_extent", extents ? free / extents : 0);
+  f->dump_int("reserved_bytes", num_reserved.load());
+  // 0 when all free space is one extent, approaching 1 as it is split
+  // into many similarly small pieces
+  f->dump_float("fragmentation_rating",
+		free ? 1.0 - sum_sq / ((double)free * (double)free) : 0.0);
+  f->open_array_section("free_extent_histogram");
+  for (unsigned i = 0; i < bin_count.size(); ++i) {
+    if (!bin_count[i])
+      continue;
+    f->open_object_section("bin");
+    f->dump_unsigned("min_size", 1ull << i);
+    f->dump_unsigned("count", bin_count[i]);
+    f->dump_unsigned("bytes", bin_bytes[i]);
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
+
+void ExtentAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+		 << std::dec << dendl;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    _add_free(offset, length);
+  }
+  num_free += length;
+}
+
+void ExtentAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  ldout(cct, 10) << __func__ << " 0x" << std::hex << offset << "~" << length
+		 << std::dec << dendl;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    auto p = by_offset.upper_bound(offset);
+    assert(p != by_offset.begin());
+    --p;
+    _take(p, offset, length);
+  }
+  num_free -= length;
+  assert(num_free.load() >= 0);
+}
+
+void ExtentAllocator::shutdown()
+{
+  ldout(cct, 1) << __func__ << dendl;
+}
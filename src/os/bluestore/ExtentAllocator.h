@@ -0,0 +1,88 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_EXTENTALLOCATOR_H
+#define CEPH_OS_BLUESTORE_EXTENTALLOCATOR_H
+
+#include <atomic>
+#include <mutex>
+
+#include "Allocator.h"
+#include "include/cpp-btree/btree_map.h"
+#include "include/cpp-btree/btree_set.h"
+#include "include/mempool.h"
+#include "os/bluestore/bluestore_types.h"
+
+class AdminSocketHook;
+
+/**
+ * ExtentAllocator - free extents indexed by both offset and size
+ *
+ * Free space is kept as non-overlapping, coalesced extents in two
+ * btrees: one keyed by offset (for merging on release and for hint
+ * locality) and one keyed by (length, offset) (for best-fit lookups).
+ * Both allocation and release are O(log n) regardless of how
+ * fragmented the device is, and init_add_free() is a plain insert.
+ *
+ * reserve()/unreserve() only touch atomic counters, so the per-txc
+ * reservations taken by writers never contend on the tree lock.
+ */
+class ExtentAllocator : public Allocator {
+  CephContext* cct;
+  std::string name;
+  std::mutex lock;
+
+  std::atomic<int64_t> num_free = {0};      ///< total bytes in freelist
+  std::atomic<int64_t> num_reserved = {0};  ///< reserved bytes
+
+  typedef mempool::bluestore_alloc::pool_allocator<
+    pair<const uint64_t,uint64_t>> offset_allocator;
+  typedef btree::btree_map<uint64_t,uint64_t,std::less<uint64_t>,
+			   offset_allocator> offset_map_t;
+  typedef pair<uint64_t,uint64_t> len_off_t;
+  typedef mempool::bluestore_alloc::pool_allocator<len_off_t> size_allocator;
+  typedef btree::btree_set<len_off_t,std::less<len_off_t>,
+			   size_allocator> size_set_t;
+
+  offset_map_t by_offset;  ///< offset -> length
+  size_set_t by_size;      ///< (length, offset)
+
+  uint64_t last_alloc = 0;
+
+  AdminSocketHook *asok_hook = nullptr;
+
+  void _insert(uint64_t offset, uint64_t length);
+  void _remove(offset_map_t::iterator p);
+  void _add_free(uint64_t offset, uint64_t length);
+  void _take(offset_map_t::iterator p, uint64_t offset, uint64_t length);
+  bool _allocate_one(uint64_t want, uint64_t alloc_unit, uint64_t hint,
+		     uint64_t *offset, uint64_t *length);
+
+public:
+  ExtentAllocator(CephContext* cct, const std::string& name);
+  ~ExtentAllocator() override;
+
+  int reserve(uint64_t need) override;
+  void unreserve(uint64_t unused) override;
+
+  int64_t allocate(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, AllocExtentVector *extents) override;
+
+  void release(
+    uint64_t offset, uint64_t length) override;
+
+  uint64_t get_free() override;
+
+  void dump() override;
+  bool foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
+  void dump_fragmentation(Formatter *f);
+
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+
+  void shutdown() override;
+};
+
+#endif
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 
 #include "KernelDevice.h"
+#include "ioring.h"
 #include "include/types.h"
 #include "include/compat.h"
 #include "include/stringify.h"
@@ -39,7 +40,6 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv)
     fd_buffered(-1),
     fs(NULL), aio(false), dio(false),
     debug_lock("KernelDevice::debug_lock"),
-    aio_queue(cct->_conf->bdev_aio_max_queue_depth),
     aio_stop(false),
     aio_thread(this),
     injecting_crash(0)
@@ -304,7 +304,24 @@ int KernelDevice::_aio_start()
 {
   if (aio) {
     dout(10) << __func__ << dendl;
-    int r = aio_queue.init();
+    std::vector<int> fds = { fd_direct };
+    int r;
+#if defined(HAVE_LIBURING)
+    if (cct->_conf->bdev_ioring) {
+      io_queue.reset(new ioring_queue_t(cct,
+					cct->_conf->bdev_aio_max_queue_depth,
+					cct->_conf->bdev_ioring_hipri));
+      r = io_queue->init(fds);
+      if (r == 0) {
+	aio_thread.create("bstore_aio");
+	return 0;
+      }
+      derr << __func__ << " io_uring unavailable (" << cpp_strerror(r)
+	   << "), falling back to libaio" << dendl;
+    }
+#endif
+    io_queue.reset(new aio_queue_t(cct->_conf->bdev_aio_max_queue_depth));
+    r = io_queue->init(fds);
     if (r < 0) {
       if (r == -EAGAIN) {
 	derr << __func__ << " io_setup(2) failed with EAGAIN; "
@@ -326,7 +343,8 @@ void KernelDevice::_aio_stop()
     aio_stop = true;
     aio_thread.join();
     aio_stop = false;
-    aio_queue.shutdown();
+    io_queue->shutdown();
+    io_queue.reset();
   }
 }
 
@@ -338,7 +356,7 @@ void KernelDevice::_aio_thread()
     dout(40) << __func__ << " polling" << dendl;
     int max = cct->_conf->bdev_aio_reap_max;
     aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
+    int r = io_queue->get_next_completed(cct->_conf->bdev_aio_poll_ms,
 					 aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
@@ -366,7 +384,15 @@ void KernelDevice::_aio_thread()
 		 << " ioc " << ioc
 		 << " with " << (ioc->num_running.load() - 1)
 		 << " aios left" << dendl;
-	assert(r >= 0);
+	if (r == -EIO && ioc->allow_eio &&
+	    aio[i]->iocb.aio_lio_opcode == IO_CMD_PREAD) {
+	  derr << __func__ << " read 0x" << std::hex << aio[i]->offset
+	       << "~" << aio[i]->length << std::dec << " got "
+	       << cpp_strerror(r) << dendl;
+	  ioc->set_return_value(r);
+	} else {
+	  assert(r >= 0);
+	}
 
 	// NOTE: once num_running and we either call the callback or
 	// call aio_wake we cannot touch ioc or aio[] as the caller
@@ -508,7 +534,7 @@ void KernelDevice::aio_submit(IOContext *ioc)
 
   void *priv = static_cast<void*>(ioc);
   int r, retries = 0;
-  r = aio_queue.submit_batch(ioc->running_aios.begin(), e, 
+  r = io_queue->submit_batch(ioc->running_aios.begin(), e,
 			     ioc->num_running.load(), priv, &retries);
   
   if (retries)
@@ -16,6 +16,7 @@
 #define CEPH_OS_BLUESTORE_KERNELDEVICE_H
 
 #include <atomic>
+#include <memory>
 
 #include "os/fs/FS.h"
 #include "include/interval_set.h"
@@ -35,7 +36,7 @@ class KernelDevice : public BlockDevice {
   std::atomic<bool> io_since_flush = {false};
   std::mutex flush_mutex;
 
-  aio_queue_t aio_queue;
+  std::unique_ptr<io_queue_t> io_queue;
   bool aio_stop;
 
   struct AioCompletionThread : public Thread {
@@ -52,6 +52,8 @@ public:
   uint64_t get_free() override;
 
   void dump() override;
+  bool foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
 
   void init_add_free(uint64_t offset, uint64_t length) override;
   void init_rm_free(uint64_t offset, uint64_t length) override;
@@ -21,6 +21,7 @@ struct aio_t {
   uint64_t offset, length;
   int rval;
   bufferlist bl;  ///< write payload (so that it remains stable for duration)
+  int buf_index = -1;  ///< io_queue_t's own read buffer in use, if any
 
   boost::intrusive::list_member_hook<> queue_item;
 
@@ -52,21 +53,35 @@ typedef boost::intrusive::list<
     boost::intrusive::list_member_hook<>,
     &aio_t::queue_item> > aio_list_t;
 
-struct aio_queue_t {
+/**
+ * io_queue_t - a kernel interface for submitting and reaping aio_t's
+ */
+struct io_queue_t {
+  typedef list<aio_t>::iterator aio_iter;
+
+  virtual ~io_queue_t() {}
+
+  /// @param fds files that ios will be submitted against
+  virtual int init(std::vector<int> &fds) = 0;
+  virtual void shutdown() = 0;
+  virtual int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+			   void *priv, int *retries) = 0;
+  virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+};
+
+struct aio_queue_t : public io_queue_t {
   int max_iodepth;
   io_context_t ctx;
 
-  typedef list<aio_t>::iterator aio_iter;
-
   explicit aio_queue_t(unsigned max_iodepth)
     : max_iodepth(max_iodepth),
       ctx(0) {
   }
-  ~aio_queue_t() {
+  ~aio_queue_t() override {
     assert(ctx == 0);
   }
 
-  int init() {
+  int init(std::vector<int> &fds) override {
     assert(ctx == 0);
     int r = io_setup(max_iodepth, &ctx);
     if (r < 0) {
@@ -77,7 +92,7 @@ struct aio_queue_t {
     }
     return r;
   }
-  void shutdown() {
+  void shutdown() override {
     if (ctx) {
       int r = io_destroy(ctx);
       assert(r == 0);
@@ -86,9 +101,9 @@ struct aio_queue_t {
   }
 
   int submit(aio_t &aio, int *retries);
-  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size, 
-		   void *priv, int *retries);
-  int get_next_completed(int timeout_ms, aio_t **paio, int max);
+  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+		   void *priv, int *retries) override;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) override;
 };
 
 #endif
@@ -715,6 +715,38 @@ void bluestore_blob_t::calc_csum(uint64_t b_off, const bufferlist& bl)
   }
 }
 
+void bluestore_blob_t::calc_csum_batch(vector<csum_batch_item_t>& items)
+{
+  // group by type; blobs written by one txc almost always share one
+  std::map<unsigned, vector<Checksummer::batch_item_t>> by_type;
+  for (auto& i : items) {
+    Checksummer::batch_item_t ci = {
+      i.blob->get_csum_chunk_size(), i.b_off, i.bl.length(), &i.bl,
+      &i.blob->csum_data
+    };
+    by_type[i.blob->csum_type].push_back(ci);
+  }
+  for (auto& p : by_type) {
+    switch (p.first) {
+    case Checksummer::CSUM_XXHASH32:
+      Checksummer::calculate_batch<Checksummer::xxhash32>(-1, p.second);
+      break;
+    case Checksummer::CSUM_XXHASH64:
+      Checksummer::calculate_batch<Checksummer::xxhash64>(-1, p.second);
+      break;
+    case Checksummer::CSUM_CRC32C:
+      Checksummer::calculate_batch<Checksummer::crc32c>(-1, p.second);
+      break;
+    case Checksummer::CSUM_CRC32C_16:
+      Checksummer::calculate_batch<Checksummer::crc32c_16>(-1, p.second);
+      break;
+    case Checksummer::CSUM_CRC32C_8:
+      Checksummer::calculate_batch<Checksummer::crc32c_8>(-1, p.second);
+      break;
+    }
+  }
+}
+
 int bluestore_blob_t::verify_csum(uint64_t b_off, const bufferlist& bl,
 				  int* b_bad_off, uint64_t *bad_csum) const
 {
@@ -1131,6 +1163,14 @@ void bluestore_compression_header_t::dump(Formatter *f) const
 {
   f->dump_unsigned("type", type);
   f->dump_unsigned("length", length);
+  if (is_framed()) {
+    f->dump_unsigned("frame_size", frame_size);
+    f->open_array_section("frame_lengths");
+    for (auto l : frame_lengths) {
+      f->dump_unsigned("length", l);
+    }
+    f->close_section();
+  }
 }
 
 void bluestore_compression_header_t::generate_test_instances(
@@ -1139,4 +1179,8 @@ void bluestore_compression_header_t::generate_test_instances(
   o.push_back(new bluestore_compression_header_t);
   o.push_back(new bluestore_compression_header_t(1));
   o.back()->length = 1234;
+  o.push_back(new bluestore_compression_header_t(1));
+  o.back()->length = 1234;
+  o.back()->frame_size = 16384;
+  o.back()->frame_lengths = {1000, 234};
 }
@@ -829,6 +829,17 @@ public:
   /// calculate csum for the buffer at the given b_off
   void calc_csum(uint64_t b_off, const bufferlist& bl);
 
+  struct csum_batch_item_t {
+    bluestore_blob_t *blob;
+    uint64_t b_off;
+    bufferlist bl;
+    csum_batch_item_t(bluestore_blob_t *blob, uint64_t b_off,
+		      const bufferlist& bl)
+      : blob(blob), b_off(b_off), bl(bl) {}
+  };
+  /// calc_csum() for several blobs at once
+  static void calc_csum_batch(vector<csum_batch_item_t>& items);
+
   /// verify csum: return -EOPNOTSUPP for unsupported checksum type;
   /// return -1 and valid(nonnegative) b_bad_off for checksum error;
   /// return 0 if all is well.
@@ -1053,14 +1064,29 @@ struct bluestore_compression_header_t {
   uint8_t type = Compressor::COMP_ALG_NONE;
   uint32_t length = 0;
 
+  /// if nonzero, the payload is a sequence of independently compressed
+  /// frames of frame_size raw bytes each (the last may be shorter)
+  uint32_t frame_size = 0;
+  std::vector<uint32_t> frame_lengths;  ///< compressed length of each frame
+
   bluestore_compression_header_t() {}
   bluestore_compression_header_t(uint8_t _type)
     : type(_type) {}
 
+  bool is_framed() const {
+    return frame_size != 0;
+  }
+
   DENC(bluestore_compression_header_t, v, p) {
-    DENC_START(1, 1, p);
+    // unframed headers stay v1 so that they remain byte-identical (and
+    // readable by older code)
+    DENC_START(v.is_framed() ? 2 : 1, 1, p);
     denc(v.type, p);
     denc(v.length, p);
+    if (struct_v >= 2) {
+      denc(v.frame_size, p);
+      denc(v.frame_lengths, p);
+    }
     DENC_FINISH(p);
   }
   void dump(Formatter *f) const;
@@ -0,0 +1,289 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ioring.h"
+
+#if defined(HAVE_LIBAIO) && defined(HAVE_LIBURING)
+
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/compat.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bdev
+#undef dout_prefix
+#define dout_prefix *_dout << "ioring "
+
+ioring_queue_t::buffer_pool_t::buffer_pool_t(unsigned slot_size,
+					     unsigned num_slots)
+  : slot_size(slot_size), num_slots(num_slots)
+{
+  void *p = ::mmap(nullptr, (size_t)slot_size * num_slots,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return;
+  }
+  base = static_cast<char*>(p);
+  free_slots.reserve(num_slots);
+  for (unsigned i = num_slots; i > 0; --i) {
+    free_slots.push_back(i - 1);
+  }
+}
+
+ioring_queue_t::buffer_pool_t::~buffer_pool_t()
+{
+  if (base) {
+    ::munmap(base, (size_t)slot_size * num_slots);
+  }
+}
+
+ioring_queue_t::ioring_queue_t(CephContext *cct, unsigned iodepth, bool hipri)
+  : cct(cct), iodepth(iodepth), hipri(hipri)
+{
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+  assert(!ring_initialized);
+}
+
+int ioring_queue_t::init(std::vector<int> &fds)
+{
+  assert(!ring_initialized);
+  unsigned flags = hipri ? IORING_SETUP_IOPOLL : 0;
+  int r = io_uring_queue_init(iodepth, &ring, flags);
+  if (r < 0) {
+    derr << __func__ << " io_uring_queue_init failed: " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+  ring_initialized = true;
+
+  r = io_uring_register_files(&ring, &fds[0], fds.size());
+  if (r < 0) {
+    dout(1) << __func__ << " unable to register files: " << cpp_strerror(r)
+	    << dendl;
+  } else {
+    for (unsigned i = 0; i < fds.size(); ++i) {
+      fixed_fds[fds[i]] = i;
+    }
+  }
+
+  unsigned num_slots = cct->_conf->bdev_ioring_registered_buffers;
+  unsigned slot_size = cct->_conf->bdev_ioring_registered_buffer_size;
+  if (num_slots && slot_size) {
+    std::unique_ptr<buffer_pool_t> pool(
+      new buffer_pool_t(slot_size, num_slots));
+    if (pool->base) {
+      struct iovec iov = { pool->base, (size_t)slot_size * num_slots };
+      r = io_uring_register_buffers(&ring, &iov, 1);
+      if (r < 0) {
+	// most likely RLIMIT_MEMLOCK
+	dout(1) << __func__ << " unable to register " << num_slots << " x "
+		<< slot_size << " byte buffers: " << cpp_strerror(r) << dendl;
+      } else {
+	buffers = std::move(pool);
+      }
+    }
+  }
+
+  if (!hipri) {
+    epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+      r = -errno;
+      derr << __func__ << " epoll_create1 failed: " << cpp_strerror(r)
+	   << dendl;
+      shutdown();
+      return r;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ring.ring_fd, &ev) < 0) {
+      r = -errno;
+      derr << __func__ << " epoll_ctl failed: " << cpp_strerror(r) << dendl;
+      shutdown();
+      return r;
+    }
+  }
+
+  dout(1) << __func__ << " depth " << iodepth
+	  << (hipri ? " polled" : "")
+	  << (fixed_fds.empty() ? "" : " fixed files")
+	  << (buffers ? " fixed buffers" : "") << dendl;
+  return 0;
+}
+
+void ioring_queue_t::shutdown()
+{
+  if (epoll_fd >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(epoll_fd));
+    epoll_fd = -1;
+  }
+  if (ring_initialized) {
+    // unregisters files and buffers, too
+    io_uring_queue_exit(&ring);
+    ring_initialized = false;
+  }
+  fixed_fds.clear();
+  // nothing is in flight, so no slot is in use
+  buffers.reset();
+}
+
+void ioring_queue_t::_prep(struct io_uring_sqe *sqe, aio_t& aio)
+{
+  int fd = aio.fd;
+  auto f = fixed_fds.find(aio.fd);
+  if (f != fixed_fds.end()) {
+    fd = f->second;
+  }
+  if (aio.iocb.aio_lio_opcode == IO_CMD_PWRITEV) {
+    io_uring_prep_writev(sqe, fd, &aio.iov[0], aio.iov.size(), aio.offset);
+  } else {
+    assert(aio.iocb.aio_lio_opcode == IO_CMD_PREAD);
+    char *buf = static_cast<char*>(aio.iocb.u.c.buf);
+    if (buffers && aio.length <= buffers->slot_size) {
+      // read into the arena and copy out on completion; the caller's
+      // buffer may well end up cached, and must not hold on to a slot
+      std::lock_guard<std::mutex> l(buffers->lock);
+      if (!buffers->free_slots.empty()) {
+	aio.buf_index = buffers->free_slots.back();
+	buffers->free_slots.pop_back();
+      }
+    }
+    if (aio.buf_index >= 0) {
+      io_uring_prep_read_fixed(sqe, fd, buffers->get_slot(aio.buf_index),
+			       aio.length, aio.offset, 0);
+    } else {
+      aio.iov.resize(1);
+      aio.iov[0].iov_base = buf;
+      aio.iov[0].iov_len = aio.length;
+      io_uring_prep_readv(sqe, fd, &aio.iov[0], 1, aio.offset);
+    }
+  }
+  if (f != fixed_fds.end()) {
+    io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+  }
+  io_uring_sqe_set_data(sqe, &aio);
+}
+
+int ioring_queue_t::submit_batch(aio_iter begin, aio_iter end,
+				 uint16_t aios_size, void *priv,
+				 int *retries)
+{
+  // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
+  int attempts = 16;
+  int delay = 125;
+  int queued = 0;
+
+  std::lock_guard<std::mutex> l(sq_mutex);
+  for (aio_iter cur = begin; cur != end; ++cur) {
+    cur->priv = priv;
+    struct io_uring_sqe *sqe;
+    while ((sqe = io_uring_get_sqe(&ring)) == nullptr) {
+      // the ring is full; hand what we have to the kernel
+      int r = io_uring_submit(&ring);
+      if (r < 0 && r != -EAGAIN && r != -EBUSY) {
+	return r;
+      }
+      if (r <= 0) {
+	if (attempts-- == 0) {
+	  return -EAGAIN;
+	}
+	usleep(delay);
+	delay *= 2;
+	(*retries)++;
+      }
+    }
+    _prep(sqe, *cur);
+    ++queued;
+    ++inflight;
+  }
+
+  while (true) {
+    int r = io_uring_submit(&ring);
+    if ((r == -EAGAIN || r == -EBUSY) && attempts-- > 0) {
+      usleep(delay);
+      delay *= 2;
+      (*retries)++;
+      continue;
+    }
+    if (r < 0) {
+      return r;
+    }
+    break;
+  }
+  if (hipri) {
+    std::lock_guard<std::mutex> l(idle_lock);
+    idle_cond.notify_one();
+  }
+  return queued;
+}
+
+void ioring_queue_t::_finish_read(aio_t& aio)
+{
+  char *slot = buffers->get_slot(aio.buf_index);
+  if (aio.rval > 0) {
+    memcpy(aio.iocb.u.c.buf, slot, aio.rval);
+  }
+  std::lock_guard<std::mutex> l(buffers->lock);
+  buffers->free_slots.push_back(aio.buf_index);
+  aio.buf_index = -1;
+}
+
+int ioring_queue_t::_reap(aio_t **paio, int max)
+{
+  struct io_uring_cqe *cqe[max];
+  unsigned n = io_uring_peek_batch_cqe(&ring, cqe, max);
+  for (unsigned i = 0; i < n; ++i) {
+    paio[i] = static_cast<aio_t*>(io_uring_cqe_get_data(cqe[i]));
+    paio[i]->rval = cqe[i]->res;
+    if (paio[i]->buf_index >= 0) {
+      _finish_read(*paio[i]);
+    }
+  }
+  io_uring_cq_advance(&ring, n);
+  inflight -= n;
+  return n;
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  int n = _reap(paio, max);
+  if (n) {
+    return n;
+  }
+
+  if (hipri) {
+    // nothing completes unless we poll for it, but do not spin on an
+    // idle device
+    if (inflight.load() == 0) {
+      std::unique_lock<std::mutex> l(idle_lock);
+      idle_cond.wait_for(l, std::chrono::milliseconds(timeout_ms),
+			 [this] { return inflight.load() > 0; });
+      if (inflight.load() == 0) {
+	return 0;
+      }
+    }
+    struct io_uring_cqe *cqe;
+    int r = io_uring_wait_cqe(&ring, &cqe);
+    if (r < 0 && r != -EINTR && r != -EAGAIN) {
+      return r;
+    }
+  } else {
+    struct epoll_event ev;
+    int r = ::epoll_wait(epoll_fd, &ev, 1, timeout_ms);
+    if (r < 0) {
+      return errno == EINTR ? 0 : -errno;
+    }
+    if (r == 0) {
+      return 0;
+    }
+  }
+  return _reap(paio, max);
+}
+
+#endif
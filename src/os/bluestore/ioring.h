@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include "acconfig.h"
+#if defined(HAVE_LIBAIO) && defined(HAVE_LIBURING)
+
+#include <liburing.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "aio.h"
+
+class CephContext;
+
+/**
+ * ioring_queue_t - io_uring backend for KernelDevice
+ *
+ * A whole IOContext is queued on the submission ring under one lock and
+ * submitted with a single io_uring_enter(2); completions are reaped in
+ * batches straight from the completion ring.  The target files are
+ * registered with the ring, and small direct reads land in a registered
+ * buffer arena so the kernel does not have to map and pin the pages for
+ * every io; the data is copied to the caller's buffer as the read
+ * completes, so arena slots are only held while io is in flight.
+ *
+ * With hipri set the ring is created with IORING_SETUP_IOPOLL and the
+ * completion thread polls the device for completions instead of waiting
+ * for interrupts; this only works for O_DIRECT io on devices with poll
+ * queues (typically NVMe).
+ */
+struct ioring_queue_t : public io_queue_t {
+  /// registered read buffers
+  struct buffer_pool_t {
+    char *base = nullptr;
+    unsigned slot_size = 0;
+    unsigned num_slots = 0;
+    std::mutex lock;
+    std::vector<unsigned> free_slots;
+
+    buffer_pool_t(unsigned slot_size, unsigned num_slots);
+    ~buffer_pool_t();
+    char *get_slot(unsigned slot) {
+      return base + (uint64_t)slot * slot_size;
+    }
+  };
+
+  ioring_queue_t(CephContext *cct, unsigned iodepth, bool hipri);
+  ~ioring_queue_t() override;
+
+  int init(std::vector<int> &fds) override;
+  void shutdown() override;
+  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+		   void *priv, int *retries) override;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) override;
+
+private:
+  CephContext *cct;
+  unsigned iodepth;
+  bool hipri;
+
+  struct io_uring ring;
+  bool ring_initialized = false;
+  int epoll_fd = -1;
+
+  std::mutex sq_mutex;       ///< the submission ring has a single producer
+  std::map<int,int> fixed_fds;  ///< fd -> registered file index
+
+  std::unique_ptr<buffer_pool_t> buffers;  ///< null if not registered
+
+  /// submitted but not yet reaped; hipri only polls while this is nonzero
+  std::atomic<int64_t> inflight = {0};
+  std::mutex idle_lock;
+  std::condition_variable idle_cond;
+
+  void _prep(struct io_uring_sqe *sqe, aio_t& aio);
+  void _finish_read(aio_t& aio);
+  int _reap(aio_t **paio, int max);
+};
+
+#endif
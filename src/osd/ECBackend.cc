@@ -1779,6 +1779,137 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
   check_ops();
 }
 
+bool ECBackend::is_write_in_flight(
+  const hobject_t &hoid,
+  bool delta_only) const
+{
+  for (auto &&l: {&waiting_reads, &waiting_commit}) {
+    for (auto &&op: *l) {
+      if (delta_only && !op.delta_write)
+	continue;
+      if (op.plan.will_write.count(hoid))
+	return true;
+    }
+  }
+  return false;
+}
+
+bool ECBackend::get_delta_read_shards(
+  const hobject_t &hoid,
+  const set<int> &data_shards,
+  set<pg_shard_t> *shards)
+{
+  set<int> want = data_shards;
+  set<int> all_data;
+  get_want_to_read_shards(&all_data);
+  for (int i = 0; i < (int)ec_impl->get_chunk_count(); ++i) {
+    if (!all_data.count(i))
+      want.insert(i);
+  }
+  for (auto &&i: get_parent()->get_acting_shards()) {
+    if (!want.count(i.shard))
+      continue;
+    if (get_parent()->get_shard_missing(i).is_missing(hoid))
+      return false;
+    shards->insert(i);
+  }
+  return shards->size() == want.size();
+}
+
+struct FinishDeltaRead :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  hobject_t hoid;
+  FinishDeltaRead(ECBackend *ec, ceph_tid_t tid, const hobject_t &hoid)
+    : ec(ec), tid(tid), hoid(hoid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ec->handle_delta_read(tid, hoid, in.second);
+  }
+};
+
+void ECBackend::start_delta_read(Op *op)
+{
+  map<hobject_t, read_request_t> for_read_op;
+  for (const auto &hpair: op->remote_read) {
+    auto diter = op->plan.delta_data_shards.find(hpair.first);
+    assert(diter != op->plan.delta_data_shards.end());
+    set<pg_shard_t> shards;
+    bool ok = get_delta_read_shards(hpair.first, diter->second, &shards);
+    assert(ok);
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+    for (auto extent: hpair.second) {
+      to_read.emplace_back(extent.first, extent.second, 0);
+    }
+    for_read_op.insert(
+      make_pair(
+	hpair.first,
+	read_request_t(
+	  to_read,
+	  shards,
+	  false,
+	  new FinishDeltaRead(this, op->tid, hpair.first))));
+  }
+  // complete once every shard has answered rather than once the data
+  // is decodable; we want exactly these shards
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    for_read_op,
+    OpRequestRef(),
+    false, true);
+}
+
+void ECBackend::handle_delta_read(
+  ceph_tid_t tid,
+  const hobject_t &hoid,
+  read_result_t &res)
+{
+  auto iter = tid_to_op_map.find(tid);
+  assert(iter != tid_to_op_map.end());
+  Op *op = &(iter->second);
+  auto diter = op->plan.delta_data_shards.find(hoid);
+  assert(diter != op->plan.delta_data_shards.end());
+
+  set<pg_shard_t> shards;
+  bool ok = res.r == 0 && res.errors.empty() &&
+    get_delta_read_shards(hoid, diter->second, &shards);
+  map<int, extent_map> chunks;
+  for (auto &&extent: res.returned) {
+    if (!ok)
+      break;
+    pair<uint64_t, uint64_t> chunk_off_len =
+      sinfo.aligned_offset_len_to_chunk(
+	make_pair(extent.get<0>(), extent.get<1>()));
+    for (auto &&shard: shards) {
+      auto biter = extent.get<2>().find(shard);
+      if (biter == extent.get<2>().end() ||
+	  biter->second.length() != chunk_off_len.second) {
+	ok = false;
+	break;
+      }
+      chunks[shard.shard].insert(
+	chunk_off_len.first, chunk_off_len.second, biter->second);
+    }
+  }
+
+  if (!ok) {
+    dout(10) << __func__ << ": " << hoid << " shard read failed, "
+	     << "falling back to a stripe read for " << *op << dendl;
+    op->plan.delta_data_shards.erase(diter);
+    objects_read_async_no_cache(
+      op->remote_read,
+      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+	for (auto &&i: results) {
+	  op->remote_read_result.emplace(i.first, i.second.second);
+	}
+	check_ops();
+      });
+    return;
+  }
+  op->delta_read_result[hoid].swap(chunks);
+  check_ops();
+}
+
 bool ECBackend::try_state_to_reads()
 {
   if (waiting_state.empty())
@@ -1794,6 +1925,16 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
+  // a delta write changes what is on disk behind the cache's back
+  for (auto &&hpair: op->plan.to_read) {
+    if (is_write_in_flight(hpair.first, true)) {
+      dout(20) << __func__ << ": blocking " << *op
+	       << " because a delta write to " << hpair.first
+	       << " is in flight" << dendl;
+      return false;
+    }
+  }
+
   if (op->invalidates_cache()) {
     dout(20) << __func__ << ": invalidating cache after this op"
 	     << dendl;
@@ -1803,6 +1944,27 @@ bool ECBackend::try_state_to_reads()
     op->using_cache = pipeline_state.caching_enabled();
   }
 
+  if (op->requires_rmw() &&
+      !op->invalidates_cache() &&
+      op->plan.to_read.size() == 1 &&
+      cct->_conf->osd_ec_delta_overwrites) {
+    // the disk content is current only if no other write to the
+    // object is in flight
+    const hobject_t &hoid = op->plan.to_read.begin()->first;
+    set<int> data_shards;
+    set<pg_shard_t> shards;
+    if (!is_write_in_flight(hoid, false) &&
+	ECTransaction::get_delta_data_shards(
+	  sinfo, ec_impl, op->plan, hoid, &data_shards) &&
+	get_delta_read_shards(hoid, data_shards, &shards)) {
+      dout(20) << __func__ << ": delta write to " << hoid
+	       << " data shards " << data_shards << dendl;
+      op->plan.delta_data_shards[hoid].swap(data_shards);
+      op->delta_write = true;
+      op->using_cache = false;
+    }
+  }
+
   waiting_state.pop_front();
   waiting_reads.push_back(*op);
 
@@ -1839,7 +2001,9 @@ bool ECBackend::try_state_to_reads()
 
   dout(10) << __func__ << ": " << *op << dendl;
 
-  if (!op->remote_read.empty()) {
+  if (!op->remote_read.empty() && op->delta_write) {
+    start_delta_read(op);
+  } else if (!op->remote_read.empty()) {
     assert(get_parent()->get_pool().allows_ecoverwrites());
     objects_read_async_no_cache(
       op->remote_read,
@@ -1902,6 +2066,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -1929,7 +2094,12 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  assert(written_set == op->plan.will_write);
+  map<hobject_t,extent_set> expected_written = op->plan.will_write;
+  for (auto &&i: op->plan.delta_data_shards) {
+    // only whole stripes go in written
+    expected_written[i.first].clear();
+  }
+  assert(written_set == expected_written);
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -1939,6 +2109,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
   ObjectStore::Transaction empty;
@@ -483,10 +483,17 @@ public:
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+    /// parity-delta overwrite: old chunks by shard, in chunk offsets
+    map<hobject_t,map<int,extent_map>> delta_read_result;
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return !remote_read.empty() && remote_read_result.empty() &&
+	delta_read_result.empty();
     }
 
+    /// reads the shards directly and bypasses the cache, see
+    /// try_state_to_reads; stays set if we fall back to a stripe read
+    bool delta_write = false;
+
     /// In progress write state
     set<pg_shard_t> pending_commit;
     set<pg_shard_t> pending_apply;
@@ -564,6 +571,18 @@ public:
   eversion_t completed_to;
   eversion_t committed_to;
   void start_rmw(Op *op, PGTransactionUPtr &&t);
+  /// true if an op past waiting_state writes hoid
+  bool is_write_in_flight(const hobject_t &hoid, bool delta_only) const;
+  bool get_delta_read_shards(
+    const hobject_t &hoid,
+    const set<int> &data_shards,
+    set<pg_shard_t> *shards);
+  void start_delta_read(Op *op);
+  friend struct FinishDeltaRead;
+  void handle_delta_read(
+    ceph_tid_t tid,
+    const hobject_t &hoid,
+    read_result_t &res);
   bool try_state_to_reads();
   bool try_reads_to_commit();
   bool try_finish_rmw();
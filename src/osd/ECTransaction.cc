@@ -82,6 +82,219 @@ void encode_and_write(
   }
 }
 
+static int data_position_to_shard(
+  ErasureCodeInterfaceRef &ecimpl,
+  unsigned i) {
+  const vector<int> &chunk_mapping = ecimpl->get_chunk_mapping();
+  return (int)chunk_mapping.size() > (int)i ? chunk_mapping[i] : (int)i;
+}
+
+static bufferlist get_chunk_range(
+  const extent_map &chunks,
+  uint64_t off,
+  uint64_t len) {
+  bufferlist bl;
+  for (auto &&extent: chunks.intersect(off, len)) {
+    assert(extent.get_off() == off + bl.length());
+    bl.append(extent.get_val());
+  }
+  assert(bl.length() == len);
+  return bl;
+}
+
+void encode_and_write_delta(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const set<int> &data_shards,
+  const PGTransaction::ObjectOperation &op,
+  const extent_set &stripes,
+  const map<int, extent_map> &old_chunks,
+  pg_log_entry_t *entry,
+  ECUtil::HashInfoRef hinfo,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+
+  // lay the new bytes over the old content of the data shards
+  map<int, extent_map> new_chunks;
+  for (auto &&shard: data_shards) {
+    auto iter = old_chunks.find(shard);
+    assert(iter != old_chunks.end());
+    new_chunks[shard] = iter->second;
+  }
+  uint32_t fadvise_flags = 0;
+  for (auto &&extent: op.buffer_updates) {
+    using BufferUpdate = PGTransaction::ObjectOperation::BufferUpdate;
+    bufferlist bl;
+    match(
+      extent.get_val(),
+      [&](const BufferUpdate::Write &op) {
+	bl = op.buffer;
+	fadvise_flags |= op.fadvise_flags;
+      },
+      [&](const BufferUpdate::Zero &) {
+	bl.append_zero(extent.get_len());
+      },
+      [&](const BufferUpdate::CloneRange &) {
+	assert(
+	  0 ==
+	  "CloneRange is not allowed, do_op should have returned ENOTSUPP");
+      });
+    for (uint64_t done = 0; done < extent.get_len(); ) {
+      uint64_t pos = extent.get_off() + done;
+      uint64_t in_chunk = (pos % stripe_width) % chunk_size;
+      int shard = data_position_to_shard(
+	ecimpl, (pos % stripe_width) / chunk_size);
+      uint64_t len = std::min(extent.get_len() - done, chunk_size - in_chunk);
+      bufferlist piece;
+      piece.substr_of(bl, done, len);
+      auto iter = new_chunks.find(shard);
+      assert(iter != new_chunks.end());
+      iter->second.insert(
+	sinfo.logical_to_prev_chunk_offset(pos) + in_chunk, len, piece);
+      done += len;
+    }
+  }
+
+  vector<pair<uint64_t, uint64_t> > rollback_extents;
+  for (auto &&stripe: stripes) {
+    uint64_t off = sinfo.aligned_logical_offset_to_chunk_offset(
+      stripe.first);
+    uint64_t len = sinfo.aligned_logical_offset_to_chunk_offset(
+      stripe.second);
+    ldpp_dout(dpp, 20) << __func__ << ": " << oid << " chunks "
+		       << off << "~" << len
+		       << " data shards " << data_shards
+		       << dendl;
+    if (entry) {
+      // every shard keeps the old range so that rollback stays uniform;
+      // clone_range does not copy the data on the stores we support
+      if (rollback_extents.empty()) {
+	for (auto &&st : *transactions) {
+	  st.second.touch(
+	    coll_t(spg_t(pgid, st.first)),
+	    ghobject_t(oid, entry->version.version, st.first));
+	}
+      }
+      rollback_extents.emplace_back(make_pair(off, len));
+      for (auto &&st : *transactions) {
+	st.second.clone_range(
+	  coll_t(spg_t(pgid, st.first)),
+	  ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	  ghobject_t(oid, entry->version.version, st.first),
+	  off,
+	  len,
+	  off);
+      }
+    }
+
+    map<int, bufferlist> to_write;
+    map<int, bufferlist> data_deltas;
+    for (auto &&shard: data_shards) {
+      bufferlist new_data = get_chunk_range(new_chunks[shard], off, len);
+      data_deltas[shard] = ECUtil::xor_buffers(
+	get_chunk_range(old_chunks.find(shard)->second, off, len),
+	new_data);
+      to_write[shard].claim(new_data);
+    }
+    map<int, bufferlist> coding_deltas;
+    int r = ECUtil::encode_delta(sinfo, ecimpl, data_deltas, &coding_deltas);
+    assert(r == 0);
+    for (auto &&i: coding_deltas) {
+      auto iter = old_chunks.find(i.first);
+      assert(iter != old_chunks.end());
+      to_write[i.first] = ECUtil::xor_buffers(
+	get_chunk_range(iter->second, off, len),
+	i.second);
+    }
+
+    for (auto &&i: to_write) {
+      auto st = transactions->find(shard_id_t(i.first));
+      if (st == transactions->end())
+	continue;
+      st->second.write(
+	coll_t(spg_t(pgid, st->first)),
+	ghobject_t(oid, ghobject_t::NO_GEN, st->first),
+	off,
+	i.second.length(),
+	i.second,
+	fadvise_flags);
+    }
+  }
+
+  if (entry && !rollback_extents.empty()) {
+    ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		       << " marking rollback extents "
+		       << rollback_extents
+		       << dendl;
+    entry->mod_desc.rollback_extents(
+      entry->version.version, rollback_extents);
+  }
+  hinfo->set_total_chunk_size_clear_hash(hinfo->get_total_chunk_size());
+
+  bufferlist hbuf;
+  ::encode(*hinfo, hbuf);
+  for (auto &&i : *transactions) {
+    i.second.setattr(
+      coll_t(spg_t(pgid, i.first)),
+      ghobject_t(oid, ghobject_t::NO_GEN, i.first),
+      ECUtil::get_hinfo_key(),
+      hbuf);
+  }
+}
+
+bool ECTransaction::get_delta_data_shards(
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const WritePlan &plan,
+  const hobject_t &oid,
+  set<int> *data_shards)
+{
+  assert(plan.t);
+  auto opiter = plan.t->op_map.find(oid);
+  if (opiter == plan.t->op_map.end())
+    return false;
+  const auto &op = opiter->second;
+  if (!op.is_none() || op.truncate || op.buffer_updates.empty())
+    return false;
+
+  // every stripe written must be a partial one we read anyway
+  auto riter = plan.to_read.find(oid);
+  auto witer = plan.will_write.find(oid);
+  if (riter == plan.to_read.end() ||
+      witer == plan.will_write.end() ||
+      !(riter->second == witer->second))
+    return false;
+
+  auto hiter = plan.hash_infos.find(oid);
+  assert(hiter != plan.hash_infos.end());
+  const uint64_t size = hiter->second->get_total_logical_size(sinfo);
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+
+  set<int> touched;
+  for (auto &&extent: op.buffer_updates) {
+    using BufferUpdate = PGTransaction::ObjectOperation::BufferUpdate;
+    if (boost::get<BufferUpdate::CloneRange>(&(extent.get_val())))
+      return false;
+    uint64_t end = extent.get_off() + extent.get_len();
+    if (end > size)
+      return false;
+    for (uint64_t pos = extent.get_off(); pos < end; ) {
+      uint64_t in_stripe = pos % stripe_width;
+      touched.insert(data_position_to_shard(ecimpl, in_stripe / chunk_size));
+      if (touched.size() >= ecimpl->get_data_chunk_count())
+	return false;
+      pos += chunk_size - (in_stripe % chunk_size);
+    }
+  }
+  data_shards->swap(touched);
+  return true;
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -101,6 +314,7 @@ void ECTransaction::generate_transactions(
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<int,extent_map>> &partial_chunks,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -389,6 +603,27 @@ void ECTransaction::generate_transactions(
 	}
       }
 
+      auto diter = plan.delta_data_shards.find(oid);
+      if (diter != plan.delta_data_shards.end()) {
+	auto citer = partial_chunks.find(oid);
+	assert(citer != partial_chunks.end());
+	assert(entry);
+	encode_and_write_delta(
+	  pgid,
+	  oid,
+	  sinfo,
+	  ecimpl,
+	  diter->second,
+	  op,
+	  plan.will_write[oid],
+	  citer->second,
+	  entry,
+	  hinfo,
+	  transactions,
+	  dpp);
+	return;
+      }
+
       extent_map to_write;
       auto pextiter = partial_extents.find(oid);
       if (pextiter != partial_extents.end()) {
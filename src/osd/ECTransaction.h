@@ -30,12 +30,31 @@ namespace ECTransaction {
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// objects to overwrite by parity delta -> data shards touched;
+    /// chosen by ECBackend, see get_delta_data_shards
+    map<hobject_t,set<int>> delta_data_shards;
   };
 
   bool requires_overwrite(
     uint64_t prev_size,
     const PGTransaction::ObjectOperation &op);
 
+  /**
+   * Determine whether the overwrite of oid in plan can be applied as a
+   * parity delta: only partial stripes within the current object size
+   * are written, and some data shard is left untouched.  If so, fills
+   * in the data shards it touches.  The caller then reads the old
+   * content of those shards and of the coding shards for
+   * plan.to_read[oid] instead of the whole stripes.
+   */
+  bool get_delta_data_shards(
+    const ECUtil::stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ecimpl,
+    const WritePlan &plan,
+    const hobject_t &oid,
+    set<int> *data_shards);
+
   template <typename F>
   WritePlan get_write_plan(
     const ECUtil::stripe_info_t &sinfo,
@@ -188,6 +207,7 @@ namespace ECTransaction {
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const map<hobject_t,map<int,extent_map>> &partial_chunks,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
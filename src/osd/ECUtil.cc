@@ -138,6 +138,72 @@ int ECUtil::encode(
   return 0;
 }
 
+int ECUtil::encode_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &data_deltas,
+  map<int, bufferlist> *coding_deltas) {
+  assert(data_deltas.size());
+  assert(coding_deltas);
+  assert(coding_deltas->empty());
+
+  uint64_t total_data_size = data_deltas.begin()->second.length();
+  assert(total_data_size % sinfo.get_chunk_size() == 0);
+
+  for (map<int, bufferlist>::iterator i = data_deltas.begin();
+       i != data_deltas.end();
+       ++i) {
+    assert(i->second.length() == total_data_size);
+  }
+
+  for (uint64_t i = 0; i < total_data_size; i += sinfo.get_chunk_size()) {
+    map<int, bufferlist> chunks;
+    for (map<int, bufferlist>::iterator j = data_deltas.begin();
+	 j != data_deltas.end();
+	 ++j) {
+      chunks[j->first].substr_of(j->second, i, sinfo.get_chunk_size());
+    }
+    map<int, bufferlist> encoded;
+    int r = ec_impl->encode_delta(chunks, &encoded);
+    if (r < 0)
+      return r;
+    for (map<int, bufferlist>::iterator j = encoded.begin();
+	 j != encoded.end();
+	 ++j) {
+      assert(j->second.length() == sinfo.get_chunk_size());
+      (*coding_deltas)[j->first].claim_append(j->second);
+    }
+  }
+  return 0;
+}
+
+bufferlist ECUtil::xor_buffers(const bufferlist &a, const bufferlist &b) {
+  assert(a.length() == b.length());
+  bufferptr out(buffer::create_aligned(a.length(), CHUNK_ALIGNMENT));
+  a.copy(0, a.length(), out.c_str());
+  bufferlist::const_iterator p = b.begin();
+  char *dst = out.c_str();
+  while (!p.end()) {
+    const char *src;
+    unsigned len = p.get_ptr_and_advance(b.length(), &src);
+    unsigned i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+      uint64_t x, y;
+      memcpy(&x, dst + i, sizeof(x));
+      memcpy(&y, src + i, sizeof(y));
+      x ^= y;
+      memcpy(dst + i, &x, sizeof(x));
+    }
+    for (; i < len; ++i) {
+      dst[i] ^= src[i];
+    }
+    dst += len;
+  }
+  bufferlist bl;
+  bl.push_back(std::move(out));
+  return bl;
+}
+
 void ECUtil::HashInfo::append(uint64_t old_size,
 			      map<int, bufferlist> &to_append) {
   assert(old_size == total_chunk_size);
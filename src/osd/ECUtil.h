@@ -102,6 +102,16 @@ int encode(
   const std::set<int> &want,
   std::map<int, bufferlist> *out);
 
+/// coding chunk deltas for data chunk deltas spanning whole stripes
+int encode_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  std::map<int, bufferlist> &data_deltas,
+  std::map<int, bufferlist> *coding_deltas);
+
+/// a ^ b; both must have the same length
+bufferlist xor_buffers(const bufferlist &a, const bufferlist &b);
+
 class HashInfo {
   uint64_t total_chunk_size = 0;
   std::vector<uint32_t> cumulative_shard_hashes;
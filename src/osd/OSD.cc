@@ -1686,6 +1686,43 @@ void OSDService::queue_for_peering(PG *pg)
   peering_wq.queue(pg);
 }
 
+void OSDService::note_client_op_latency(utime_t lat)
+{
+  if (cct->_conf->osd_scrub_sleep_target_latency <= 0)
+    return;
+  // frugal streaming quantile estimate: nudge the estimate up by p*step
+  // for samples above it and down by (1-p)*step for those below, which
+  // settles where a fraction p of the samples fall below.  the step
+  // scales with the estimate so it adapts at any latency magnitude.
+  double p = cct->_conf->osd_scrub_sleep_latency_percentile;
+  double x = (double)lat;
+  double q = client_lat_quantile.load(std::memory_order_relaxed);
+  double step = std::max(.000001, q / 32);
+  if (x > q) {
+    q += step * p;
+  } else if (x < q) {
+    q = std::max(0.0, q - step * (1.0 - p));
+  }
+  // racing updates may drop a sample; that is harmless for an estimate
+  client_lat_quantile.store(q, std::memory_order_relaxed);
+}
+
+double OSDService::get_scrub_sleep()
+{
+  if (osd->is_mclock_scheduler())
+    return 0;
+  double sleep = cct->_conf->osd_scrub_sleep;
+  double target = cct->_conf->osd_scrub_sleep_target_latency;
+  if (target <= 0)
+    return sleep;
+  double q = client_lat_quantile.load(std::memory_order_relaxed);
+  if (q <= target)
+    return sleep;
+  // ramp the extra sleep in linearly between target and twice target
+  double over = std::min(1.0, (q - target) / target);
+  return sleep + over * cct->_conf->osd_scrub_sleep_max;
+}
+
 void OSDService::queue_for_snap_trim(PG *pg)
 {
   dout(10) << "queueing " << *pg << " for snaptrim" << dendl;
@@ -2350,6 +2387,8 @@ int OSD::get_num_op_shards()
 
 int OSD::get_num_op_threads()
 {
+  if (cct->_conf->osd_op_run_to_completion)
+    return get_num_op_shards();
   if (cct->_conf->osd_op_num_threads_per_shard)
     return get_num_op_shards() * cct->_conf->osd_op_num_threads_per_shard;
   if (store_is_rotational)
@@ -2360,6 +2399,8 @@ int OSD::get_num_op_threads()
 
 float OSD::get_osd_recovery_sleep()
 {
+  if (is_mclock_scheduler())
+    return 0;
   if (cct->_conf->osd_recovery_sleep)
     return cct->_conf->osd_recovery_sleep;
   if (!store_is_rotational && !journal_is_rotational)
@@ -2370,6 +2411,60 @@ float OSD::get_osd_recovery_sleep()
     return cct->_conf->osd_recovery_sleep_hdd;
 }
 
+void OSD::init_mclock_capacity()
+{
+  if (!is_mclock_scheduler())
+    return;
+  double iops = cct->_conf->osd_mclock_max_capacity_iops;
+  if (iops <= 0 && !cct->_conf->osd_mclock_skip_benchmark) {
+    // 4k writes to fresh objects, as many as osd bench allows by default
+    int64_t bsize = 4096;
+    int64_t count = bsize * cct->_conf->osd_bench_duration *
+      cct->_conf->osd_bench_small_size_max_iops;
+    double elapsed = 0.0;
+    stringstream ss;
+    int r = run_osd_bench_test(count, bsize, 0, 0, &elapsed, ss);
+    if (r < 0 || elapsed <= 0) {
+      derr << __func__ << " unable to measure iops capacity: " << ss.str()
+	   << dendl;
+    } else {
+      iops = (count / bsize) / elapsed;
+    }
+  }
+  if (iops <= 0) {
+    iops = store_is_rotational ?
+      cct->_conf->osd_mclock_max_capacity_iops_hdd :
+      cct->_conf->osd_mclock_max_capacity_iops_ssd;
+  }
+  dout(1) << __func__ << " " << iops << " iops" << dendl;
+  op_shardedwq.set_mclock_capacity(iops);
+}
+
+void OSD::update_mclock_pool_qos()
+{
+  if (!is_mclock_scheduler())
+    return;
+  map<int64_t, ceph::mClockScheduler::qos_t> qos;
+  for (auto& p : osdmap->get_pools()) {
+    const pool_opts_t& opts = p.second.opts;
+    if (!opts.is_set(pool_opts_t::QOS_RES) &&
+	!opts.is_set(pool_opts_t::QOS_WGT) &&
+	!opts.is_set(pool_opts_t::QOS_LIM)) {
+      continue;
+    }
+    // unset values fall back to those of the client class
+    ceph::mClockScheduler::qos_t q(
+      cct->_conf->osd_mclock_scheduler_client_res,
+      cct->_conf->osd_mclock_scheduler_client_wgt,
+      cct->_conf->osd_mclock_scheduler_client_lim);
+    opts.get(pool_opts_t::QOS_RES, &q.res);
+    opts.get(pool_opts_t::QOS_WGT, &q.wgt);
+    opts.get(pool_opts_t::QOS_LIM, &q.lim);
+    qos[p.first] = q;
+  }
+  op_shardedwq.set_mclock_pool_qos(qos);
+}
+
 int OSD::init()
 {
   CompatSet initial, diff;
@@ -2529,14 +2624,16 @@ int OSD::init()
   // initialize osdmap references in sharded wq
   op_shardedwq.prune_pg_waiters(osdmap, whoami);
 
+  // before load_pgs, so that its progress can be watched
+  create_logger();
+
   // load up pgs (as they previously existed)
   load_pgs();
 
   dout(2) << "superblock: I am osd." << superblock.whoami << dendl;
   dout(0) << "using " << op_queue << " op queue with priority op cut off at " <<
     op_prio_cutoff << "." << dendl;
-
-  create_logger();
+  init_mclock_capacity();
 
   // i'm ready!
   client_messenger->add_dispatcher_head(this);
@@ -3084,6 +3181,12 @@ void OSD::create_logger()
   osd_plb.add_u64(
     l_osd_pg_stray, "numpg_stray",
     "Placement groups ready to be deleted from this osd");
+  osd_plb.add_u64(
+    l_osd_pg_load_total, "numpg_load_total",
+    "Placement groups found on disk at startup");
+  osd_plb.add_u64(
+    l_osd_pg_loaded, "numpg_loaded",
+    "Placement groups loaded so far at startup");
   osd_plb.add_u64(
     l_osd_hb_to, "heartbeat_to_peers", "Heartbeat (ping) peers we send to");
   osd_plb.add_u64_counter(l_osd_map, "map_messages", "OSD map messages");
@@ -3155,6 +3258,18 @@ void OSD::create_logger()
     l_osd_object_ctx_cache_hit, "object_ctx_cache_hit", "Object context cache hits");
   osd_plb.add_u64_counter(
     l_osd_object_ctx_cache_total, "object_ctx_cache_total", "Object context cache lookups");
+  osd_plb.add_u64_counter(
+    l_osd_object_ctx_cache_miss, "object_ctx_cache_miss",
+    "Object context cache misses");
+  osd_plb.add_time_avg(
+    l_osd_object_ctx_decode_lat, "object_ctx_decode_lat",
+    "Time to read and decode an object context on a cache miss");
+  osd_plb.add_u64_counter(
+    l_osd_snapset_ctx_cache_hit, "snapset_ctx_cache_hit",
+    "Snapset lookups served already decoded");
+  osd_plb.add_u64_counter(
+    l_osd_snapset_ctx_cache_miss, "snapset_ctx_cache_miss",
+    "Snapsets read and decoded from disk");
 
   osd_plb.add_u64_counter(l_osd_op_cache_hit, "op_cache_hit");
   osd_plb.add_time_avg(
@@ -3878,7 +3993,8 @@ void OSD::load_pgs()
     derr << "failed to list pgs: " << cpp_strerror(-r) << dendl;
   }
 
-  bool has_upgraded = false;
+  std::atomic_bool has_upgraded = { false };
+  vector<pair<PG*,bufferlist>> to_load;
 
   for (vector<coll_t>::iterator it = ls.begin();
        it != ls.end();
@@ -3935,58 +4051,31 @@ void OSD::load_pgs()
       pg = _open_lock_pg(osdmap, pgid);
     }
     // there can be no waiters here, so we don't call wake_pg_waiters
-
-    pg->ch = store->open_collection(pg->coll);
-
-    // read pg state, log
-    pg->read_state(store, bl);
-
-    if (pg->must_upgrade()) {
-      if (!pg->can_upgrade()) {
-	derr << "PG needs upgrade, but on-disk data is too old; upgrade to"
-	     << " an older version first." << dendl;
-	assert(0 == "PG too old to upgrade");
-      }
-      if (!has_upgraded) {
-	derr << "PGs are upgrading" << dendl;
-	has_upgraded = true;
-      }
-      dout(10) << "PG " << pg->info.pgid
-	       << " must upgrade..." << dendl;
-      pg->upgrade(store);
-    }
-
-    service.init_splits_between(pg->info.pgid, pg->get_osdmap(), osdmap);
-
-    // generate state for PG's current mapping
-    int primary, up_primary;
-    vector<int> acting, up;
-    pg->get_osdmap()->pg_to_up_acting_osds(
-      pgid.pgid, &up, &up_primary, &acting, &primary);
-    pg->init_primary_up_acting(
-      up,
-      acting,
-      up_primary,
-      primary);
-    int role = OSDMap::calc_pg_role(whoami, pg->acting);
-    if (pg->pool.info.is_replicated() || role == pg->pg_whoami.shard)
-      pg->set_role(role);
-    else
-      pg->set_role(-1);
-
-    pg->reg_next_scrub();
-
-    PG::RecoveryCtx rctx(0, 0, 0, 0, 0, 0);
-    pg->handle_loaded(&rctx);
-
-    dout(10) << "load_pgs loaded " << *pg << " " << pg->pg_log.get_log() << dendl;
-    if (pg->pg_log.is_dirty()) {
-      ObjectStore::Transaction t;
-      pg->write_if_dirty(t);
-      store->apply_transaction(pg->osr.get(), std::move(t));
-    }
     pg->unlock();
+    to_load.push_back(make_pair(pg, bl));
+  }
+
+  // reading the pg state and log is the bulk of the work and each pg is
+  // independent, so spread it over a few threads
+  logger->set(l_osd_pg_load_total, to_load.size());
+  logger->set(l_osd_pg_loaded, 0);
+  unsigned num_threads = cct->_conf->osd_load_pgs_threads;
+  if (num_threads == 0)
+    num_threads = get_num_op_shards();
+  num_threads = MAX(1u, MIN(num_threads, (unsigned)to_load.size()));
+  dout(10) << "load_pgs loading " << to_load.size() << " pgs with "
+	   << num_threads << " threads" << dendl;
+  {
+    ThreadPool load_tp(cct, "OSD::load_tp", "tp_osd_load", num_threads);
+    LoadPGWQ load_wq(this, &has_upgraded, &load_tp);
+    for (auto& i : to_load) {
+      load_wq.queue(&i);
+    }
+    load_tp.start();
+    load_wq.drain();
+    load_tp.stop();
   }
+
   {
     RWLock::RLocker l(pg_map_lock);
     dout(0) << "load_pgs opened " << pg_map.size() << " pgs" << dendl;
@@ -4009,6 +4098,60 @@ void OSD::load_pgs()
 }
 
 
+void OSD::_load_pg(PG *pg, bufferlist& bl, std::atomic_bool *has_upgraded)
+{
+  pg->lock();
+  pg->ch = store->open_collection(pg->coll);
+
+  // read pg state, log
+  pg->read_state(store, bl);
+
+  if (pg->must_upgrade()) {
+    if (!pg->can_upgrade()) {
+      derr << "PG needs upgrade, but on-disk data is too old; upgrade to"
+	   << " an older version first." << dendl;
+      assert(0 == "PG too old to upgrade");
+    }
+    if (!has_upgraded->exchange(true)) {
+      derr << "PGs are upgrading" << dendl;
+    }
+    dout(10) << "PG " << pg->info.pgid
+	     << " must upgrade..." << dendl;
+    pg->upgrade(store);
+  }
+
+  service.init_splits_between(pg->info.pgid, pg->get_osdmap(), osdmap);
+
+  // generate state for PG's current mapping
+  int primary, up_primary;
+  vector<int> acting, up;
+  pg->get_osdmap()->pg_to_up_acting_osds(
+    pg->info.pgid.pgid, &up, &up_primary, &acting, &primary);
+  pg->init_primary_up_acting(
+    up,
+    acting,
+    up_primary,
+    primary);
+  int role = OSDMap::calc_pg_role(whoami, pg->acting);
+  if (pg->pool.info.is_replicated() || role == pg->pg_whoami.shard)
+    pg->set_role(role);
+  else
+    pg->set_role(-1);
+
+  pg->reg_next_scrub();
+
+  PG::RecoveryCtx rctx(0, 0, 0, 0, 0, 0);
+  pg->handle_loaded(&rctx);
+
+  dout(10) << "load_pgs loaded " << *pg << " " << pg->pg_log.get_log() << dendl;
+  if (pg->pg_log.is_dirty()) {
+    ObjectStore::Transaction t;
+    pg->write_if_dirty(t);
+    store->apply_transaction(pg->osr.get(), std::move(t));
+  }
+  pg->unlock();
+}
+
 /*
  * build past_intervals efficiently on old, degraded, and buried
  * clusters.  this is important for efficiently catching up osds that
@@ -4631,6 +4774,15 @@ void OSD::maybe_update_heartbeat_peers()
 
   dout(10) << "maybe_update_heartbeat_peers updating" << dendl;
 
+  if (cct->_conf->osd_heartbeat_topology == "hierarchical") {
+    _update_hierarchical_heartbeat_peers();
+    return;
+  }
+  hb_aggregator = -1;
+  hb_domain.clear();
+  hb_remote_domains.clear();
+  hb_failed_aggregators.clear();
+  hb_adopted.clear();
 
   // build heartbeat from set
   if (is_active()) {
@@ -4712,6 +4864,127 @@ void OSD::maybe_update_heartbeat_peers()
   dout(10) << "maybe_update_heartbeat_peers " << heartbeat_peers.size() << " peers, extras " << extras << dendl;
 }
 
+/*
+ * Up osds are grouped by crush subtree into heartbeat domains, each
+ * with an aggregator (see OSDMap::get_heartbeat_domains).  Members only
+ * ping their aggregator; aggregators ping their members and each
+ * other.  If a remote aggregator stops responding we ping the rest of
+ * its domain ourselves, as if we had been pinging them all along,
+ * until a responsive aggregator takes over.
+ */
+void OSD::_update_hierarchical_heartbeat_peers()
+{
+  assert(osd_lock.is_locked());
+  assert(heartbeat_lock.is_locked());
+
+  map<int, set<int>> domains;
+  osdmap->get_heartbeat_domains(cct->_conf->osd_heartbeat_aggregate_level,
+				&domains);
+  map<int, int> aggregator_of;
+  hb_aggregator = -1;
+  for (auto& d : domains) {
+    for (auto o : d.second) {
+      aggregator_of[o] = d.first;
+    }
+    if (d.second.count(whoami)) {
+      hb_aggregator = d.first;
+    }
+  }
+
+  set<int> want;
+  hb_domain.clear();
+  hb_remote_domains.clear();
+  if (hb_aggregator == whoami) {
+    for (auto& d : domains) {
+      if (d.first == whoami) {
+	hb_domain = d.second;
+	hb_domain.erase(whoami);
+	want.insert(hb_domain.begin(), hb_domain.end());
+      } else {
+	want.insert(d.first);
+	hb_remote_domains[d.first] = d.second;
+      }
+    }
+  } else if (hb_aggregator >= 0) {
+    want.insert(hb_aggregator);
+  } else {
+    // we are not up; any aggregator will do to judge our health
+    for (auto& d : domains) {
+      want.insert(d.first);
+    }
+  }
+
+  utime_t now = ceph_clock_now();
+  // give adopted members at least one interval to answer
+  utime_t earliest = now;
+  earliest -= cct->_conf->osd_heartbeat_grace;
+  earliest += cct->_conf->osd_heartbeat_interval;
+  map<int, utime_t> vouched;
+  for (auto p = hb_failed_aggregators.begin();
+       p != hb_failed_aggregators.end(); ) {
+    auto d = hb_remote_domains.find(p->first);
+    if (d == hb_remote_domains.end()) {
+      hb_failed_aggregators.erase(p++);
+      continue;
+    }
+    for (auto o : d->second) {
+      if (o != p->first && !hb_adopted.count(o)) {
+	dout(10) << __func__ << " aggregator osd." << p->first
+		 << " unresponsive, adopting osd." << o << dendl;
+	hb_adopted[o] = now;
+	vouched[o] = MAX(p->second, earliest);
+      }
+    }
+    ++p;
+  }
+  for (auto p = hb_adopted.begin(); p != hb_adopted.end(); ) {
+    auto a = aggregator_of.find(p->first);
+    bool keep = hb_aggregator == whoami && a != aggregator_of.end() &&
+      a->second != p->first;
+    if (keep) {
+      auto hi = heartbeat_peers.find(a->second);
+      if (hi != heartbeat_peers.end() &&
+	  hi->second.last_rx_back > p->second &&
+	  hi->second.last_rx_front > p->second) {
+	// its aggregator answers again
+	keep = false;
+      }
+    }
+    if (!keep) {
+      dout(10) << __func__ << " releasing adopted osd." << p->first << dendl;
+      hb_adopted.erase(p++);
+      continue;
+    }
+    want.insert(p->first);
+    ++p;
+  }
+
+  for (auto p = heartbeat_peers.begin(); p != heartbeat_peers.end(); ) {
+    int o = p->first;
+    ++p;
+    if (!want.count(o) || !osdmap->is_up(o)) {
+      _remove_heartbeat_peer(o);
+    }
+  }
+  for (auto o : want) {
+    if (!osdmap->is_up(o)) {
+      continue;
+    }
+    _add_heartbeat_peer(o);
+    auto v = vouched.find(o);
+    auto hi = heartbeat_peers.find(o);
+    if (v != vouched.end() && hi != heartbeat_peers.end() &&
+	hi->second.first_tx == utime_t()) {
+      hi->second.first_tx = v->second;
+    }
+  }
+
+  dout(10) << __func__ << " " << heartbeat_peers.size() << " peers, aggregator "
+	   << hb_aggregator << ", " << hb_domain.size() << " members, "
+	   << hb_remote_domains.size() << " remote domains, adopted "
+	   << hb_adopted << dendl;
+}
+
 void OSD::reset_heartbeat_peers()
 {
   assert(osd_lock.is_locked());
@@ -4725,6 +4998,8 @@ void OSD::reset_heartbeat_peers()
     }
     heartbeat_peers.erase(heartbeat_peers.begin());
   }
+  hb_failed_aggregators.clear();
+  hb_adopted.clear();
   failure_queue.clear();
 }
 
@@ -4841,6 +5116,11 @@ void OSD::handle_osd_ping(MOSDPing *m)
         utime_t cutoff = ceph_clock_now();
         cutoff -= cct->_conf->osd_heartbeat_grace;
         if (i->second.is_healthy(cutoff)) {
+	  if (hb_failed_aggregators.erase(from)) {
+	    dout(1) << "handle_osd_ping aggregator osd." << from
+		    << " is responsive again" << dendl;
+	    heartbeat_set_peers_need_update();
+	  }
           // Cancel false reports
 	  auto failure_queue_entry = failure_queue.find(from);
 	  if (failure_queue_entry != failure_queue.end()) {
@@ -4928,6 +5208,18 @@ void OSD::heartbeat_check()
 	     << " last_rx_front " << p->second.last_rx_front
 	     << dendl;
     if (p->second.is_unhealthy(cutoff)) {
+      if (hb_remote_domains.count(p->first) &&
+	  !hb_failed_aggregators.count(p->first)) {
+	// nobody else pings its domain; start doing it ourselves
+	utime_t heard = MIN(p->second.last_rx_back, p->second.last_rx_front);
+	if (heard == utime_t()) {
+	  heard = p->second.first_tx;
+	}
+	dout(1) << "heartbeat_check: aggregator osd." << p->first
+		<< " unresponsive, will ping its domain" << dendl;
+	hb_failed_aggregators[p->first] = heard;
+	heartbeat_set_peers_need_update();
+      }
       if (p->second.last_rx_back == utime_t() ||
 	  p->second.last_rx_front == utime_t()) {
 	derr << "heartbeat_check: no reply from " << p->second.con_front->get_peer_addr().get_sockaddr()
@@ -5948,8 +6240,13 @@ void OSD::send_failures()
     if (!failure_pending.count(osd)) {
       entity_inst_t i = osdmap->get_inst(osd);
       int failed_for = (int)(double)(now - failure_queue.begin()->second);
+      __u8 flags = MOSDFailure::FLAG_FAILED;
+      if (hb_aggregator == whoami && hb_domain.count(osd)) {
+	// we are the only one watching it
+	flags |= MOSDFailure::FLAG_AGGREGATED;
+      }
       monc->send_mon_message(new MOSDFailure(monc->get_fsid(), i, failed_for,
-					     osdmap->get_epoch()));
+					     osdmap->get_epoch(), flags));
       failure_pending[osd] = make_pair(failure_queue.begin()->second, i);
     }
     failure_queue.erase(osd);
@@ -6120,6 +6417,142 @@ COMMAND("compact",
         "osd", "rw", "cli,rest")
 };
 
+int OSD::run_osd_bench_test(
+  int64_t count, int64_t bsize, int64_t osize, int64_t onum,
+  double *elapsed, ostream &ss)
+{
+  ceph::shared_ptr<ObjectStore::Sequencer> osr (std::make_shared<
+                                      ObjectStore::Sequencer>("bench"));
+
+  uint32_t duration = cct->_conf->osd_bench_duration;
+
+  if (bsize > (int64_t) cct->_conf->osd_bench_max_block_size) {
+    // let us limit the block size because the next checks rely on it
+    // having a sane value.  If we allow any block size to be set things
+    // can still go sideways.
+    ss << "block 'size' values are capped at "
+       << prettybyte_t(cct->_conf->osd_bench_max_block_size) << ". If you wish to use"
+       << " a higher value, please adjust 'osd_bench_max_block_size'";
+    return -EINVAL;
+  } else if (bsize < (int64_t) (1 << 20)) {
+    // entering the realm of small block sizes.
+    // limit the count to a sane value, assuming a configurable amount of
+    // IOPS and duration, so that the OSD doesn't get hung up on this,
+    // preventing timeouts from going off
+    int64_t max_count =
+      bsize * duration * cct->_conf->osd_bench_small_size_max_iops;
+    if (count > max_count) {
+      ss << "'count' values greater than " << max_count
+         << " for a block size of " << prettybyte_t(bsize) << ", assuming "
+         << cct->_conf->osd_bench_small_size_max_iops << " IOPS,"
+         << " for " << duration << " seconds,"
+         << " can cause ill effects on osd. "
+         << " Please adjust 'osd_bench_small_size_max_iops' with a higher"
+         << " value if you wish to use a higher 'count'.";
+      return -EINVAL;
+    }
+  } else {
+    // 1MB block sizes are big enough so that we get more stuff done.
+    // However, to avoid the osd from getting hung on this and having
+    // timers being triggered, we are going to limit the count assuming
+    // a configurable throughput and duration.
+    // NOTE: max_count is the total amount of bytes that we believe we
+    //       will be able to write during 'duration' for the given
+    //       throughput.  The block size hardly impacts this unless it's
+    //       way too big.  Given we already check how big the block size
+    //       is, it's safe to assume everything will check out.
+    int64_t max_count =
+      cct->_conf->osd_bench_large_size_max_throughput * duration;
+    if (count > max_count) {
+      ss << "'count' values greater than " << max_count
+         << " for a block size of " << prettybyte_t(bsize) << ", assuming "
+         << prettybyte_t(cct->_conf->osd_bench_large_size_max_throughput) << "/s,"
+         << " for " << duration << " seconds,"
+         << " can cause ill effects on osd. "
+         << " Please adjust 'osd_bench_large_size_max_throughput'"
+         << " with a higher value if you wish to use a higher 'count'.";
+      return -EINVAL;
+    }
+  }
+
+  if (osize && bsize > osize)
+    bsize = osize;
+
+  dout(1) << " bench count " << count
+          << " bsize " << prettybyte_t(bsize) << dendl;
+
+  ObjectStore::Transaction cleanupt;
+
+  if (osize && onum) {
+    bufferlist bl;
+    bufferptr bp(osize);
+    bp.zero();
+    bl.push_back(std::move(bp));
+    bl.rebuild_page_aligned();
+    for (int i=0; i<onum; ++i) {
+      char nm[30];
+      snprintf(nm, sizeof(nm), "disk_bw_test_%d", i);
+      object_t oid(nm);
+      hobject_t soid(sobject_t(oid, 0));
+      ObjectStore::Transaction t;
+      t.write(coll_t(), ghobject_t(soid), 0, osize, bl);
+      store->queue_transaction(osr.get(), std::move(t), NULL);
+      cleanupt.remove(coll_t(), ghobject_t(soid));
+    }
+  }
+
+  bufferlist bl;
+  bufferptr bp(bsize);
+  bp.zero();
+  bl.push_back(std::move(bp));
+  bl.rebuild_page_aligned();
+
+  {
+    C_SaferCond waiter;
+    if (!osr->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+
+  utime_t start = ceph_clock_now();
+  for (int64_t pos = 0; pos < count; pos += bsize) {
+    char nm[30];
+    unsigned offset = 0;
+    if (onum && osize) {
+      snprintf(nm, sizeof(nm), "disk_bw_test_%d", (int)(rand() % onum));
+      offset = rand() % (osize / bsize) * bsize;
+    } else {
+      snprintf(nm, sizeof(nm), "disk_bw_test_%lld", (long long)pos);
+    }
+    object_t oid(nm);
+    hobject_t soid(sobject_t(oid, 0));
+    ObjectStore::Transaction t;
+    t.write(coll_t::meta(), ghobject_t(soid), offset, bsize, bl);
+    store->queue_transaction(osr.get(), std::move(t), NULL);
+    if (!onum || !osize)
+      cleanupt.remove(coll_t::meta(), ghobject_t(soid));
+  }
+
+  {
+    C_SaferCond waiter;
+    if (!osr->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+  utime_t end = ceph_clock_now();
+
+  // clean up
+  store->queue_transaction(osr.get(), std::move(cleanupt), NULL);
+  {
+    C_SaferCond waiter;
+    if (!osr->flush_commit(&waiter)) {
+      waiter.wait();
+    }
+  }
+  *elapsed = end - start;
+  return 0;
+}
+
 void OSD::do_command(Connection *con, ceph_tid_t tid, vector<string>& cmd, bufferlist& data)
 {
   int r = 0;
@@ -6292,139 +6725,15 @@ void OSD::do_command(Connection *con, ceph_tid_t tid, vector<string>& cmd, buffe
     cmd_getval(cct, cmdmap, "object_size", osize, (int64_t)0);
     cmd_getval(cct, cmdmap, "object_num", onum, (int64_t)0);
 
-    ceph::shared_ptr<ObjectStore::Sequencer> osr (std::make_shared<
-                                        ObjectStore::Sequencer>("bench"));
-
-    uint32_t duration = cct->_conf->osd_bench_duration;
-
-    if (bsize > (int64_t) cct->_conf->osd_bench_max_block_size) {
-      // let us limit the block size because the next checks rely on it
-      // having a sane value.  If we allow any block size to be set things
-      // can still go sideways.
-      ss << "block 'size' values are capped at "
-         << prettybyte_t(cct->_conf->osd_bench_max_block_size) << ". If you wish to use"
-         << " a higher value, please adjust 'osd_bench_max_block_size'";
-      r = -EINVAL;
+    double elapsed = 0.0;
+    r = run_osd_bench_test(count, bsize, osize, onum, &elapsed, ss);
+    if (r < 0) {
       goto out;
-    } else if (bsize < (int64_t) (1 << 20)) {
-      // entering the realm of small block sizes.
-      // limit the count to a sane value, assuming a configurable amount of
-      // IOPS and duration, so that the OSD doesn't get hung up on this,
-      // preventing timeouts from going off
-      int64_t max_count =
-        bsize * duration * cct->_conf->osd_bench_small_size_max_iops;
-      if (count > max_count) {
-        ss << "'count' values greater than " << max_count
-           << " for a block size of " << prettybyte_t(bsize) << ", assuming "
-           << cct->_conf->osd_bench_small_size_max_iops << " IOPS,"
-           << " for " << duration << " seconds,"
-           << " can cause ill effects on osd. "
-           << " Please adjust 'osd_bench_small_size_max_iops' with a higher"
-           << " value if you wish to use a higher 'count'.";
-        r = -EINVAL;
-        goto out;
-      }
-    } else {
-      // 1MB block sizes are big enough so that we get more stuff done.
-      // However, to avoid the osd from getting hung on this and having
-      // timers being triggered, we are going to limit the count assuming
-      // a configurable throughput and duration.
-      // NOTE: max_count is the total amount of bytes that we believe we
-      //       will be able to write during 'duration' for the given
-      //       throughput.  The block size hardly impacts this unless it's
-      //       way too big.  Given we already check how big the block size
-      //       is, it's safe to assume everything will check out.
-      int64_t max_count =
-        cct->_conf->osd_bench_large_size_max_throughput * duration;
-      if (count > max_count) {
-        ss << "'count' values greater than " << max_count
-           << " for a block size of " << prettybyte_t(bsize) << ", assuming "
-           << prettybyte_t(cct->_conf->osd_bench_large_size_max_throughput) << "/s,"
-           << " for " << duration << " seconds,"
-           << " can cause ill effects on osd. "
-           << " Please adjust 'osd_bench_large_size_max_throughput'"
-           << " with a higher value if you wish to use a higher 'count'.";
-        r = -EINVAL;
-        goto out;
-      }
     }
-
     if (osize && bsize > osize)
       bsize = osize;
 
-    dout(1) << " bench count " << count
-            << " bsize " << prettybyte_t(bsize) << dendl;
-
-    ObjectStore::Transaction cleanupt;
-
-    if (osize && onum) {
-      bufferlist bl;
-      bufferptr bp(osize);
-      bp.zero();
-      bl.push_back(std::move(bp));
-      bl.rebuild_page_aligned();
-      for (int i=0; i<onum; ++i) {
-	char nm[30];
-	snprintf(nm, sizeof(nm), "disk_bw_test_%d", i);
-	object_t oid(nm);
-	hobject_t soid(sobject_t(oid, 0));
-	ObjectStore::Transaction t;
-	t.write(coll_t(), ghobject_t(soid), 0, osize, bl);
-	store->queue_transaction(osr.get(), std::move(t), NULL);
-	cleanupt.remove(coll_t(), ghobject_t(soid));
-      }
-    }
-
-    bufferlist bl;
-    bufferptr bp(bsize);
-    bp.zero();
-    bl.push_back(std::move(bp));
-    bl.rebuild_page_aligned();
-
-    {
-      C_SaferCond waiter;
-      if (!osr->flush_commit(&waiter)) {
-	waiter.wait();
-      }
-    }
-
-    utime_t start = ceph_clock_now();
-    for (int64_t pos = 0; pos < count; pos += bsize) {
-      char nm[30];
-      unsigned offset = 0;
-      if (onum && osize) {
-	snprintf(nm, sizeof(nm), "disk_bw_test_%d", (int)(rand() % onum));
-	offset = rand() % (osize / bsize) * bsize;
-      } else {
-	snprintf(nm, sizeof(nm), "disk_bw_test_%lld", (long long)pos);
-      }
-      object_t oid(nm);
-      hobject_t soid(sobject_t(oid, 0));
-      ObjectStore::Transaction t;
-      t.write(coll_t::meta(), ghobject_t(soid), offset, bsize, bl);
-      store->queue_transaction(osr.get(), std::move(t), NULL);
-      if (!onum || !osize)
-	cleanupt.remove(coll_t::meta(), ghobject_t(soid));
-    }
-
-    {
-      C_SaferCond waiter;
-      if (!osr->flush_commit(&waiter)) {
-	waiter.wait();
-      }
-    }
-    utime_t end = ceph_clock_now();
-
-    // clean up
-    store->queue_transaction(osr.get(), std::move(cleanupt), NULL);
-    {
-      C_SaferCond waiter;
-      if (!osr->flush_commit(&waiter)) {
-	waiter.wait();
-      }
-    }
-
-    uint64_t rate = (double)count / (end - start);
+    uint64_t rate = (double)count / elapsed;
     if (f) {
       f->open_object_section("osd_bench_results");
       f->dump_int("bytes_written", count);
@@ -6435,7 +6744,7 @@ void OSD::do_command(Connection *con, ceph_tid_t tid, vector<string>& cmd, buffe
     } else {
       ss << "bench: wrote " << prettybyte_t(count)
 	 << " in blocks of " << prettybyte_t(bsize) << " in "
-	 << (end-start) << " sec at " << prettybyte_t(rate) << "/sec";
+	 << elapsed << " sec at " << prettybyte_t(rate) << "/sec";
     }
   }
 
@@ -6626,6 +6935,12 @@ void OSD::maybe_share_map(
   if (!op->check_send_map) {
     return;
   }
+  if (op->sent_epoch >= osdmap->get_epoch()) {
+    // the sender is already current; nothing to share, and no need to
+    // touch the session or the OSDService peer epoch map
+    op->check_send_map = false;
+    return;
+  }
   epoch_t last_sent_epoch = 0;
 
   session->sent_epoch_lock.lock();
@@ -7216,6 +7531,12 @@ void OSD::note_down_osd(int peer)
     heartbeat_peers.erase(p);
   }
   heartbeat_lock.Unlock();
+
+  if (cct->_conf->osd_heartbeat_topology == "hierarchical") {
+    // if it was an aggregator, its domain has a new one now that pings
+    // it, but nothing else tells the new one (or its peers) to start
+    heartbeat_set_peers_need_update();
+  }
 }
 
 void OSD::note_up_osd(int peer)
@@ -7425,10 +7746,10 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
-        bool got = get_map_bl(e - 1, obl);
-        assert(got);
-	o->decode(obl);
+	// start from the (usually cached) previous epoch; everything the
+	// incremental leaves alone stays shared with it
+	OSDMapRef prev = get_map(e - 1);
+	o->deepish_copy_from(*prev);
       }
 
       OSDMap::Incremental inc;
@@ -7918,6 +8239,8 @@ void OSD::consume_map()
   assert(osd_lock.is_locked());
   dout(7) << "consume_map version " << osdmap->get_epoch() << dendl;
 
+  update_mclock_pool_qos();
+
   int num_pg_primary = 0, num_pg_replica = 0, num_pg_stray = 0;
   list<PGRef> to_remove;
 
@@ -9409,6 +9732,24 @@ const char** OSD::get_tracked_conf_keys() const
     "osd_client_message_cap",
     "osd_heartbeat_min_size",
     "osd_heartbeat_interval",
+    "osd_heartbeat_topology",
+    "osd_heartbeat_aggregate_level",
+    "osd_mclock_scheduler_client_res",
+    "osd_mclock_scheduler_client_wgt",
+    "osd_mclock_scheduler_client_lim",
+    "osd_mclock_scheduler_recovery_res",
+    "osd_mclock_scheduler_recovery_wgt",
+    "osd_mclock_scheduler_recovery_lim",
+    "osd_mclock_scheduler_backfill_res",
+    "osd_mclock_scheduler_backfill_wgt",
+    "osd_mclock_scheduler_backfill_lim",
+    "osd_mclock_scheduler_scrub_res",
+    "osd_mclock_scheduler_scrub_wgt",
+    "osd_mclock_scheduler_scrub_lim",
+    "osd_mclock_scheduler_snaptrim_res",
+    "osd_mclock_scheduler_snaptrim_wgt",
+    "osd_mclock_scheduler_snaptrim_lim",
+    "osd_mclock_max_capacity_iops",
     NULL
   };
   return KEYS;
@@ -9475,11 +9816,31 @@ void OSD::handle_conf_change(const struct md_config_t *conf,
   }
 #endif
 
+  if (changed.count("osd_heartbeat_topology") ||
+      changed.count("osd_heartbeat_aggregate_level")) {
+    need_heartbeat_peer_update();
+  }
+
   if (changed.count("osd_recovery_delay_start")) {
     service.defer_recovery(cct->_conf->osd_recovery_delay_start);
     service.kick_recovery_queue();
   }
 
+  bool mclock_changed = false;
+  for (auto& key : changed) {
+    if (key.compare(0, strlen("osd_mclock_scheduler_"),
+		    "osd_mclock_scheduler_") == 0) {
+      mclock_changed = true;
+    }
+  }
+  if (mclock_changed) {
+    op_shardedwq.update_mclock_configuration();
+  }
+  if (changed.count("osd_mclock_max_capacity_iops") &&
+      cct->_conf->osd_mclock_max_capacity_iops > 0) {
+    op_shardedwq.set_mclock_capacity(cct->_conf->osd_mclock_max_capacity_iops);
+  }
+
   if (changed.count("osd_client_message_cap")) {
     uint64_t newval = cct->_conf->osd_client_message_cap;
     Messenger::Policy pol = client_messenger->get_policy(entity_name_t::TYPE_CLIENT);
@@ -9877,6 +10238,7 @@ void OSD::ShardedOpWQ::clear_pg_slots()
   for (auto sdata : shard_list) {
     Mutex::Locker l(sdata->sdata_op_ordering_lock);
     sdata->pg_slots.clear();
+    sdata->next_pg = boost::none;
     sdata->waiting_for_pg_osdmap.reset();
     // don't bother with reserved pushes; we are shutting down
   }
@@ -9891,49 +10253,74 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   ShardData *sdata = shard_list[shard_index];
   assert(NULL != sdata);
 
-  // peek at spg_t
+  spg_t pgid;
   sdata->sdata_op_ordering_lock.Lock();
-  if (sdata->pqueue->empty()) {
-    dout(20) << __func__ << " empty q, waiting" << dendl;
-    // optimistically sleep a moment; maybe another work item will come along.
-    osd->cct->get_heartbeat_map()->reset_timeout(hb,
-      osd->cct->_conf->threadpool_default_timeout, 0);
-    sdata->sdata_lock.Lock();
-    sdata->sdata_op_ordering_lock.Unlock();
-    sdata->sdata_cond.WaitInterval(sdata->sdata_lock,
-      utime_t(osd->cct->_conf->threadpool_empty_queue_max_wait, 0));
-    sdata->sdata_lock.Unlock();
-    sdata->sdata_op_ordering_lock.Lock();
+  if (sdata->next_pg) {
+    // left for us by _run_pg_batch, already on its slot's to_process
+    pgid = *sdata->next_pg;
+    sdata->next_pg = boost::none;
+    dout(20) << __func__ << " " << pgid << " continuing after batch" << dendl;
+  } else {
     if (sdata->pqueue->empty()) {
+      dout(20) << __func__ << " empty q, waiting" << dendl;
+      // optimistically sleep a moment; maybe another work item will come along.
+      osd->cct->get_heartbeat_map()->reset_timeout(hb,
+	osd->cct->_conf->threadpool_default_timeout, 0);
+      sdata->sdata_lock.Lock();
+      sdata->sdata_op_ordering_lock.Unlock();
+      sdata->sdata_cond.WaitInterval(sdata->sdata_lock,
+	utime_t(osd->cct->_conf->threadpool_empty_queue_max_wait, 0));
+      sdata->sdata_lock.Unlock();
+      sdata->sdata_op_ordering_lock.Lock();
+      if (sdata->pqueue->empty()) {
+	sdata->sdata_op_ordering_lock.Unlock();
+	return;
+      }
+    }
+    utime_t ready_at;
+    if (!sdata->_is_ready(&ready_at)) {
+      // everything queued is over its mclock limit; wait until the first
+      // item is due or something new is queued
+      dout(20) << __func__ << " limited until " << ready_at << dendl;
+      osd->cct->get_heartbeat_map()->reset_timeout(hb,
+	osd->cct->_conf->threadpool_default_timeout, 0);
+      utime_t max_wait = ceph_clock_now();
+      max_wait += osd->cct->_conf->threadpool_empty_queue_max_wait;
+      sdata->sdata_lock.Lock();
       sdata->sdata_op_ordering_lock.Unlock();
+      sdata->sdata_cond.WaitUntil(sdata->sdata_lock,
+				  std::min(ready_at, max_wait));
+      sdata->sdata_lock.Unlock();
       return;
     }
-  }
-  pair<spg_t, PGQueueable> item = sdata->pqueue->dequeue();
-  if (osd->is_stopping()) {
-    sdata->sdata_op_ordering_lock.Unlock();
-    return;    // OSD shutdown, discard.
+    pair<spg_t, PGQueueable> item = sdata->pqueue->dequeue();
+    if (osd->is_stopping()) {
+      sdata->sdata_op_ordering_lock.Unlock();
+      return;    // OSD shutdown, discard.
+    }
+    pgid = item.first;
+    auto& slot = sdata->pg_slots[pgid];
+    dout(30) << __func__ << " " << pgid
+	     << " to_process " << slot.to_process
+	     << " waiting_for_pg=" << (int)slot.waiting_for_pg << dendl;
+    slot.to_process.push_back(item.second);
+    dout(20) << __func__ << " " << pgid << " item " << item.second
+	     << " queued" << dendl;
   }
   PGRef pg;
   uint64_t requeue_seq;
   {
-    auto& slot = sdata->pg_slots[item.first];
-    dout(30) << __func__ << " " << item.first
-	     << " to_process " << slot.to_process
-	     << " waiting_for_pg=" << (int)slot.waiting_for_pg << dendl;
-    slot.to_process.push_back(item.second);
+    auto& slot = sdata->pg_slots[pgid];
     // note the requeue seq now...
     requeue_seq = slot.requeue_seq;
     if (slot.waiting_for_pg) {
       // save ourselves a bit of effort
-      dout(20) << __func__ << " " << item.first << " item " << item.second
-	       << " queued, waiting_for_pg" << dendl;
+      dout(20) << __func__ << " " << pgid << " queued, waiting_for_pg"
+	       << dendl;
       sdata->sdata_op_ordering_lock.Unlock();
       return;
     }
     pg = slot.pg;
-    dout(20) << __func__ << " " << item.first << " item " << item.second
-	     << " queued" << dendl;
     ++slot.num_running;
   }
   sdata->sdata_op_ordering_lock.Unlock();
@@ -9942,7 +10329,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
   // [lookup +] lock pg (if we have it)
   if (!pg) {
-    pg = osd->_lookup_lock_pg(item.first);
+    pg = osd->_lookup_lock_pg(pgid);
   } else {
     pg->lock();
   }
@@ -9955,14 +10342,14 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   // osd->service.release_reserved_pushes() call below
   sdata->sdata_op_ordering_lock.Lock();
 
-  auto q = sdata->pg_slots.find(item.first);
+  auto q = sdata->pg_slots.find(pgid);
   assert(q != sdata->pg_slots.end());
   auto& slot = q->second;
   --slot.num_running;
 
   if (slot.to_process.empty()) {
     // raced with wake_pg_waiters or prune_pg_waiters
-    dout(20) << __func__ << " " << item.first << " nothing queued" << dendl;
+    dout(20) << __func__ << " " << pgid << " nothing queued" << dendl;
     if (pg) {
       pg->unlock();
     }
@@ -9970,7 +10357,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
     return;
   }
   if (requeue_seq != slot.requeue_seq) {
-    dout(20) << __func__ << " " << item.first
+    dout(20) << __func__ << " " << pgid
 	     << " requeue_seq " << slot.requeue_seq << " > our "
 	     << requeue_seq << ", we raced with wake_pg_waiters"
 	     << dendl;
@@ -9981,16 +10368,15 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
     return;
   }
   if (pg && !slot.pg && !pg->deleting) {
-    dout(20) << __func__ << " " << item.first << " set pg to " << pg << dendl;
+    dout(20) << __func__ << " " << pgid << " set pg to " << pg << dendl;
     slot.pg = pg;
   }
-  dout(30) << __func__ << " " << item.first << " to_process " << slot.to_process
+  dout(30) << __func__ << " " << pgid << " to_process " << slot.to_process
 	   << " waiting_for_pg=" << (int)slot.waiting_for_pg << dendl;
 
   // make sure we're not already waiting for this pg
   if (slot.waiting_for_pg) {
-    dout(20) << __func__ << " " << item.first << " item " << item.second
-	     << " slot is waiting_for_pg" << dendl;
+    dout(20) << __func__ << " " << pgid << " slot is waiting_for_pg" << dendl;
     if (pg) {
       pg->unlock();
     }
@@ -10001,25 +10387,25 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   // take next item
   qi = slot.to_process.front();
   slot.to_process.pop_front();
-  dout(20) << __func__ << " " << item.first << " item " << *qi
+  dout(20) << __func__ << " " << pgid << " item " << *qi
 	   << " pg " << pg << dendl;
 
   if (!pg) {
     // should this pg shard exist on this osd in this (or a later) epoch?
     OSDMapRef osdmap = sdata->waiting_for_pg_osdmap;
-    if (osdmap->is_up_acting_osd_shard(item.first, osd->whoami)) {
-      dout(20) << __func__ << " " << item.first
+    if (osdmap->is_up_acting_osd_shard(pgid, osd->whoami)) {
+      dout(20) << __func__ << " " << pgid
 	       << " no pg, should exist, will wait on " << *qi << dendl;
       slot.to_process.push_front(*qi);
       slot.waiting_for_pg = true;
     } else if (qi->get_map_epoch() > osdmap->get_epoch()) {
-      dout(20) << __func__ << " " << item.first << " no pg, item epoch is "
+      dout(20) << __func__ << " " << pgid << " no pg, item epoch is "
 	       << qi->get_map_epoch() << " > " << osdmap->get_epoch()
 	       << ", will wait on " << *qi << dendl;
       slot.to_process.push_front(*qi);
       slot.waiting_for_pg = true;
     } else {
-      dout(20) << __func__ << " " << item.first << " no pg, shouldn't exist,"
+      dout(20) << __func__ << " " << pgid << " no pg, shouldn't exist,"
 	       << " dropping " << *qi << dendl;
       // share map with client?
       if (boost::optional<OpRequestRef> _op = qi->maybe_get_op()) {
@@ -10080,9 +10466,58 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
         reqid.name._num, reqid.tid, reqid.inc);
   }
 
+  if (osd->cct->_conf->osd_op_run_to_completion) {
+    _run_pg_batch(sdata, shard_index, pgid, pg, tp_handle);
+  }
+
   pg->unlock();
 }
 
+void OSD::ShardedOpWQ::_run_pg_batch(
+  ShardData *sdata, uint32_t shard_index, spg_t pgid, PGRef& pg,
+  ThreadPool::TPHandle& tp_handle)
+{
+  // Keep the pg lock and run whatever the queue hands out next while it
+  // is for the same pg.  We are the shard's only worker, so the item we
+  // dequeue is the one the queue would have had us run next anyway.  An
+  // item for another pg is left on its slot and run by the next
+  // _process, rather than requeued: that would reorder it, and charge it
+  // twice in mclock.
+  unsigned max_items = osd->cct->_conf->osd_op_run_to_completion_max_items;
+  for (unsigned n = 1; n < max_items; ++n) {
+    sdata->sdata_op_ordering_lock.Lock();
+    utime_t ready_at;
+    if (sdata->pqueue->empty() || osd->is_stopping() ||
+	!sdata->_is_ready(&ready_at)) {
+      sdata->sdata_op_ordering_lock.Unlock();
+      return;
+    }
+    pair<spg_t, PGQueueable> next = sdata->pqueue->dequeue();
+    auto& slot = sdata->pg_slots[next.first];
+    slot.to_process.push_back(next.second);
+    if (next.first != pgid ||
+	pg->deleting ||
+	slot.pg != pg ||
+	slot.waiting_for_pg) {
+      dout(20) << __func__ << " " << pgid << " batch ends at "
+	       << next.first << " item " << next.second << dendl;
+      assert(!sdata->next_pg);
+      sdata->next_pg = next.first;
+      sdata->sdata_op_ordering_lock.Unlock();
+      return;
+    }
+    assert(slot.num_running == 0);
+    PGQueueable qi = slot.to_process.front();
+    slot.to_process.pop_front();
+    sdata->sdata_op_ordering_lock.Unlock();
+
+    dout(20) << __func__ << " " << pgid << " item " << qi
+	     << " pg " << pg << " (batched " << n << ")" << dendl;
+    tp_handle.reset_tp_timeout();
+    qi.run(osd, pg, tp_handle);
+  }
+}
+
 void OSD::ShardedOpWQ::_enqueue(pair<spg_t, PGQueueable> item) {
   uint32_t shard_index =
     item.first.hash_to_shard(shard_list.size());
@@ -10178,6 +10613,9 @@ std::ostream& operator<<(std::ostream& out, const OSD::io_queue& q) {
   case OSD::io_queue::mclock_client:
     out << "mclock_client";
     break;
+  case OSD::io_queue::mclock_scheduler:
+    out << "mclock_scheduler";
+    break;
   }
   return out;
 }
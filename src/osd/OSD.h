@@ -57,6 +57,7 @@ using namespace std;
 #include "common/PrioritizedQueue.h"
 #include "osd/mClockOpClassQueue.h"
 #include "osd/mClockClientQueue.h"
+#include "osd/mClockScheduler.h"
 #include "messages/MOSDOp.h"
 #include "common/EventTrace.h"
 
@@ -126,6 +127,8 @@ enum {
   l_osd_pg_primary,
   l_osd_pg_replica,
   l_osd_pg_stray,
+  l_osd_pg_load_total,
+  l_osd_pg_loaded,
   l_osd_hb_to,
   l_osd_map,
   l_osd_mape,
@@ -166,6 +169,10 @@ enum {
 
   l_osd_object_ctx_cache_hit,
   l_osd_object_ctx_cache_total,
+  l_osd_object_ctx_cache_miss,
+  l_osd_object_ctx_decode_lat,
+  l_osd_snapset_ctx_cache_hit,
+  l_osd_snapset_ctx_cache_miss,
 
   l_osd_op_cache_hit,
   l_osd_tier_flush_lat,
@@ -856,6 +863,15 @@ public:
   Mutex scrub_sleep_lock;
   SafeTimer scrub_sleep_timer;
 
+private:
+  /// streaming estimate of the osd_scrub_sleep_latency_percentile
+  /// client op latency, in seconds
+  std::atomic<double> client_lat_quantile = {0};
+public:
+  void note_client_op_latency(utime_t lat);
+  /// sleep before the next scrub chunk, stretched while clients are slow
+  double get_scrub_sleep();
+
   AsyncReserver<spg_t> snap_reserver;
   void queue_for_snap_trim(PG *pg);
 
@@ -892,10 +908,13 @@ private:
   void _queue_for_recovery(
     pair<epoch_t, PGRef> p, uint64_t reserved_pushes) {
     assert(recovery_lock.is_locked_by_me());
+    // the state is read without the pg lock; it only picks the
+    // scheduler class
     enqueue_back(
       p.second->info.pgid,
       PGQueueable(
-	PGRecovery(p.first, reserved_pushes),
+	PGRecovery(p.first, reserved_pushes,
+		   p.second->get_state() & PG_STATE_BACKFILL),
 	cct->_conf->osd_recovery_cost,
 	cct->_conf->osd_recovery_priority,
 	ceph_clock_now(),
@@ -1488,6 +1507,12 @@ private:
   bool heartbeat_stop;
   std::atomic_bool heartbeat_need_update;   
   map<int,HeartbeatInfo> heartbeat_peers;  ///< map of osd id to HeartbeatInfo
+  // hierarchical heartbeats (osd_heartbeat_topology); heartbeat_lock
+  int hb_aggregator = -1;       ///< aggregator of our domain, -1 if none
+  set<int> hb_domain;           ///< other members, if we aggregate our domain
+  map<int,set<int>> hb_remote_domains;  ///< other aggregators -> their domain
+  map<int,utime_t> hb_failed_aggregators;  ///< unresponsive -> last heard from
+  map<int,utime_t> hb_adopted;  ///< remote members we ping -> since when
   utime_t last_mon_heartbeat;
   Messenger *hb_front_client_messenger;
   Messenger *hb_back_client_messenger;
@@ -1500,6 +1525,7 @@ private:
   void _remove_heartbeat_peer(int p);
   bool heartbeat_reset(Connection *con);
   void maybe_update_heartbeat_peers();
+  void _update_hierarchical_heartbeat_peers();
   void reset_heartbeat_peers();
   bool heartbeat_peers_need_update() {
     return heartbeat_need_update.load();
@@ -1592,6 +1618,7 @@ private:
     weightedpriority,
     mclock_opclass,
     mclock_client,
+    mclock_scheduler,
   };
   friend std::ostream& operator<<(std::ostream& out, const OSD::io_queue& q);
 
@@ -1649,9 +1676,22 @@ private:
       /// pg lock.  slots are removed only by prune_pg_waiters.
       unordered_map<spg_t,pg_slot> pg_slots;
 
+      /// with osd_op_run_to_completion, the pg whose slot got the item
+      /// that ended a batch; the shard's worker runs it before it
+      /// dequeues again
+      boost::optional<spg_t> next_pg;
+
       /// priority queue
       std::unique_ptr<OpQueue< pair<spg_t, PGQueueable>, entity_inst_t>> pqueue;
 
+      /// pqueue, if it is an mClockScheduler
+      ceph::mClockScheduler *mclock = nullptr;
+
+      /// false if everything queued is held back by its mclock limit
+      bool _is_ready(utime_t *when) {
+	return !mclock || mclock->is_ready(when);
+      }
+
       void _enqueue_front(pair<spg_t, PGQueueable> item, unsigned cutoff) {
 	unsigned priority = item.second.get_priority();
 	unsigned cost = item.second.get_cost();
@@ -1688,6 +1728,9 @@ private:
 	} else if (opqueue == io_queue::mclock_client) {
 	  pqueue = std::unique_ptr
 	    <ceph::mClockClientQueue>(new ceph::mClockClientQueue(cct));
+	} else if (opqueue == io_queue::mclock_scheduler) {
+	  mclock = new ceph::mClockScheduler(cct);
+	  pqueue = std::unique_ptr<ceph::mClockScheduler>(mclock);
 	}
       }
     }; // struct ShardData
@@ -1740,6 +1783,10 @@ private:
     /// try to do some work
     void _process(uint32_t thread_index, heartbeat_handle_d *hb) override;
 
+    /// run further queued items for pgid while we still hold its lock
+    void _run_pg_batch(ShardData *sdata, uint32_t shard_index, spg_t pgid,
+		       PGRef& pg, ThreadPool::TPHandle& tp_handle);
+
     /// enqueue a new item
     void _enqueue(pair <spg_t, PGQueueable> item) override;
 
@@ -1756,6 +1803,35 @@ private:
       }
     }
 
+    /// split the OSD's iops capacity between the mclock shards
+    void set_mclock_capacity(double iops) {
+      for (auto sdata : shard_list) {
+	Mutex::Locker l(sdata->sdata_op_ordering_lock);
+	if (sdata->mclock) {
+	  sdata->mclock->set_capacity(iops / num_shards);
+	}
+      }
+    }
+
+    void update_mclock_configuration() {
+      for (auto sdata : shard_list) {
+	Mutex::Locker l(sdata->sdata_op_ordering_lock);
+	if (sdata->mclock) {
+	  sdata->mclock->update_configuration();
+	}
+      }
+    }
+
+    void set_mclock_pool_qos(
+      const map<int64_t, ceph::mClockScheduler::qos_t>& qos) {
+      for (auto sdata : shard_list) {
+	Mutex::Locker l(sdata->sdata_op_ordering_lock);
+	if (sdata->mclock) {
+	  sdata->mclock->set_pool_qos(qos);
+	}
+      }
+    }
+
     void dump(Formatter *f) {
       for(uint32_t i = 0; i < num_shards; i++) {
 	ShardData* sdata = shard_list[i];
@@ -1803,7 +1879,7 @@ private:
       ShardData* sdata = shard_list[shard_index];
       assert(NULL != sdata);
       Mutex::Locker l(sdata->sdata_op_ordering_lock);
-      return sdata->pqueue->empty();
+      return sdata->pqueue->empty() && !sdata->next_pg;
     }
   } op_shardedwq;
 
@@ -1988,6 +2064,43 @@ protected:
     PG::CephPeeringEvtRef evt);
   
   void load_pgs();
+  void _load_pg(PG *pg, bufferlist& bl, std::atomic_bool *has_upgraded);
+
+  /// feeds the pgs opened by load_pgs() to a short-lived pool
+  struct LoadPGWQ : public ThreadPool::WorkQueue<pair<PG*,bufferlist>> {
+    OSD *osd;
+    std::atomic_bool *has_upgraded;
+    std::deque<pair<PG*,bufferlist>*> q;
+
+    LoadPGWQ(OSD *o, std::atomic_bool *u, ThreadPool *tp)
+      : ThreadPool::WorkQueue<pair<PG*,bufferlist>>("OSD::LoadPGWQ", 0, 0, tp),
+	osd(o), has_upgraded(u) {}
+
+    bool _empty() override {
+      return q.empty();
+    }
+    bool _enqueue(pair<PG*,bufferlist> *i) override {
+      q.push_back(i);
+      return true;
+    }
+    void _dequeue(pair<PG*,bufferlist> *i) override {
+      ceph_abort();
+    }
+    pair<PG*,bufferlist> *_dequeue() override {
+      if (q.empty())
+	return nullptr;
+      auto i = q.front();
+      q.pop_front();
+      return i;
+    }
+    void _process(pair<PG*,bufferlist> *i, ThreadPool::TPHandle &) override {
+      osd->_load_pg(i->first, i->second, has_upgraded);
+      osd->logger->inc(l_osd_pg_loaded);
+    }
+    void _clear() override {
+      q.clear();
+    }
+  };
   void build_past_intervals_parallel();
 
   /// build initial pg history and intervals on create
@@ -2281,7 +2394,8 @@ private:
       static io_queue index_lookup[] = { io_queue::prioritized,
 					 io_queue::weightedpriority,
 					 io_queue::mclock_opclass,
-					 io_queue::mclock_client };
+					 io_queue::mclock_client,
+					 io_queue::mclock_scheduler };
       srand(time(NULL));
       unsigned which = rand() % (sizeof(index_lookup) / sizeof(index_lookup[0]));
       return index_lookup[which];
@@ -2291,6 +2405,8 @@ private:
       return io_queue::mclock_opclass;
     } else if (cct->_conf->osd_op_queue == "mclock_client") {
       return io_queue::mclock_client;
+    } else if (cct->_conf->osd_op_queue == "mclock_scheduler") {
+      return io_queue::mclock_scheduler;
     } else {
       // default / catch-all is 'wpq'
       return io_queue::weightedpriority;
@@ -2359,7 +2475,17 @@ private:
 
   float get_osd_recovery_sleep();
 
+  int run_osd_bench_test(int64_t count, int64_t bsize, int64_t osize,
+			 int64_t onum, double *elapsed, ostream &ss);
+  void init_mclock_capacity();
+  void update_mclock_pool_qos();
+
 public:
+  /// background work is paced by the op queue rather than by sleeps
+  bool is_mclock_scheduler() const {
+    return op_queue == io_queue::mclock_scheduler;
+  }
+
   static int peek_meta(ObjectStore *store, string& magic,
 		       uuid_d& cluster_fsid, uuid_d& osd_fsid, int& whoami);
   
@@ -1115,6 +1115,9 @@ void OSDMap::set_max_osd(int m)
   }
   osd_info.resize(m);
   osd_xinfo.resize(m);
+  _unshare(osd_addrs);
+  _unshare(osd_uuid);
+  _unshare(osd_primary_affinity);
   osd_addrs->client_addr.resize(m);
   osd_addrs->cluster_addr.resize(m);
   osd_addrs->hb_back_addr.resize(m);
@@ -1232,6 +1235,59 @@ void OSDMap::get_up_osds(set<int32_t>& ls) const
   }
 }
 
+void OSDMap::get_heartbeat_domains(const string& type_name,
+				   map<int, set<int>> *domains) const
+{
+  domains->clear();
+  set<int> unassigned;
+  get_up_osds(unassigned);
+
+  int type = crush->get_type_id(type_name);
+  if (type > 0) {
+    for (int i = 0; i < crush->get_max_buckets(); ++i) {
+      int id = -1 - i;
+      if (!crush->bucket_exists(id) ||
+	  crush->is_shadow_item(id) ||
+	  crush->get_bucket_type(id) != type) {
+	continue;
+      }
+      const char *name = crush->get_item_name(id);
+      set<int> leaves;
+      if (!name || crush->get_leaves(name, &leaves) < 0) {
+	continue;
+      }
+      set<int> members;
+      for (auto o : leaves) {
+	if (unassigned.erase(o)) {
+	  members.insert(o);
+	}
+      }
+      if (!members.empty()) {
+	int aggregator = *members.begin();
+	(*domains)[aggregator].swap(members);
+      }
+    }
+  }
+  for (auto o : unassigned) {
+    (*domains)[o].insert(o);
+  }
+}
+
+int OSDMap::get_heartbeat_aggregator(const string& type_name, int osd) const
+{
+  if (!is_up(osd)) {
+    return -1;
+  }
+  map<int, set<int>> domains;
+  get_heartbeat_domains(type_name, &domains);
+  for (auto& d : domains) {
+    if (d.second.count(osd)) {
+      return d.first;
+    }
+  }
+  return -1;
+}
+
 void OSDMap::get_out_osds(set<int32_t>& ls) const
 {
   for (int i = 0; i < max_osd; i++) {
@@ -1451,56 +1507,65 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
 
   int diff = 0;
 
-  // do addrs match?
-  if (o->max_osd != n->max_osd)
-    diff++;
-  for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
-    if ( n->osd_addrs->client_addr[i] &&  o->osd_addrs->client_addr[i] &&
-	*n->osd_addrs->client_addr[i] == *o->osd_addrs->client_addr[i])
-      n->osd_addrs->client_addr[i] = o->osd_addrs->client_addr[i];
-    else
-      diff++;
-    if ( n->osd_addrs->cluster_addr[i] &&  o->osd_addrs->cluster_addr[i] &&
-	*n->osd_addrs->cluster_addr[i] == *o->osd_addrs->cluster_addr[i])
-      n->osd_addrs->cluster_addr[i] = o->osd_addrs->cluster_addr[i];
-    else
-      diff++;
-    if ( n->osd_addrs->hb_back_addr[i] &&  o->osd_addrs->hb_back_addr[i] &&
-	*n->osd_addrs->hb_back_addr[i] == *o->osd_addrs->hb_back_addr[i])
-      n->osd_addrs->hb_back_addr[i] = o->osd_addrs->hb_back_addr[i];
-    else
+  // do addrs match?  (maps derived from one another share everything
+  // that did not change, so most of these are pointer compares)
+  if (n->osd_addrs != o->osd_addrs) {
+    _unshare(n->osd_addrs);
+    if (o->max_osd != n->max_osd)
       diff++;
-    if ( n->osd_addrs->hb_front_addr[i] &&  o->osd_addrs->hb_front_addr[i] &&
-	*n->osd_addrs->hb_front_addr[i] == *o->osd_addrs->hb_front_addr[i])
-      n->osd_addrs->hb_front_addr[i] = o->osd_addrs->hb_front_addr[i];
-    else
-      diff++;
-  }
-  if (diff == 0) {
-    // zoinks, no differences at all!
-    n->osd_addrs = o->osd_addrs;
+    for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
+      if ( n->osd_addrs->client_addr[i] &&  o->osd_addrs->client_addr[i] &&
+	  *n->osd_addrs->client_addr[i] == *o->osd_addrs->client_addr[i])
+	n->osd_addrs->client_addr[i] = o->osd_addrs->client_addr[i];
+      else
+	diff++;
+      if ( n->osd_addrs->cluster_addr[i] &&  o->osd_addrs->cluster_addr[i] &&
+	  *n->osd_addrs->cluster_addr[i] == *o->osd_addrs->cluster_addr[i])
+	n->osd_addrs->cluster_addr[i] = o->osd_addrs->cluster_addr[i];
+      else
+	diff++;
+      if ( n->osd_addrs->hb_back_addr[i] &&  o->osd_addrs->hb_back_addr[i] &&
+	  *n->osd_addrs->hb_back_addr[i] == *o->osd_addrs->hb_back_addr[i])
+	n->osd_addrs->hb_back_addr[i] = o->osd_addrs->hb_back_addr[i];
+      else
+	diff++;
+      if ( n->osd_addrs->hb_front_addr[i] &&  o->osd_addrs->hb_front_addr[i] &&
+	  *n->osd_addrs->hb_front_addr[i] == *o->osd_addrs->hb_front_addr[i])
+	n->osd_addrs->hb_front_addr[i] = o->osd_addrs->hb_front_addr[i];
+      else
+	diff++;
+    }
+    if (diff == 0) {
+      // zoinks, no differences at all!
+      n->osd_addrs = o->osd_addrs;
+    }
   }
 
   // does crush match?
-  bufferlist oc, nc;
-  ::encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  ::encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  if (oc.contents_equal(nc)) {
-    n->crush = o->crush;
+  if (n->crush != o->crush) {
+    bufferlist oc, nc;
+    ::encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    ::encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    if (oc.contents_equal(nc)) {
+      n->crush = o->crush;
+    }
   }
 
   // does pg_temp match?
-  if (*o->pg_temp == *n->pg_temp)
+  if (n->pg_temp != o->pg_temp &&
+      *o->pg_temp == *n->pg_temp)
     n->pg_temp = o->pg_temp;
 
   // does primary_temp match?
-  if (o->primary_temp->size() == n->primary_temp->size()) {
+  if (n->primary_temp != o->primary_temp &&
+      o->primary_temp->size() == n->primary_temp->size()) {
     if (*o->primary_temp == *n->primary_temp)
       n->primary_temp = o->primary_temp;
   }
 
   // do uuids match?
-  if (o->osd_uuid->size() == n->osd_uuid->size() &&
+  if (n->osd_uuid != o->osd_uuid &&
+      o->osd_uuid->size() == n->osd_uuid->size() &&
       *o->osd_uuid == *n->osd_uuid)
     n->osd_uuid = o->osd_uuid;
 }
@@ -1678,6 +1743,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
     if ((osd_state[osd] & CEPH_OSD_EXISTS) &&
 	(s & CEPH_OSD_EXISTS)) {
       // osd is destroyed; clear out anything interesting.
+      _unshare(osd_uuid);
+      _unshare(osd_addrs);
       (*osd_uuid)[osd] = uuid_d();
       osd_info[osd] = osd_info_t();
       osd_xinfo[osd] = osd_xinfo_t();
@@ -1692,6 +1759,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
     }
   }
 
+  if (!inc.new_up_client.empty() || !inc.new_up_cluster.empty())
+    _unshare(osd_addrs);
   for (const auto &client : inc.new_up_client) {
     osd_state[client.first] |= CEPH_OSD_EXISTS | CEPH_OSD_UP;
     osd_addrs->client_addr[client.first].reset(new entity_addr_t(client.second));
@@ -1729,10 +1798,14 @@ int OSDMap::apply_incremental(const Incremental &inc)
     osd_xinfo[xinfo.first] = xinfo.second;
 
   // uuid
+  if (!inc.new_uuid.empty())
+    _unshare(osd_uuid);
   for (const auto &uuid : inc.new_uuid)
     (*osd_uuid)[uuid.first] = uuid.second;
 
   // pg rebuild
+  if (!inc.new_pg_temp.empty())
+    _unshare(pg_temp);
   for (const auto &pg : inc.new_pg_temp) {
     if (pg.second.empty())
       pg_temp->erase(pg.first);
@@ -1744,6 +1817,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
     pg_temp->rebuild();
   }
 
+  if (!inc.new_primary_temp.empty())
+    _unshare(primary_temp);
   for (const auto &pg : inc.new_primary_temp) {
     if (pg.second == -1)
       primary_temp->erase(pg.first);
@@ -2453,6 +2528,18 @@ void OSDMap::decode(bufferlist& bl)
   decode(p);
 }
 
+void OSDMap::_reset_shared()
+{
+  // decoding in place must not scribble over structures that we share
+  // with other epochs
+  osd_addrs = std::make_shared<addrs_s>();
+  pg_temp = std::make_shared<PGTempMap>();
+  primary_temp = std::make_shared<mempool::osdmap::map<pg_t,int32_t>>();
+  osd_uuid = std::make_shared<mempool::osdmap::vector<uuid_d>>();
+  osd_primary_affinity.reset();
+  crush = std::make_shared<CrushWrapper>();
+}
+
 void OSDMap::decode_classic(bufferlist::iterator& p)
 {
   __u32 n, t;
@@ -2582,6 +2669,7 @@ void OSDMap::decode(bufferlist::iterator& bl)
    * a struct_v < 7, we must rewind to the beginning and use our
    * classic decoder.
    */
+  _reset_shared();
   size_t start_offset = bl.get_off();
   size_t tail_offset = 0;
   bufferlist crc_front, crc_tail;
@@ -558,6 +558,15 @@ private:
 
   void _calc_up_osd_features();
 
+  /// copy a structure that other maps still reference before changing it
+  template <typename T>
+  static void _unshare(ceph::shared_ptr<T>& p) {
+    if (p && !p.unique())
+      p = std::make_shared<T>(*p);
+  }
+  /// replace shared structures with empty ones ahead of a full decode
+  void _reset_shared();
+
  public:
   bool have_crc() const { return crc_defined; }
   uint32_t get_crc() const { return crc; }
@@ -593,19 +602,11 @@ private:
 public:
 
   void deepish_copy_from(const OSDMap& o) {
+    // NOTE: the crush map, addrs, pg_temp, primary_temp, primary
+    // affinity and uuids are shared with o; they are copied on write
+    // (see _unshare) by whatever modifies them, so unchanged ones stay
+    // shared between consecutive epochs.
     *this = o;
-    primary_temp.reset(new mempool::osdmap::map<pg_t,int32_t>(*o.primary_temp));
-    pg_temp.reset(new PGTempMap(*o.pg_temp));
-    osd_uuid.reset(new mempool::osdmap::vector<uuid_d>(*o.osd_uuid));
-
-    if (o.osd_primary_affinity)
-      osd_primary_affinity.reset(new mempool::osdmap::vector<__u32>(*o.osd_primary_affinity));
-
-    // NOTE: this still references shared entity_addr_t's.
-    osd_addrs.reset(new addrs_s(*o.osd_addrs));
-
-    // NOTE: we do not copy crush.  note that apply_incremental will
-    // allocate a new CrushWrapper, though.
   }
 
   // map info
@@ -721,6 +722,8 @@ public:
       osd_primary_affinity.reset(
 	new mempool::osdmap::vector<__u32>(
 	  max_osd, CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
+    else
+      _unshare(osd_primary_affinity);
     (*osd_primary_affinity)[o] = w;
   }
   unsigned get_primary_affinity(int o) const {
@@ -957,6 +960,17 @@ public:
     return -1;
   }
 
+  /**
+   * group the up osds into heartbeat domains, the crush subtrees of
+   * type type_name.  each domain is keyed by its lowest-numbered up
+   * osd, which aggregates heartbeats for the domain.  up osds outside
+   * any subtree of that type are domains of their own.
+   */
+  void get_heartbeat_domains(const string& type_name,
+			     map<int, set<int>> *domains) const;
+  /// the aggregator of the heartbeat domain of osd, or -1 if it is down
+  int get_heartbeat_aggregator(const string& type_name, int osd) const;
+
   /**
    * get feature bits required by the current structure
    *
@@ -1332,6 +1346,8 @@ public:
   bool crush_ruleset_in_use(int ruleset) const;
 
   void clear_temp() {
+    _unshare(pg_temp);
+    _unshare(primary_temp);
     pg_temp->clear();
     primary_temp->clear();
   }
@@ -53,7 +53,46 @@ void OSDMapMapping::update(const OSDMap& osdmap)
 
 void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
 {
+  auto& pm = pools.at(pgid.pool());
+  vector<int> old_acting;
+  pm.get(pgid.ps(), nullptr, nullptr, &old_acting, nullptr);
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
+  vector<int> acting;
+  pm.get(pgid.ps(), nullptr, nullptr, &acting, nullptr);
+
+  // keep the rmap in step
+  for (auto osd : old_acting) {
+    if (osd == CRUSH_ITEM_NONE || osd >= (int)acting_rmap.size()) {
+      continue;
+    }
+    auto& v = acting_rmap[osd];
+    auto q = std::find(v.begin(), v.end(), pgid);
+    if (q != v.end()) {
+      v.erase(q);
+    }
+  }
+  for (auto osd : acting) {
+    if (osd == CRUSH_ITEM_NONE) {
+      continue;
+    }
+    if (osd >= (int)acting_rmap.size()) {
+      acting_rmap.resize(osd + 1);
+    }
+    acting_rmap[osd].push_back(pgid);
+  }
+}
+
+void OSDMapMapping::update(const OSDMap& osdmap, const set<pg_t>& pgids)
+{
+  assert(pools.size() == osdmap.get_pools().size());
+  for (auto pgid : pgids) {
+    auto p = pools.find(pgid.pool());
+    if (p == pools.end() || pgid.ps() >= p->second.pg_num) {
+      continue;
+    }
+    update(osdmap, pgid);
+  }
+  epoch = osdmap.get_epoch();
 }
 
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
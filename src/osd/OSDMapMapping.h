@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <map>
+#include <set>
 
 #include "osd/osd_types.h"
 #include "common/WorkQueue.h"
@@ -302,6 +303,9 @@ public:
 
   void update(const OSDMap& map);
   void update(const OSDMap& map, pg_t pgid);
+  /// bring a complete mapping up to map, when only pgids can have
+  /// changed since the epoch it is for (same pools, crush and osds)
+  void update(const OSDMap& map, const std::set<pg_t>& pgids);
 
   std::unique_ptr<MappingJob> start_update(
     const OSDMap& map,
@@ -304,6 +304,7 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   scrub_queued(false),
   recovery_queued(false),
   recovery_ops_active(0),
+  recovery_slots_held(0),
   role(-1),
   state(0),
   send_notify(false),
@@ -2142,20 +2143,31 @@ void PG::_finish_recovery(Context *c)
   unlock();
 }
 
-void PG::start_recovery_op(const hobject_t& soid)
+/*
+ * take_slot=false starts an object that rides along in a batch whose
+ * osd recovery slot is already held.  slots are given back only as the
+ * number of active ops drops below the number held, so a batch keeps its
+ * slot until its last object finishes.
+ */
+void PG::start_recovery_op(const hobject_t& soid, bool take_slot)
 {
   dout(10) << "start_recovery_op " << soid
+	   << (take_slot ? "" : " (batched)")
 #ifdef DEBUG_RECOVERY_OIDS
 	   << " (" << recovering_oids << ")"
 #endif
 	   << dendl;
   assert(recovery_ops_active >= 0);
+  assert(take_slot || recovery_slots_held > 0);
   recovery_ops_active++;
 #ifdef DEBUG_RECOVERY_OIDS
   assert(recovering_oids.count(soid) == 0);
   recovering_oids.insert(soid);
 #endif
-  osd->start_recovery_op(this, soid);
+  if (take_slot) {
+    recovery_slots_held++;
+    osd->start_recovery_op(this, soid);
+  }
 }
 
 void PG::finish_recovery_op(const hobject_t& soid, bool dequeue)
@@ -2171,7 +2183,10 @@ void PG::finish_recovery_op(const hobject_t& soid, bool dequeue)
   assert(recovering_oids.count(soid));
   recovering_oids.erase(soid);
 #endif
-  osd->finish_recovery_op(this, soid, dequeue);
+  if (recovery_slots_held > recovery_ops_active) {
+    recovery_slots_held--;
+    osd->finish_recovery_op(this, soid, dequeue);
+  }
 
   if (!dequeue) {
     queue_recovery();
@@ -2419,6 +2434,7 @@ void PG::clear_recovery_state()
 #endif
     finish_recovery_op(soid, true);
   }
+  assert(recovery_slots_held == 0);
 
   backfill_targets.clear();
   backfill_info.clear();
@@ -4135,12 +4151,14 @@ void PG::replica_scrub(
  */
 void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
 {
-  if (cct->_conf->osd_scrub_sleep > 0 &&
+  double scrub_sleep = osd->get_scrub_sleep();
+  if (scrub_sleep > 0 &&
       (scrubber.state == PG::Scrubber::NEW_CHUNK ||
        scrubber.state == PG::Scrubber::INACTIVE) &&
        scrubber.needs_sleep) {
     ceph_assert(!scrubber.sleeping);
-    dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
+    dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping "
+	     << scrub_sleep << dendl;
 
     // Do an async sleep so we don't block the op queue
     OSDService *osds = osd;
@@ -4168,7 +4186,7 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
           pg->unlock();
         });
     Mutex::Locker l(osd->scrub_sleep_lock);
-    osd->scrub_sleep_timer.add_event_after(cct->_conf->osd_scrub_sleep,
+    osd->scrub_sleep_timer.add_event_after(scrub_sleep,
                                            scrub_requeue_callback);
     scrubber.sleeping = true;
     scrubber.sleep_start = ceph_clock_now();
@@ -572,6 +572,8 @@ public:
   bool recovery_queued;
 
   int recovery_ops_active;
+  /// osd recovery slots held; batched objects share a slot
+  int recovery_slots_held;
   set<pg_shard_t> waiting_on_backfill;
 #ifdef DEBUG_RECOVERY_OIDS
   set<hobject_t> recovering_oids;
@@ -1157,7 +1159,7 @@ public:
   void clear_recovery_state();
   virtual void _clear_recovery_state() = 0;
   virtual void check_recovery_sources(const OSDMapRef& newmap) = 0;
-  void start_recovery_op(const hobject_t& soid);
+  void start_recovery_op(const hobject_t& soid, bool take_slot=true);
   void finish_recovery_op(const hobject_t& soid, bool dequeue=false);
 
   void split_into(pg_t child_pgid, PG *child, unsigned split_bits);
@@ -38,8 +38,8 @@ void PGLog::IndexedLog::split_out_child(
 {
   unindex();
   *target = IndexedLog(pg_log_t::split_out_child(child_pgid, split_bits));
-  index();
-  target->index();
+  reindex();
+  target->reindex();
   reset_rollback_info_trimmed_to_riter();
 }
 
@@ -82,10 +82,34 @@ public:
    * plus some methods to manipulate it all.
    */
   struct IndexedLog : public pg_log_t {
-    mutable ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
-    mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_dup_t*> dup_index;
+    typedef std::reference_wrapper<const hobject_t> hobject_ref_t;
+    struct hobject_ref_hash {
+      size_t operator()(const hobject_ref_t& r) const {
+	return std::hash<hobject_t>()(r.get());
+      }
+    };
+    struct hobject_ref_equal {
+      bool operator()(const hobject_ref_t& l, const hobject_ref_t& r) const {
+	return l.get() == r.get();
+      }
+    };
+
+    /**
+     * ptrs into log.  be careful!
+     *
+     * The key refers to the soid of the entry it maps to, so the index
+     * does not hold a second copy of every object name; only ever
+     * insert through _index_object() so the key moves with the entry.
+     */
+    mutable mempool::osd_pglog::unordered_map<
+      hobject_ref_t, pg_log_entry_t*,
+      hobject_ref_hash, hobject_ref_equal> objects;
+    mutable mempool::osd_pglog::unordered_map<
+      osd_reqid_t,pg_log_entry_t*> caller_ops;
+    mutable mempool::osd_pglog::unordered_multimap<
+      osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
+    mutable mempool::osd_pglog::unordered_map<
+      osd_reqid_t,pg_log_dup_t*> dup_index;
 
     // recovery pointers
     list<pg_log_entry_t>::iterator complete_to; // not inclusive of referenced item
@@ -122,6 +146,13 @@ public:
       }
     }
 
+    void _index_object(pg_log_entry_t *e) const {
+      auto p = objects.find(e->soid);
+      if (p != objects.end())
+	objects.erase(p);
+      objects.emplace(hobject_ref_t(e->soid), e);
+    }
+
     void reset_rollback_info_trimmed_to_riter() {
       rollback_info_trimmed_to_riter = log.rbegin();
       while (rollback_info_trimmed_to_riter != log.rend() &&
@@ -147,7 +178,7 @@ public:
       rollback_info_trimmed_to_riter(log.rbegin())
     {
       reset_rollback_info_trimmed_to_riter();
-      index();
+      reindex();
     }
 
     IndexedLog(const IndexedLog &rhs) :
@@ -158,7 +189,7 @@ public:
       rollback_info_trimmed_to_riter(log.rbegin())
     {
       reset_rollback_info_trimmed_to_riter();
-      index(rhs.indexed_data);
+      index(rhs.indexed_data & PGLOG_INDEXED_OBJECTS);
     }
 
     IndexedLog &operator=(const IndexedLog &rhs) {
@@ -188,7 +219,7 @@ public:
 
     mempool::osd_pglog::list<pg_log_entry_t> rewind_from_head(eversion_t newhead) {
       auto divergent = pg_log_t::rewind_from_head(newhead);
-      index();
+      reindex();
       reset_rollback_info_trimmed_to_riter();
       return divergent;
     }
@@ -217,7 +248,7 @@ public:
       *this = IndexedLog(o);
 
       skip_can_rollback_to_to_head();
-      index();
+      reindex();
     }
 
     void split_out_child(
@@ -273,11 +304,10 @@ public:
       assert(version);
       assert(user_version);
       assert(return_code);
-      ceph::unordered_map<osd_reqid_t,pg_log_entry_t*>::const_iterator p;
       if (!(indexed_data & PGLOG_INDEXED_CALLER_OPS)) {
         index_caller_ops();
       }
-      p = caller_ops.find(r);
+      auto p = caller_ops.find(r);
       if (p != caller_ops.end()) {
 	*version = p->second->version;
 	*user_version = p->second->user_version;
@@ -290,15 +320,15 @@ public:
       if (!(indexed_data & PGLOG_INDEXED_EXTRA_CALLER_OPS)) {
         index_extra_caller_ops();
       }
-      p = extra_caller_ops.find(r);
-      if (p != extra_caller_ops.end()) {
-	for (auto i = p->second->extra_reqids.begin();
-	     i != p->second->extra_reqids.end();
+      auto e = extra_caller_ops.find(r);
+      if (e != extra_caller_ops.end()) {
+	for (auto i = e->second->extra_reqids.begin();
+	     i != e->second->extra_reqids.end();
 	     ++i) {
 	  if (i->first == r) {
-	    *version = p->second->version;
+	    *version = e->second->version;
 	    *user_version = i->second;
-	    *return_code = p->second->return_code;
+	    *return_code = e->second->return_code;
 	    return true;
 	  }
 	}
@@ -376,7 +406,7 @@ public:
 	     ++i) {
 	  if (to_index & PGLOG_INDEXED_OBJECTS) {
 	    if (i->object_is_indexed()) {
-	      objects[i->soid] = const_cast<pg_log_entry_t*>(&(*i));
+	      _index_object(const_cast<pg_log_entry_t*>(&(*i)));
 	    }
 	  }
 
@@ -400,6 +430,18 @@ public:
       indexed_data |= to_index;
     }
 
+    /**
+     * rebuild the object index from scratch
+     *
+     * The reqid indexes are dropped and only rebuilt by the first
+     * lookup that needs them; replicas never answer client requests,
+     * so most PGs on an OSD never pay for them.
+     */
+    void reindex() {
+      unindex();
+      index(PGLOG_INDEXED_OBJECTS);
+    }
+
     void index_objects() const {
       index(PGLOG_INDEXED_OBJECTS);
     }
@@ -418,9 +460,10 @@ public:
 
     void index(pg_log_entry_t& e) {
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        if (objects.count(e.soid) == 0 ||
-            objects[e.soid]->version < e.version)
-          objects[e.soid] = &e;
+        auto p = objects.find(e.soid);
+        if (p == objects.end() ||
+            p->second->version < e.version)
+          _index_object(&e);
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
 	// divergent merge_log indexes new before unindexing old
@@ -448,8 +491,9 @@ public:
     void unindex(const pg_log_entry_t& e) {
       // NOTE: this only works if we remove from the _tail_ of the log!
       if (indexed_data & PGLOG_INDEXED_OBJECTS) {
-        if (objects.count(e.soid) && objects[e.soid]->version == e.version)
-          objects.erase(e.soid);
+        auto p = objects.find(e.soid);
+        if (p != objects.end() && p->second->version == e.version)
+          objects.erase(p);
       }
       if (e.reqid_is_indexed()) {
         if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
@@ -462,8 +506,7 @@ public:
         for (auto j = e.extra_reqids.begin();
              j != e.extra_reqids.end();
              ++j) {
-          for (ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*>::iterator k =
-		 extra_caller_ops.find(j->first);
+          for (auto k = extra_caller_ops.find(j->first);
                k != extra_caller_ops.end() && k->first == j->first;
                ++k) {
             if (k->second == &e) {
@@ -512,7 +555,7 @@ public:
 
       // to our index
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        objects[e.soid] = &(log.back());
+        _index_object(&(log.back()));
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
         if (e.reqid_is_indexed()) {
@@ -912,8 +955,7 @@ protected:
 		       << " last_divergent_update: " << last_divergent_update
 		       << dendl;
 
-    ceph::unordered_map<hobject_t, pg_log_entry_t*>::const_iterator objiter =
-      log.objects.find(hoid);
+    auto objiter = log.objects.find(hoid);
     if (objiter != log.objects.end() &&
 	objiter->second->version >= first_divergent_update) {
       /// Case 1)
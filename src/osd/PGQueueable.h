@@ -45,11 +45,13 @@ struct PGSnapTrim {
 struct PGRecovery {
   epoch_t epoch_queued;
   uint64_t reserved_pushes;
-  PGRecovery(epoch_t e, uint64_t reserved_pushes)
-    : epoch_queued(e), reserved_pushes(reserved_pushes) {}
+  bool backfill;   ///< the pg was backfilling when this was queued
+  PGRecovery(epoch_t e, uint64_t reserved_pushes, bool backfill = false)
+    : epoch_queued(e), reserved_pushes(reserved_pushes), backfill(backfill) {}
   ostream &operator<<(ostream &rhs) {
     return rhs << "PGRecovery(epoch=" << epoch_queued
-	       << ", reserved_pushes: " << reserved_pushes << ")";
+	       << ", reserved_pushes: " << reserved_pushes
+	       << (backfill ? ", backfill" : "") << ")";
   }
 };
 
@@ -1585,6 +1585,17 @@ void PrimaryLogPG::calc_trim_to()
   }
 }
 
+// what an object context costs against osd_pg_object_context_cache_bytes
+static size_t object_context_cost(const ObjectContext& obc)
+{
+  size_t cost = sizeof(ObjectContext) + obc.obs.oi.soid.oid.name.size() +
+    obc.obs.oi.watchers.size() * sizeof(watch_info_t);
+  for (auto& p : obc.attr_cache) {
+    cost += p.first.size() + p.second.length();
+  }
+  return cost;
+}
+
 PrimaryLogPG::PrimaryLogPG(OSDService *o, OSDMapRef curmap,
 			   const PGPool &_pool, spg_t p) :
   PG(o, curmap, _pool, p),
@@ -1597,6 +1608,10 @@ PrimaryLogPG::PrimaryLogPG(OSDService *o, OSDMapRef curmap,
   temp_seq(0),
   snap_trimmer_machine(this)
 { 
+  if (cct->_conf->osd_pg_object_context_cache_bytes) {
+    object_contexts.set_cost_func(object_context_cost);
+    object_contexts.set_size(cct->_conf->osd_pg_object_context_cache_bytes);
+  }
   missing_loc.set_backend_predicates(
     pgbackend->get_is_readable_predicate(),
     pgbackend->get_is_recoverable_predicate());
@@ -3416,6 +3431,7 @@ void PrimaryLogPG::log_op_stats(OpContext *ctx)
   osd->logger->inc(l_osd_op_inb, inb);
   osd->logger->tinc(l_osd_op_lat, latency);
   osd->logger->tinc(l_osd_op_process_lat, process_latency);
+  osd->note_client_op_latency(latency);
 
   if (op->may_read() && op->may_write()) {
     osd->logger->inc(l_osd_op_rw);
@@ -9707,6 +9723,8 @@ ObjectContextRef PrimaryLogPG::get_object_context(
 	     << dendl;
   } else {
     dout(10) << __func__ << ": obc NOT found in cache: " << soid << dendl;
+    osd->logger->inc(l_osd_object_ctx_cache_miss);
+    utime_t start = ceph_clock_now();
     // check disk
     bufferlist bv;
     if (attrs) {
@@ -9773,6 +9791,9 @@ ObjectContextRef PrimaryLogPG::get_object_context(
 	assert(r == 0);
       }
     }
+    // the cost depends on what was just loaded
+    object_contexts.update_cost(soid);
+    osd->logger->tinc(l_osd_object_ctx_decode_lat, ceph_clock_now() - start);
 
     dout(10) << __func__ << ": creating obc from disk: " << obc
 	     << dendl;
@@ -10141,10 +10162,12 @@ SnapSetContext *PrimaryLogPG::get_snapset_context(
   if (p != snapset_contexts.end()) {
     if (can_create || p->second->exists) {
       ssc = p->second;
+      osd->logger->inc(l_osd_snapset_ctx_cache_hit);
     } else {
       return NULL;
     }
   } else {
+    osd->logger->inc(l_osd_snapset_ctx_cache_miss);
     bufferlist bv;
     if (!attrs) {
       int r = -ENOENT;
@@ -10178,12 +10201,19 @@ SnapSetContext *PrimaryLogPG::get_snapset_context(
   }
   assert(ssc);
   ssc->ref++;
+  _touch_snapset_lru(ssc);
   return ssc;
 }
 
 void PrimaryLogPG::put_snapset_context(SnapSetContext *ssc)
 {
   Mutex::Locker l(snapset_contexts_lock);
+  _put_snapset_context(ssc);
+}
+
+void PrimaryLogPG::_put_snapset_context(SnapSetContext *ssc)
+{
+  assert(snapset_contexts_lock.is_locked());
   --ssc->ref;
   if (ssc->ref == 0) {
     if (ssc->registered)
@@ -10192,6 +10222,36 @@ void PrimaryLogPG::put_snapset_context(SnapSetContext *ssc)
   }
 }
 
+void PrimaryLogPG::_touch_snapset_lru(SnapSetContext *ssc)
+{
+  assert(snapset_contexts_lock.is_locked());
+  // only keep what is on disk; a snapset created for a new object is
+  // dropped with its obc as before
+  if (!ssc->exists || !ssc->registered) {
+    return;
+  }
+  if (!ssc->lru_item.is_on_list()) {
+    ssc->ref++;
+  }
+  snapset_lru.push_front(&ssc->lru_item);
+  while (snapset_lru.size() >
+	 (int)cct->_conf->osd_pg_snapset_context_cache_count) {
+    SnapSetContext *victim = snapset_lru.back();
+    victim->lru_item.remove_myself();
+    _put_snapset_context(victim);
+  }
+}
+
+void PrimaryLogPG::clear_snapset_lru()
+{
+  Mutex::Locker l(snapset_contexts_lock);
+  while (!snapset_lru.empty()) {
+    SnapSetContext *ssc = snapset_lru.front();
+    ssc->lru_item.remove_myself();
+    _put_snapset_context(ssc);
+  }
+}
+
 /** pull - request object from a peer
  */
 
@@ -10859,7 +10919,7 @@ void PrimaryLogPG::on_shutdown()
   pgbackend->on_change();
 
   context_registry_on_change();
-  object_contexts.clear();
+  clear_object_contexts();
 
   clear_async_reads();
 
@@ -11032,7 +11092,7 @@ void PrimaryLogPG::on_change(ObjectStore::Transaction *t)
   // we don't want to cache object_contexts through the interval change
   // NOTE: we actually assert that all currently live references are dead
   // by the time the flush for the next interval completes.
-  object_contexts.clear();
+  clear_object_contexts();
 
   // should have been cleared above by finishing all of the degraded objects
   assert(objects_blocked_on_degraded_snap.empty());
@@ -11279,6 +11339,7 @@ bool PrimaryLogPG::start_recovery_ops(
 
   assert(recovering.empty());
   assert(recovery_ops_active == 0);
+  assert(recovery_slots_held == 0);
 
   dout(10) << __func__ << " needs_recovery: "
 	   << missing_loc.get_needs_recovery()
@@ -11548,9 +11609,19 @@ int PrimaryLogPG::prep_object_replica_deletes(
   return 1;
 }
 
+/**
+ * returns the number of recovery slots taken (0 or 1)
+ *
+ * If batch_room is given, small objects are batched: one that finds
+ * room in the current batch rides along without taking a slot, and one
+ * that takes a slot opens a new batch.  With may_take_slot false only a
+ * ride-along is allowed.
+ */
 int PrimaryLogPG::prep_object_replica_pushes(
   const hobject_t& soid, eversion_t v,
-  PGBackend::RecoveryHandle *h)
+  PGBackend::RecoveryHandle *h,
+  bool may_take_slot,
+  uint64_t *batch_room)
 {
   assert(is_primary());
   dout(10) << __func__ << ": on " << soid << dendl;
@@ -11562,6 +11633,17 @@ int PrimaryLogPG::prep_object_replica_pushes(
     return 0;
   }
 
+  bool small = batch_room &&
+    !obc->obs.oi.is_omap() &&
+    obc->obs.oi.size <= cct->_conf->osd_recovery_batch_max_object_size;
+  bool take_slot = !(small && *batch_room > 0);
+  if (take_slot && !may_take_slot) {
+    // the batch ends at the first object that does not fit
+    if (batch_room)
+      *batch_room = 0;
+    return 0;
+  }
+
   if (!obc->get_recovery_read()) {
     dout(20) << "recovery delayed on " << soid
 	     << "; could not get rw_manager lock" << dendl;
@@ -11571,7 +11653,20 @@ int PrimaryLogPG::prep_object_replica_pushes(
 	     << dendl;
   }
 
-  start_recovery_op(soid);
+  if (small) {
+    if (take_slot) {
+      uint64_t batch = std::min(cct->_conf->osd_recovery_batch_max_objects,
+				cct->_conf->osd_max_push_objects);
+#ifdef DEBUG_RECOVERY_OIDS
+      // the osd tracks recovering oids per slot
+      batch = 1;
+#endif
+      *batch_room = batch > 0 ? batch - 1 : 0;
+    } else {
+      --*batch_room;
+    }
+  }
+  start_recovery_op(soid, take_slot);
   assert(!recovering.count(soid));
   recovering.insert(make_pair(soid, obc));
 
@@ -11594,13 +11689,15 @@ int PrimaryLogPG::prep_object_replica_pushes(
     primary_error(soid, v);
     return 0;
   }
-  return 1;
+  return take_slot ? 1 : 0;
 }
 
 uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &handle)
 {
   dout(10) << __func__ << "(" << max << ")" << dendl;
   uint64_t started = 0;
+  // small objects left to fill the batch that holds the last slot taken
+  uint64_t batch_room = 0;
 
   PGBackend::RecoveryHandle *h = pgbackend->open_recovery_op();
 
@@ -11616,6 +11713,7 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
     map<pg_shard_t, pg_info_t>::const_iterator pi = peer_info.find(peer);
     assert(pi != peer_info.end());
     size_t m_sz = pm->second.num_missing();
+    batch_room = 0;  // batches go to one peer
 
     dout(10) << " peer osd." << peer << " missing " << m_sz << " objects." << dendl;
     dout(20) << " peer osd." << peer << " missing " << pm->second.get_items() << dendl;
@@ -11623,7 +11721,7 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
     // oldest first!
     const pg_missing_t &m(pm->second);
     for (map<version_t, hobject_t>::const_iterator p = m.get_rmissing().begin();
-	 p != m.get_rmissing().end() && started < max;
+	 p != m.get_rmissing().end() && (started < max || batch_room > 0);
 	   ++p) {
       handle.reset_tp_timeout();
       const hobject_t soid(p->second);
@@ -11650,6 +11748,8 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
 
       if (missing_loc.is_deleted(soid)) {
 	dout(10) << __func__ << ": " << soid << " is a delete, removing" << dendl;
+	if (started >= max)
+	  continue;
 	map<hobject_t,pg_missing_item>::const_iterator r = m.get_items().find(soid);
 	started += prep_object_replica_deletes(soid, r->second.need, h);
 	continue;
@@ -11675,7 +11775,7 @@ uint64_t PrimaryLogPG::recover_replicas(uint64_t max, ThreadPool::TPHandle &hand
       dout(10) << __func__ << ": recover_object_replicas(" << soid << ")" << dendl;
       map<hobject_t,pg_missing_item>::const_iterator r = m.get_items().find(soid);
       started += prep_object_replica_pushes(soid, r->second.need,
-					    h);
+					    h, started < max, &batch_room);
     }
   }
 
@@ -14103,7 +14203,7 @@ void PrimaryLogPG::_scrub_finish()
   }
   // Clear object context cache to get repair information
   if (repair)
-    object_contexts.clear();
+    clear_object_contexts();
 }
 
 bool PrimaryLogPG::check_osdmap_full(const set<pg_shard_t> &missing_on)
@@ -941,6 +941,9 @@ protected:
   // map from oid.snapdir() to SnapSetContext *
   map<hobject_t, SnapSetContext*> snapset_contexts;
   Mutex snapset_contexts_lock;
+  // recently used snapsets, kept decoded after their obcs are gone;
+  // protected by snapset_contexts_lock
+  xlist<SnapSetContext*> snapset_lru;
 
   // debug order that client ops are applied
   map<hobject_t, map<client_t, ceph_tid_t>> debug_op_order;
@@ -994,6 +997,13 @@ protected:
     }
   }
   void put_snapset_context(SnapSetContext *ssc);
+  void _put_snapset_context(SnapSetContext *ssc);
+  void _touch_snapset_lru(SnapSetContext *ssc);
+  void clear_snapset_lru();
+  void clear_object_contexts() {
+    object_contexts.clear();
+    clear_snapset_lru();
+  }
 
   map<hobject_t, ObjectContextRef> recovering;
 
@@ -1073,7 +1083,9 @@ protected:
   bool new_backfill;
 
   int prep_object_replica_pushes(const hobject_t& soid, eversion_t v,
-				 PGBackend::RecoveryHandle *h);
+				 PGBackend::RecoveryHandle *h,
+				 bool may_take_slot = true,
+				 uint64_t *batch_room = nullptr);
   int prep_object_replica_deletes(const hobject_t& soid, eversion_t v,
 				  PGBackend::RecoveryHandle *h);
 
@@ -1368,7 +1380,9 @@ protected:
 public:
   PrimaryLogPG(OSDService *o, OSDMapRef curmap,
 	       const PGPool &_pool, spg_t p);
-  ~PrimaryLogPG() override {}
+  ~PrimaryLogPG() override {
+    clear_snapset_lru();
+  }
 
   int do_command(
     cmdmap_t cmdmap,
@@ -706,6 +706,37 @@ void ReplicatedBackend::be_deep_scrub(
 
   uint32_t fadvise_flags = CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL | CEPH_OSD_OP_FLAG_FADVISE_DONTNEED;
 
+  if (cct->_conf->osd_deep_scrub_checksum_only) {
+    // let the store verify the data against its own checksums in place;
+    // no data digest is produced, so none is compared either
+    r = 0;
+    while (pos < o.size) {
+      handle.reset_tp_timeout();
+      r = store->verify_checksums(
+	ch,
+	ghobject_t(
+	  poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+	pos,
+	cct->_conf->osd_deep_scrub_stride);
+      if (r < 0)
+	break;
+      pos += cct->_conf->osd_deep_scrub_stride;
+    }
+    if (r == -EOPNOTSUPP) {
+      dout(20) << __func__ << "  " << poid
+	       << " store cannot verify checksums, reading" << dendl;
+      pos = 0;
+    } else if (r < 0) {
+      // anything but a clean pass leaves the data unverified
+      dout(25) << __func__ << "  " << poid << " got "
+	       << r << " verifying checksums, read_error" << dendl;
+      o.read_error = true;
+      return;
+    } else {
+      goto omap;
+    }
+  }
+
   while (true) {
     handle.reset_tp_timeout();
     r = store->read(
@@ -731,6 +762,7 @@ void ReplicatedBackend::be_deep_scrub(
   o.digest = h.digest();
   o.digest_present = true;
 
+ omap:
   bl.clear();
   r = store->omap_get_header(
     coll,
@@ -1874,6 +1906,8 @@ void ReplicatedBackend::send_pushes(int prio, map<pg_shard_t, vector<PushOp> > &
 	msg->pushes.push_back(*j);
       }
       msg->set_cost(cost);
+      dout(10) << __func__ << ": sending " << pushes << " pushes to osd."
+	       << i->first << dendl;
       get_parent()->send_message_osd_cluster(msg, con);
     }
   }
@@ -0,0 +1,359 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+
+#include <algorithm>
+#include <memory>
+
+#include "osd/mClockScheduler.h"
+#include "common/dout.h"
+
+
+namespace dmc = crimson::dmclock;
+
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix *_dout << "mClockScheduler: "
+
+
+namespace ceph {
+
+  const char *mClockScheduler::get_op_class_name(op_class_t c) {
+    switch(c) {
+    case op_class_t::client:
+      return "client";
+    case op_class_t::recovery:
+      return "recovery";
+    case op_class_t::backfill:
+      return "backfill";
+    case op_class_t::scrub:
+      return "scrub";
+    case op_class_t::snaptrim:
+      return "snaptrim";
+    default:
+      return "???";
+    }
+  }
+
+  mClockScheduler::op_class_t
+  mClockScheduler::pg_queueable_visitor_t::operator()(
+    const OpRequestRef& o) const {
+    // ops from peers that move data for recovery or backfill belong
+    // to those classes; everything else, including replica writes,
+    // is scheduled with the client ops of the pool
+    switch (o->get_req()->get_type()) {
+    case MSG_OSD_PG_PUSH:
+    case MSG_OSD_PG_PULL:
+    case MSG_OSD_PG_PUSH_REPLY:
+    case MSG_OSD_PG_RECOVERY_DELETE:
+    case MSG_OSD_PG_RECOVERY_DELETE_REPLY:
+      return op_class_t::recovery;
+    case MSG_OSD_PG_SCAN:
+    case MSG_OSD_PG_BACKFILL:
+    case MSG_OSD_PG_BACKFILL_REMOVE:
+      return op_class_t::backfill;
+    default:
+      return op_class_t::client;
+    }
+  }
+
+  /*
+   * class mClockScheduler
+   */
+
+  mClockScheduler::pg_queueable_visitor_t
+  mClockScheduler::pg_queueable_visitor;
+
+  mClockScheduler::mClockScheduler(CephContext *cct) :
+    cct(cct),
+    queue(
+      [this](const sched_id_t& id) { return client_info(id); },
+      true)
+  {
+    update_configuration();
+  }
+
+  void mClockScheduler::update_configuration() {
+    std::map<op_class_t, qos_t> qos;
+    const md_config_t *conf = cct->_conf;
+    qos[op_class_t::client] = qos_t(
+      conf->osd_mclock_scheduler_client_res,
+      conf->osd_mclock_scheduler_client_wgt,
+      conf->osd_mclock_scheduler_client_lim);
+    qos[op_class_t::recovery] = qos_t(
+      conf->osd_mclock_scheduler_recovery_res,
+      conf->osd_mclock_scheduler_recovery_wgt,
+      conf->osd_mclock_scheduler_recovery_lim);
+    qos[op_class_t::backfill] = qos_t(
+      conf->osd_mclock_scheduler_backfill_res,
+      conf->osd_mclock_scheduler_backfill_wgt,
+      conf->osd_mclock_scheduler_backfill_lim);
+    qos[op_class_t::scrub] = qos_t(
+      conf->osd_mclock_scheduler_scrub_res,
+      conf->osd_mclock_scheduler_scrub_wgt,
+      conf->osd_mclock_scheduler_scrub_lim);
+    qos[op_class_t::snaptrim] = qos_t(
+      conf->osd_mclock_scheduler_snaptrim_res,
+      conf->osd_mclock_scheduler_snaptrim_wgt,
+      conf->osd_mclock_scheduler_snaptrim_lim);
+    if (qos != class_qos) {
+      class_qos.swap(qos);
+      ++gen;
+    }
+  }
+
+  void mClockScheduler::set_capacity(double iops) {
+    if (iops != capacity) {
+      dout(10) << __func__ << " " << capacity << " -> " << iops
+	       << " iops" << dendl;
+      capacity = iops;
+      ++gen;
+    }
+  }
+
+  void mClockScheduler::set_pool_qos(const std::map<int64_t, qos_t>& qos) {
+    if (qos != pool_qos) {
+      pool_qos = qos;
+      ++gen;
+    }
+  }
+
+  const mClockScheduler::qos_t&
+  mClockScheduler::get_qos(const class_id_t& id) const {
+    if (id.first == op_class_t::client) {
+      auto p = pool_qos.find(id.second);
+      if (p != pool_qos.end()) {
+	return p->second;
+      }
+    }
+    auto p = class_qos.find(id.first);
+    assert(p != class_qos.end());
+    return p->second;
+  }
+
+  dmc::ClientInfo
+  mClockScheduler::client_info(const sched_id_t& id) const {
+    const qos_t& qos = get_qos(id.class_id);
+
+    // the client reservation is shared by the active pools without
+    // settings of their own; a pool with its own counts on its own
+    double total_res = 0.0;
+    for (auto& p : class_qos) {
+      if (p.first != op_class_t::client) {
+	total_res += p.second.res;
+      }
+    }
+    unsigned shared_pools = 0;
+    for (auto& p : classes) {
+      if (p.first.first != op_class_t::client) {
+	continue;
+      }
+      auto q = pool_qos.find(p.first.second);
+      if (q != pool_qos.end()) {
+	total_res += q->second.res;
+      } else {
+	++shared_pools;
+      }
+    }
+    if (shared_pools) {
+      total_res += class_qos.at(op_class_t::client).res;
+    }
+    double res = qos.res;
+    if (id.class_id.first == op_class_t::client &&
+	!pool_qos.count(id.class_id.second) &&
+	shared_pools > 1) {
+      res /= shared_pools;
+    }
+    // reservations beyond what the OSD can do would leave nothing for
+    // the weight-based phase, so scale them down to fit
+    if (total_res > 1.0) {
+      res /= total_res;
+    }
+    // dmclock cannot schedule a client with neither reservation nor
+    // weight
+    double wgt = std::max(qos.wgt, 0.001);
+
+    if (capacity <= 0.0) {
+      // no way to turn fractions into iops; schedule by weight alone
+      return dmc::ClientInfo(0.0, wgt, 0.0);
+    }
+    dmc::ClientInfo info(res * capacity, wgt, qos.lim * capacity);
+    dout(20) << __func__ << " " << get_op_class_name(id.class_id.first)
+	     << " pool " << id.class_id.second << " gen " << id.gen
+	     << " " << info << dendl;
+    return info;
+  }
+
+  mClockScheduler::class_id_t
+  mClockScheduler::get_class_id(const Request& request) const {
+    op_class_t c =
+      boost::apply_visitor(pg_queueable_visitor, request.second.get_variant());
+    return class_id_t(c, c == op_class_t::client ? request.first.pool() : -1);
+  }
+
+  mClockScheduler::sched_id_t
+  mClockScheduler::get_sched_id(const Request& request) {
+    class_id_t id = get_class_id(request);
+    utime_t now = ceph_clock_now();
+    prune_idle_classes(now);
+    auto p = classes.find(id);
+    if (p == classes.end()) {
+      if (id.first == op_class_t::client) {
+	// one more pool shares the reservations
+	++gen;
+      }
+      p = classes.emplace(id, class_state_t()).first;
+      p->second.gen = gen;
+    } else if (p->second.gen != gen) {
+      if (p->second.queued) {
+	queue.move_client(sched_id_t{id, p->second.gen}, sched_id_t{id, gen});
+      }
+      p->second.gen = gen;
+    }
+    class_state_t& state = p->second;
+    state.last_enqueue = now;
+    ++state.queued;
+    ++state.enqueued;
+    return sched_id_t{id, state.gen};
+  }
+
+  void mClockScheduler::prune_idle_classes(utime_t now) {
+    if (now - last_prune < client_idle_age) {
+      return;
+    }
+    last_prune = now;
+    bool pruned = false;
+    for (auto p = classes.begin(); p != classes.end(); ) {
+      if (p->first.first == op_class_t::client &&
+	  p->second.queued == 0 &&
+	  now - p->second.last_enqueue > client_idle_age) {
+	dout(10) << __func__ << " pool " << p->first.second
+		 << " idle, dropping its client class" << dendl;
+	p = classes.erase(p);
+	pruned = true;
+      } else {
+	++p;
+      }
+    }
+    if (pruned) {
+      // the pools left get bigger shares
+      ++gen;
+    }
+  }
+
+  void mClockScheduler::account_dequeue(const Request& request) {
+    auto p = classes.find(get_class_id(request));
+    assert(p != classes.end());
+    assert(p->second.queued > 0);
+    --p->second.queued;
+    ++p->second.dequeued;
+    p->second.dequeued_cost += request.second.get_cost();
+  }
+
+  void mClockScheduler::remove_by_class(Client cl,
+					std::list<Request> *out) {
+    std::list<Request> removed;
+    queue.remove_by_filter(
+      [&cl, &removed] (const Request& r) -> bool {
+	if (cl == r.second.get_owner()) {
+	  removed.push_front(r);
+	  return true;
+	} else {
+	  return false;
+	}
+      });
+    for (auto& r : removed) {
+      auto p = classes.find(get_class_id(r));
+      assert(p != classes.end());
+      --p->second.queued;
+    }
+    if (out) {
+      out->splice(out->begin(), removed);
+    }
+  }
+
+  void mClockScheduler::enqueue_strict(Client cl,
+				       unsigned priority,
+				       Request item) {
+    queue.enqueue_strict(get_sched_id(item), priority, item);
+  }
+
+  // Enqueue op in the front of the strict queue
+  void mClockScheduler::enqueue_strict_front(Client cl,
+					     unsigned priority,
+					     Request item) {
+    queue.enqueue_strict_front(get_sched_id(item), priority, item);
+  }
+
+  // Enqueue op in the back of the regular queue
+  void mClockScheduler::enqueue(Client cl,
+				unsigned priority,
+				unsigned cost,
+				Request item) {
+    // capacity is counted in ops, so every item is one unit of work;
+    // dmclock would add the cost to the reservation tag in seconds
+    queue.enqueue(get_sched_id(item), priority, 0, item);
+  }
+
+  // Enqueue the op in the front of the regular queue
+  void mClockScheduler::enqueue_front(Client cl,
+				      unsigned priority,
+				      unsigned cost,
+				      Request item) {
+    queue.enqueue_front(get_sched_id(item), priority, 0, item);
+  }
+
+  bool mClockScheduler::is_ready(utime_t *when) {
+    double t = 0.0;
+    if (queue.is_ready(&t)) {
+      return true;
+    }
+    when->set_from_double(t);
+    return false;
+  }
+
+  // Return an op to be dispatched
+  Request mClockScheduler::dequeue() {
+    Request r = queue.dequeue();
+    account_dequeue(r);
+    return r;
+  }
+
+  // Formatted output of the queue
+  void mClockScheduler::dump(ceph::Formatter *f) const {
+    queue.dump(f);
+    f->dump_float("capacity_iops", capacity);
+    f->open_array_section("classes");
+    for (auto& p : classes) {
+      f->open_object_section("class");
+      f->dump_string("op_class", get_op_class_name(p.first.first));
+      if (p.first.first == op_class_t::client) {
+	f->dump_int("pool", p.first.second);
+      }
+      dmc::ClientInfo info = client_info(sched_id_t{p.first, gen});
+      f->dump_float("reservation_iops", info.reservation);
+      f->dump_float("weight", info.weight);
+      f->dump_float("limit_iops", info.limit);
+      f->dump_unsigned("queued", p.second.queued);
+      f->dump_unsigned("enqueued", p.second.enqueued);
+      f->dump_unsigned("dequeued", p.second.dequeued);
+      f->dump_unsigned("dequeued_cost", p.second.dequeued_cost);
+      f->close_section();
+    }
+    f->close_section();
+  }
+
+} // namespace ceph
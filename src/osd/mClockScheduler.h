@@ -0,0 +1,213 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2017 Red Hat Inc.
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+
+#pragma once
+
+#include <map>
+#include <ostream>
+
+#include "boost/variant.hpp"
+
+#include "common/config.h"
+#include "common/ceph_context.h"
+#include "osd/PGQueueable.h"
+
+#include "common/mClockPriorityQueue.h"
+
+
+namespace ceph {
+
+  using Request = std::pair<spg_t, PGQueueable>;
+  using Client = entity_inst_t;
+
+
+  // One dmclock queue for everything an op shard runs.  Client ops
+  // (and the replica ops they generate) are scheduled per pool;
+  // recovery, backfill, scrub and snap trim each have a class of their
+  // own.  Every class carries a reservation, weight and limit; the
+  // reservation and limit are configured as fractions of the OSD's
+  // IOPS capacity and turned into IOPS once that is known.
+  //
+  // Unlike mClockOpClassQueue, limits are enforced: callers must check
+  // is_ready() before dequeue().
+  class mClockScheduler : public OpQueue<Request, Client> {
+
+  public:
+
+    enum class op_class_t {
+      client, recovery, backfill, scrub, snaptrim };
+
+    static const char *get_op_class_name(op_class_t c);
+
+    // reservation and limit are fractions of capacity; 0 limit means
+    // unlimited
+    struct qos_t {
+      double res = 0.0;
+      double wgt = 1.0;
+      double lim = 0.0;
+
+      qos_t() {}
+      qos_t(double r, double w, double l) : res(r), wgt(w), lim(l) {}
+
+      bool operator==(const qos_t& o) const {
+	return res == o.res && wgt == o.wgt && lim == o.lim;
+      }
+      bool operator!=(const qos_t& o) const {
+	return !(*this == o);
+      }
+    };
+
+  private:
+
+    // a scheduling class: an op class, plus the pool for client ops
+    using class_id_t = std::pair<op_class_t, int64_t>;
+
+    // the dmclock client of a class.  dmclock only reads a client's
+    // ClientInfo when it first sees it, so a settings change moves the
+    // class to a new generation on its next enqueue.  Whatever the class
+    // still has queued is moved along, in order, so ops of one class are
+    // never reordered.  Items the class only has in the strict or front
+    // queues keep their old generation; they are not scheduled by tag.
+    struct sched_id_t {
+      class_id_t class_id;
+      uint64_t gen;
+
+      bool operator<(const sched_id_t& o) const {
+	return class_id < o.class_id ||
+	  (class_id == o.class_id && gen < o.gen);
+      }
+      bool operator==(const sched_id_t& o) const {
+	return class_id == o.class_id && gen == o.gen;
+      }
+    };
+
+    struct class_state_t {
+      uint64_t gen = 0;           ///< generation of the dmclock client
+      uint64_t queued = 0;        ///< items in the queue now
+      utime_t last_enqueue;
+      uint64_t enqueued = 0;
+      uint64_t dequeued = 0;
+      uint64_t dequeued_cost = 0;
+    };
+
+    using queue_t = mClockQueue<Request, sched_id_t>;
+
+    CephContext *cct;
+
+    double capacity = 0.0;     ///< iops this shard can sustain
+    uint64_t gen = 0;          ///< bumped whenever settings change
+    std::map<op_class_t, qos_t> class_qos;
+    std::map<int64_t, qos_t> pool_qos;
+    // client classes are dropped once idle for this long, so their
+    // share of the client reservation goes to the pools still in use
+    static constexpr double client_idle_age = 60.0;
+
+    // active classes; every client class present takes a share of the
+    // reservations
+    std::map<class_id_t, class_state_t> classes;
+    utime_t last_prune;
+
+    queue_t queue;
+
+    const qos_t& get_qos(const class_id_t& id) const;
+    crimson::dmclock::ClientInfo client_info(const sched_id_t& id) const;
+
+    class_id_t get_class_id(const Request& request) const;
+    sched_id_t get_sched_id(const Request& request);
+    void prune_idle_classes(utime_t now);
+    void account_dequeue(const Request& request);
+
+  public:
+
+    mClockScheduler(CephContext *cct);
+
+    // re-read the per-class settings from the config
+    void update_configuration();
+
+    // iops this shard can sustain; 0 if unknown
+    void set_capacity(double iops);
+    double get_capacity() const {
+      return capacity;
+    }
+
+    // client settings of the pools that have their own
+    void set_pool_qos(const std::map<int64_t, qos_t>& qos);
+
+    inline unsigned length() const override final {
+      return queue.length();
+    }
+
+    void remove_by_class(Client cl,
+			 std::list<Request> *out) override final;
+
+    void enqueue_strict(Client cl,
+			unsigned priority,
+			Request item) override final;
+
+    // Enqueue op in the front of the strict queue
+    void enqueue_strict_front(Client cl,
+			      unsigned priority,
+			      Request item) override final;
+
+    // Enqueue op in the back of the regular queue
+    void enqueue(Client cl,
+		 unsigned priority,
+		 unsigned cost,
+		 Request item) override final;
+
+    // Enqueue the op in the front of the regular queue
+    void enqueue_front(Client cl,
+		       unsigned priority,
+		       unsigned cost,
+		       Request item) override final;
+
+    // Returns if the queue is empty
+    inline bool empty() const override final {
+      return queue.empty();
+    }
+
+    // Returns false if everything queued is held back by its limit,
+    // and sets *when to the time the first item is due
+    bool is_ready(utime_t *when);
+
+    // Return an op to be dispatched
+    Request dequeue() override final;
+
+    // Formatted output of the queue and per-class accounting
+    void dump(ceph::Formatter *f) const override final;
+
+  protected:
+
+    struct pg_queueable_visitor_t :
+      public boost::static_visitor<op_class_t> {
+      op_class_t operator()(const OpRequestRef& o) const;
+
+      op_class_t operator()(const PGSnapTrim& o) const {
+	return op_class_t::snaptrim;
+      }
+
+      op_class_t operator()(const PGScrub& o) const {
+	return op_class_t::scrub;
+      }
+
+      op_class_t operator()(const PGRecovery& o) const {
+	return o.backfill ? op_class_t::backfill : op_class_t::recovery;
+      }
+    }; // class pg_queueable_visitor_t
+
+    static pg_queueable_visitor_t pg_queueable_visitor;
+  }; // class mClockScheduler
+
+} // namespace ceph
@@ -6,6 +6,7 @@
 
 #include "osd_types.h"
 #include "OpRequest.h"
+#include "include/xlist.h"
 
 /*
   * keep tabs on object modifications that are in flight.
@@ -20,9 +21,11 @@ struct SnapSetContext {
   int ref;
   bool registered : 1;
   bool exists : 1;
+  /// on the PG's lru of decoded snapsets, which holds a ref
+  xlist<SnapSetContext*>::item lru_item;
 
   explicit SnapSetContext(const hobject_t& o) :
-    oid(o), ref(0), registered(false), exists(true) { }
+    oid(o), ref(0), registered(false), exists(true), lru_item(this) { }
 };
 
 struct ObjectContext;
@@ -1058,6 +1058,9 @@ public:
     CSUM_TYPE,
     CSUM_MAX_BLOCK,
     CSUM_MIN_BLOCK,
+    QOS_RES,
+    QOS_WGT,
+    QOS_LIM,
   };
 
   enum type_t {
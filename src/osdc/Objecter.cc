@@ -139,6 +139,9 @@ enum {
   l_osdc_osd_session_close,
   l_osdc_osd_laggy,
 
+  l_osdc_calc_target_mapped,
+  l_osdc_calc_target_crush,
+
   l_osdc_osdop_omap_wr,
   l_osdc_osdop_omap_rd,
   l_osdc_osdop_omap_del,
@@ -239,6 +242,16 @@ void Objecter::init()
 {
   assert(!initialized);
 
+  if (!mapping_tp && cct->_conf->objecter_pg_mapping_threads) {
+    mapping_tp.reset(new ThreadPool(cct, "Objecter::mapping_tp",
+				    "objecter_map",
+				    cct->_conf->objecter_pg_mapping_threads));
+    mapper.reset(new ParallelPGMapper(cct, mapping_tp.get()));
+  }
+  if (mapping_tp) {
+    mapping_tp->start();
+  }
+
   if (!logger) {
     PerfCountersBuilder pcb(cct, "objecter", l_osdc_first, l_osdc_last);
 
@@ -358,6 +371,11 @@ void Objecter::init()
 			"Sessions closed");
     pcb.add_u64(l_osdc_osd_laggy, "osd_laggy", "Laggy OSD sessions");
 
+    pcb.add_u64_counter(l_osdc_calc_target_mapped, "calc_target_mapped",
+			"Op targets looked up in the precalculated PG mapping");
+    pcb.add_u64_counter(l_osdc_calc_target_crush, "calc_target_crush",
+			"Op targets calculated with CRUSH");
+
     pcb.add_u64_counter(l_osdc_osdop_omap_wr, "omap_wr",
 			"OSD OMAP write operations");
     pcb.add_u64_counter(l_osdc_osdop_omap_rd, "omap_rd",
@@ -496,6 +514,9 @@ void Objecter::shutdown()
     cop->put();
   }
 
+  // aborted below, without the lock
+  std::unique_ptr<PGMapping> old_mapping = std::move(pg_mapping);
+
   if (tick_event) {
     if (timer.cancel_event(tick_event)) {
       ldout(cct, 10) <<  " successfully canceled tick" << dendl;
@@ -512,6 +533,11 @@ void Objecter::shutdown()
   // Let go of Objecter write lock so timer thread can shutdown
   wl.unlock();
 
+  old_mapping.reset();
+  if (mapping_tp) {
+    mapping_tp->stop();
+  }
+
   // Outside of lock to avoid cycle WRT calls to RequestStateHook
   // This is safe because we guarantee no concurrent calls to
   // shutdown() with the ::initialized check at start.
@@ -1133,6 +1159,9 @@ void Objecter::_scan_requests(OSDSession *s,
 
 void Objecter::handle_osd_map(MOSDMap *m)
 {
+  // a superseded pg mapping; declared first so that it is dropped, and
+  // its job aborted, only after sul has let go of rwlock
+  std::unique_ptr<PGMapping> old_mapping;
   shunique_lock sul(rwlock, acquire_unique);
   if (!initialized)
     return;
@@ -1182,6 +1211,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 			<< dendl;
 	  OSDMap::Incremental inc(m->incremental_maps[e]);
 	  osdmap->apply_incremental(inc);
+	  _note_pg_mapping_changes(&inc);
 
           emit_blacklist_events(inc);
 
@@ -1195,6 +1225,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
           emit_blacklist_events(*osdmap, *new_osdmap);
 
           osdmap = new_osdmap;
+	  _note_pg_mapping_changes(nullptr);
 
 	  logger->inc(l_osdc_map_full);
 	}
@@ -1251,6 +1282,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	ldout(cct, 3) << "handle_osd_map decoding full epoch "
 		      << m->get_last() << dendl;
 	osdmap->decode(m->maps[m->get_last()]);
+	_note_pg_mapping_changes(nullptr);
 
 	_scan_requests(homeless_session, false, false, NULL,
 		       need_resend, need_resend_linger,
@@ -1264,6 +1296,8 @@ void Objecter::handle_osd_map(MOSDMap *m)
     }
   }
 
+  _maybe_start_pg_mapping(&old_mapping);
+
   // make sure need_resend targets reflect latest map
   for (auto p = need_resend.begin(); p != need_resend.end(); ) {
     Op *op = p->second;
@@ -1515,7 +1549,7 @@ int Objecter::pool_snap_list(int64_t poolid, vector<uint64_t> *snaps)
 }
 
 // sl may be unlocked.
-void Objecter::_check_op_pool_dne(Op *op, unique_lock *sl)
+void Objecter::_check_op_pool_dne(Op *op, OSDSession::unique_lock *sl)
 {
   // rwlock is locked unique
 
@@ -2818,8 +2852,16 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
   unsigned pg_num = pi->get_pg_num();
   int up_primary, acting_primary;
   vector<int> up, acting;
-  osdmap->pg_to_up_acting_osds(pgid, &up, &up_primary,
-			       &acting, &acting_primary);
+  const OSDMapMapping *mapping = _get_pg_mapping();
+  if (mapping) {
+    mapping->get(pi->raw_pg_to_pg(pgid), &up, &up_primary,
+		 &acting, &acting_primary);
+    logger->inc(l_osdc_calc_target_mapped);
+  } else {
+    osdmap->pg_to_up_acting_osds(pgid, &up, &up_primary,
+				 &acting, &acting_primary);
+    logger->inc(l_osdc_calc_target_crush);
+  }
   bool sort_bitwise = osdmap->test_flag(CEPH_OSDMAP_SORTBITWISE);
   bool recovery_deletes = osdmap->test_flag(CEPH_OSDMAP_RECOVERY_DELETES);
   unsigned prev_seed = ceph_stable_mod(pgid.ps(), t->pg_num, t->pg_num_mask);
@@ -2934,6 +2976,113 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
   return RECALC_OP_TARGET_NO_ACTION;
 }
 
+struct Objecter::C_MappingDone : public Context {
+  Objecter *objecter;
+  uint64_t gen;
+  C_MappingDone(Objecter *o, uint64_t g) : objecter(o), gen(g) {}
+  void finish(int r) override {
+    if (r < 0)
+      return;  // aborted
+    // runs on a mapping thread without rwlock, possibly after a newer
+    // job was started; never step back to an older generation
+    uint64_t done = objecter->mapping_done_gen.load();
+    while (done < gen &&
+	   !objecter->mapping_done_gen.compare_exchange_weak(done, gen)) ;
+  }
+};
+
+void Objecter::_note_pg_mapping_changes(const OSDMap::Incremental *inc)
+{
+  // rwlock is locked unique
+  if (!mapper || !mapping_dirty_pgs)
+    return;
+  if (!inc ||
+      inc->fullmap.length() ||
+      inc->crush.length() ||
+      inc->new_max_osd >= 0 ||
+      !inc->new_pools.empty() ||
+      !inc->old_pools.empty() ||
+      !inc->new_up_client.empty() ||
+      !inc->new_state.empty() ||
+      !inc->new_weight.empty() ||
+      !inc->new_primary_affinity.empty()) {
+    // anything else may move any pg
+    mapping_dirty_pgs = boost::none;
+    return;
+  }
+  for (auto& p : inc->new_pg_temp)
+    mapping_dirty_pgs->insert(p.first);
+  for (auto& p : inc->new_primary_temp)
+    mapping_dirty_pgs->insert(p.first);
+  for (auto& p : inc->new_pg_upmap)
+    mapping_dirty_pgs->insert(p.first);
+  for (auto& p : inc->new_pg_upmap_items)
+    mapping_dirty_pgs->insert(p.first);
+  mapping_dirty_pgs->insert(inc->old_pg_upmap.begin(),
+			    inc->old_pg_upmap.end());
+  mapping_dirty_pgs->insert(inc->old_pg_upmap_items.begin(),
+			    inc->old_pg_upmap_items.end());
+}
+
+void Objecter::_maybe_start_pg_mapping(std::unique_ptr<PGMapping> *old)
+{
+  // rwlock is locked unique
+  if (!mapper || !initialized)
+    return;
+  if (pg_mapping && pg_mapping->epoch == osdmap->get_epoch())
+    return;
+
+  if (pg_mapping && mapping_dirty_pgs &&
+      mapping_done_gen.load(std::memory_order_acquire) == mapping_gen) {
+    // only pg temps and upmaps changed since the mapping was built:
+    // remap just those pgs, in place, as no reader can look at it now
+    ldout(cct, 10) << __func__ << " remapping " << mapping_dirty_pgs->size()
+		   << " pgs from epoch " << pg_mapping->epoch << " to "
+		   << osdmap->get_epoch() << dendl;
+    pg_mapping->mapping.update(*osdmap, *mapping_dirty_pgs);
+    pg_mapping->epoch = osdmap->get_epoch();
+    mapping_dirty_pgs = set<pg_t>();
+    return;
+  }
+
+  if (pg_mapping) {
+    // superseded; our caller drops it, aborting its job if that is
+    // still running, once rwlock is released
+    ldout(cct, 10) << __func__ << " dropping mapping of epoch "
+		   << pg_mapping->epoch << dendl;
+    assert(!*old);
+    *old = std::move(pg_mapping);
+  }
+  // from here on readers leave pg_mapping alone until the new job is done
+  ++mapping_gen;
+  mapping_dirty_pgs = set<pg_t>();
+  if (osdmap->get_pools().empty())
+    return;
+
+  // the job works on its own copy, as ours changes in place
+  pg_mapping.reset(new PGMapping);
+  pg_mapping->epoch = osdmap->get_epoch();
+  pg_mapping->osdmap.reset(new OSDMap);
+  pg_mapping->osdmap->deepish_copy_from(*osdmap);
+  pg_mapping->job = pg_mapping->mapping.start_update(
+    *pg_mapping->osdmap, *mapper,
+    cct->_conf->objecter_pg_mapping_pgs_per_chunk);
+  pg_mapping->job->set_finish_event(new C_MappingDone(this, mapping_gen));
+  ldout(cct, 10) << __func__ << " mapping epoch " << pg_mapping->epoch
+		 << dendl;
+}
+
+const OSDMapMapping *Objecter::_get_pg_mapping() const
+{
+  // rwlock is locked
+  if (pg_mapping &&
+      mapping_done_gen.load(std::memory_order_acquire) == mapping_gen &&
+      pg_mapping->mapping.get_epoch() == osdmap->get_epoch()) {
+    return &pg_mapping->mapping;
+  }
+  return nullptr;
+}
+
 int Objecter::_map_session(op_target_t *target, OSDSession **s,
 			   shunique_lock& sul)
 {
@@ -34,11 +34,13 @@
 #include "common/ceph_time.h"
 #include "common/ceph_timer.h"
 #include "common/Finisher.h"
+#include "common/sharded_shared_mutex.h"
 #include "common/shunique_lock.h"
 #include "common/zipkin_trace.h"
 
 #include "messages/MOSDOp.h"
 #include "osd/OSDMap.h"
+#include "osd/OSDMapMapping.h"
 
 using namespace std;
 
@@ -1221,11 +1223,40 @@ private:
   version_t last_seen_osdmap_version;
   version_t last_seen_pgmap_version;
 
-  mutable boost::shared_mutex rwlock;
+  // guards the osdmap and the sessions; op submission only reads it,
+  // from every client thread at once, so readers are spread over shards
+  mutable ceph::sharded_shared_mutex rwlock;
   using lock_guard = std::unique_lock<decltype(rwlock)>;
   using unique_lock = std::unique_lock<decltype(rwlock)>;
   using shared_lock = boost::shared_lock<decltype(rwlock)>;
   using shunique_lock = ceph::shunique_lock<decltype(rwlock)>;
+
+  // every pg of the current osdmap precalculated in the background, so
+  // _calc_target can look targets up rather than run crush; only set
+  // up with objecter_pg_mapping_threads
+  std::unique_ptr<ThreadPool> mapping_tp;
+  std::unique_ptr<ParallelPGMapper> mapper;
+  /// a mapping and the job building it; an old one is dropped, which
+  /// aborts its job, only after rwlock is
+  struct PGMapping {
+    epoch_t epoch = 0;                      ///< the mapping is (to be) for
+    std::unique_ptr<OSDMap> osdmap;         ///< copy of the map being mapped
+    OSDMapMapping mapping;
+    std::unique_ptr<ParallelPGMapper::Job> job;
+    ~PGMapping() {
+      if (job) {
+	// waits for the chunks being mapped right now
+	job->abort();
+      }
+    }
+  };
+  std::unique_ptr<PGMapping> pg_mapping;    ///< of the latest epoch
+  uint64_t mapping_gen = 0;                 ///< of the latest job
+  std::atomic<uint64_t> mapping_done_gen{0};  ///< of the latest job done
+  /// pgs the incrementals applied since pg_mapping's epoch remapped;
+  /// none if they changed more than pg temps and upmaps
+  boost::optional<set<pg_t>> mapping_dirty_pgs;
+  struct C_MappingDone;
   ceph::timer<ceph::mono_clock> timer;
 
   PerfCounters *logger;
@@ -1902,6 +1933,9 @@ public:
   bool target_should_be_paused(op_target_t *op);
   int _calc_target(op_target_t *t, Connection *con,
 		   bool any_change = false);
+  void _note_pg_mapping_changes(const OSDMap::Incremental *inc);
+  void _maybe_start_pg_mapping(std::unique_ptr<PGMapping> *old);
+  const OSDMapMapping *_get_pg_mapping() const;
   int _map_session(op_target_t *op, OSDSession **s,
 		   shunique_lock& lc);
 
@@ -1933,7 +1967,7 @@ public:
   }
 
 private:
-  void _check_op_pool_dne(Op *op, unique_lock *sl);
+  void _check_op_pool_dne(Op *op, OSDSession::unique_lock *sl);
   void _send_op_map_check(Op *op);
   void _op_cancel_map_check(Op *op);
   void _check_linger_pool_dne(LingerOp *op, bool *need_unregister);
@@ -2003,6 +2037,7 @@ private:
     keep_balanced_budget(false), honor_osdmap_full(true), osdmap_full_try(false),
     blacklist_events_enabled(false),
     last_seen_osdmap_version(0), last_seen_pgmap_version(0),
+    rwlock(cct->_conf->objecter_map_lock_shards),
     logger(NULL), tick_event(0), m_request_state_hook(NULL),
     homeless_session(new OSDSession(cct, -1)),
     mon_timeout(ceph::make_timespan(mon_timeout)),
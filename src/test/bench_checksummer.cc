@@ -0,0 +1,111 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Compare the batched Checksummer paths (calculate(), calculate_batch())
+ * against checksumming one csum block at a time, per chunk size.
+ *
+ * usage: ceph_bench_checksummer [total_mb] [iterations]
+ */
+
+#include "include/types.h"
+#include "include/buffer.h"
+#include "common/Checksummer.h"
+#include "common/ceph_time.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+
+static double mb_per_sec(uint64_t bytes, ceph::mono_clock::duration d)
+{
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+  if (!ns)
+    return 0;
+  return (double)bytes / 1000000.0 / ((double)ns / 1000000000.0);
+}
+
+template<class Alg>
+static void bench(const char *name, const bufferlist& bl,
+		  size_t chunk, unsigned iterations)
+{
+  size_t blocks = bl.length() / chunk;
+  bufferptr csum(blocks * sizeof(typename Alg::value_t));
+  uint64_t bytes = (uint64_t)bl.length() * iterations;
+
+  // one block at a time
+  auto start = ceph::mono_clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    typename Alg::state_t state;
+    Alg::init(&state);
+    bufferlist::const_iterator p = bl.begin();
+    typename Alg::value_t *pv =
+      reinterpret_cast<typename Alg::value_t*>(csum.c_str());
+    for (size_t b = 0; b < blocks; ++b) {
+      pv[b] = Alg::calc(state, -1, chunk, p);
+    }
+    Alg::fini(&state);
+  }
+  double scalar = mb_per_sec(bytes, ceph::mono_clock::now() - start);
+
+  // batched blocks of one region
+  start = ceph::mono_clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    Checksummer::calculate<Alg>(chunk, 0, bl.length(), bl, &csum);
+  }
+  double batched = mb_per_sec(bytes, ceph::mono_clock::now() - start);
+
+  // one single-block region per item, as for many small blobs
+  vector<bufferlist> pieces(blocks);
+  vector<bufferptr> csums(blocks);
+  vector<Checksummer::batch_item_t> items(blocks);
+  for (size_t b = 0; b < blocks; ++b) {
+    pieces[b].substr_of(bl, b * chunk, chunk);
+    csums[b] = bufferptr(sizeof(typename Alg::value_t));
+    items[b] = { chunk, 0, chunk, &pieces[b], &csums[b] };
+  }
+  start = ceph::mono_clock::now();
+  for (unsigned i = 0; i < iterations; ++i) {
+    Checksummer::calculate_batch<Alg>(-1, items);
+  }
+  double items_batched = mb_per_sec(bytes, ceph::mono_clock::now() - start);
+
+  cout << name << "\t" << chunk
+       << "\t" << (int)scalar
+       << "\t" << (int)batched << " (" << batched / scalar << "x)"
+       << "\t" << (int)items_batched << " (" << items_batched / scalar << "x)"
+       << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  unsigned total_mb = 64;
+  unsigned iterations = 10;
+  if (args.size() > 0)
+    total_mb = atoi(args[0]);
+  if (args.size() > 1)
+    iterations = atoi(args[1]);
+
+  bufferptr bp(total_mb << 20);
+  for (unsigned i = 0; i < bp.length(); ++i)
+    bp.c_str()[i] = (i * 2654435761u) >> 24;
+  bufferlist bl;
+  bl.append(bp);
+
+  cout << "type\tchunk\tsingle MB/s\tbatched MB/s\tper-item batched MB/s"
+       << std::endl;
+  for (size_t chunk = 512; chunk <= 65536; chunk *= 2) {
+    bench<Checksummer::crc32c>("crc32c", bl, chunk, iterations);
+    bench<Checksummer::crc32c_16>("crc32c_16", bl, chunk, iterations);
+    bench<Checksummer::crc32c_8>("crc32c_8", bl, chunk, iterations);
+    bench<Checksummer::xxhash32>("xxhash32", bl, chunk, iterations);
+    bench<Checksummer::xxhash64>("xxhash64", bl, chunk, iterations);
+  }
+  return 0;
+}
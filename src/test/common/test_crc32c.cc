@@ -41,6 +41,25 @@ TEST(Crc32c, Big) {
   ASSERT_EQ(1400919119u, ceph_crc32c(1234, (unsigned char *)a, len));
 }
 
+TEST(Crc32c, Multi) {
+  int len = 65536 + 15;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (int i = 0; i < len; i++)
+    a[i] = (i * 31) & 0xff;
+  for (unsigned chunk = 1; chunk <= 4096; chunk = chunk * 2 + 1) {
+    for (unsigned n = 1; n <= 9; ++n) {
+      const unsigned char *bufs[9];
+      uint32_t out[9];
+      for (unsigned i = 0; i < n; ++i)
+	bufs[i] = a + i * chunk + i;  // unaligned, too
+      ceph_crc32c_multi(-1, bufs, chunk, n, out);
+      for (unsigned i = 0; i < n; ++i)
+	ASSERT_EQ(ceph_crc32c(-1, bufs[i], chunk), out[i]);
+    }
+  }
+  free(a);
+}
+
 TEST(Crc32c, Performance) {
   int len = 1000 * 1024 * 1024;
   char *a = (char *)malloc(len);
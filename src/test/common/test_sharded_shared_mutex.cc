@@ -0,0 +1,116 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "common/sharded_shared_mutex.h"
+#include "common/shunique_lock.h"
+
+#include "gtest/gtest.h"
+
+using ceph::sharded_shared_mutex;
+
+static bool try_lock_elsewhere(sharded_shared_mutex *sm) {
+  return std::async(std::launch::async, [sm] {
+      if (!sm->try_lock())
+	return false;
+      sm->unlock();
+      return true;
+    }).get();
+}
+
+static bool try_lock_shared_elsewhere(sharded_shared_mutex *sm) {
+  return std::async(std::launch::async, [sm] {
+      if (!sm->try_lock_shared())
+	return false;
+      sm->unlock_shared();
+      return true;
+    }).get();
+}
+
+TEST(ShardedSharedMutex, Exclusive) {
+  sharded_shared_mutex sm(4);
+  ASSERT_EQ(4u, sm.get_num_shards());
+  {
+    std::unique_lock<sharded_shared_mutex> l(sm);
+    // no shard is left for anyone, whatever thread they are
+    for (int i = 0; i < 16; ++i) {
+      ASSERT_FALSE(try_lock_elsewhere(&sm));
+      ASSERT_FALSE(try_lock_shared_elsewhere(&sm));
+    }
+  }
+  ASSERT_TRUE(try_lock_elsewhere(&sm));
+  ASSERT_TRUE(try_lock_shared_elsewhere(&sm));
+}
+
+TEST(ShardedSharedMutex, Shared) {
+  sharded_shared_mutex sm(4);
+  {
+    boost::shared_lock<sharded_shared_mutex> l(sm);
+    for (int i = 0; i < 16; ++i) {
+      ASSERT_TRUE(try_lock_shared_elsewhere(&sm));
+      ASSERT_FALSE(try_lock_elsewhere(&sm));
+    }
+  }
+  ASSERT_TRUE(try_lock_elsewhere(&sm));
+}
+
+TEST(ShardedSharedMutex, TryLockBacksOut) {
+  sharded_shared_mutex sm(8);
+  // a reader holds one shard; a failed try_lock must release the
+  // shards it got before reaching that one
+  std::promise<void> locked, done;
+  std::thread reader([&] {
+      sm.lock_shared();
+      locked.set_value();
+      done.get_future().wait();
+      sm.unlock_shared();
+    });
+  locked.get_future().wait();
+  ASSERT_FALSE(sm.try_lock());
+  ASSERT_TRUE(sm.try_lock_shared());
+  sm.unlock_shared();
+  done.set_value();
+  reader.join();
+  ASSERT_TRUE(sm.try_lock());
+  sm.unlock();
+}
+
+TEST(ShardedSharedMutex, Shunique) {
+  sharded_shared_mutex sm(3);
+  ceph::shunique_lock<sharded_shared_mutex> sul(sm, ceph::acquire_shared);
+  ASSERT_TRUE(sul.owns_lock_shared());
+  ASSERT_FALSE(try_lock_elsewhere(&sm));
+  sul.unlock();
+  sul.lock();
+  ASSERT_TRUE(sul.owns_lock());
+  ASSERT_FALSE(try_lock_shared_elsewhere(&sm));
+  sul.unlock();
+  ASSERT_TRUE(try_lock_elsewhere(&sm));
+}
+
+TEST(ShardedSharedMutex, Counter) {
+  sharded_shared_mutex sm(4);
+  int value = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+	for (int i = 0; i < 1000; ++i) {
+	  {
+	    std::unique_lock<sharded_shared_mutex> l(sm);
+	    ++value;
+	  }
+	  boost::shared_lock<sharded_shared_mutex> l(sm);
+	  ASSERT_GT(value, 0);
+	}
+      });
+  }
+  for (auto& t : threads)
+    t.join();
+  ASSERT_EQ(8000, value);
+}
@@ -391,6 +391,32 @@ TEST(SharedCache_all, lru) {
   ASSERT_TRUE(cache.lookup(0).get());
 }
 
+TEST(SharedCache_all, cost) {
+  SharedLRU<int, int> cache(NULL, 10);
+  cache.set_cost_func([](const int& v) { return (size_t)v; });
+
+  cache.add(1, new int(4));
+  cache.add(2, new int(4));
+  ASSERT_EQ(8u, cache.get_size());
+  // 1 and 2 no longer fit with 3
+  cache.add(3, new int(7));
+  ASSERT_EQ(7u, cache.get_size());
+  ASSERT_FALSE(cache.lookup(1));
+  ASSERT_FALSE(cache.lookup(2));
+
+  // a value that grows in place is charged again
+  {
+    ceph::shared_ptr<int> ptr = cache.lookup(3);
+    *ptr = 9;
+    cache.update_cost(3);
+    ASSERT_EQ(9u, cache.get_size());
+    cache.add(4, new int(2));
+    ASSERT_EQ(2u, cache.get_size());
+  }
+  ASSERT_FALSE(cache.lookup(3));
+  ASSERT_EQ(2, *cache.lookup(4));
+}
+
 // Local Variables:
 // compile-command: "cd ../.. ; make unittest_shared_cache && ./unittest_shared_cache # --gtest_filter=*.* --log-to-stderr=true"
 // End:
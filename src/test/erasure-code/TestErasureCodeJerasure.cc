@@ -277,6 +277,56 @@ TEST(ErasureCodeTest, encode)
   }
 }
 
+TEST(ErasureCodeTest, encode_delta)
+{
+  ErasureCodeJerasureReedSolomonVandermonde jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["w"] = "8";
+  jerasure.init(profile, &cerr);
+
+  unsigned aligned_object_size = jerasure.get_alignment() * 2;
+  unsigned chunk_size = jerasure.get_chunk_size(aligned_object_size);
+  set<int> want_to_encode = { 0, 1, 2, 3 };
+
+  bufferlist before;
+  before.append(string(chunk_size, 'A'));
+  before.append(string(chunk_size, 'B'));
+  map<int,bufferlist> old_encoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, before, &old_encoded));
+
+  // only the first data chunk changes
+  bufferlist after;
+  after.append(string(chunk_size, 'C'));
+  after.append(string(chunk_size, 'B'));
+  map<int,bufferlist> new_encoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, after, &new_encoded));
+
+  map<int,bufferlist> data_deltas;
+  {
+    bufferptr delta(chunk_size);
+    for (unsigned i = 0; i < chunk_size; ++i)
+      delta[i] = 'A' ^ 'C';
+    data_deltas[0].append(delta);
+  }
+  map<int,bufferlist> coding_deltas;
+  EXPECT_EQ(0, jerasure.encode_delta(data_deltas, &coding_deltas));
+  EXPECT_EQ(2u, coding_deltas.size());
+  for (int i = 2; i < 4; ++i) {
+    ASSERT_EQ(chunk_size, coding_deltas[i].length());
+    const char *o = old_encoded[i].c_str();
+    const char *n = new_encoded[i].c_str();
+    const char *d = coding_deltas[i].c_str();
+    for (unsigned j = 0; j < chunk_size; ++j)
+      EXPECT_EQ(n[j], (char)(o[j] ^ d[j]));
+  }
+
+  // deltas of mismatched lengths are rejected
+  data_deltas[1].append(string(chunk_size / 2, 'X'));
+  EXPECT_EQ(-EINVAL, jerasure.encode_delta(data_deltas, &coding_deltas));
+}
+
 TEST(ErasureCodeTest, create_rule)
 {
   CrushWrapper *c = new CrushWrapper;
@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <string>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <iostream>
 
 using namespace std;
@@ -207,10 +208,21 @@ int main(int argc, char **argv)
 
   client.ready(concurrent, numjobs, ios, len);
   Cycles::init();
+  struct rusage start_usage, stop_usage;
+  getrusage(RUSAGE_SELF, &start_usage);
   uint64_t start = Cycles::rdtsc();
   client.start();
   uint64_t stop = Cycles::rdtsc();
+  getrusage(RUSAGE_SELF, &stop_usage);
   cerr << " Total op " << ios << " run time " << Cycles::to_microseconds(stop - start) << "us." << std::endl;
 
+  // cpu spent by the whole process, i.e. mostly encoding and framing
+  // the messages and the messenger threads sending them
+  utime_t cpu = utime_t(stop_usage.ru_utime) - utime_t(start_usage.ru_utime) +
+    utime_t(stop_usage.ru_stime) - utime_t(start_usage.ru_stime);
+  uint64_t total_ops = (uint64_t)ios * numjobs;
+  cerr << " cpu " << cpu.to_nsec() / 1000 << "us, "
+       << (total_ops ? cpu.to_nsec() / total_ops : 0) << "ns/op" << std::endl;
+
   return 0;
 }
@@ -22,6 +22,7 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/ceph_argparse.h"
+#include "common/ceph_json.h"
 #include "global/global_init.h"
 #include "msg/Dispatcher.h"
 #include "msg/msg_types.h"
@@ -766,6 +767,95 @@ TEST_P(MessengerTest, MessageTest) {
   client_msgr->wait();
 }
 
+class CrcDispatcher : public FakeDispatcher {
+ public:
+  // the last message received, as it came off the wire
+  ceph_msg_header header;
+  ceph_msg_footer footer;
+  bufferlist front, middle, data;
+
+  explicit CrcDispatcher(bool s) : FakeDispatcher(s) {}
+  void ms_fast_dispatch(Message *m) override {
+    {
+      Mutex::Locker l(lock);
+      header = m->get_header();
+      footer = m->get_footer();
+      front = m->get_payload();
+      middle = m->get_middle();
+      data = m->get_data();
+    }
+    FakeDispatcher::ms_fast_dispatch(m);
+  }
+};
+
+TEST_P(MessengerTest, DataCrcTest) {
+  ASSERT_TRUE(g_ceph_context->_conf->ms_crc_data);
+  FakeDispatcher cli_dispatcher(false);
+  CrcDispatcher srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  Messenger::Policy p = Messenger::Policy::stateful_server(0);
+  server_msgr->set_policy(entity_name_t::TYPE_CLIENT, p);
+  p = Messenger::Policy::lossless_peer(0);
+  client_msgr->set_policy(entity_name_t::TYPE_OSD, p);
+
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  ConnectionRef conn = client_msgr->get_connection(server_msgr->get_myinst());
+  // a message small enough to be copied into one buffer, and one that
+  // is sent by reference
+  for (unsigned len : { 16u, 65536u }) {
+    bufferlist bl;
+    bl.append(string(len, 'a'));
+    MPing *m = new MPing();
+    m->set_data(bl);
+    conn->send_message(m);
+    {
+      utime_t t;
+      t += 1000*1000*500;
+      Mutex::Locker l(cli_dispatcher.lock);
+      while (!cli_dispatcher.got_new)
+        cli_dispatcher.cond.WaitInterval(cli_dispatcher.lock, t);
+      ASSERT_TRUE(cli_dispatcher.got_new);
+      cli_dispatcher.got_new = false;
+    }
+
+    Mutex::Locker l(srv_dispatcher.lock);
+    ASSERT_EQ(len, srv_dispatcher.data.length());
+    ASSERT_FALSE(srv_dispatcher.footer.flags & CEPH_MSG_FOOTER_NOCRC);
+    ASSERT_EQ(srv_dispatcher.data.crc32c(0), srv_dispatcher.footer.data_crc);
+
+    Message *good = decode_message(g_ceph_context, MSG_CRC_ALL,
+                                   srv_dispatcher.header,
+                                   srv_dispatcher.footer,
+                                   srv_dispatcher.front,
+                                   srv_dispatcher.middle,
+                                   srv_dispatcher.data, nullptr);
+    ASSERT_TRUE(good);
+    good->put();
+
+    // flip a bit of the data as if it was damaged on the way
+    bufferlist bad;
+    bad.append(srv_dispatcher.data.c_str(), len);
+    bad.c_str()[len / 2] ^= 1;
+    ASSERT_EQ(nullptr, decode_message(g_ceph_context, MSG_CRC_ALL,
+                                      srv_dispatcher.header,
+                                      srv_dispatcher.footer,
+                                      srv_dispatcher.front,
+                                      srv_dispatcher.middle,
+                                      bad, nullptr));
+  }
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+}
+
+
 
 class SyntheticWorkload;
 
@@ -1220,6 +1310,143 @@ TEST_P(MessengerTest, SyntheticStressTest1) {
   test_msg.wait_for_done();
 }
 
+/// each async messenger worker counter, summed over the workers;
+/// averages come back as (avgcount, sum), plain counters as (value, 0)
+static map<string, pair<uint64_t, uint64_t>> get_worker_counters()
+{
+  JSONFormatter f;
+  g_ceph_context->get_perfcounters_collection()->dump_formatted(&f, false);
+  stringstream ss;
+  f.flush(ss);
+  string s = ss.str();
+  JSONParser parser;
+  map<string, pair<uint64_t, uint64_t>> out;
+  EXPECT_TRUE(parser.parse(s.c_str(), s.length()));
+  for (JSONObjIter w = parser.find_first(); !w.end(); ++w) {
+    if ((*w)->get_name().find("AsyncMessenger::Worker-") != 0)
+      continue;
+    for (JSONObjIter c = (*w)->find_first(); !c.end(); ++c) {
+      auto& v = out[(*c)->get_name()];
+      JSONObj *avgcount = (*c)->find_obj("avgcount");
+      if (avgcount) {
+	v.first += strtoull(avgcount->get_data().c_str(), NULL, 10);
+	v.second += strtoull((*c)->find_obj("sum")->get_data().c_str(),
+			     NULL, 10);
+      } else {
+	v.first += strtoull((*c)->get_data().c_str(), NULL, 10);
+      }
+    }
+  }
+  return out;
+}
+
+TEST_P(MessengerTest, SyntheticZeroCopyTest) {
+  // loopback copies anyway, but this still exercises holding the sent
+  // buffers until the kernel reports the sends complete
+  g_ceph_context->_conf->set_val("ms_tcp_zerocopy_min_bytes", "1");
+  auto before = get_worker_counters();
+  SyntheticWorkload test_msg(8, 16, GetParam(), 100,
+                             Messenger::Policy::stateful_server(0),
+                             Messenger::Policy::lossless_client(0));
+  for (int i = 0; i < 10; ++i) {
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 90) {
+      test_msg.generate_connection();
+    } else if (val > 80) {
+      test_msg.drop_connection();
+    } else {
+      test_msg.send_message();
+    }
+  }
+  test_msg.wait_for_done();
+  g_ceph_context->_conf->set_val("ms_tcp_zerocopy_min_bytes", "0");
+  if (string(GetParam()).find("async+posix") == 0) {
+    // sends either went out zerocopy and were reaped, or the socket
+    // could not do zerocopy and said so
+    auto after = get_worker_counters();
+    uint64_t done = after["msgr_send_zerocopy_done"].first -
+      before["msgr_send_zerocopy_done"].first;
+    uint64_t fallback = after["msgr_send_zerocopy_fallback"].first -
+      before["msgr_send_zerocopy_fallback"].first;
+    ASSERT_GT(done + fallback, 0u);
+  }
+}
+
+TEST_P(MessengerTest, SyntheticLocklessSendTest) {
+  // only new connections pick the setting up
+  g_ceph_context->_conf->set_val("ms_async_lockless_send", "true");
+  auto before = get_worker_counters();
+  SyntheticWorkload test_msg(8, 32, GetParam(), 100,
+                             Messenger::Policy::stateful_server(0),
+                             Messenger::Policy::lossless_client(0));
+  for (int i = 0; i < 10; ++i) {
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 90) {
+      test_msg.generate_connection();
+    } else if (val > 80) {
+      test_msg.drop_connection();
+    } else {
+      test_msg.send_message();
+    }
+  }
+  test_msg.wait_for_done();
+  g_ceph_context->_conf->set_val("ms_async_lockless_send", "false");
+  if (string(GetParam()).find("async") == 0) {
+    auto after = get_worker_counters();
+    ASSERT_GT(after["msgr_send_inbox"].first,
+	      before["msgr_send_inbox"].first);
+  }
+}
+
+TEST_P(MessengerTest, SyntheticCoalesceTest) {
+  // only new connections pick the settings up
+  g_ceph_context->_conf->set_val("ms_async_coalesce_max_messages", "4");
+  g_ceph_context->_conf->set_val("ms_async_coalesce_delay_us", "500");
+  auto before = get_worker_counters();
+  SyntheticWorkload test_msg(8, 32, GetParam(), 100,
+                             Messenger::Policy::stateful_server(0),
+                             Messenger::Policy::lossless_client(0));
+  for (int i = 0; i < 10; ++i) {
+    test_msg.generate_connection();
+  }
+  gen_type rng(time(NULL));
+  for (int i = 0; i < 2000; ++i) {
+    boost::uniform_int<> true_false(0, 99);
+    int val = true_false(rng);
+    if (val > 90) {
+      test_msg.generate_connection();
+    } else if (val > 80) {
+      test_msg.drop_connection();
+    } else {
+      test_msg.send_message();
+    }
+  }
+  test_msg.wait_for_done();
+  g_ceph_context->_conf->set_val("ms_async_coalesce_max_messages", "16");
+  g_ceph_context->_conf->set_val("ms_async_coalesce_delay_us", "0");
+  if (string(GetParam()).find("async") == 0) {
+    // sends were held back, and packed more than one message on average
+    auto after = get_worker_counters();
+    uint64_t sends = after["msgr_send_coalesced"].first -
+      before["msgr_send_coalesced"].first;
+    uint64_t messages = after["msgr_send_coalesced"].second -
+      before["msgr_send_coalesced"].second;
+    ASSERT_GT(sends, 0u);
+    ASSERT_GT(messages, sends);
+    ASSERT_GT(after["msgr_send_deferred"].first,
+	      before["msgr_send_deferred"].first);
+  }
+}
 
 TEST_P(MessengerTest, SyntheticInjectTest) {
   uint64_t dispatch_throttle_bytes = g_ceph_context->_conf->ms_dispatch_throttle_bytes;
@@ -15,6 +15,8 @@
 #include "include/Context.h"
 #include "os/bluestore/Allocator.h"
 #include "os/bluestore/BitAllocator.h"
+#include "os/bluestore/ExtentAllocator.h"
+#include "common/Formatter.h"
 
 
 #if GTEST_HAS_PARAM_TEST
@@ -218,7 +220,7 @@ TEST_P(AllocTest, test_alloc_big)
 
 TEST_P(AllocTest, test_alloc_hint_bmap)
 {
-  if (GetParam() == std::string("stupid")) {
+  if (GetParam() != std::string("bitmap")) {
     return;
   }
   int64_t blocks = BitMapArea::get_level_factor(g_ceph_context, 2) * 4;
@@ -294,7 +296,62 @@ TEST_P(AllocTest, test_alloc_non_aligned_len)
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "extent"));
+
+TEST(ExtentAllocator, coalesce_and_fragmentation)
+{
+  int64_t block_size = 4096;
+  ExtentAllocator alloc(g_ceph_context, "");
+  for (int64_t i = 0; i < 16; i += 2) {
+    alloc.init_add_free(i * block_size, block_size);
+  }
+  ASSERT_EQ(8u * block_size, alloc.get_free());
+
+  // filling the holes merges everything into one extent
+  for (int64_t i = 1; i < 16; i += 2) {
+    alloc.release(i * block_size, block_size);
+  }
+  ASSERT_EQ(16u * block_size, alloc.get_free());
+  {
+    std::unique_ptr<Formatter> f(Formatter::create("json"));
+    alloc.dump_fragmentation(f.get());
+    stringstream ss;
+    f->flush(ss);
+    EXPECT_NE(string::npos, ss.str().find("\"free_extents\":1,"));
+    EXPECT_NE(string::npos, ss.str().find("\"fragmentation_rating\":0"));
+  }
+
+  // the hint is honored, and allocations continue from the last one
+  ASSERT_EQ(0, alloc.reserve(2 * block_size));
+  AllocExtentVector extents;
+  ASSERT_EQ(block_size, alloc.allocate(block_size, block_size, 0,
+				       5 * block_size, &extents));
+  ASSERT_EQ(1u, extents.size());
+  EXPECT_EQ(5u * block_size, extents[0].offset);
+  extents.clear();
+  ASSERT_EQ(block_size, alloc.allocate(block_size, block_size, 0,
+				       (int64_t)0, &extents));
+  ASSERT_EQ(1u, extents.size());
+  EXPECT_EQ(6u * block_size, extents[0].offset);
+
+  // reservations never exceed free space
+  EXPECT_EQ(-ENOSPC, alloc.reserve(15 * block_size));
+  EXPECT_EQ(0, alloc.reserve(14 * block_size));
+  alloc.unreserve(14 * block_size);
+  alloc.shutdown();
+
+  // without a hint, best fit prefers a small hole over a big extent
+  ExtentAllocator alloc2(g_ceph_context, "");
+  alloc2.init_add_free(8 * block_size, 8 * block_size);
+  alloc2.init_add_free(2 * block_size, block_size);
+  ASSERT_EQ(0, alloc2.reserve(block_size));
+  extents.clear();
+  ASSERT_EQ(block_size, alloc2.allocate(block_size, block_size, 0,
+					(int64_t)0, &extents));
+  ASSERT_EQ(1u, extents.size());
+  EXPECT_EQ(2u * block_size, extents[0].offset);
+  alloc2.shutdown();
+}
 
 #else
 
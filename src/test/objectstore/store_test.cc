@@ -28,6 +28,9 @@
 #include "os/filestore/FileStore.h"
 #if defined(HAVE_LIBAIO)
 #include "os/bluestore/BlueStore.h"
+#if defined(HAVE_LIBURING)
+#include <liburing.h>
+#endif
 #endif
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
@@ -1106,11 +1109,150 @@ TEST_P(StoreTest, CompressionTest) {
 
   doCompressionTest(store);
 
+  // independently compressed frames; partial reads only inflate (and
+  // cache) some of them
+  g_conf->set_val("bluestore_compression_frame_size", "16384");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  doCompressionTest(store);
+
+  g_conf->set_val("bluestore_compression_frame_size", "0");
   g_conf->set_val("bluestore_compression_algorithm", "snappy");
   g_conf->set_val("bluestore_compression_mode", "none");
   g_ceph_context->_conf->apply_changes(NULL);
 }
 
+#if defined(HAVE_LIBAIO) && defined(HAVE_LIBURING)
+TEST_P(StoreTest, IoringReadTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  {
+    struct io_uring ring;
+    if (io_uring_queue_init(2, &ring, 0) < 0) {
+      cout << "SKIP: io_uring is not available" << std::endl;
+      return;
+    }
+    io_uring_queue_exit(&ring);
+  }
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  const unsigned num_objects = 16;
+  const unsigned len = 0x4000;
+  auto hoid = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+  };
+  auto data = [len](unsigned i) {
+    bufferlist bl;
+    bl.append(string(len, 'a' + i));
+    return bl;
+  };
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    for (unsigned i = 0; i < num_objects; ++i) {
+      t.write(cid, hoid(i), 0, len, data(i));
+    }
+    bufferlist big;
+    big.append(string(0x40000, 'z'));
+    t.write(cid, hoid(num_objects), 0, big.length(), big);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // fewer registered buffers than objects we are about to read and keep
+  // (cached) around
+  g_conf->set_val("bdev_ioring", "true");
+  g_conf->set_val("bdev_ioring_registered_buffers", "4");
+  g_conf->set_val("bdev_ioring_registered_buffer_size", "65536");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    vector<bufferlist> held(num_objects);
+    for (unsigned i = 0; i < num_objects; ++i) {
+      r = store->read(cid, hoid(i), 0, len, held[i]);
+      ASSERT_EQ((int)len, r);
+      ASSERT_TRUE(bl_eq(data(i), held[i]));
+    }
+    // larger than a registered buffer
+    bufferlist bl;
+    r = store->read(cid, hoid(num_objects), 0x1000, 0x30000, bl);
+    ASSERT_EQ(0x30000, r);
+    ASSERT_EQ(string(0x30000, 'z'), bl.to_str());
+    // and once more from the device
+    ASSERT_EQ(0, store->umount());
+    ASSERT_EQ(0, store->mount());
+  }
+
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i <= num_objects; ++i) {
+      t.remove(cid, hoid(i));
+    }
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bdev_ioring", "false");
+  g_conf->set_val("bdev_ioring_registered_buffers", "256");
+  g_conf->set_val("bdev_ioring_registered_buffer_size", "65536");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+}
+#endif
+
+TEST_P(StoreTest, VerifyChecksumsTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl;
+    bl.append(string(0x30000, 'a'));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ObjectStore::CollectionHandle ch = store->open_collection(cid);
+  ASSERT_TRUE(ch);
+
+  // a clean blob verifies, whole or in part
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, 0, 0x30000));
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, 0x1234, 0x10000));
+  // past the end there is nothing to verify
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, 0x40000, 0x1000));
+  ASSERT_EQ(-ENOENT, store->verify_checksums(
+	      ch, ghobject_t(hobject_t(sobject_t("nope", CEPH_NOSNAP))),
+	      0, 0x1000));
+
+  // a checksum mismatch is reported, not the data
+  g_conf->set_val("bluestore_debug_inject_csum_err_probability", "1.0");
+  g_ceph_context->_conf->apply_changes(NULL);
+  r = store->verify_checksums(ch, hoid, 0, 0x30000);
+  g_conf->set_val("bluestore_debug_inject_csum_err_probability", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ASSERT_EQ(-EIO, r);
+
+  ASSERT_EQ(0, store->verify_checksums(ch, hoid, 0, 0x30000));
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   ObjectStore::Sequencer osr("test");
   int r;
@@ -4392,6 +4534,129 @@ TEST_P(StoreTestSpecificAUSize, SyntheticMatrixNoCsum) {
   do_matrix(m, store, doSyntheticTest);
 }
 
+TEST_P(StoreTestSpecificAUSize, SyntheticMatrixKVSubmitLanes) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  const char *m[][10] = {
+    { "bluestore_min_alloc_size", "4096", "65536", 0 }, // to be the first!
+    { "max_write", "65536", 0 },
+    { "max_size", "1048576", 0 },
+    { "alignment", "512", 0 },
+    { "bluestore_kv_submit_lanes", "1", "4", 0 },
+    { "bluestore_sync_submit_transaction", "true", "false", 0 },
+    { 0 },
+  };
+  do_matrix(m, store, doSyntheticTest);
+}
+
+TEST_P(StoreTestSpecificAUSize, SyntheticCacheLocklessHits) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // cache shards are created with the store, so set this up front
+  g_conf->set_val("bluestore_cache_lockless_hits", "true");
+  g_conf->set_val("bluestore_cache_trim_batch_bytes", "65536");
+  g_conf->set_val("bluestore_cache_trim_interval", "0.01");
+  g_conf->apply_changes(NULL);
+  for (auto type : { "lru", "2q" }) {
+    if (store) {
+      TearDown();
+    }
+    g_conf->set_val("bluestore_cache_type", type);
+    g_conf->apply_changes(NULL);
+    StartDeferred(4096);
+    doSyntheticTest(store, 10000, 400*1024, 40*1024, 0);
+  }
+  g_conf->set_val("bluestore_cache_type", "2q");
+  g_conf->set_val("bluestore_cache_lockless_hits", "false");
+  g_conf->set_val("bluestore_cache_trim_batch_bytes", "4194304");
+  g_conf->set_val("bluestore_cache_trim_interval", "0.2");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, SyntheticDeferredLog) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  char cwd[PATH_MAX];
+  ASSERT_TRUE(::getcwd(cwd, sizeof(cwd)));
+  string fn = string(cwd) + "/store_test_temp_deferred";
+  ::unlink(fn.c_str());
+  g_conf->set_val("bluestore_block_deferred_path", fn);
+  g_conf->set_val("bluestore_block_deferred_size", "67108864");
+  g_conf->set_val("bluestore_block_deferred_create", "true");
+  g_conf->set_val("bluestore_prefer_deferred_size", "32768");
+  g_conf->apply_changes(NULL);
+  StartDeferred(65536);
+  doSyntheticTest(store, 10000, 400*1024, 40*1024, 0);
+  // replay whatever is still in the log
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->fsck(false));
+  ASSERT_EQ(0, store->mount());
+  g_conf->set_val("bluestore_block_deferred_path", "");
+  g_conf->set_val("bluestore_block_deferred_create", "false");
+  g_conf->set_val("bluestore_prefer_deferred_size", "0");
+  g_conf->apply_changes(NULL);
+  // still open until the store is torn down, which is fine
+  ::unlink(fn.c_str());
+}
+
+TEST_P(StoreTestSpecificAUSize, BluestoreAllocSnapshot) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  StartDeferred(65536);
+  ObjectStore::Sequencer osr("test");
+  coll_t cid;
+  bufferlist bl;
+  bl.append(std::string(256 * 1024, 'a'));
+  auto write = [&](unsigned from, unsigned to) {
+    for (unsigned i = from; i < to; ++i) {
+      ObjectStore::Transaction t;
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+      t.write(cid, hoid, 0, bl.length(), bl);
+      ASSERT_EQ(0, apply_transaction(store, &osr, std::move(t)));
+    }
+  };
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(0, apply_transaction(store, &osr, std::move(t)));
+  }
+  write(0, 20);
+  for (unsigned i = 0; i < 20; i += 2) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					CEPH_NOSNAP)));
+    t.remove(cid, hoid);
+    ASSERT_EQ(0, apply_transaction(store, &osr, std::move(t)));
+  }
+
+  // mount from the snapshot, then make sure nothing gets allocated twice
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->mount());
+  write(20, 40);
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->fsck(false));
+
+  // with snapshots disabled, an existing one is dropped at mount and the
+  // freelist is enumerated instead
+  ASSERT_EQ(0, store->mount());
+  write(40, 50);
+  ASSERT_EQ(0, store->umount());
+  g_conf->set_val("bluestore_alloc_snapshot", "false");
+  g_conf->apply_changes(NULL);
+  ASSERT_EQ(0, store->mount());
+  write(50, 60);
+  ASSERT_EQ(0, store->umount());
+  ASSERT_EQ(0, store->fsck(false));
+  g_conf->set_val("bluestore_alloc_snapshot", "true");
+  g_conf->apply_changes(NULL);
+  ASSERT_EQ(0, store->mount());
+}
+
 TEST_P(StoreTestSpecificAUSize, SyntheticMatrixPreferDeferred) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -8,6 +8,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <thread>
+#include <atomic>
 #include "global/global_init.h"
 #include "common/ceph_argparse.h"
 #include "include/stringify.h"
@@ -565,6 +566,81 @@ TEST(BlueFS, test_replay) {
   rm_temp_bdev(fn);
 }
 
+#define FSYNC_CHUNK 4096
+#define FSYNC_CHUNKS 200
+
+void append_fsync_file(BlueFS &fs, string file, char c)
+{
+  BlueFS::FileWriter *h;
+  ASSERT_EQ(0, fs.open_for_write("dir", file, &h, false));
+  string chunk(FSYNC_CHUNK, c);
+  for (unsigned i = 0; i < FSYNC_CHUNKS; ++i) {
+    h->append(chunk.c_str(), chunk.length());
+    ASSERT_EQ(0, fs.fsync(h));
+  }
+  fs.close_writer(h);
+}
+
+TEST(BlueFS, test_compaction_async_concurrent_fsync) {
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  g_ceph_context->_conf->set_val(
+    "bluefs_alloc_size",
+    "65536");
+  g_ceph_context->_conf->set_val(
+    "bluefs_compact_log_sync",
+    "false");
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+  {
+    // writers fsync their own files while the log is compacted under
+    // them, so log flushes and compaction io overlap
+    std::atomic<bool> done(false);
+    unsigned compactions = 0;
+    std::thread compactor([&] {
+	while (!done) {
+	  fs.compact_log();
+	  ++compactions;
+	}
+      });
+    std::vector<std::thread> write_threads;
+    for (int i = 0; i < NUM_WRITERS; i++) {
+      write_threads.push_back(std::thread(append_fsync_file, std::ref(fs),
+					  "file." + stringify(i), 'a' + i));
+    }
+    join_all(write_threads);
+    done = true;
+    compactor.join();
+    ASSERT_LT(0u, compactions);
+  }
+  fs.umount();
+
+  // everything that was fsynced must replay
+  ASSERT_EQ(0, fs.mount());
+  for (int i = 0; i < NUM_WRITERS; i++) {
+    string file = "file." + stringify(i);
+    uint64_t file_size;
+    utime_t mtime;
+    ASSERT_EQ(0, fs.stat("dir", file, &file_size, &mtime));
+    ASSERT_EQ((uint64_t)FSYNC_CHUNK * FSYNC_CHUNKS, file_size);
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("dir", file, &h));
+    bufferlist bl;
+    BlueFS::FileReaderBuffer buf(4096);
+    ASSERT_EQ((int)file_size, fs.read(h, &buf, 0, file_size, &bl, NULL));
+    ASSERT_EQ(string(file_size, 'a' + i), bl.to_str());
+    delete h;
+  }
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -306,6 +306,59 @@ TEST(bluestore_blob_t, calc_csum)
   }
 }
 
+TEST(bluestore_blob_t, calc_csum_batch)
+{
+  // odd-sized fragments so that some csum blocks straddle buffers
+  bufferlist bl;
+  unsigned frag[] = { 4096, 100, 8092, 1, 4095, 16384, 3, 32765 };
+  char c = 0;
+  for (auto len : frag) {
+    bufferptr bp(len);
+    for (unsigned i = 0; i < len; ++i)
+      bp.c_str()[i] = c++ * 7;
+    bl.append(bp);
+  }
+  ASSERT_EQ(65536u, bl.length());
+  bufferlist small;
+  small.substr_of(bl, 4096, 8192);
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX;
+       ++csum_type) {
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+	 << std::endl;
+    bluestore_blob_t a, b, c, d;
+    a.init_csum(csum_type, 12, bl.length());
+    b.init_csum(csum_type, 12, bl.length());
+    c.init_csum(csum_type, 9, 16384);
+    d.init_csum(csum_type, 9, 16384);
+    a.calc_csum(0, bl);
+    c.calc_csum(4096, small);
+
+    vector<bluestore_blob_t::csum_batch_item_t> batch;
+    batch.emplace_back(&b, 0, bl);
+    batch.emplace_back(&d, 4096, small);
+    bluestore_blob_t::calc_csum_batch(batch);
+    ASSERT_EQ(a.csum_data.length(), b.csum_data.length());
+    ASSERT_EQ(0, memcmp(a.csum_data.c_str(), b.csum_data.c_str(),
+			a.csum_data.length()));
+    ASSERT_EQ(0, memcmp(c.csum_data.c_str(), d.csum_data.c_str(),
+			c.csum_data.length()));
+
+    int bad_off;
+    uint64_t bad_csum;
+    ASSERT_EQ(0, b.verify_csum(0, bl, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+    ASSERT_EQ(0, d.verify_csum(4096, small, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+    bufferlist corrupt;
+    corrupt.append(bl.c_str(), bl.length());
+    corrupt.c_str()[40000] ^= 1;
+    ASSERT_EQ(-1, b.verify_csum(0, corrupt, &bad_off, &bad_csum));
+    ASSERT_EQ(36864, bad_off);
+  }
+}
+
 TEST(bluestore_blob_t, csum_bench)
 {
   bufferlist bl;
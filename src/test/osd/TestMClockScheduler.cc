@@ -0,0 +1,279 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/common_init.h"
+
+#include "common/ceph_json.h"
+#include "include/stringify.h"
+#include "messages/MOSDRepOp.h"
+#include "osd/mClockScheduler.h"
+#include "osd/OpRequest.h"
+
+
+int main(int argc, char **argv) {
+  std::vector<const char*> args(argv, argv+argc);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+
+class MClockSchedulerTest : public testing::Test {
+public:
+  OpTracker tracker;
+  mClockScheduler q;
+
+  entity_inst_t client1;
+  entity_inst_t client2;
+
+  MClockSchedulerTest() :
+    tracker(g_ceph_context, false, 1),
+    q(g_ceph_context),
+    client1(entity_name_t(CEPH_ENTITY_TYPE_OSD, 1), entity_addr_t()),
+    client2(entity_name_t(CEPH_ENTITY_TYPE_OSD, 2), entity_addr_t())
+  {}
+
+  Request create_snaptrim(epoch_t e, const entity_inst_t& owner) {
+    return Request(spg_t(),
+		   PGQueueable(PGSnapTrim(e),
+			       12, 12,
+			       utime_t(), owner, e));
+  }
+
+  Request create_scrub(epoch_t e, const entity_inst_t& owner) {
+    return Request(spg_t(),
+		   PGQueueable(PGScrub(e),
+			       12, 12,
+			       utime_t(), owner, e));
+  }
+
+  Request create_recovery(epoch_t e, const entity_inst_t& owner,
+			  bool backfill = false) {
+    return Request(spg_t(),
+		   PGQueueable(PGRecovery(e, 64, backfill),
+			       12, 12,
+			       utime_t(), owner, e));
+  }
+
+  // a replica write, scheduled with the client ops of pool
+  Request create_client_op(epoch_t e, const entity_inst_t& owner,
+			   int64_t pool) {
+    OpRequestRef op = tracker.create_request<OpRequest, Message*>(
+      new MOSDRepOp);
+    return Request(spg_t(pg_t(0, pool)),
+		   PGQueueable(op, e));
+  }
+
+  // reservation_iops of every class in the dump, keyed by
+  // "<op_class>" or "client.<pool>"
+  std::map<std::string, double> get_reservations() {
+    JSONFormatter f;
+    f.open_object_section("queue");
+    q.dump(&f);
+    f.close_section();
+    std::stringstream ss;
+    f.flush(ss);
+
+    std::map<std::string, double> out;
+    JSONParser parser;
+    string s = ss.str();
+    EXPECT_TRUE(parser.parse(s.c_str(), s.length()));
+    JSONObjIter classes = parser.find_first("classes");
+    EXPECT_FALSE(classes.end());
+    if (classes.end()) {
+      return out;
+    }
+    for (JSONObjIter i = (*classes)->find_first(); !i.end(); ++i) {
+      string op_class;
+      int64_t pool = -1;
+      JSONDecoder::decode_json("op_class", op_class, *i);
+      JSONDecoder::decode_json("pool", pool, *i);
+      JSONObj *res = (*i)->find_obj("reservation_iops");
+      EXPECT_TRUE(res);
+      if (op_class == "client") {
+	op_class += "." + stringify(pool);
+      }
+      out[op_class] = res ? atof(res->get_data().c_str()) : 0.0;
+    }
+    return out;
+  }
+
+  static double sum(const std::map<std::string, double>& m) {
+    double total = 0.0;
+    for (auto& p : m) {
+      total += p.second;
+    }
+    return total;
+  }
+};
+
+
+TEST_F(MClockSchedulerTest, TestSize) {
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, q.length());
+
+  q.enqueue(client1, 12, 0, create_snaptrim(100, client1));
+  q.enqueue_strict(client2, 12, create_scrub(101, client2));
+  q.enqueue(client2, 12, 0, create_recovery(102, client2));
+  q.enqueue(client1, 12, 0, create_recovery(103, client1, true));
+
+  ASSERT_FALSE(q.empty());
+  ASSERT_EQ(4u, q.length());
+
+  for (int i = 0; i < 4; ++i) {
+    utime_t when;
+    ASSERT_TRUE(q.is_ready(&when));
+    (void) q.dequeue();
+  }
+
+  ASSERT_TRUE(q.empty());
+  ASSERT_EQ(0u, q.length());
+}
+
+
+TEST_F(MClockSchedulerTest, TestEnqueueStrict) {
+  q.enqueue(client1, 12, 0, create_snaptrim(100, client1));
+  q.enqueue_strict(client1, 12, create_scrub(101, client1));
+  q.enqueue_strict(client2, 14, create_recovery(102, client2));
+
+  Request r = q.dequeue();
+  ASSERT_EQ(102u, r.second.get_map_epoch());
+
+  r = q.dequeue();
+  ASSERT_EQ(101u, r.second.get_map_epoch());
+
+  r = q.dequeue();
+  ASSERT_EQ(100u, r.second.get_map_epoch());
+}
+
+
+TEST_F(MClockSchedulerTest, TestLimit) {
+  // scrub is limited to a fraction of capacity; with 10 iops the second
+  // scrub is not due for a while
+  q.set_capacity(10.0);
+  ASSERT_GT(g_conf->osd_mclock_scheduler_scrub_lim, 0.0);
+  ASSERT_LT(g_conf->osd_mclock_scheduler_scrub_lim, 1.0);
+
+  q.enqueue(client1, 12, 0, create_scrub(100, client1));
+  q.enqueue(client1, 12, 0, create_scrub(101, client1));
+
+  utime_t when;
+  ASSERT_TRUE(q.is_ready(&when));
+  Request r = q.dequeue();
+  ASSERT_EQ(100u, r.second.get_map_epoch());
+
+  utime_t now = ceph_clock_now();
+  ASSERT_FALSE(q.is_ready(&when));
+  ASSERT_GT(when, now);
+  ASSERT_EQ(1u, q.length());
+
+  // strict items are never held back
+  q.enqueue_strict(client2, 12, create_snaptrim(102, client2));
+  ASSERT_TRUE(q.is_ready(&when));
+  r = q.dequeue();
+  ASSERT_EQ(102u, r.second.get_map_epoch());
+}
+
+
+TEST_F(MClockSchedulerTest, TestRemoveByClass) {
+  q.enqueue(client1, 12, 0, create_snaptrim(100, client1));
+  q.enqueue_strict(client2, 12, create_snaptrim(101, client2));
+  q.enqueue(client2, 12, 0, create_recovery(102, client2));
+  q.enqueue(client1, 12, 0, create_scrub(103, client1));
+
+  std::list<Request> filtered_out;
+  q.remove_by_class(client2, &filtered_out);
+
+  ASSERT_EQ(2u, filtered_out.size());
+  while (!filtered_out.empty()) {
+    auto e = filtered_out.front().second.get_map_epoch();
+    ASSERT_TRUE(e == 101 || e == 102);
+    filtered_out.pop_front();
+  }
+  ASSERT_EQ(2u, q.length());
+}
+
+
+TEST_F(MClockSchedulerTest, TestPoolReservationsFitCapacity) {
+  const double capacity = 1000.0;
+  q.set_capacity(capacity);
+  q.enqueue(client1, 12, 0, create_recovery(100, client1));
+  q.enqueue(client1, 12, 0, create_recovery(101, client1, true));
+  q.enqueue(client1, 12, 0, create_scrub(102, client1));
+  q.enqueue(client1, 12, 0, create_snaptrim(103, client1));
+  q.enqueue(client2, 12, 0, create_client_op(104, client2, 1));
+
+  auto res = get_reservations();
+  ASSERT_EQ(5u, res.size());
+  double one_pool = sum(res);
+  ASSERT_LE(one_pool, capacity);
+
+  // more pools split the client reservation rather than add to it
+  for (int64_t pool = 2; pool <= 4; ++pool) {
+    q.enqueue(client2, 12, 0, create_client_op(105, client2, pool));
+    q.enqueue(client2, 12, 0, create_client_op(106, client2, pool));
+  }
+  res = get_reservations();
+  ASSERT_EQ(8u, res.size());
+  ASSERT_NEAR(one_pool, sum(res), 1e-6);
+  ASSERT_DOUBLE_EQ(res["client.1"], res["client.2"]);
+  ASSERT_DOUBLE_EQ(res["client.1"], res["client.4"]);
+
+  // a pool with a reservation of its own adds it; the total is scaled
+  // back down to the capacity
+  std::map<int64_t, mClockScheduler::qos_t> pool_qos;
+  pool_qos[4] = mClockScheduler::qos_t(0.5, 1.0, 0.0);
+  q.set_pool_qos(pool_qos);
+  res = get_reservations();
+  ASSERT_LE(sum(res), capacity + 1e-6);
+  ASSERT_GT(res["client.4"], res["client.1"]);
+  ASSERT_DOUBLE_EQ(res["client.1"], res["client.3"]);
+
+  while (!q.empty()) {
+    utime_t when;
+    ASSERT_TRUE(q.is_ready(&when));
+    (void) q.dequeue();
+  }
+}
+
+
+TEST_F(MClockSchedulerTest, TestBusyClassTakesNewSettings) {
+  // with 10 iops the second scrub is held back by the scrub limit
+  q.set_capacity(10.0);
+  q.enqueue(client1, 12, 0, create_scrub(100, client1));
+  q.enqueue(client1, 12, 0, create_scrub(101, client1));
+  q.enqueue(client1, 12, 0, create_scrub(102, client1));
+
+  utime_t when;
+  ASSERT_TRUE(q.is_ready(&when));
+  Request r = q.dequeue();
+  ASSERT_EQ(100u, r.second.get_map_epoch());
+  ASSERT_FALSE(q.is_ready(&when));
+
+  // the class never drains, yet the next enqueue moves it to the new
+  // limit, without reordering what it has queued
+  q.set_capacity(1000000.0);
+  q.enqueue(client1, 12, 0, create_scrub(103, client1));
+  for (epoch_t e = 101; e <= 103; ++e) {
+    if (!q.is_ready(&when)) {
+      double wait = when - ceph_clock_now();
+      ASSERT_LT(wait, 0.01);
+      if (wait > 0) {
+	usleep(wait * 1000000);
+      }
+      ASSERT_TRUE(q.is_ready(&when));
+    }
+    r = q.dequeue();
+    ASSERT_EQ(e, r.second.get_map_epoch());
+  }
+  ASSERT_TRUE(q.empty());
+}
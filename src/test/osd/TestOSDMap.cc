@@ -7,6 +7,8 @@
 #include "global/global_init.h"
 #include "common/common_init.h"
 #include "common/ceph_argparse.h"
+#include "common/Cond.h"
+#include "include/stringify.h"
 
 #include <iostream>
 
@@ -222,6 +224,51 @@ TEST_F(OSDMapTest, MapFunctionsMatch) {
   EXPECT_EQ(acting_osds, acting_osds_two);
 }
 
+TEST_F(OSDMapTest, ParallelMappingMatchesCrush) {
+  // the way the Objecter maps ops when objecter_pg_mapping_threads is set
+  set_up_map();
+  ThreadPool tp(g_ceph_context, "OSDMapTest::tp", "tp_osdmap_test", 2);
+  tp.start();
+  ParallelPGMapper mapper(g_ceph_context, &tp);
+
+  for (int round = 0; round < 2; ++round) {
+    if (round) {
+      // a pg_temp change must show up in the next mapping
+      OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+      pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, my_rep_pool));
+      vector<int> up;
+      osdmap.pg_to_up_acting_osds(pgid, up, up);
+      pending_inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+	up.rbegin(), up.rend());
+      osdmap.apply_incremental(pending_inc);
+    }
+    C_SaferCond fin;
+    auto job = mapping.start_update(osdmap, mapper, 16);
+    job->set_finish_event(&fin);
+    ASSERT_EQ(0, fin.wait());
+    ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+
+    for (int i = 0; i < 1000; ++i) {
+      object_t oid("obj" + stringify(i));
+      for (int64_t pool : { my_ec_pool, my_rep_pool }) {
+	pg_t raw;
+	osdmap.object_locator_to_pg(oid, object_locator_t(pool), raw);
+	vector<int> up, acting, up2, acting2;
+	int up_primary, acting_primary, up_primary2, acting_primary2;
+	osdmap.pg_to_up_acting_osds(raw, &up, &up_primary,
+				    &acting, &acting_primary);
+	mapping.get(osdmap.get_pg_pool(pool)->raw_pg_to_pg(raw),
+		    &up2, &up_primary2, &acting2, &acting_primary2);
+	ASSERT_EQ(up, up2);
+	ASSERT_EQ(up_primary, up_primary2);
+	ASSERT_EQ(acting, acting2);
+	ASSERT_EQ(acting_primary, acting_primary2);
+      }
+    }
+  }
+  tp.stop();
+}
+
 /** This test must be removed or modified appropriately when we allow
  * other ways to specify a primary. */
 TEST_F(OSDMapTest, PrimaryIsFirst) {
@@ -288,6 +335,125 @@ TEST_F(OSDMapTest, PrimaryTempRespected) {
   EXPECT_EQ(acting_primary, acting_osds[1]);
 }
 
+TEST_F(OSDMapTest, MappingUpdatesTouchedPGs) {
+  set_up_map();
+  mapping.update(osdmap);
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, my_rep_pool, -1));
+  vector<int> acting_osds;
+  int acting_primary;
+  osdmap.pg_to_acting_osds(pgid, &acting_osds, &acting_primary);
+  // move the pg to an osd it was not on
+  vector<int> new_acting_osds(acting_osds);
+  for (int osd = 0; osd < (int)get_num_osds(); ++osd) {
+    if (std::find(acting_osds.begin(), acting_osds.end(), osd) ==
+	acting_osds.end()) {
+      new_acting_osds[0] = osd;
+      break;
+    }
+  }
+  ASSERT_NE(acting_osds, new_acting_osds);
+
+  OSDMap::Incremental pgtemp_map(osdmap.get_epoch() + 1);
+  pgtemp_map.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+    new_acting_osds.begin(), new_acting_osds.end());
+  osdmap.apply_incremental(pgtemp_map);
+
+  set<pg_t> touched = { pgid };
+  mapping.update(osdmap, touched);
+  ASSERT_EQ(osdmap.get_epoch(), mapping.get_epoch());
+
+  // the same as a mapping built from scratch, rmap included
+  OSDMapMapping full;
+  full.update(osdmap);
+  for (auto pool : { my_ec_pool, my_rep_pool }) {
+    for (unsigned ps = 0; ps < 64; ++ps) {
+      vector<int> up, acting, up2, acting2;
+      int up_primary, acting_primary, up_primary2, acting_primary2;
+      full.get(pg_t(ps, pool), &up, &up_primary, &acting, &acting_primary);
+      mapping.get(pg_t(ps, pool), &up2, &up_primary2, &acting2,
+		  &acting_primary2);
+      ASSERT_EQ(up, up2);
+      ASSERT_EQ(up_primary, up_primary2);
+      ASSERT_EQ(acting, acting2);
+      ASSERT_EQ(acting_primary, acting_primary2);
+    }
+  }
+  for (unsigned osd = 0; osd < get_num_osds(); ++osd) {
+    auto a = full.get_osd_acting_pgs(osd);
+    auto b = mapping.get_osd_acting_pgs(osd);
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    ASSERT_EQ(a, b);
+  }
+}
+
+TEST_F(OSDMapTest, CopyOnWrite) {
+  set_up_map();
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, my_rep_pool));
+  vector<int> up_osds, acting_osds;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+
+  OSDMap next;
+  next.deepish_copy_from(osdmap);
+  ASSERT_EQ(osdmap.crush, next.crush);
+
+  // change pg_temp and an osd uuid in the copy only
+  // move the pg to an osd it was not on
+  vector<int> new_acting_osds(acting_osds);
+  for (int osd = 0; osd < (int)get_num_osds(); ++osd) {
+    if (std::find(acting_osds.begin(), acting_osds.end(), osd) ==
+	acting_osds.end()) {
+      new_acting_osds[0] = osd;
+      break;
+    }
+  }
+  ASSERT_NE(acting_osds, new_acting_osds);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  inc.new_pg_temp[pgid] = mempool::osdmap::vector<int>(
+    new_acting_osds.begin(), new_acting_osds.end());
+  uuid_d uuid;
+  uuid.generate_random();
+  inc.new_uuid[0] = uuid;
+  next.apply_incremental(inc);
+
+  // crush was not touched and is still shared
+  EXPECT_EQ(osdmap.crush, next.crush);
+  EXPECT_EQ(0u, osdmap.get_num_pg_temp());
+  EXPECT_EQ(1u, next.get_num_pg_temp());
+  EXPECT_NE(uuid, osdmap.get_uuid(0));
+  EXPECT_EQ(uuid, next.get_uuid(0));
+
+  vector<int> orig_acting;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &orig_acting, &acting_primary);
+  EXPECT_EQ(acting_osds, orig_acting);
+  next.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                            &acting_osds, &acting_primary);
+  EXPECT_EQ(new_acting_osds, acting_osds);
+
+  // clearing the temps of a copy leaves them in the original
+  OSDMap cleared;
+  cleared.deepish_copy_from(next);
+  cleared.clear_temp();
+  EXPECT_EQ(0u, cleared.get_num_pg_temp());
+  EXPECT_EQ(1u, next.get_num_pg_temp());
+
+  // a full decode into the copy leaves the original alone
+  bufferlist bl;
+  osdmap.encode(bl, CEPH_FEATURES_SUPPORTED_DEFAULT | CEPH_FEATURE_RESERVED);
+  OSDMap other;
+  other.deepish_copy_from(osdmap);
+  other.decode(bl);
+  EXPECT_NE(osdmap.crush, other.crush);
+  other.crush->set_item_name(0, "renamed");
+  EXPECT_NE(string("renamed"), osdmap.crush->get_item_name(0));
+}
+
 TEST_F(OSDMapTest, CleanTemps) {
   set_up_map();
 
@@ -484,6 +650,41 @@ TEST_F(OSDMapTest, parse_osd_id_list) {
   ASSERT_EQ(-EINVAL, osdmap.parse_osd_id_list({"-12"}, &out, &cout));
 }
 
+TEST_F(OSDMapTest, HeartbeatDomains) {
+  set_up_map();
+
+  // osd.3-5 live on a second host
+  for (int i = 3; i < (int)get_num_osds(); ++i) {
+    map<string,string> loc;
+    loc["host"] = "otherhost";
+    loc["rack"] = "localrack";
+    loc["root"] = "default";
+    ASSERT_EQ(1, osdmap.crush->create_or_move_item(
+      g_ceph_context, i, 1.0, "osd." + stringify(i), loc));
+  }
+
+  map<int, set<int>> domains;
+  osdmap.get_heartbeat_domains("host", &domains);
+  ASSERT_EQ(2u, domains.size());
+  ASSERT_EQ(set<int>({0, 1, 2}), domains[0]);
+  ASSERT_EQ(set<int>({3, 4, 5}), domains[3]);
+
+  // every osd is a domain of its own below the host level
+  osdmap.get_heartbeat_domains("osd", &domains);
+  ASSERT_EQ(get_num_osds(), domains.size());
+  osdmap.get_heartbeat_domains("rack", &domains);
+  ASSERT_EQ(1u, domains.size());
+
+  // the next up osd takes over
+  OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+  pending_inc.new_state[0] = CEPH_OSD_UP;
+  osdmap.apply_incremental(pending_inc);
+  ASSERT_FALSE(osdmap.is_up(0));
+  ASSERT_EQ(-1, osdmap.get_heartbeat_aggregator("host", 0));
+  ASSERT_EQ(1, osdmap.get_heartbeat_aggregator("host", 2));
+  ASSERT_EQ(3, osdmap.get_heartbeat_aggregator("host", 5));
+}
+
 TEST(PGTempMap, basic)
 {
   PGTempMap m;
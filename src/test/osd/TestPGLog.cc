@@ -2288,6 +2288,43 @@ TEST_F(PGLogTest, ErrorNotIndexedByObject) {
   EXPECT_EQ(del.reqid, entry->reqid);
 }
 
+TEST_F(PGLogTest, LazyReqidIndex) {
+  clear();
+
+  hobject_t oid(object_t("objname"), "key", 123, 456, 0, "");
+  osd_reqid_t reqid(entity_name_t::CLIENT(777), 8, 1);
+  mempool::osd_pglog::list<pg_log_entry_t> entries;
+  entries.push_back(
+    pg_log_entry_t(pg_log_entry_t::MODIFY, oid, eversion_t(6,2),
+		   eversion_t(3,4), 1, reqid, utime_t(0,1), 0));
+
+  IndexedLog ilog(
+    eversion_t(6,2), eversion_t(3,4), eversion_t(6,2), eversion_t(6,2),
+    std::move(entries), mempool::osd_pglog::list<pg_log_dup_t>());
+  // the object index is always there, the reqid index only on demand
+  EXPECT_TRUE(ilog.objects.count(oid));
+  EXPECT_EQ(0u, ilog.caller_ops.size());
+  EXPECT_TRUE(ilog.logged_req(reqid));
+  EXPECT_EQ(1u, ilog.caller_ops.size());
+
+  // a newer entry for the object takes over the index key
+  pg_log_entry_t modify(pg_log_entry_t::MODIFY, oid, eversion_t(6,3),
+			eversion_t(6,2), 2,
+			osd_reqid_t(entity_name_t::CLIENT(777), 8, 2),
+			utime_t(1,2), 0);
+  ilog.add(modify);
+  EXPECT_EQ(2u, ilog.caller_ops.size());
+  set<eversion_t> trimmed;
+  set<string> trimmed_dups;
+  eversion_t write_from_dups = eversion_t::max();
+  ilog.trim(cct, eversion_t(6,2), &trimmed, &trimmed_dups, &write_from_dups);
+  EXPECT_EQ(1u, ilog.log.size());
+  ASSERT_TRUE(ilog.objects.count(oid));
+  EXPECT_EQ(modify.version, ilog.objects.find(oid)->second->version);
+  EXPECT_EQ(&ilog.log.back().soid, &ilog.objects.find(oid)->first.get());
+  EXPECT_FALSE(ilog.logged_req(reqid));
+}
+
 TEST_F(PGLogTest, split_into_preserves_may_include_deletes) {
   clear();
 
@@ -15,6 +15,7 @@
 #include <gtest/gtest.h>
 #include "osd/PGTransaction.h"
 #include "osd/ECTransaction.h"
+#include "erasure-code/ErasureCode.h"
 
 #include "test/unit.cc"
 
@@ -122,3 +123,315 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+// k=4, m=2 code built from XORs: linear, so the generic
+// ErasureCode::encode_delta() applies.  The second parity shifts one
+// data chunk by a byte so that position mix-ups show up as mismatches.
+class ErasureCodeXor : public ceph::ErasureCode {
+public:
+  static const unsigned k = 4;
+  static const unsigned m = 2;
+
+  int init(ErasureCodeProfile &profile, ostream *ss) override {
+    return 0;
+  }
+  unsigned int get_chunk_count() const override { return k + m; }
+  unsigned int get_data_chunk_count() const override { return k; }
+  unsigned int get_chunk_size(unsigned int object_size) const override {
+    return (object_size + k - 1) / k;
+  }
+  int encode_chunks(const set<int> &want_to_encode,
+		    map<int, bufferlist> *encoded) override {
+    unsigned blocksize = (*encoded)[0].length();
+    const char *d[k];
+    for (unsigned j = 0; j < k; ++j)
+      d[j] = (*encoded)[j].c_str();
+    char *p0 = (*encoded)[k].c_str();
+    char *p1 = (*encoded)[k + 1].c_str();
+    for (unsigned i = 0; i < blocksize; ++i) {
+      p0[i] = d[0][i] ^ d[1][i] ^ d[2][i] ^ d[3][i];
+      p1[i] = d[0][i] ^ d[2][i] ^ d[3][(i + 1) % blocksize];
+    }
+    return 0;
+  }
+  int decode_chunks(const set<int> &want_to_read,
+		    const map<int, bufferlist> &chunks,
+		    map<int, bufferlist> *decoded) override {
+    ceph_abort();
+    return -EOPNOTSUPP;
+  }
+  int create_rule(const string &name,
+		  CrushWrapper &crush,
+		  ostream *ss) const override { return 0; }
+};
+
+static const uint64_t ec_chunk_size = 4096;
+static const uint64_t ec_object_size = 2 * ErasureCodeXor::k * ec_chunk_size;
+
+static hobject_t ec_oid()
+{
+  return hobject_t(object_t("obj"), "", CEPH_NOSNAP, 0, 1, "");
+}
+
+static bufferlist random_buffer(uint64_t len)
+{
+  bufferptr bp(len);
+  for (uint64_t i = 0; i < len; ++i)
+    bp[i] = rand();
+  bufferlist bl;
+  bl.append(bp);
+  return bl;
+}
+
+static map<int, bufferlist> encode_object(
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const bufferlist &data)
+{
+  bufferlist in = data;
+  uint64_t aligned = sinfo.logical_to_next_stripe_offset(in.length());
+  in.append_zero(aligned - in.length());
+  set<int> want;
+  for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i)
+    want.insert(i);
+  map<int, bufferlist> shards;
+  int r = ECUtil::encode(sinfo, ecimpl, in, want, &shards);
+  assert(r == 0);
+  return shards;
+}
+
+/// play the head object writes of each shard transaction onto shards
+static void apply_writes(
+  map<shard_id_t, ObjectStore::Transaction> &transactions,
+  map<int, bufferlist> *shards,
+  set<int> *written)
+{
+  for (auto &&st : transactions) {
+    bufferlist &shard = (*shards)[st.first];
+    auto i = st.second.begin();
+    while (i.have_op()) {
+      ObjectStore::Transaction::Op *op = i.decode_op();
+      switch (op->op) {
+      case ObjectStore::Transaction::OP_WRITE:
+	{
+	  ghobject_t oid = i.get_oid(op->oid);
+	  bufferlist bl;
+	  i.decode_bl(bl);
+	  if (oid.generation != ghobject_t::NO_GEN)
+	    break;
+	  uint64_t off = op->off;
+	  uint64_t len = op->len;
+	  if (off + len > shard.length())
+	    shard.append_zero(off + len - shard.length());
+	  bufferlist result, tail;
+	  result.substr_of(shard, 0, off);
+	  result.append(bl);
+	  tail.substr_of(shard, off + len, shard.length() - off - len);
+	  result.append(tail);
+	  shard.swap(result);
+	  written->insert(st.first);
+	}
+	break;
+      case ObjectStore::Transaction::OP_SETATTR:
+	{
+	  i.decode_string();
+	  bufferlist bl;
+	  i.decode_bl(bl);
+	}
+	break;
+      case ObjectStore::Transaction::OP_SETATTRS:
+	{
+	  map<string, bufferptr> aset;
+	  i.decode_attrset(aset);
+	}
+	break;
+      case ObjectStore::Transaction::OP_TOUCH:
+      case ObjectStore::Transaction::OP_CLONERANGE2:
+	break;
+      default:
+	ADD_FAILURE() << "unexpected op " << op->op;
+	return;
+      }
+    }
+  }
+}
+
+static ECTransaction::WritePlan overwrite_plan(
+  const ECUtil::stripe_info_t &sinfo,
+  const hobject_t &h,
+  const vector<pair<uint64_t, bufferlist> > &writes,
+  bool truncate = false)
+{
+  PGTransactionUPtr t(new PGTransaction);
+  ObjectContextRef obc(new ObjectContext);
+  obc->obs.oi = object_info_t(h);
+  obc->obs.oi.size = ec_object_size;
+  obc->obs.exists = true;
+  t->add_obc(obc);
+  for (auto &&w : writes) {
+    bufferlist bl = w.second;
+    t->write(h, w.first, bl.length(), bl, 0);
+  }
+  if (truncate)
+    t->truncate(h, ec_object_size - 100);
+  return ECTransaction::get_write_plan(
+    sinfo,
+    std::move(t),
+    [&](const hobject_t &i) {
+      ECUtil::HashInfoRef ref(new ECUtil::HashInfo(ErasureCodeXor::k +
+						   ErasureCodeXor::m));
+      ref->set_total_chunk_size_clear_hash(
+	sinfo.aligned_logical_offset_to_chunk_offset(ec_object_size));
+      ref->set_projected_total_logical_size(sinfo, ec_object_size);
+      return ref;
+    },
+    &dpp);
+}
+
+/**
+ * Overwrite a random two-stripe object with writes (offset, length)
+ * and check that the shards produced by generate_transactions() are
+ * those of a full encode of the new content.  With delta set the
+ * parity-delta path is required and must only touch the data shards
+ * being written plus the parity shards; otherwise the full-stripe
+ * read/modify/write path is used.
+ */
+static void check_overwrite(
+  const vector<pair<uint64_t, uint64_t> > &extents,
+  bool delta)
+{
+  ErasureCodeInterfaceRef ecimpl(new ErasureCodeXor);
+  ECUtil::stripe_info_t sinfo(ErasureCodeXor::k,
+			      ErasureCodeXor::k * ec_chunk_size);
+  hobject_t h = ec_oid();
+
+  bufferlist old_data = random_buffer(ec_object_size);
+  map<int, bufferlist> old_shards = encode_object(sinfo, ecimpl, old_data);
+
+  bufferlist new_data = old_data;
+  vector<pair<uint64_t, bufferlist> > writes;
+  for (auto &&e : extents) {
+    bufferlist bl = random_buffer(e.second);
+    if (e.first + e.second > new_data.length())
+      new_data.append_zero(e.first + e.second - new_data.length());
+    bufferlist result, tail;
+    result.substr_of(new_data, 0, e.first);
+    result.append(bl);
+    tail.substr_of(new_data, e.first + e.second,
+		   new_data.length() - e.first - e.second);
+    result.append(tail);
+    new_data.swap(result);
+    writes.push_back(make_pair(e.first, bl));
+  }
+  map<int, bufferlist> new_shards = encode_object(sinfo, ecimpl, new_data);
+
+  auto plan = overwrite_plan(sinfo, h, writes);
+  set<int> data_shards;
+  bool use_delta = ECTransaction::get_delta_data_shards(
+    sinfo, ecimpl, plan, h, &data_shards);
+  ASSERT_EQ(delta, use_delta);
+
+  map<hobject_t, extent_map> partial_extents;
+  map<hobject_t, map<int, extent_map> > partial_chunks;
+  const extent_set &stripes = plan.to_read[h];
+  if (delta) {
+    plan.delta_data_shards[h] = data_shards;
+    set<int> to_read = data_shards;
+    for (unsigned i = ErasureCodeXor::k;
+	 i < ErasureCodeXor::k + ErasureCodeXor::m; ++i)
+      to_read.insert(i);
+    for (auto &&shard : to_read) {
+      for (auto &&stripe : stripes) {
+	uint64_t off = sinfo.aligned_logical_offset_to_chunk_offset(
+	  stripe.first);
+	uint64_t len = sinfo.aligned_logical_offset_to_chunk_offset(
+	  stripe.second);
+	bufferlist bl;
+	bl.substr_of(old_shards[shard], off, len);
+	partial_chunks[h][shard].insert(off, len, bl);
+      }
+    }
+  } else {
+    for (auto &&stripe : stripes) {
+      bufferlist bl;
+      bl.substr_of(old_data, stripe.first, stripe.second);
+      partial_extents[h].insert(stripe.first, stripe.second, bl);
+    }
+  }
+
+  vector<pg_log_entry_t> entries;
+  entries.push_back(
+    pg_log_entry_t(pg_log_entry_t::MODIFY, h, eversion_t(1, 2),
+		   eversion_t(1, 1), 2, osd_reqid_t(), utime_t(), 0));
+  map<shard_id_t, ObjectStore::Transaction> transactions;
+  for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i)
+    transactions[shard_id_t(i)];
+  map<hobject_t, extent_map> written_map;
+  set<hobject_t> temp_added, temp_removed;
+  ECTransaction::generate_transactions(
+    plan, ecimpl, pg_t(0, 1), sinfo,
+    partial_extents, partial_chunks, entries,
+    &written_map, &transactions, &temp_added, &temp_removed, &dpp);
+
+  map<int, bufferlist> shards = old_shards;
+  set<int> written;
+  apply_writes(transactions, &shards, &written);
+
+  set<int> expect_written;
+  for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
+    if (!delta || data_shards.count(i) || i >= ErasureCodeXor::k)
+      expect_written.insert(i);
+  }
+  ASSERT_EQ(expect_written, written);
+  for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
+    ASSERT_EQ(new_shards[i].length(), shards[i].length()) << "shard " << i;
+    ASSERT_TRUE(new_shards[i].contents_equal(shards[i])) << "shard " << i;
+  }
+}
+
+TEST(ectransaction, delta_matches_full_encode)
+{
+  const uint64_t cs = ec_chunk_size;
+  const uint64_t sw = ErasureCodeXor::k * ec_chunk_size;
+  // unaligned, inside one chunk
+  check_overwrite({{cs + 100, 300}}, true);
+  // exactly one chunk
+  check_overwrite({{cs, cs}}, true);
+  // unaligned, across the boundary between two chunks
+  check_overwrite({{sw + 2 * cs + 4000, 200}}, true);
+  // two stripes, a different chunk in each
+  check_overwrite({{100, 50}, {sw + 3 * cs + 10, 20}}, true);
+  // three of the four data chunks
+  check_overwrite({{cs - 1, cs + 2}}, true);
+}
+
+TEST(ectransaction, delta_fallback_to_full_rmw)
+{
+  const uint64_t cs = ec_chunk_size;
+  const uint64_t sw = ErasureCodeXor::k * ec_chunk_size;
+  // every data chunk of a stripe is touched
+  check_overwrite({{1000, 3 * cs}}, false);
+  check_overwrite({{100, 50}, {sw - 100, 50}, {2 * cs, 10}, {cs, 10}}, false);
+  // whole stripe, nothing to read
+  check_overwrite({{sw, sw}}, false);
+  // runs past the end of the object
+  check_overwrite({{2 * sw - 100, 300}}, false);
+
+  ErasureCodeInterfaceRef ecimpl(new ErasureCodeXor);
+  ECUtil::stripe_info_t sinfo(ErasureCodeXor::k, sw);
+  hobject_t h = ec_oid();
+  set<int> data_shards;
+  // truncate alongside the write
+  {
+    auto plan = overwrite_plan(
+      sinfo, h, {make_pair(cs + 100, random_buffer(300))}, true);
+    ASSERT_FALSE(ECTransaction::get_delta_data_shards(
+		   sinfo, ecimpl, plan, h, &data_shards));
+  }
+  // no ops on the object
+  {
+    auto plan = overwrite_plan(sinfo, h, {});
+    ASSERT_FALSE(ECTransaction::get_delta_data_shards(
+		   sinfo, ecimpl, plan, h, &data_shards));
+  }
+}